@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <numeric>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include <elle/json/json.hh>
+#include <elle/log.hh>
+#include <elle/printf.hh>
+#include <elle/reactor/scheduler.hh>
+
+#include <infinit/utility.hh>
+
+namespace bench
+{
+  /// Benchmark harness.
+  ///
+  /// Cases are timed operation by operation and summarized with latency
+  /// percentiles and throughput. Results are printed as a table on the
+  /// standard error and, with `--json <path>`, written as a JSON document
+  /// so runs of different releases can be compared:
+  ///
+  ///   {"version": ..., "results": [{"name": "silo.get", "parameters":
+  ///    {"backend": "memory", "size": 4096}, "iterations": 1000,
+  ///    "mean_us": ..., "p50_us": ..., "p99_us": ..., "ops_per_s": ...,
+  ///    "bytes_per_s": ...}, ...]}
+  ///
+  /// Positional arguments are regular expressions selecting cases by name,
+  /// and `--scale <factor>` multiplies every iteration count.
+  class Suite
+  {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    Suite(int argc, char const** argv)
+      : _scale(1)
+    {
+      for (int i = 1; i < argc; ++i)
+      {
+        auto const arg = std::string(argv[i]);
+        if (arg == "--json" && i + 1 < argc)
+          this->_json = argv[++i];
+        else if (arg == "--scale" && i + 1 < argc)
+          this->_scale = std::stod(argv[++i]);
+        else
+          this->_filters.emplace_back(arg);
+      }
+    }
+
+    /// Whether case `name` was selected.
+    bool
+    enabled(std::string const& name) const
+    {
+      return this->_filters.empty() ||
+        std::any_of(this->_filters.begin(), this->_filters.end(),
+                    [&] (std::regex const& r)
+                    {
+                      return std::regex_search(name, r);
+                    });
+    }
+
+    /// Whether any of the cases `names` was selected, to skip setting up
+    /// unused fixtures.
+    bool
+    enabled(std::initializer_list<std::string> names) const
+    {
+      return std::any_of(names.begin(), names.end(),
+                         [&] (std::string const& n)
+                         {
+                           return this->enabled(n);
+                         });
+    }
+
+    /// Number of iterations for a case scaled by `--scale`.
+    int
+    iterations(int base) const
+    {
+      return std::max(1, int(base * this->_scale));
+    }
+
+    /// Time `iterations` calls of `f(i)`, each handling `bytes` bytes.
+    ///
+    /// Unselected cases are skipped, unless later cases depend on them
+    /// (`required`), in which case they run untimed.
+    template <typename F>
+    void
+    run(std::string const& name,
+        elle::json::Object parameters,
+        int iterations,
+        int64_t bytes,
+        F const& f,
+        bool required = false)
+    {
+      if (!this->enabled(name))
+      {
+        if (required)
+          for (int i = 0; i < iterations; ++i)
+            f(i);
+        return;
+      }
+      ELLE_LOG_COMPONENT("bench");
+      ELLE_TRACE_SCOPE("run %s %s", name, elle::json::pretty_print(parameters));
+      auto samples = std::vector<double>{};
+      samples.reserve(iterations);
+      auto const start = Clock::now();
+      for (int i = 0; i < iterations; ++i)
+      {
+        auto const op = Clock::now();
+        f(i);
+        samples.push_back(microseconds(Clock::now() - op));
+      }
+      auto const total = microseconds(Clock::now() - start) / 1e6;
+      std::sort(samples.begin(), samples.end());
+      auto const mean =
+        std::accumulate(samples.begin(), samples.end(), 0.) / iterations;
+      auto res = elle::json::Object
+        {
+          {"name", name},
+          {"parameters", parameters},
+          {"iterations", iterations},
+          {"total_s", total},
+          {"mean_us", mean},
+          {"p50_us", percentile(samples, 0.5)},
+          {"p90_us", percentile(samples, 0.9)},
+          {"p99_us", percentile(samples, 0.99)},
+          {"max_us", samples.back()},
+          {"ops_per_s", iterations / total},
+          {"bytes_per_s", bytes * iterations / total},
+        };
+      std::cerr << elle::sprintf(
+        "%-24s %-40s %8s ops %10.1f us/op %10.1f p99 %10.2f MiB/s\n",
+        name, summary(parameters), iterations, mean,
+        percentile(samples, 0.99), bytes * iterations / total / (1 << 20));
+      this->_results.emplace_back(std::move(res));
+    }
+
+    /// Write the JSON report if requested.
+    void
+    report() const
+    {
+      if (!this->_json)
+        return;
+      auto doc = elle::json::Object
+        {
+          {"version", infinit::version_describe()},
+          {"date", std::chrono::duration_cast<std::chrono::seconds>(
+              std::chrono::system_clock::now().time_since_epoch()).count()},
+          {"scale", this->_scale},
+          {"results", this->_results},
+        };
+      std::ofstream output(*this->_json);
+      elle::json::write(output, doc, true);
+    }
+
+    /// Run `body` in a scheduler, then write the report.
+    template <typename F>
+    int
+    main(F const& body)
+    {
+      elle::reactor::Scheduler sched;
+      elle::reactor::Thread main(sched, "bench", [&] { body(*this); });
+      sched.run();
+      this->report();
+      return 0;
+    }
+
+  private:
+    static
+    double
+    microseconds(Clock::duration d)
+    {
+      return std::chrono::duration<double, std::micro>(d).count();
+    }
+
+    static
+    double
+    percentile(std::vector<double> const& sorted, double p)
+    {
+      auto const i = std::min<std::size_t>(p * sorted.size(),
+                                           sorted.size() - 1);
+      return sorted[i];
+    }
+
+    static
+    std::string
+    summary(elle::json::Object const& parameters)
+    {
+      auto res = std::string{};
+      for (auto const& p: parameters)
+      {
+        if (!res.empty())
+          res += " ";
+        res += p.first + "=" + elle::json::pretty_print(p.second);
+      }
+      return res;
+    }
+
+    double _scale;
+    boost::optional<std::string> _json;
+    std::vector<std::regex> _filters;
+    elle::json::Array _results;
+  };
+}
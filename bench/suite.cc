@@ -0,0 +1,346 @@
+#include <fcntl.h>
+
+#include <random>
+
+#include <elle/filesystem/TemporaryDirectory.hh>
+#include <elle/log.hh>
+#include <elle/serialization/binary.hh>
+
+#include <infinit/filesystem/filesystem.hh>
+#include <infinit/model/blocks/ACLBlock.hh>
+#include <infinit/model/blocks/ImmutableBlock.hh>
+#include <infinit/model/blocks/MutableBlock.hh>
+#include <infinit/silo/Filesystem.hh>
+#include <infinit/silo/Memory.hh>
+#include <infinit/silo/Packed.hh>
+
+#include "DHT.hh" // XXX Shared with tests.
+#include "bench.hh"
+
+ELLE_LOG_COMPONENT("bench");
+
+namespace
+{
+  auto const small = 4 * 1024;
+  auto const large = 1024 * 1024;
+
+  elle::Buffer
+  payload(int size)
+  {
+    auto res = elle::Buffer(size);
+    auto random = std::mt19937(size);
+    for (auto& c: res)
+      c = random();
+    return res;
+  }
+
+  /*-------.
+  | Silos. |
+  `-------*/
+
+  void
+  silo(bench::Suite& suite,
+       std::string const& backend,
+       infinit::silo::Silo& storage)
+  {
+    for (auto size: {small, large})
+    {
+      auto const data = payload(size);
+      auto const count = suite.iterations(size == small ? 2000 : 100);
+      auto keys = std::vector<infinit::model::Address>{};
+      for (int i = 0; i < count; ++i)
+        keys.emplace_back(infinit::model::Address::random());
+      auto const parameters = elle::json::Object
+        {
+          {"backend", backend},
+          {"size", size},
+        };
+      suite.run("silo.set", parameters, count, size,
+                [&] (int i) { storage.set(keys[i], data); }, true);
+      suite.run("silo.update", parameters, count, size,
+                [&] (int i) { storage.set(keys[i], data, false, true); });
+      suite.run("silo.get", parameters, count, size,
+                [&] (int i) { storage.get(keys[i]); });
+      suite.run("silo.erase", parameters, count, 0,
+                [&] (int i) { storage.erase(keys[i]); });
+    }
+  }
+
+  void
+  silos(bench::Suite& suite)
+  {
+    if (!suite.enabled(
+          {"silo.set", "silo.update", "silo.get", "silo.erase"}))
+      return;
+    {
+      infinit::silo::Memory storage;
+      silo(suite, "memory", storage);
+    }
+    {
+      elle::filesystem::TemporaryDirectory d;
+      infinit::silo::Filesystem storage(d.path());
+      silo(suite, "filesystem", storage);
+    }
+    {
+      elle::filesystem::TemporaryDirectory d;
+      infinit::silo::Filesystem storage(d.path(), {}, true);
+      silo(suite, "filesystem-sync", storage);
+    }
+    {
+      elle::filesystem::TemporaryDirectory d;
+      infinit::silo::Packed storage(d.path());
+      silo(suite, "packed", storage);
+    }
+  }
+
+  /*-------.
+  | Blocks |
+  `-------*/
+
+  elle::Buffer
+  serialize(blocks::Block const& block)
+  {
+    auto res = elle::Buffer{};
+    {
+      elle::IOStream s(res.ostreambuf());
+      elle::serialization::binary::SerializerOut output(s);
+      auto ptr = &block;
+      output.serialize_forward(ptr);
+    }
+    return res;
+  }
+
+  std::unique_ptr<blocks::Block>
+  deserialize(dht::Doughnut& dht, elle::Buffer const& data)
+  {
+    elle::serialization::Context ctx;
+    ctx.set<dht::Doughnut*>(&dht);
+    return elle::serialization::binary::deserialize<
+      std::unique_ptr<blocks::Block>>(data, true, ctx);
+  }
+
+  void
+  crypto(bench::Suite& suite)
+  {
+    if (!suite.enabled({"block.chb.seal", "block.chb.open", "block.acb.seal",
+                        "block.acb.validate", "block.acb.decrypt"}))
+      return;
+    DHT node(paxos = false);
+    auto& dht = *node.dht;
+    for (auto size: {small, large})
+    {
+      auto const data = payload(size);
+      auto const count = suite.iterations(size == small ? 500 : 50);
+      auto const parameters = elle::json::Object{{"size", size}};
+      // Immutable blocks.
+      auto chbs = std::vector<std::unique_ptr<blocks::ImmutableBlock>>{};
+      suite.run("block.chb.seal", parameters, count, size, [&] (int)
+        {
+          chbs.emplace_back(
+            dht.make_block<blocks::ImmutableBlock>(elle::Buffer(data)));
+          chbs.back()->seal();
+        }, true);
+      auto const chb = serialize(*chbs.front());
+      suite.run("block.chb.open", parameters, count, size, [&] (int)
+        {
+          deserialize(dht, chb)->data();
+        });
+      // Access-controlled blocks.
+      auto acbs = std::vector<std::unique_ptr<blocks::ACLBlock>>{};
+      suite.run("block.acb.seal", parameters, count, size, [&] (int)
+        {
+          acbs.emplace_back(dht.make_block<blocks::ACLBlock>());
+          acbs.back()->data(elle::Buffer(data));
+          acbs.back()->seal();
+        }, true);
+      auto const acb = serialize(*acbs.front());
+      suite.run("block.acb.validate", parameters, count, size, [&] (int)
+        {
+          deserialize(dht, acb)->validate(dht, false);
+        });
+      suite.run("block.acb.decrypt", parameters, count, size, [&] (int)
+        {
+          deserialize(dht, acb)->data();
+        });
+    }
+  }
+
+  /*------------.
+  | Consensus.  |
+  `------------*/
+
+  /// In-process nodes connected to each other.
+  struct Network
+  {
+    Network(int count, bool paxos_)
+      : owner(elle::cryptography::rsa::keypair::generate(512))
+    {
+      for (int i = 0; i < count; ++i)
+      {
+        this->nodes.emplace_back(paxos = paxos_, ::owner = this->owner);
+        for (int j = 0; j < i; ++j)
+          this->nodes[j].overlay->connect(*this->nodes[i].overlay);
+      }
+    }
+
+    /// A storage-less client connected to every node.
+    DHT
+    client(bool paxos_)
+    {
+      auto res = DHT(::owner = this->owner,
+                     keys = this->owner,
+                     storage = nullptr,
+                     dht::consensus_builder = no_cheat_consensus(paxos_),
+                     paxos = paxos_);
+      for (auto& node: this->nodes)
+        node.overlay->connect(*res.overlay);
+      return res;
+    }
+
+    elle::cryptography::rsa::KeyPair owner;
+    std::vector<DHT> nodes;
+  };
+
+  void
+  consensus(bench::Suite& suite)
+  {
+    if (!suite.enabled({"paxos.insert", "paxos.update", "paxos.fetch"}))
+      return;
+    for (auto count: {1, 3, 5})
+    {
+      Network network(count, true);
+      auto client = network.client(true);
+      auto& dht = *client.dht;
+      for (auto size: {small, large})
+      {
+        auto const data = payload(size);
+        auto const iterations = suite.iterations(size == small ? 200 : 20);
+        auto const parameters = elle::json::Object
+          {
+            {"nodes", count},
+            {"size", size},
+          };
+        auto mutables = std::vector<std::unique_ptr<blocks::MutableBlock>>{};
+        suite.run("paxos.insert", parameters, iterations, size, [&] (int)
+          {
+            mutables.emplace_back(dht.make_block<blocks::MutableBlock>());
+            mutables.back()->data(elle::Buffer(data));
+            dht.seal_and_insert(*mutables.back());
+          }, true);
+        suite.run("paxos.update", parameters, iterations, size, [&] (int i)
+          {
+            mutables[i]->data(elle::Buffer(data));
+            dht.seal_and_update(*mutables[i]);
+          });
+        suite.run("paxos.fetch", parameters, iterations, size, [&] (int i)
+          {
+            dht.fetch(mutables[i]->address())->data();
+          });
+      }
+    }
+  }
+
+  /*------------.
+  | Filesystem. |
+  `------------*/
+
+  void
+  filesystem(bench::Suite& suite)
+  {
+    if (!suite.enabled({"fs.write.sequential", "fs.read.sequential",
+                        "fs.read.random", "fs.write.random",
+                        "fs.create", "fs.list", "fs.stat"}))
+      return;
+    Network network(1, true);
+    auto client = network.client(true);
+    elle::reactor::filesystem::FileSystem fs(
+      std::make_unique<infinit::filesystem::FileSystem>(
+        "volume", client.dht,
+        infinit::filesystem::allow_root_creation = true),
+      true);
+    auto const& root = fs.path("/");
+    auto const file_size = int64_t(64) * 1024 * 1024;
+    for (auto chunk: {small, large})
+    {
+      auto const data = payload(chunk);
+      auto const count = int(file_size / chunk);
+      auto const name = elle::sprintf("file-%s", chunk);
+      auto const parameters = elle::json::Object
+        {
+          {"chunk", chunk},
+          {"file_size", file_size},
+        };
+      auto handle =
+        root->child(name)->create(O_CREAT | O_RDWR, S_IFREG | 0644);
+      suite.run("fs.write.sequential", parameters, count, chunk, [&] (int i)
+        {
+          handle->write(elle::ConstWeakBuffer(data), chunk, int64_t(i) * chunk);
+        }, true);
+      handle->fsync(true);
+      handle->close();
+      auto buffer = elle::Buffer(chunk);
+      handle = root->child(name)->open(O_RDWR, 0);
+      suite.run("fs.read.sequential", parameters, count, chunk, [&] (int i)
+        {
+          handle->read(elle::WeakBuffer(buffer), chunk, int64_t(i) * chunk);
+        });
+      auto random = std::mt19937(chunk);
+      auto offset = [&]
+        {
+          return int64_t(random() % count) * chunk;
+        };
+      auto const ops = suite.iterations(chunk == small ? 2000 : 50);
+      suite.run("fs.read.random", parameters, ops, chunk, [&] (int)
+        {
+          handle->read(elle::WeakBuffer(buffer), chunk, offset());
+        });
+      suite.run("fs.write.random", parameters, ops, chunk, [&] (int)
+        {
+          handle->write(elle::ConstWeakBuffer(data), chunk, offset());
+        });
+      handle->fsync(true);
+      handle->close();
+      root->child(name)->unlink();
+    }
+    for (auto entries: {100, 1000, 10000})
+    {
+      auto const count = suite.iterations(entries);
+      auto const name = elle::sprintf("dir-%s", entries);
+      auto const parameters = elle::json::Object{{"entries", count}};
+      root->child(name)->mkdir(0755);
+      auto const dir = fs.path("/" + name);
+      suite.run("fs.create", parameters, count, 0, [&] (int i)
+        {
+          dir->child(elle::sprintf("%s", i))
+            ->create(O_CREAT | O_RDWR, S_IFREG | 0644)->close();
+        }, true);
+      suite.run("fs.list", parameters, 1, 0, [&] (int)
+        {
+          auto listed = 0;
+          dir->list_directory([&] (std::string const&, struct stat*)
+                              {
+                                ++listed;
+                              });
+          ELLE_ASSERT_GTE(listed, count);
+        });
+      suite.run("fs.stat", parameters, count, 0, [&] (int i)
+        {
+          struct stat st;
+          dir->child(elle::sprintf("%s", i))->stat(&st);
+        });
+    }
+  }
+}
+
+int
+main(int argc, char const* argv[])
+{
+  auto suite = bench::Suite(argc, argv);
+  return suite.main([] (bench::Suite& suite)
+    {
+      silos(suite);
+      crypto(suite);
+      consensus(suite);
+      filesystem(suite);
+    });
+}
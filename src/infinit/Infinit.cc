@@ -6,6 +6,7 @@
 #include <infinit/utility.hh>
 
 #include <infinit/silo/Filesystem.hh>
+#include <infinit/silo/Packed.hh>
 
 ELLE_LOG_COMPONENT("infinit");
 
@@ -550,6 +551,9 @@ namespace infinit
       if (auto fs_silo =
           dynamic_cast<infinit::silo::FilesystemSiloConfig*>(silo.get()))
         this->_delete_all(fs_silo->path, "silo content", name);
+      else if (auto packed_silo =
+               dynamic_cast<infinit::silo::PackedSiloConfig*>(silo.get()))
+        this->_delete_all(packed_silo->path, "silo content", name);
       else
         elle::err("only filesystem silos can be cleared");
     }
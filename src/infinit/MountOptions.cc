@@ -31,6 +31,7 @@ namespace infinit
     infinit::merge(publish, b.publish);
     infinit::merge(async, b.async);
     infinit::merge(readonly, b.readonly);
+    infinit::merge(deduplicate, b.deduplicate);
     infinit::merge(cache_ram_size, b.cache_ram_size);
     infinit::merge(cache_ram_ttl, b.cache_ram_ttl);
     infinit::merge(cache_ram_invalidation, b.cache_ram_invalidation);
@@ -38,6 +39,8 @@ namespace infinit
     infinit::merge(mountpoint, b.mountpoint);
     infinit::merge(peers, b.peers);
     infinit::merge(poll_beyond, b.poll_beyond);
+    infinit::merge(readahead_blocks, b.readahead_blocks);
+    infinit::merge(readahead_memory, b.readahead_memory);
 #ifndef INFINIT_WINDOWS
     infinit::merge(enable_monitoring, b.enable_monitoring);
 #endif
@@ -71,10 +74,13 @@ namespace infinit
     if (cache && *cache) args("--cache");
     if (async && *async) args("--async");
     if (readonly && *readonly) args("--readonly");
+    if (deduplicate && *deduplicate) args("--deduplicate");
     if (cache_ram_size) args("--cache-ram-size", std::to_string(*cache_ram_size));
     if (cache_ram_ttl) args("--cache-ram-ttl", std::to_string(*cache_ram_ttl));
     if (cache_ram_invalidation) args("--cache-ram-invalidation", std::to_string(*cache_ram_invalidation));
     if (cache_disk_size) args("--cache-disk-size", std::to_string(*cache_disk_size));
+    if (readahead_blocks) args("--readahead-blocks", std::to_string(*readahead_blocks));
+    if (readahead_memory) args("--readahead-memory", std::to_string(*readahead_memory));
     if (poll_beyond && *poll_beyond >0) args("--poll-hub", std::to_string(*poll_beyond));
 #ifndef INFINIT_WINDOWS
     if (enable_monitoring && !*enable_monitoring) args("--monitoring=false");
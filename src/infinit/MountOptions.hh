@@ -23,6 +23,7 @@ namespace infinit
     ELLE_DAS_SYMBOL(cache_ram_invalidation);
     ELLE_DAS_SYMBOL(cache_ram_size);
     ELLE_DAS_SYMBOL(cache_ram_ttl);
+    ELLE_DAS_SYMBOL(deduplicate);
 #ifndef INFINIT_WINDOWS
     ELLE_DAS_SYMBOL(enable_monitoring); // aka monitoring.
 #endif
@@ -36,6 +37,8 @@ namespace infinit
     ELLE_DAS_SYMBOL(push);              // aka push_endpoints.
     ELLE_DAS_SYMBOL(publish);           // aka push && fetch.
     ELLE_DAS_SYMBOL(rdv);
+    ELLE_DAS_SYMBOL(readahead_blocks);
+    ELLE_DAS_SYMBOL(readahead_memory);
     ELLE_DAS_SYMBOL(readonly);
   }
 
@@ -57,6 +60,7 @@ namespace infinit
     boost::optional<bool> cache;
     boost::optional<bool> async;
     boost::optional<bool> readonly;
+    boost::optional<bool> deduplicate;
     boost::optional<int> cache_ram_size;
     boost::optional<int> cache_ram_ttl;
     boost::optional<int> cache_ram_invalidation;
@@ -64,6 +68,8 @@ namespace infinit
     boost::optional<std::string> mountpoint;
     boost::optional<Strings> peers;
     boost::optional<int> poll_beyond;
+    boost::optional<int> readahead_blocks;
+    boost::optional<int64_t> readahead_memory;
     boost::optional<boost::asio::ip::address> listen_address;
 #ifndef INFINIT_WINDOWS
     boost::optional<bool> enable_monitoring;
@@ -81,6 +87,7 @@ namespace infinit
                  mount_options::cache,
                  mount_options::async,
                  mount_options::readonly,
+                 mount_options::deduplicate,
                  mount_options::cache_ram_size,
                  mount_options::cache_ram_ttl,
                  mount_options::cache_ram_invalidation,
@@ -88,7 +95,9 @@ namespace infinit
                  mount_options::mountpoint,
                  mount_options::as,
                  mount_options::peers,
-                 mount_options::poll_beyond
+                 mount_options::poll_beyond,
+                 mount_options::readahead_blocks,
+                 mount_options::readahead_memory
                  // mount_options::listen_address,
 #ifndef INFINIT_WINDOWS
                  , mount_options::enable_monitoring
@@ -1,7 +1,13 @@
 #include <infinit/RPC.hh>
 
+#include <cstring>
+
+#include <elle/cryptography/hmac.hh>
+
 #include <infinit/utility.hh>
 
+ELLE_LOG_COMPONENT("infinit.RPC");
+
 namespace infinit
 {
   RPCServer::RPCServer()
@@ -10,7 +16,248 @@ namespace infinit
 
   RPCServer::RPCServer(elle::Version version)
     : _version(version)
-  {}
+    , _framing(false)
+    , _streaming(false)
+  {
+    this->add("rpc_procedures", [this] { return this->procedures(); });
+    this->add("rpc_framing",
+              [this]
+              {
+                this->_framing = true;
+                return true;
+              });
+    this->add("rpc_streaming",
+              [this]
+              {
+                this->_streaming = true;
+                return true;
+              });
+  }
+
+  RPCProcedures
+  RPCServer::procedures() const
+  {
+    auto res = RPCProcedures{};
+    for (auto const& rpc: this->_rpcs)
+      res.emplace(rpc.first, rpc.second->id());
+    return res;
+  }
+
+  std::string const&
+  rpc_argument(int n)
+  {
+    // Spare formatting argument names on every call.
+    static auto const names = []
+      {
+        auto res = std::vector<std::string>{};
+        for (int i = 0; i < 32; ++i)
+          res.emplace_back(elle::sprintf("arg%s", i));
+        return res;
+      }();
+    return names.at(n);
+  }
+
+  RPCProcedures
+  rpc_procedures(elle::protocol::ChanneledStream& channels,
+                 elle::Version const& version,
+                 elle::Buffer* credentials)
+  {
+    auto rpc = RPC<RPCProcedures ()>(
+      "rpc_procedures", &channels, version, credentials);
+    try
+    {
+      return rpc();
+    }
+    catch (UnknownRPC const&)
+    {
+      ELLE_TRACE("peer has no procedure identifiers, use names");
+      return {};
+    }
+  }
+
+  bool
+  rpc_framing(elle::protocol::ChanneledStream& channels,
+              elle::Version const& version,
+              elle::Buffer* credentials,
+              bool streaming)
+  {
+    auto rpc = RPC<bool ()>("rpc_framing", &channels, version, credentials);
+    rpc.streaming(streaming);
+    try
+    {
+      return rpc();
+    }
+    catch (UnknownRPC const&)
+    {
+      ELLE_TRACE("peer does not frame messages, encipher them whole");
+      return false;
+    }
+  }
+
+  bool
+  rpc_streaming(elle::protocol::ChanneledStream& channels,
+                elle::Version const& version,
+                elle::Buffer* credentials)
+  {
+    auto rpc = RPC<bool ()>("rpc_streaming", &channels, version, credentials);
+    try
+    {
+      return rpc();
+    }
+    catch (UnknownRPC const&)
+    {
+      ELLE_TRACE("peer does not stream messages, send them whole");
+      return false;
+    }
+  }
+
+  /*--------.
+  | Framing |
+  `--------*/
+
+  namespace
+  {
+    enum Frame: uint8_t
+    {
+      enciphered = 1,
+      authenticated = 2,
+    };
+
+    auto const tag_size = 32;
+
+    /// Run `f` on `message`, off the scheduler for large messages.
+    template <typename F>
+    void
+    _crypt(elle::Buffer const& message, F const& f)
+    {
+      if (message.size() > 262144)
+        elle::With<elle::reactor::Thread::NonInterruptible>() << [&]
+        {
+          elle::reactor::background(f);
+        };
+      else
+        f();
+    }
+
+    /// Key of the frame tags, so that the cipher and the MAC never share
+    /// one: HKDF-Expand (RFC 5869) of the session password, which is
+    /// random already, with a label of its own.
+    elle::Buffer
+    _tag_key(elle::cryptography::SecretKey const& key)
+    {
+      static auto const info = std::string("infinit rpc frame tag\x01");
+      return elle::cryptography::hmac::sign(
+        elle::ConstWeakBuffer(info.data(), info.size()),
+        key.password(),
+        elle::cryptography::Oneway::sha256);
+    }
+
+    /// HMAC-SHA256 of `message`, followed by the frame flag, the direction,
+    /// the channel and the sequence number. These are appended to `message`
+    /// while the tag is computed, sparing a copy of the content.
+    elle::Buffer
+    _tag(elle::Buffer& message,
+         elle::cryptography::SecretKey const& key,
+         bool response,
+         int channel,
+         uint64_t sequence)
+    {
+      auto const size = message.size();
+      uint8_t header[14];
+      header[0] = Frame::authenticated;
+      header[1] = response ? 'R' : 'Q';
+      for (int i = 0; i < 4; ++i)
+        header[2 + i] = (uint32_t(channel) >> (8 * i)) & 0xff;
+      for (int i = 0; i < 8; ++i)
+        header[6 + i] = (sequence >> (8 * i)) & 0xff;
+      message.append(header, sizeof(header));
+      auto const tag_key = _tag_key(key);
+      auto res = elle::Buffer{};
+      _crypt(message, [&]
+             {
+               res = elle::cryptography::hmac::sign(
+                 elle::ConstWeakBuffer(message.contents(), message.size()),
+                 tag_key,
+                 elle::cryptography::Oneway::sha256);
+             });
+      message.size(size);
+      return res;
+    }
+  }
+
+  void
+  rpc_seal(elle::Buffer& message,
+           elle::cryptography::SecretKey const& key,
+           bool encipher,
+           bool response,
+           int channel,
+           uint64_t sequence)
+  {
+    static auto bench =
+      elle::Bench("bench.rpc.seal", std::chrono::seconds(10000));
+    auto bs = elle::Bench::BenchScope(bench);
+    uint8_t frame;
+    if (encipher)
+    {
+      _crypt(message, [&]
+             {
+               message = key.encipher(
+                 elle::ConstWeakBuffer(message.contents(), message.size()));
+             });
+      frame = Frame::enciphered;
+    }
+    else
+    {
+      auto const tag = _tag(message, key, response, channel, sequence);
+      message.append(tag.contents(), tag.size());
+      frame = Frame::authenticated;
+    }
+    message.append(&frame, 1);
+  }
+
+  bool
+  rpc_open(elle::Buffer& message,
+           elle::cryptography::SecretKey const& key,
+           bool response,
+           int channel,
+           uint64_t sequence)
+  {
+    static auto bench =
+      elle::Bench("bench.rpc.open", std::chrono::seconds(10000));
+    auto bs = elle::Bench::BenchScope(bench);
+    if (message.empty())
+      elle::err("truncated RPC message");
+    auto const frame = message[message.size() - 1];
+    message.size(message.size() - 1);
+    if (frame == Frame::enciphered)
+    {
+      _crypt(message, [&]
+             {
+               message = key.decipher(
+                 elle::ConstWeakBuffer(message.contents(), message.size()));
+             });
+      return true;
+    }
+    else if (frame == Frame::authenticated)
+    {
+      if (message.size() < tag_size)
+        elle::err("truncated RPC message");
+      auto const size = message.size() - tag_size;
+      uint8_t received[tag_size];
+      std::memcpy(received, message.contents() + size, tag_size);
+      message.size(size);
+      auto const tag = _tag(message, key, response, channel, sequence);
+      // Compare in constant time.
+      auto diff = 0;
+      for (int i = 0; i < tag_size; ++i)
+        diff |= tag[i] ^ received[i];
+      if (diff)
+        elle::err("RPC message authentication failed");
+      return false;
+    }
+    else
+      elle::err("unknown RPC message framing: %s", int(frame));
+  }
 
   std::ostream&
   operator <<(std::ostream& output, RPCHandler const& rpc)
@@ -19,6 +266,200 @@ namespace infinit
     return output;
   }
 
+  /*----------.
+  | Transport |
+  `----------*/
+
+  namespace
+  {
+    /// Pieces in flight, which both ends must agree on.
+    auto const window = 4u;
+
+    void
+    _protect(elle::Buffer& message,
+             elle::protocol::Channel const& channel,
+             RPCTransport& transport)
+    {
+      if (!transport.key)
+        return;
+      if (transport.framing)
+        return rpc_seal(message, *transport.key, transport.encipher,
+                        transport.response, channel.id(),
+                        transport.sequence++);
+      static auto client =
+        elle::Bench("bench.rpcclient.encipher", std::chrono::seconds(10000));
+      static auto server =
+        elle::Bench("bench.rpcserve.encipher", std::chrono::seconds(10000));
+      auto bs = elle::Bench::BenchScope(transport.response ? server : client);
+      _crypt(message, [&]
+             {
+               message = transport.key->encipher(
+                 elle::ConstWeakBuffer(message.contents(), message.size()));
+             });
+    }
+
+    void
+    _unprotect(elle::Buffer& message,
+               elle::protocol::Channel const& channel,
+               RPCTransport& transport)
+    {
+      if (!transport.key)
+        return;
+      if (transport.framing)
+      {
+        transport.encipher =
+          rpc_open(message, *transport.key, transport.response, channel.id(),
+                   transport.sequence++);
+        return;
+      }
+      static auto client =
+        elle::Bench("bench.rpcclient.decipher", std::chrono::seconds(10000));
+      static auto server =
+        elle::Bench("bench.rpcserve.decipher", std::chrono::seconds(10000));
+      auto bs = elle::Bench::BenchScope(transport.response ? client : server);
+      try
+      {
+        _crypt(message, [&]
+               {
+                 message = transport.key->decipher(
+                   elle::ConstWeakBuffer(message.contents(), message.size()));
+               });
+      }
+      catch (std::exception const& e)
+      {
+        if (!transport.response)
+          ELLE_ERR("decypher request: %s", e.what());
+        throw;
+      }
+    }
+
+    /// Marks the last piece of a streamed message.
+    auto const last_piece = uint32_t(1) << 31;
+
+    void
+    _append_index(elle::Buffer& piece, uint32_t index)
+    {
+      uint8_t bytes[4];
+      for (int i = 0; i < 4; ++i)
+        bytes[i] = (index >> (8 * i)) & 0xff;
+      piece.append(bytes, 4);
+    }
+
+    uint32_t
+    _strip_index(elle::Buffer& piece)
+    {
+      if (piece.size() < 4)
+        elle::err("truncated RPC message piece");
+      auto const offset = piece.size() - 4;
+      auto res = uint32_t(0);
+      for (int i = 0; i < 4; ++i)
+        res |= uint32_t(piece[offset + i]) << (8 * i);
+      piece.size(offset);
+      return res;
+    }
+  }
+
+  RPCWriter::RPCWriter(elle::protocol::Channel& channel,
+                       RPCTransport& transport)
+    : _channel(channel)
+    , _transport(transport)
+    , _index(0)
+  {
+    static auto const piece_size = std::size_t(std::max(
+      elle::os::getenv("INFINIT_RPC_PIECE_SIZE", 128 * 1024), 1024));
+    this->_piece.size(piece_size);
+    auto const begin = reinterpret_cast<char*>(this->_piece.mutable_contents());
+    this->setp(begin, begin + this->_piece.size());
+  }
+
+  RPCWriter::int_type
+  RPCWriter::overflow(int_type c)
+  {
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+      return traits_type::not_eof(c);
+    auto const used = this->pptr() - this->pbase();
+    if (this->_transport.streaming)
+      this->_write(false);
+    else
+    {
+      // Unstreamed messages are written whole: grow the buffer.
+      this->_piece.size(this->_piece.size() * 2);
+      auto const begin =
+        reinterpret_cast<char*>(this->_piece.mutable_contents());
+      this->setp(begin, begin + this->_piece.size());
+      this->pbump(int(used));
+    }
+    *this->pptr() = traits_type::to_char_type(c);
+    this->pbump(1);
+    return c;
+  }
+
+  void
+  RPCWriter::finish()
+  {
+    this->_write(true);
+  }
+
+  void
+  RPCWriter::_write(bool last)
+  {
+    auto& transport = this->_transport;
+    auto piece = elle::Buffer(this->_piece.contents(),
+                              this->pptr() - this->pbase());
+    this->setp(this->pbase(), this->epptr());
+    if (transport.streaming)
+    {
+      // Wait for the acknowledgment of piece index - window.
+      if (this->_index >= window)
+        this->_channel.read();
+      _append_index(piece, this->_index | (last ? last_piece : 0));
+    }
+    _protect(piece, this->_channel, transport);
+    transport.bytes += piece.size();
+    this->_channel.write(piece);
+    if (transport.streaming && last)
+    {
+      if (this->_index)
+        ELLE_DEBUG("streamed %s pieces", this->_index + 1);
+      for (auto i = std::min(this->_index, window - 1); i > 0; --i)
+        this->_channel.read();
+    }
+    ++this->_index;
+  }
+
+  elle::Buffer
+  rpc_read(elle::protocol::Channel& channel, RPCTransport& transport)
+  {
+    static auto const max_size = std::size_t(std::max(
+      elle::os::getenv("INFINIT_RPC_MAX_MESSAGE_SIZE", 256 * 1024 * 1024),
+      1024 * 1024));
+    auto res = elle::Buffer{};
+    for (auto expected = uint32_t(0); true; ++expected)
+    {
+      auto piece = channel.read();
+      transport.bytes += piece.size();
+      _unprotect(piece, channel, transport);
+      if (!transport.streaming)
+        return piece;
+      auto const index = _strip_index(piece);
+      auto const last = bool(index & last_piece);
+      // Pieces follow one another: none is dropped or repeated.
+      if ((index & ~last_piece) != expected)
+        elle::err("unexpected RPC message piece: %s instead of %s",
+                  index & ~last_piece, expected);
+      if (last && expected == 0)
+        return piece;
+      // The buffer grows as pieces arrive.
+      if (res.size() + piece.size() > max_size)
+        elle::err("RPC message exceeds %s bytes", max_size);
+      if (!last)
+        channel.write(elle::Buffer());
+      res.append(piece.contents(), piece.size());
+      if (last)
+        return res;
+    }
+  }
+
   namespace
   {
     auto const _register_serialization =
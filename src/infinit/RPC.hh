@@ -1,5 +1,10 @@
 #pragma once
 
+#include <chrono>
+#include <streambuf>
+#include <unordered_map>
+#include <vector>
+
 #include <elle/serialization/json.hh>
 #include <elle/serialization/binary.hh>
 #include <elle/os/environ.hh>
@@ -13,6 +18,7 @@
 #include <elle/reactor/Scope.hh>
 #include <elle/reactor/semaphore.hh>
 #include <elle/reactor/storage.hh>
+#include <elle/reactor/Thread.hh>
 
 #include <elle/protocol/ChanneledStream.hh>
 #include <elle/protocol/Serializer.hh>
@@ -68,6 +74,116 @@ namespace infinit
     ELLE_ATTRIBUTE_R(std::string, name);
   };
 
+  /// Numeric identifiers of the procedures of a server, by name.
+  ///
+  /// Peers fetch them once per connection, with `rpc_procedures`, and then
+  /// designate procedures by identifier instead of sending their names.
+  using RPCProcedures = std::unordered_map<std::string, int>;
+
+  /// The serialization name of argument `n`.
+  std::string const&
+  rpc_argument(int n);
+
+  /*--------.
+  | Framing |
+  `--------*/
+
+  /// Protect `message` in place for a peer that negotiated framing.
+  ///
+  /// Framed messages end with a flag telling whether they were enciphered.
+  /// Messages whose content is already ciphertext, such as blocks encrypted
+  /// at rest, need not be enciphered again: they are only followed by a
+  /// HMAC-SHA256 tag, which costs a hash instead of a cipher and a MAC. The
+  /// tag covers the frame flag, the direction, the channel and the position
+  /// of the message on it as well as its content, so authenticated messages
+  /// can't be replayed on another channel, out of order or the other way.
+  ///
+  /// @param message The serialized message.
+  /// @param key The connection key.
+  /// @param encipher Whether to encipher, or only authenticate.
+  /// @param response Whether this is a response.
+  /// @param channel The identifier of the channel the message is sent on.
+  /// @param sequence The number of messages sent before this one on the
+  ///                 channel in the same direction.
+  void
+  rpc_seal(elle::Buffer& message,
+           elle::cryptography::SecretKey const& key,
+           bool encipher,
+           bool response,
+           int channel,
+           uint64_t sequence);
+
+  /// Check and strip in place the protection of a framed `message`.
+  ///
+  /// @return Whether the message was enciphered.
+  /// @throw elle::Error if it was tampered with, or was not sealed with the
+  ///        same direction, channel and sequence.
+  bool
+  rpc_open(elle::Buffer& message,
+           elle::cryptography::SecretKey const& key,
+           bool response,
+           int channel,
+           uint64_t sequence);
+
+  /// How messages are exchanged on a channel.
+  struct RPCTransport
+  {
+    /// The connection key, if messages are protected.
+    elle::cryptography::SecretKey const* key = nullptr;
+    /// Whether messages are framed, see `rpc_seal`.
+    bool framing = false;
+    /// Whether messages are streamed, see `RPCWriter`.
+    bool streaming = false;
+    /// Whether framed messages are enciphered, or only authenticated. Set
+    /// by `rpc_read` to the mode of the message read.
+    bool encipher = true;
+    bool response = false;
+    /// Messages exchanged on the channel in this direction, see `rpc_seal`.
+    uint64_t sequence = 0;
+    /// Bytes exchanged on the wire.
+    int64_t bytes = 0;
+  };
+
+  /// Protect and write a message on a channel as it is serialized.
+  ///
+  /// Streamed messages are split in pieces of `INFINIT_RPC_PIECE_SIZE`
+  /// bytes, protected and written as soon as they are full: the sender
+  /// never holds the whole message and the receiver deciphers pieces as
+  /// they arrive. Each piece ends with its index, whose high bit marks the
+  /// last piece. The receiver acknowledges all pieces but the last, and the
+  /// sender waits for the acknowledgment of piece `n` before writing piece
+  /// `n + 4`, and for the remaining ones after the last piece. At most 4
+  /// pieces are thus in flight, and no acknowledgment is left unread.
+  ///
+  /// Other messages are written whole by `finish`.
+  class RPCWriter
+    : public std::streambuf
+  {
+  public:
+    RPCWriter(elle::protocol::Channel& channel, RPCTransport& transport);
+    /// Write the rest of the message.
+    void
+    finish();
+  protected:
+    int_type
+    overflow(int_type c) override;
+  private:
+    void
+    _write(bool last);
+    ELLE_ATTRIBUTE(elle::protocol::Channel&, channel);
+    ELLE_ATTRIBUTE(RPCTransport&, transport);
+    ELLE_ATTRIBUTE(elle::Buffer, piece);
+    ELLE_ATTRIBUTE(uint32_t, index);
+  };
+
+  /// Read and unprotect a message from `channel`, see `RPCWriter`.
+  ///
+  /// @throw elle::Error if streamed pieces are missing or repeated, or add
+  ///        up to more than `INFINIT_RPC_MAX_MESSAGE_SIZE` bytes (256MiB by
+  ///        default).
+  elle::Buffer
+  rpc_read(elle::protocol::Channel& channel, RPCTransport& transport);
+
   /*-------.
   | Server |
   `-------*/
@@ -81,14 +197,17 @@ namespace infinit
     /// Construct
     RPCHandler(std::string name)
       : _name(std::move(name))
+      , _id(-1)
     {}
     virtual
     ~RPCHandler() = default;
+    /// Run the procedure, return whether it succeeded.
     virtual
-    void
+    bool
     handle(elle::serialization::SerializerIn& input,
            elle::serialization::SerializerOut& output) = 0;
     ELLE_ATTRIBUTE_R(std::string, name);
+    ELLE_ATTRIBUTE_RW(int, id);
   };
 
   std::ostream&
@@ -136,11 +255,11 @@ namespace infinit
 
     ELLE_ATTRIBUTE_R(Function, function);
 
-    void
+    bool
     handle(elle::serialization::SerializerIn& input,
            elle::serialization::SerializerOut& output) override
     {
-      this->_handle<List<Args...>>(0, input, output);
+      return this->_handle<List<Args...>>(0, input, output);
     }
 
   private:
@@ -148,7 +267,7 @@ namespace infinit
     std::enable_if_t<
       !Remaining::empty &&
       !elle::serialization::virtually<
-        std::remove_reference_t<typename Remaining::Head>>()>
+        std::remove_reference_t<typename Remaining::Head>>(), bool>
     _handle(int n,
             elle::serialization::SerializerIn& input,
             elle::serialization::SerializerOut& output,
@@ -156,9 +275,9 @@ namespace infinit
     {
       ELLE_LOG_COMPONENT("infinit.RPC");
       using Head = std::remove_cv_reference_t<typename Remaining::Head>;
-      auto arg = input.deserialize<Head>(elle::sprintf("arg%s", n));
+      auto arg = input.deserialize<Head>(rpc_argument(n));
       ELLE_DUMP("got argument: %s", arg);
-      this->_handle<typename Remaining::Tail,
+      return this->_handle<typename Remaining::Tail,
                     Parsed..., typename Remaining::Head>(
         n + 1, input, output, std::forward<Parsed>(parsed)..., std::move(arg));
     }
@@ -167,7 +286,7 @@ namespace infinit
     std::enable_if_t<
       !Remaining::empty &&
       elle::serialization::virtually<
-        std::remove_reference_t<typename Remaining::Head>>()>
+        std::remove_reference_t<typename Remaining::Head>>(), bool>
     _handle(int n,
             elle::serialization::SerializerIn& input,
             elle::serialization::SerializerOut& output,
@@ -176,15 +295,15 @@ namespace infinit
       ELLE_LOG_COMPONENT("infinit.RPC");
       using Head = std::remove_cv_reference_t<typename Remaining::Head>;
       auto arg =
-        input.deserialize<std::unique_ptr<Head>>(elle::sprintf("arg%s", n));
+        input.deserialize<std::unique_ptr<Head>>(rpc_argument(n));
       ELLE_DUMP("got argument: %s", *arg);
-      this->_handle<typename Remaining::Tail,
+      return this->_handle<typename Remaining::Tail,
                     Parsed..., typename Remaining::Head>(
         n + 1, input, output, std::forward<Parsed>(parsed)..., std::move(*arg));
     }
 
     template <typename Remaining, typename ... Parsed>
-    std::enable_if_t<Remaining::empty && std::is_void<R>::value>
+    std::enable_if_t<Remaining::empty && std::is_void<R>::value, bool>
     _handle(int n,
             elle::serialization::SerializerIn& input,
             elle::serialization::SerializerOut& output,
@@ -197,6 +316,7 @@ namespace infinit
         this->_function(std::forward<Parsed>(parsed)...);
         ELLE_TRACE("%s: success", *this);
         output.serialize("success", true);
+        return true;
       }
       catch (elle::Error& e)
       {
@@ -205,17 +325,19 @@ namespace infinit
         ELLE_DUMP("{}", e.backtrace());
         output.serialize("success", false);
         output.serialize("exception", std::current_exception());
+        return false;
       }
       catch (...)
       {
         ELLE_TRACE("%s: exception escaped: %s",
                    *this, elle::exception_string());
         output.serialize("success", false);
+        return false;
       }
     }
 
     template <typename Remaining, typename ... Parsed>
-    std::enable_if_t<Remaining::empty && !std::is_void<R>::value>
+    std::enable_if_t<Remaining::empty && !std::is_void<R>::value, bool>
     _handle(int n,
             elle::serialization::SerializerIn& input,
             elle::serialization::SerializerOut& output,
@@ -229,6 +351,7 @@ namespace infinit
         ELLE_TRACE("%s: success: %s", *this, res);
         output.serialize("success", true);
         output.serialize("value", res);
+        return true;
       }
       catch (elle::Error& e)
       {
@@ -236,21 +359,29 @@ namespace infinit
                    *this, elle::exception_string());
         output.serialize("success", false);
         output.serialize("exception", std::current_exception());
+        return false;
       }
       catch (...)
       {
         ELLE_TRACE("%s: exception escaped: %s",
                    *this, elle::exception_string());
         output.serialize("success", false);
+        return false;
       }
     }
   };
 
   /// Answer to RPCs.
+  ///
+  /// Procedures are numbered as they are added, and the built-in
+  /// `rpc_procedures` procedure lists these identifiers so clients can use
+  /// them in place of names. Calls are accounted for by procedure in
+  /// `statistics`.
   class RPCServer
   {
   public:
     using Passport = infinit::model::doughnut::Passport;
+    using Clock = std::chrono::steady_clock;
 
     RPCServer();
     RPCServer(elle::Version version);
@@ -270,8 +401,18 @@ namespace infinit
     void
     add(std::string const& name, std::function<R (Args...)> f)
     {
-      this->_rpcs[name] =
-        std::make_unique<ConcreteRPCHandler<R, Args...>>(name, f);
+      auto handler = std::make_unique<ConcreteRPCHandler<R, Args...>>(name, f);
+      auto& slot = this->_rpcs[name];
+      // Replacing a procedure keeps its identifier.
+      if (slot)
+        handler->id(slot->id());
+      else
+      {
+        handler->id(this->_procedures.size());
+        this->_procedures.emplace_back();
+      }
+      this->_procedures[handler->id()] = handler.get();
+      slot = std::move(handler);
     }
 
     /// Add an RPC to the server.
@@ -395,35 +536,13 @@ namespace infinit
     _serve(elle::protocol::Channel& channel)
     {
       ELLE_LOG_COMPONENT("infinit.RPC");
-      auto request = channel.read();
+      auto transport = RPCTransport{};
+      transport.key = this->_key.get_ptr();
+      transport.framing = this->_framing;
+      transport.streaming = this->_streaming;
+      auto request = rpc_read(channel, transport);
+      auto const start = Clock::now();
       ELLE_TRACE_SCOPE("%s: process RPC", this);
-      bool had_key = !!_key;
-      if (had_key)
-      {
-        ELLE_DEBUG_SCOPE("decipher RPC");
-        try
-        {
-          static auto bench = elle::Bench("bench.rpcserve.decipher",
-                                          std::chrono::seconds(10000));
-          auto bs = elle::Bench::BenchScope(bench);
-          if (request.size() > 262144)
-          {
-            auto& key = this->_key.get();
-            elle::With<elle::reactor::Thread::NonInterruptible>() << [&] {
-              elle::reactor::background([&] {
-                  request = key.decipher(request);
-              });
-            };
-          }
-          else
-            request = this->_key->decipher(request);
-        }
-        catch(std::exception const& e)
-        {
-          ELLE_ERR("decypher request: %s", e.what());
-          throw;
-        }
-      }
       elle::IOStream ins(request.istreambuf());
       auto const versions = elle::serialization::get_serialization_versions
         <infinit::serialization_tag>(this->_version);
@@ -431,13 +550,33 @@ namespace infinit
       input.set_context(this->_context);
       std::string name;
       input.serialize("procedure", name);
-      elle::Buffer response;
+      RPCHandler* handler = nullptr;
+      // An empty name announces a procedure identifier.
+      if (name.empty())
+      {
+        auto const id = input.deserialize<int>("id");
+        if (id >= 0 && id < signed(this->_procedures.size()))
+          handler = this->_procedures[id];
+        name = handler ? handler->name() : elle::sprintf("#%s", id);
+      }
+      else
       {
         auto it = this->_rpcs.find(name);
-        elle::IOStream outs(response.ostreambuf());
+        if (it != this->_rpcs.end())
+          handler = it->second.get();
+      }
+      Statistics* stats = nullptr;
+      // Answer in the mode of the request.
+      auto const request_bytes = transport.bytes;
+      transport.response = true;
+      transport.sequence = 0;
+      transport.bytes = 0;
+      RPCWriter response(channel, transport);
+      {
+        std::ostream outs(&response);
         auto output = elle::serialization::binary::SerializerOut(
           outs, versions, false);
-        if (it == this->_rpcs.end())
+        if (!handler)
         {
           ELLE_WARN("%s: unknown RPC: %s", *this, name);
           output.serialize("success", false);
@@ -447,14 +586,19 @@ namespace infinit
         else
         {
           ELLE_TRACE_SCOPE("%s: run procedure %s", *this, name);
+          stats = &this->_statistics[name];
+          ++stats->calls;
+          stats->request_bytes += request_bytes;
           {
             output.set_context(this->_context);
             try
             {
-              it->second->handle(input, output);
+              if (!handler->handle(input, output))
+                ++stats->errors;
             }
             catch (elle::Error const& e)
             {
+              ++stats->errors;
               ELLE_WARN("%s: deserialization error: %s",
                         *this, e);
               throw;
@@ -462,29 +606,20 @@ namespace infinit
           }
         }
       }
-      if (had_key)
+      response.finish();
+      if (stats)
       {
-        static auto bench =
-          elle::Bench("bench.rpcserve.encipher", std::chrono::seconds(10000));
-        auto bs = elle::Bench::BenchScope(bench);
-        if (response.size() >= 262144)
-        {
-          auto& key = this->_key.get();
-          elle::With<elle::reactor::Thread::NonInterruptible>() << [&] {
-            elle::reactor::background([&] {
-                response = key.encipher(
-	          elle::ConstWeakBuffer(response.contents(),
-	            response.size()));
-              });
-          };
-        }
-        else
-          response = _key->encipher(
-            elle::ConstWeakBuffer(response.contents(), response.size()));
+        auto const duration = Clock::now() - start;
+        stats->response_bytes += transport.bytes;
+        stats->duration += duration;
+        stats->max_duration = std::max(stats->max_duration, duration);
       }
-      channel.write(response);
     }
 
+    /// Identifiers of the procedures, for `rpc_procedures`.
+    RPCProcedures
+    procedures() const;
+
     /// Upsert a value of type `T` to the context.
     ///
     /// @tparam T The type of the value to add.
@@ -501,6 +636,33 @@ namespace infinit
     boost::optional<elle::cryptography::SecretKey> _key;
     boost::signals2::signal<void()> _destroying;
     ELLE_ATTRIBUTE(elle::Version, version);
+    /// Handlers by identifier.
+    ELLE_ATTRIBUTE(std::vector<RPCHandler*>, procedures);
+    /// Whether the client negotiated framing, with `rpc_framing`.
+    ELLE_ATTRIBUTE_R(bool, framing);
+    /// Whether the client negotiated streaming, with `rpc_streaming`.
+    ELLE_ATTRIBUTE_R(bool, streaming);
+
+  /*-----------.
+  | Statistics |
+  `-----------*/
+  public:
+    /// Calls to a procedure.
+    struct Statistics
+    {
+      int64_t calls = 0;
+      /// Calls that failed, including undecodable ones.
+      int64_t errors = 0;
+      /// Bytes received and sent, as on the wire.
+      int64_t request_bytes = 0;
+      int64_t response_bytes = 0;
+      /// Time spent serving calls, from reading the request to writing the
+      /// response.
+      Clock::duration duration = Clock::duration::zero();
+      Clock::duration max_duration = Clock::duration::zero();
+    };
+    ELLE_ATTRIBUTE_R((std::unordered_map<std::string, Statistics>),
+                     statistics);
   };
 
   /*-------.
@@ -528,6 +690,10 @@ namespace infinit
       , _channels(channels)
       , _key(std::move(key))
       , _version(version)
+      , _procedures(nullptr)
+      , _framing(false)
+      , _streaming(false)
+      , _ciphertext(false)
     {}
 
     /// Return the credentials, if applicable.
@@ -562,8 +728,60 @@ namespace infinit
     ELLE_ATTRIBUTE_RX(
       boost::optional<elle::cryptography::SecretKey>, key, protected);
     ELLE_ATTRIBUTE_R(elle::Version, version, protected);
+    /// Procedure identifiers of the peer, to send instead of the name.
+    ELLE_ATTRIBUTE_RW(RPCProcedures const*, procedures);
+    /// Whether the peer negotiated framing, see `rpc_seal`.
+    ELLE_ATTRIBUTE_RW(bool, framing);
+    /// Whether the peer negotiated streaming, see `RPCWriter`.
+    ELLE_ATTRIBUTE_RW(bool, streaming);
+    /// Whether arguments and results are already ciphertext, in which case
+    /// framed messages are only authenticated.
+    ELLE_ATTRIBUTE_RW(bool, ciphertext);
+
+    /// How to exchange requests, or responses, with the peer.
+    RPCTransport
+    transport(bool response)
+    {
+      auto res = RPCTransport{};
+      res.key = this->_key.get_ptr();
+      res.framing = this->_framing;
+      res.streaming = this->_streaming;
+      res.encipher = !this->_ciphertext;
+      res.response = response;
+      return res;
+    }
   };
 
+  /// Fetch the procedure identifiers of the server at the end of `channels`.
+  ///
+  /// Servers predating identifiers yield none, names being used then.
+  RPCProcedures
+  rpc_procedures(elle::protocol::ChanneledStream& channels,
+                 elle::Version const& version,
+                 elle::Buffer* credentials = nullptr);
+
+  /// Switch the server at the end of `channels` to framed messages.
+  ///
+  /// @param streaming Whether streaming was negotiated already, see
+  ///                  `rpc_streaming`.
+  /// @return Whether it supports them.
+  bool
+  rpc_framing(elle::protocol::ChanneledStream& channels,
+              elle::Version const& version,
+              elle::Buffer* credentials,
+              bool streaming = false);
+
+  /// Switch the server at the end of `channels` to streamed messages.
+  ///
+  /// This call is not framed: negotiate it before `rpc_framing`, which must
+  /// then be streamed.
+  ///
+  /// @return Whether it supports them.
+  bool
+  rpc_streaming(elle::protocol::ChanneledStream& channels,
+                elle::Version const& version,
+                elle::Buffer* credentials);
+
   template <typename Proto>
   class RPC;
 
@@ -622,6 +840,40 @@ namespace infinit
     R
     operator ()(Args const& ... args);
     using result_type = R;
+
+    /// A call whose response was not read yet.
+    ///
+    /// Streamed responses are read in the background as they arrive: their
+    /// pieces are acknowledged even if the caller is busy sending another
+    /// call, which may itself wait for the server.
+    class Call
+    {
+    public:
+      Call(RPC& rpc, elle::protocol::Channel channel);
+      /// Wait for the response, at most once.
+      R
+      get();
+    private:
+      struct Response
+      {
+        elle::protocol::Channel channel;
+        elle::Buffer buffer;
+        std::exception_ptr error;
+      };
+      ELLE_ATTRIBUTE(RPC&, rpc);
+      ELLE_ATTRIBUTE(std::shared_ptr<Response>, response);
+      ELLE_ATTRIBUTE(elle::reactor::Thread::unique_ptr, reader);
+    };
+
+    /// Send a call without waiting for its response.
+    ///
+    /// Each call has its own channel, so a single thread can pipeline
+    /// several calls on the same stream and collect the responses later,
+    /// in any order. The RPC must outlive the calls.
+    ///
+    /// @param args The arguments of the RPC.
+    Call
+    send(Args const& ... args);
   };
 
   template <typename T>
@@ -641,7 +893,7 @@ namespace infinit
     {
       using RawHead = std::remove_cv_reference_t<Head>;
       RawHead* ptr = const_cast<RawHead*>(&head);
-      output.serialize(elle::sprintf("arg%s", n), ptr);
+      output.serialize(rpc_argument(n), ptr);
       call_arguments(n + 1, output, std::forward<Tail>(tail)...);
     }
 
@@ -654,7 +906,7 @@ namespace infinit
                    Head&& head,
                    Tail&& ... tail)
     {
-      output.serialize(elle::sprintf("arg%s", n), head);
+      output.serialize(rpc_argument(n), head);
       call_arguments(n + 1, output, std::forward<Tail>(tail)...);
     }
 
@@ -693,77 +945,79 @@ namespace infinit
     {
       ELLE_LOG_COMPONENT("infinit.RPC");
       ELLE_TRACE_SCOPE("%s: call", self);
+      auto channel = _send(version, self, args...);
+      return _receive(version, self, channel);
+    }
+
+    static
+    elle::protocol::Channel
+    _send(elle::Version const& version,
+          RPC<R (Args...)>& self,
+          Args const&... args)
+    {
+      ELLE_LOG_COMPONENT("infinit.RPC");
       auto versions = elle::serialization::get_serialization_versions
         <infinit::serialization_tag>(version);
       auto channel = elle::protocol::Channel{*ELLE_ENFORCE(self.channels())};
       {
-        elle::Buffer call;
-        elle::IOStream outs(call.ostreambuf());
-
-        ELLE_DEBUG("build request")
+        auto transport = self.transport(false);
+        RPCWriter call(channel, transport);
+        std::ostream outs(&call);
+        ELLE_DEBUG("send request")
         {
           auto output = elle::serialization::binary::SerializerOut(outs, versions, false);
           output.set_context(self._context);
-          output.serialize("procedure", self.name());
+          auto const procedures = self.procedures();
+          auto const id = procedures ?
+            procedures->find(self.name()) : RPCProcedures::const_iterator();
+          if (procedures && id != procedures->end())
+          {
+            output.serialize("procedure", std::string());
+            output.serialize("id", id->second);
+          }
+          else
+            output.serialize("procedure", self.name());
           call_arguments(0, output, args...);
         }
-        outs.flush();
-        if (self.key())
-        {
-          static auto bench =
-            elle::Bench("bench.rpcclient.encipher", std::chrono::seconds(10000));
-          auto bs = elle::Bench::BenchScope(bench);
-          // FIXME: scheduler::run?
-          ELLE_DEBUG("encipher request")
-            if (call.size() > 262144)
-            {
-              elle::With<elle::reactor::Thread::NonInterruptible>() << [&] {
-                elle::reactor::background([&] {
-                    call = self.key()->encipher(
-                      elle::ConstWeakBuffer(call.contents(), call.size()));
-                  });
-              };
-            }
-            else
-              call = self.key()->encipher(
-                elle::ConstWeakBuffer(call.contents(), call.size()));
-        }
-        ELLE_DEBUG("send request")
-          channel.write(call);
+        call.finish();
       }
+      return channel;
+    }
+
+    static
+    R
+    _receive(elle::Version const& version,
+             RPC<R (Args...)>& self,
+             elle::protocol::Channel& channel)
+    {
+      ELLE_LOG_COMPONENT("infinit.RPC");
       ELLE_DEBUG("read response request")
       {
-        auto response = channel.read();
-        if (self.key())
-        {
-          static auto bench
-            = elle::Bench("bench.rpcclient.decipher", std::chrono::seconds(10000));
-          auto bs = elle::Bench::BenchScope(bench);
-          if (response.size() > 262144)
-          {
-            elle::With<elle::reactor::Thread::NonInterruptible>() << [&] {
-              elle::reactor::background([&] {
-                  response = self.key()->decipher(
-                    elle::ConstWeakBuffer(response.contents(), response.size()));
-              });
-            };
-          }
-          else
-            response = self.key()->decipher(
-              elle::ConstWeakBuffer(response.contents(), response.size()));
-        }
-        auto ins = elle::IOStream(response.istreambuf());
-        auto input
-          = elle::serialization::binary::SerializerIn(ins, versions, false);
-        input.set_context(self._context);
-        if (input.deserialize<bool>("success"))
-          return get_result<R>(input);
-        else
-        {
-          ELLE_TRACE_SCOPE("call failed, get exception");
-          auto e = input.deserialize<std::exception_ptr>("exception");
-          std::rethrow_exception(e);
-        }
+        auto transport = self.transport(true);
+        return _result(version, self, rpc_read(channel, transport));
+      }
+    }
+
+    static
+    R
+    _result(elle::Version const& version,
+            RPC<R (Args...)>& self,
+            elle::Buffer response)
+    {
+      ELLE_LOG_COMPONENT("infinit.RPC");
+      auto versions = elle::serialization::get_serialization_versions
+        <infinit::serialization_tag>(version);
+      auto ins = elle::IOStream(response.istreambuf());
+      auto input
+        = elle::serialization::binary::SerializerIn(ins, versions, false);
+      input.set_context(self._context);
+      if (input.deserialize<bool>("success"))
+        return get_result<R>(input);
+      else
+      {
+        ELLE_TRACE_SCOPE("call failed, get exception");
+        auto e = input.deserialize<std::exception_ptr>("exception");
+        std::rethrow_exception(e);
       }
     }
   };
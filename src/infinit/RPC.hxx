@@ -7,6 +7,56 @@ namespace infinit
     return RPCCall<R (Args...)>::_call(this->_version, *this, args...);
   }
 
+  template <typename R, typename ... Args>
+  typename RPC<R (Args...)>::Call
+  RPC<R (Args...)>::send(Args const& ... args)
+  {
+    ELLE_LOG_COMPONENT("infinit.RPC");
+    ELLE_TRACE_SCOPE("%s: send", *this);
+    return Call(
+      *this, RPCCall<R (Args...)>::_send(this->_version, *this, args...));
+  }
+
+  template <typename R, typename ... Args>
+  RPC<R (Args...)>::Call::Call(RPC& rpc, elle::protocol::Channel channel)
+    : _rpc(rpc)
+    , _response(std::make_shared<Response>(Response{std::move(channel)}))
+  {
+    if (!rpc.streaming())
+      return;
+    this->_reader.reset(new elle::reactor::Thread(
+      elle::sprintf("%s: read response", rpc),
+      [response = this->_response, transport = rpc.transport(true)] () mutable
+      {
+        try
+        {
+          response->buffer = rpc_read(response->channel, transport);
+        }
+        catch (elle::reactor::Terminate const&)
+        {
+          throw;
+        }
+        catch (...)
+        {
+          response->error = std::current_exception();
+        }
+      }));
+  }
+
+  template <typename R, typename ... Args>
+  R
+  RPC<R (Args...)>::Call::get()
+  {
+    if (!this->_reader)
+      return RPCCall<R (Args...)>::_receive(
+        this->_rpc.version(), this->_rpc, this->_response->channel);
+    elle::reactor::wait(*this->_reader);
+    if (this->_response->error)
+      std::rethrow_exception(this->_response->error);
+    return RPCCall<R (Args...)>::_result(
+      this->_rpc.version(), this->_rpc, std::move(this->_response->buffer));
+  }
+
   inline
   std::ostream&
   operator <<(std::ostream& o, BaseRPC const& rpc)
@@ -34,6 +34,7 @@
 #include <infinit/silo/Filesystem.hh>
 #include <infinit/silo/GCS.hh>
 #include <infinit/silo/GoogleDrive.hh>
+#include <infinit/silo/Packed.hh>
 #include <infinit/silo/Strip.hh>
 #include <elle/cryptography/random.hh>
 #ifndef INFINIT_WINDOWS
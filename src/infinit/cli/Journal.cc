@@ -41,22 +41,30 @@ namespace infinit
 
     namespace
     {
+      using AsyncJournal = infinit::model::doughnut::consensus::Journal;
+
       Async::Op
-      get_operation(infinit::Infinit& ifnt,
-                    infinit::User const& owner,
-                    infinit::Network& network,
-                    bfs::path const& path, std::string const& id)
+      get_operation(infinit::model::doughnut::Doughnut& dht,
+                    elle::Buffer const& data)
       {
-        bfs::ifstream f;
-        ifnt._open_read(f, path, id, "operation");
-        auto dht = network.run(owner);
         auto ctx = elle::serialization::Context
           {
-            dht.get(),
+            &dht,
             infinit::model::doughnut::ACBDontWaitForSignature{},
             infinit::model::doughnut::OKBDontWaitForSignature{}
           };
-        return elle::serialization::binary::deserialize<Async::Op>(f, true, ctx);
+        return elle::serialization::binary::deserialize<Async::Op>(
+          data, true, ctx);
+      }
+
+      elle::Buffer const&
+      find_operation(std::map<int, elle::Buffer> const& operations, int id)
+      {
+        auto it = operations.find(id);
+        if (it == operations.end())
+          elle::err<MissingLocalResource>(
+            "operation \"%s\" does not exist", id);
+        return it->second;
       }
     }
 
@@ -70,14 +78,14 @@ namespace infinit
       auto owner = cli.as_user();
       auto network = ifnt.network_get(network_name, owner);
       auto dht = network.run(owner);
-      bfs::path async_path = network.cache_dir(owner) / "async";
-      auto report = [&] (bfs::path const& path)
+      auto const operations =
+        AsyncJournal::load(network.cache_dir(owner) / "async");
+      auto report = [&] (int id, elle::Buffer const& data)
         {
-          auto name = path.filename().string();
-          std::cout << name << ": ";
+          std::cout << id << ": ";
           try
           {
-            auto op = get_operation(ifnt, owner, network, path, name);
+            auto op = get_operation(*dht, data);
             if (op.resolver)
               std::cout << op.resolver->description();
             else
@@ -90,10 +98,10 @@ namespace infinit
           std::cout << std::endl;
         };
       if (operation)
-        report(async_path / elle::sprintf("%s", *operation));
+        report(*operation, find_operation(operations, *operation));
       else
-        for (auto const& path: Async::entries(async_path))
-          report(path);
+        for (auto const& op: operations)
+          report(op.first, op.second);
     }
 
     /*---------------.
@@ -109,9 +117,10 @@ namespace infinit
       auto& ifnt = cli.infinit();
       auto owner = cli.as_user();
       auto network = ifnt.network_get(network_name, owner);
-      auto id = std::to_string(operation);
-      auto path = network.cache_dir(owner) / "async" / id;
-      auto op = get_operation(ifnt, owner, network, path, id);
+      auto dht = network.run(owner);
+      auto const operations =
+        AsyncJournal::load(network.cache_dir(owner) / "async");
+      auto op = get_operation(*dht, find_operation(operations, operation));
       elle::serialization::json::serialize(op, std::cout);
     }
 
@@ -134,16 +143,12 @@ namespace infinit
       auto res = elle::json::Object{};
       for (auto const& network: networks)
       {
-        bfs::path async_path = network.cache_dir(owner) / "async";
-        int operation_count = 0;
+        auto const operations =
+          AsyncJournal::load(network.cache_dir(owner) / "async");
+        int operation_count = operations.size();
         int64_t data_size = 0;
-        if (bfs::exists(async_path))
-          for (auto const& p: bfs::directory_iterator(async_path))
-            if (is_visible_file(p))
-            {
-              operation_count++;
-              data_size += bfs::file_size(p);
-            }
+        for (auto const& op: operations)
+          data_size += op.second.size();
         if (cli.script())
           res[network.name] = elle::json::Object
             {
@@ -10,6 +10,7 @@
 #include <infinit/silo/Filesystem.hh>
 #include <infinit/silo/GCS.hh>
 #include <infinit/silo/GoogleDrive.hh>
+#include <infinit/silo/Packed.hh>
 #include <infinit/silo/S3.hh>
 #ifndef INFINIT_WINDOWS
 # include <infinit/silo/sftp.hh>
@@ -144,6 +145,18 @@ namespace infinit
                    cli::capacity = boost::none,
                    cli::output = boost::none,
                    cli::path = boost::none)
+      , packed(*this,
+               "Store blocks packed in large segment files on local filesystem",
+               elle::das::cli::Options{
+                 {"path", elle::das::cli::Option{
+                     '\0', "directory where to store segments", false}}},
+               cli::name,
+               cli::description = boost::none,
+               cli::capacity = boost::none,
+               cli::output = boost::none,
+               cli::path = boost::none,
+               cli::segment_size = boost::none,
+               cli::compaction_threshold = boost::none)
       MEMO_ENTREPRISE(
       , gcs(*this,
             "Store blocks on Google Cloud Storage",
@@ -252,6 +265,42 @@ namespace infinit
           std::move(description)));
     }
 
+    void
+    Silo::Create::mode_packed(std::string const& name,
+                              boost::optional<std::string> description,
+                              boost::optional<std::string> capacity,
+                              boost::optional<std::string> output,
+                              boost::optional<std::string> root,
+                              boost::optional<std::string> segment_size,
+                              boost::optional<int> compaction_threshold)
+    {
+      if (compaction_threshold &&
+          (*compaction_threshold <= 0 || *compaction_threshold > 100))
+        elle::err<CLIError>("compaction threshold must be between 1 and 100");
+      auto path = root ?
+        infinit::canonical_folder(root.get()) :
+        (infinit::xdg_data_home() / "blocks" / name);
+      if (boost::filesystem::exists(path))
+      {
+        if (!boost::filesystem::is_directory(path))
+          elle::err("path is not directory: %s", path);
+        if (!boost::filesystem::is_empty(path))
+          std::cout << "WARNING: Path is not empty: " << path << '\n'
+                    << "WARNING: You may encounter unexpected behavior.\n";
+      }
+      mode_create(
+        this->cli(),
+        output,
+        std::make_unique<infinit::silo::PackedSiloConfig>(
+          name,
+          std::move(path.string()),
+          convert_capacity(capacity),
+          std::move(description),
+          convert_capacity(segment_size),
+          compaction_threshold ?
+            *compaction_threshold / 100. : boost::optional<double>()));
+    }
+
     MEMO_ENTREPRISE(
     void
     Silo::Create::mode_gcs(std::string const& name,
@@ -412,7 +461,8 @@ namespace infinit
       auto& infinit = this->cli().infinit();
       auto silo = infinit.silo_get(name);
       auto fs_silo =
-        dynamic_cast<infinit::silo::FilesystemSiloConfig*>(silo.get());
+        dynamic_cast<infinit::silo::FilesystemSiloConfig*>(silo.get()) ||
+        dynamic_cast<infinit::silo::PackedSiloConfig*>(silo.get());
       if (clear && !fs_silo)
         elle::err("only filesystem silos can be cleared");
       if (purge)
@@ -34,6 +34,7 @@ namespace infinit
         using Super = Object<Create, Silo>;
         using Modes = decltype(elle::meta::list(
                                  cli::filesystem
+                                 , cli::packed
                                  MEMO_ENTREPRISE(,cli::dropbox)
                                  MEMO_ENTREPRISE(,cli::gcs)
                                  MEMO_ENTREPRISE(,cli::google_drive)
@@ -78,6 +79,28 @@ namespace infinit
                         boost::optional<std::string> output,
                         boost::optional<std::string> path);
 
+        // Packed.
+        Mode<Create,
+             void (decltype(cli::name)::Formal<std::string const&>,
+                   decltype(cli::description = boost::optional<std::string>()),
+                   decltype(cli::capacity = boost::optional<std::string>()),
+                   decltype(cli::output = boost::optional<std::string>()),
+                   decltype(cli::path = boost::optional<std::string>()),
+                   decltype(cli::segment_size =
+                            boost::optional<std::string>()),
+                   decltype(cli::compaction_threshold =
+                            boost::optional<int>())),
+             decltype(modes::mode_packed)>
+        packed;
+        void
+        mode_packed(std::string const& name,
+                    boost::optional<std::string> description,
+                    boost::optional<std::string> capacity,
+                    boost::optional<std::string> output,
+                    boost::optional<std::string> path,
+                    boost::optional<std::string> segment_size,
+                    boost::optional<int> compaction_threshold);
+
         MEMO_ENTREPRISE(
 
         Mode<Create,
@@ -2029,6 +2029,14 @@ namespace
           store(results.silos, silo->name, status, "filesystem",
                 elle::sprintf("\"%s\" %s", fsconfig->path, perms.second));
         }
+        if (auto packed
+            = dynamic_cast<PackedSiloConfig const*>(silo.get()))
+        {
+          auto perms = has_permission(packed->path);
+          status = perms.first;
+          store(results.silos, silo->name, status, "packed",
+                elle::sprintf("\"%s\" %s", packed->path, perms.second));
+        }
         MEMO_ENTREPRISE(
         if (auto gcsconfig = dynamic_cast<GCSConfig const*>(silo.get()))
         {
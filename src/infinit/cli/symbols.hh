@@ -38,11 +38,13 @@ namespace infinit
     ELLE_DAS_CLI_SYMBOL(cache_ram_ttl, 0, "RAM block cache time-to-live in seconds (default: 5min)", false);
     ELLE_DAS_CLI_SYMBOL(capacity, 'c', "limit silo capacity (use: B,kB,kiB,MB,MiB,GB,GiB,TB,TiB)", false);
     ELLE_DAS_CLI_SYMBOL(clear_content, '\0', "remove all blocks from disk (filesystem storage only)", false);
+    ELLE_DAS_CLI_SYMBOL(compaction_threshold, 0, "percentage of garbage at which segments are compacted (default: 50)", false);
     ELLE_DAS_CLI_SYMBOL(compatibility_version, '\0', "compatibility version to force", false);
     ELLE_DAS_CLI_SYMBOL(create, 'c', "create the {object}", false);
     ELLE_DAS_CLI_SYMBOL(create_home, 0, "create user home directory of the form home/<user>", false);
     ELLE_DAS_CLI_SYMBOL(create_root, 'R', "create root directory", false);
     ELLE_DAS_CLI_SYMBOL(daemon, 'd', "run as a background daemon" , false);
+    ELLE_DAS_CLI_SYMBOL(deduplicate, 0, "store identical file blocks once, across files", false);
     ELLE_DAS_CLI_SYMBOL(default_network, 0, "Default network for volume creation", false);
     ELLE_DAS_CLI_SYMBOL(default_permissions, 'd', "default permissions (optional: r,rw)", false);
     ELLE_DAS_CLI_SYMBOL(deny_storage, '\0', "deny user ability to contribute storage to the network", false);
@@ -155,6 +157,8 @@ namespace infinit
     ELLE_DAS_CLI_SYMBOL(push_passport, 0, "push passport to {hub}", false);
     ELLE_DAS_CLI_SYMBOL(push_user, 0, "push user to {hub}", false);
     ELLE_DAS_CLI_SYMBOL(push_volume, 0, "push the volume to {hub}" , false);
+    ELLE_DAS_CLI_SYMBOL(readahead_blocks, 0, "maximum number of blocks a file reads ahead (default: 32)", false);
+    ELLE_DAS_CLI_SYMBOL(readahead_memory, 0, "memory for blocks read ahead in bytes, shared by all files (default: 128MB)", false);
     ELLE_DAS_CLI_SYMBOL(readonly, 0, "mount as readonly" , false);
     ELLE_DAS_CLI_SYMBOL(receive, 0, "receive an object from another device using {hub}", false);
     ELLE_DAS_CLI_SYMBOL(recursive, 'R', "{verb} {object} recursively", false);
@@ -171,6 +175,7 @@ namespace infinit
     ELLE_DAS_CLI_SYMBOL(root_permissions, 0, "volume root permissions to give (optional: r, w, rw)", false);
     ELLE_DAS_CLI_SYMBOL(script, 's', "suppress extraneous human friendly messages and use JSON output", false);
     ELLE_DAS_CLI_SYMBOL(searchbase, 'b', "search starting point (without domain)", false); // FIXME: why not search_base?
+    ELLE_DAS_CLI_SYMBOL(segment_size, 0, "size of segment files (default: 64MiB, use: B,kB,kiB,MB,MiB,GB,GiB,TB,TiB)", false);
     ELLE_DAS_CLI_SYMBOL(server, 0, "connectivity server address (default = 192.241.139.66)", false);
     ELLE_DAS_CLI_SYMBOL(service, 0, "fetch {object} from the network, not beyond", false);
     ELLE_DAS_CLI_SYMBOL(show, '\0', "list group users, administrators and description", false);
@@ -228,6 +233,7 @@ namespace infinit
     ELLE_DAS_SYMBOL(login);
     ELLE_DAS_SYMBOL(manage_volumes);
     ELLE_DAS_SYMBOL(networking);
+    ELLE_DAS_SYMBOL(packed);
     ELLE_DAS_SYMBOL(populate_hub);
     ELLE_DAS_SYMBOL(populate_network);
     ELLE_DAS_SYMBOL(run);
@@ -285,6 +291,7 @@ namespace infinit
       ELLE_DAS_SYMBOL(mode_manage_volumes);
       ELLE_DAS_SYMBOL(mode_mount);
       ELLE_DAS_SYMBOL(mode_networking);
+      ELLE_DAS_SYMBOL(mode_packed);
       ELLE_DAS_SYMBOL(mode_populate_hub);
       ELLE_DAS_SYMBOL(mode_populate_network);
       ELLE_DAS_SYMBOL(mode_pull);
@@ -1,5 +1,7 @@
 #include <infinit/filesystem/Directory.hh>
 
+#include <algorithm>
+#include <numeric>
 #include <unordered_map>
 #include <utility>
 
@@ -15,10 +17,13 @@
 
 #include <infinit/filesystem/Node.hh>
 #include <infinit/filesystem/File.hh>
+#include <infinit/filesystem/FileHandle.hh>
 #include <infinit/filesystem/Symlink.hh>
 #include <infinit/filesystem/Unknown.hh>
 #include <infinit/filesystem/xattribute.hh>
 
+#include <infinit/model/Conflict.hh>
+#include <infinit/model/MissingBlock.hh>
 #include <infinit/model/doughnut/Async.hh>
 #include <infinit/model/doughnut/Cache.hh>
 #include <infinit/model/doughnut/Doughnut.hh>
@@ -62,6 +67,89 @@ namespace infinit
       return FileSystem::clock::now();
     }
 
+    /// Whether an operation edits an entry, as opposed to the directory
+    /// itself.
+    static
+    bool
+    entry_operation(Operation const& op)
+    {
+      return !op.target.empty() && op.target[0] != '/';
+    }
+
+    /// Replay an entry operation on a set of entries, and on the content of
+    /// inlined files unless null.
+    static
+    void
+    apply_entry_operation(DirectoryData::Files& files,
+                          DirectoryData::Inlined* inlined,
+                          Operation const& op,
+                          bool deserialized)
+    {
+      auto const set_inlined = [&]
+        {
+          if (!inlined)
+            return;
+          if (op.inlined)
+            (*inlined)[op.target] = *op.inlined;
+          else
+            inlined->erase(op.target);
+        };
+      switch(op.type)
+      {
+      case OperationType::insert:
+      case OperationType::insert_exclusive:
+        ELLE_ASSERT(!op.target.empty());
+        // Inlined files moving to a block of their own are inserted again.
+        if (files.find(op.target) != files.end() &&
+            !(inlined && !op.inlined && inlined->count(op.target)))
+        {
+          ELLE_LOG("Conflict: the object %s was also created remotely,"
+            " your changes will overwrite the previous content.",
+            op.target);
+          if (op.type == OperationType::insert_exclusive)
+          {
+            if (deserialized)
+              ELLE_WARN("Ignoring 'exclusive' create flag in asynchronous mode");
+            else
+              THROW_EXIST();
+          }
+        }
+        ELLE_TRACE("insert: Overriding entry %s", op.target);
+        files[op.target] = std::make_pair(op.entry_type, op.address);
+        set_inlined();
+        break;
+
+      case OperationType::update:
+        if (files.find(op.target) == files.end())
+        {
+          ELLE_LOG("Conflict: the object %s (%s / %s) was removed remotely,"
+            " your changes will be dropped.",
+            op.target, "", op.target);
+          // FIXME update cached entry
+        }
+        else if (files[op.target].second != op.address)
+        {
+          ELLE_LOG("Conflict: the object %s was replaced remotely,"
+            " your changes will be dropped.",
+            op.target);
+          // FIXME update cached entry
+        }
+        else
+        {
+          ELLE_TRACE("update: Overriding entry %s", op.target);
+          files[op.target] = std::make_pair(op.entry_type, op.address);
+          set_inlined();
+        }
+        break;
+
+      case OperationType::remove:
+        files.erase(op.target);
+        if (inlined)
+          inlined->erase(op.target);
+        break;
+      }
+    }
+
     std::unique_ptr<Block>
     resolve_directory_conflict(Block& b,
                                Block& current,
@@ -73,72 +161,44 @@ namespace infinit
        ELLE_TRACE("edit conflict on %s (%s %s)",
                   b.address(), op.type, op.target);
        auto d = DirectoryData({}, current, {true, true});
-       switch(op.type)
+       if (op.type == OperationType::update && op.target == "")
+       {
+         ELLE_LOG("Conflict: the directory %s was updated remotely, your"
+                  " changes will be dropped.", "");
+       }
+       else if (op.type == OperationType::update && op.target == "/perms")
+       {
+         auto wp = dynamic_cast<ACLBlock&>(b).get_world_permissions();
+         auto& aclb = dynamic_cast<ACLBlock&>(current);
+         aclb.set_world_permissions(wp.first, wp.second);
+       }
+       else if (op.type == OperationType::update && op.target == "/inherit")
+       {
+         d._inherit_auth = true;
+       }
+       else if (op.type == OperationType::update && op.target == "/disinherit")
        {
-       case OperationType::insert:
-       case OperationType::insert_exclusive:
-         ELLE_ASSERT(!op.target.empty());
-         if (d.files().find(op.target) != d.files().end())
+         d._inherit_auth = false;
+       }
+       else
+       {
+         apply_entry_operation(d._files, &d._inlined, op, deserialized);
+         if (!d._shards.empty())
          {
-           ELLE_LOG("Conflict: the object %s was also created remotely,"
-             " your changes will overwrite the previous content.",
-             op.target);
-           if (op.type == OperationType::insert_exclusive)
+           // The directory was sharded remotely: keep the entry in the root
+           // block, it will be moved to its shard on the next write.
+           ELLE_LOG("Conflict: the directory was sharded remotely, "
+                    "entry %s will be moved to its shard later", op.target);
+           auto it = std::find(d._unsharded.begin(), d._unsharded.end(),
+                               op.target);
+           if (op.type == OperationType::remove)
            {
-             if (deserialized)
-               ELLE_WARN("Ignoring 'exclusive' create flag in asynchronous mode");
-             else
-               THROW_EXIST();
+             if (it != d._unsharded.end())
+               d._unsharded.erase(it);
            }
+           else if (it == d._unsharded.end())
+             d._unsharded.push_back(op.target);
          }
-         ELLE_TRACE("insert: Overriding entry %s", op.target);
-         d._files[op.target] = std::make_pair(op.entry_type, op.address);
-         break;
-
-       case OperationType::update:
-         if (op.target == "")
-         {
-           ELLE_LOG("Conflict: the directory %s was updated remotely, your"
-                    " changes will be dropped.", "");
-         }
-         else if (op.target == "/perms")
-         {
-           auto wp = dynamic_cast<ACLBlock&>(b).get_world_permissions();
-           auto& aclb = dynamic_cast<ACLBlock&>(current);
-           aclb.set_world_permissions(wp.first, wp.second);
-         }
-         else if (op.target == "/inherit")
-         {
-           d._inherit_auth = true;
-         }
-         else if (op.target == "/disinherit")
-         {
-           d._inherit_auth = false;
-         }
-         else if (d._files.find(op.target) == d._files.end())
-         {
-           ELLE_LOG("Conflict: the object %s (%s / %s) was removed remotely,"
-             " your changes will be dropped.",
-             op.target, "", op.target);
-           // FIXME update cached entry
-         }
-         else if (d._files[op.target].second != op.address)
-         {
-           ELLE_LOG("Conflict: the object %s was replaced remotely,"
-             " your changes will be dropped.",
-             op.target);
-           // FIXME update cached entry
-         }
-         else
-         {
-           ELLE_TRACE("update: Overriding entry %s", op.target);
-           d._files[op.target] = std::make_pair(op.entry_type, op.address);
-         }
-         break;
-
-       case OperationType::remove:
-         d._files.erase(op.target);
-         break;
        }
        elle::Buffer data = [&d]
          {
@@ -207,6 +267,8 @@ namespace infinit
       s.serialize("optarget", _op.target);
       s.serialize("opaddr", _op.address);
       s.serialize("opetype", _op.entry_type, elle::serialization::as<int>());
+      if (version >= elle::Version(0, 10, 0))
+        s.serialize("opinline", _op.inlined);
     }
 
     struct ConflictContent
@@ -286,6 +348,278 @@ namespace infinit
     static const elle::serialization::Hierarchy<model::ConflictResolver>::
     Register<DirectoryConflictResolver> _register_dcr("dcr");
 
+    /*-------.
+    | Shards |
+    `-------*/
+
+    static
+    DirectoryData::Files
+    shard_entries(Block& block)
+    {
+      auto files = DirectoryData::Files{};
+      auto const& data = umbrella([&] () -> elle::Buffer const&
+                                  { return block.data(); }, EACCES);
+      if (data.empty())
+        return files;
+      elle::IOStream is(data.istreambuf());
+      elle::serialization::binary::SerializerIn input(is);
+      input.serialize("content", files);
+      return files;
+    }
+
+    static
+    elle::Buffer
+    shard_data(DirectoryData::Files& files)
+    {
+      elle::Buffer res;
+      {
+        elle::IOStream os(res.ostreambuf());
+        elle::serialization::binary::SerializerOut output(os);
+        output.serialize("content", files);
+      }
+      return res;
+    }
+
+    /// Replay an entry operation on the current version of a shard.
+    struct DirectoryShardConflictResolver
+      : public model::ConflictResolver
+    {
+      DirectoryShardConflictResolver(Operation op)
+        : _op(std::move(op))
+        , _deserialized(false)
+      {}
+
+      DirectoryShardConflictResolver(elle::serialization::SerializerIn& s,
+                                     elle::Version const& v)
+        : _deserialized(true)
+      {
+        this->serialize(s, v);
+      }
+
+      std::unique_ptr<Block>
+      operator() (Block& block, Block& current) override
+      {
+        ELLE_TRACE("edit conflict on shard %f (%s %s)",
+                   current.address(), this->_op.type, this->_op.target);
+        auto files = shard_entries(current);
+        apply_entry_operation(files, nullptr, this->_op, this->_deserialized);
+        auto res = elle::cast<ACLBlock>::runtime(current.clone());
+        res->data(shard_data(files));
+        return std::move(res);
+      }
+
+      void
+      serialize(elle::serialization::Serializer& s,
+                elle::Version const& version) override
+      {
+        s.serialize("optype", this->_op.type, elle::serialization::as<int>());
+        s.serialize("optarget", this->_op.target);
+        s.serialize("opaddr", this->_op.address);
+        s.serialize("opetype", this->_op.entry_type,
+                    elle::serialization::as<int>());
+      }
+
+      std::string
+      description() const override
+      {
+        return elle::sprintf("edit directory shard: %s %s \"%s\"",
+                             this->_op.type,
+                             this->_op.entry_type,
+                             this->_op.target);
+      }
+
+      Operation _op;
+      bool _deserialized;
+      using serialization_tag = infinit::serialization_tag;
+    };
+
+    static const elle::serialization::Hierarchy<model::ConflictResolver>::
+    Register<DirectoryShardConflictResolver> _register_dscr("dscr");
+
+    /// Remove the entries moved to a new shard from the current version of
+    /// the split one.
+    struct DirectoryShardSplitResolver
+      : public model::ConflictResolver
+    {
+      DirectoryShardSplitResolver(std::vector<std::string> moved)
+        : _moved(std::move(moved))
+      {}
+
+      DirectoryShardSplitResolver(elle::serialization::SerializerIn& s,
+                                  elle::Version const& v)
+      {
+        this->serialize(s, v);
+      }
+
+      std::unique_ptr<Block>
+      operator() (Block& block, Block& current) override
+      {
+        ELLE_TRACE("split conflict on shard %f", current.address());
+        auto files = shard_entries(current);
+        for (auto const& name: this->_moved)
+          files.erase(name);
+        auto res = elle::cast<ACLBlock>::runtime(current.clone());
+        res->data(shard_data(files));
+        return std::move(res);
+      }
+
+      void
+      serialize(elle::serialization::Serializer& s,
+                elle::Version const& version) override
+      {
+        s.serialize("moved", this->_moved);
+      }
+
+      std::string
+      description() const override
+      {
+        return elle::sprintf("split directory shard (%s entries moved)",
+                             this->_moved.size());
+      }
+
+      std::vector<std::string> _moved;
+      using serialization_tag = infinit::serialization_tag;
+    };
+
+    static const elle::serialization::Hierarchy<model::ConflictResolver>::
+    Register<DirectoryShardSplitResolver> _register_dssr("dssr");
+
+    DirectoryData::Shard::Shard(Address address)
+      : address(address)
+      , version(-1)
+    {}
+
+    DirectoryData::Shard::Shard(elle::serialization::SerializerIn& s,
+                                elle::Version const& v)
+      : version(-1)
+    {
+      this->serialize(s, v);
+    }
+
+    void
+    DirectoryData::Shard::serialize(elle::serialization::Serializer& s,
+                                    elle::Version const& v)
+    {
+      s.serialize("address", this->address);
+    }
+
+    /// FNV-1a, stable across platforms and releases unlike std::hash, since
+    /// every client must agree on the shard of an entry.
+    static
+    uint64_t
+    name_hash(std::string const& name)
+    {
+      uint64_t h = 14695981039346656037ull;
+      for (unsigned char c: name)
+      {
+        h ^= c;
+        h *= 1099511628211ull;
+      }
+      return h;
+    }
+
+    int
+    DirectoryData::shard_of(std::string const& name) const
+    {
+      ELLE_ASSERT(!this->_shards.empty());
+      // Linear hashing: shards below the split pointer were already split in
+      // two using one more bit of the hash.
+      auto const count = this->_shards.size();
+      auto level = decltype(count)(1);
+      while (level * 2 <= count)
+        level *= 2;
+      auto const h = name_hash(name);
+      auto index = h % level;
+      if (index < count - level)
+        index = h % (level * 2);
+      return static_cast<int>(index);
+    }
+
+    void
+    DirectoryData::load_shard(FileSystem& fs, std::string const& name)
+    {
+      if (!this->_shards.empty())
+        this->_load_shards(fs, {this->shard_of(name)});
+    }
+
+    void
+    DirectoryData::load_shards(FileSystem& fs)
+    {
+      if (this->_shards.empty())
+        return;
+      auto indexes = std::vector<int>(this->_shards.size());
+      std::iota(indexes.begin(), indexes.end(), 0);
+      this->_load_shards(fs, indexes);
+    }
+
+    void
+    DirectoryData::_load_shards(FileSystem& fs, std::vector<int> const& indexes)
+    {
+      ELLE_DEBUG_SCOPE("%s: load %s shards", this, indexes.size());
+      static elle::Bench bench("bench.filesystem.shard.load",
+                               std::chrono::seconds(1000));
+      elle::Bench::BenchScope bs(bench);
+      // Keep the table we are loading: a concurrent root update may replace
+      // it while we wait.
+      auto const shards = this->_shards;
+      auto by_address = std::unordered_map<Address, int>{};
+      auto addresses = std::vector<model::Model::AddressVersion>{};
+      for (auto i: indexes)
+      {
+        auto const& shard = shards.at(i);
+        by_address.emplace(shard.address, i);
+        addresses.emplace_back(
+          shard.address,
+          shard.version >= 0 ? boost::optional<int>(shard.version)
+                             : boost::optional<int>());
+      }
+      auto error = std::exception_ptr{};
+      fs.block_store()->multifetch(
+        addresses,
+        [&] (Address addr,
+             std::unique_ptr<model::blocks::Block> block,
+             std::exception_ptr exception)
+        {
+          if (exception)
+          {
+            if (!error)
+              error = exception;
+            return;
+          }
+          // Unchanged since our last load.
+          if (!block)
+            return;
+          auto const i = by_address.at(addr);
+          if (i < signed(this->_shards.size()) &&
+              this->_shards[i].address == addr)
+            this->_loaded_shard(i, *block);
+        });
+      if (error)
+        umbrella([&] { std::rethrow_exception(error); });
+    }
+
+    void
+    DirectoryData::_loaded_shard(int index, Block& block)
+    {
+      auto& shard = this->_shards[index];
+      auto const version =
+        dynamic_cast<model::blocks::MutableBlock&>(block).version();
+      if (shard.version >= version)
+        return;
+      auto files = shard_entries(block);
+      ELLE_DEBUG("%s: load shard %s at %f: version %s, %s entries",
+                 this, index, shard.address, version, files.size());
+      for (auto const& name: shard.names)
+        this->_files.erase(name);
+      shard.names.clear();
+      for (auto& f: files)
+      {
+        shard.names.push_back(f.first);
+        this->_files[f.first] = std::move(f.second);
+      }
+      shard.version = version;
+    }
+
     Directory::Directory(FileSystem& owner,
                          std::shared_ptr<DirectoryData> self,
                          std::shared_ptr<DirectoryData> parent,
@@ -329,8 +663,29 @@ namespace infinit
                              elle::Version const& v)
     {
       s.serialize("header", this->_header);
-      s.serialize("content", this->_files);
+      if (s.out() && !this->_shards.empty())
+      {
+        // Sharded entries live in their shard, only keep the stray ones.
+        auto content = Files{};
+        for (auto const& name: this->_unsharded)
+        {
+          auto it = this->_files.find(name);
+          if (it != this->_files.end())
+            content.emplace(*it);
+        }
+        s.serialize("content", content);
+      }
+      else
+        s.serialize("content", this->_files);
       s.serialize("inherit_auth", this->_inherit_auth);
+      if (v >= elle::Version(0, 10, 0))
+      {
+        s.serialize("shards", this->_shards);
+        s.serialize("inlined", this->_inlined);
+      }
+      if (s.in() && !this->_shards.empty())
+        this->_unsharded = elle::make_vector(
+          this->_files, [] (auto const& f) { return f.first; });
     }
 
     static
@@ -384,9 +739,14 @@ namespace infinit
       else
       {
         elle::serialization::binary::SerializerIn input(is);
+        auto files = std::move(this->_files);
+        auto shards = std::move(this->_shards);
         try
         {
           _files.clear();
+          _inlined.clear();
+          _shards.clear();
+          _unsharded.clear();
           _header.xattrs.clear();
           input.serialize_forward(*this);
         }
@@ -407,12 +767,47 @@ namespace infinit
           _header.mode |= 0400;
         if (perms.second)
           _header.mode |= 0200;
+        // Keep the shards we loaded if the table did not change, they are
+        // refreshed individually.
+        if (!this->_shards.empty() &&
+            this->_shards.size() == shards.size() &&
+            std::equal(this->_shards.begin(), this->_shards.end(),
+                       shards.begin(),
+                       [] (Shard const& a, Shard const& b)
+                       { return a.address == b.address; }))
+        {
+          this->_shards = std::move(shards);
+          for (auto const& shard: this->_shards)
+            for (auto const& name: shard.names)
+            {
+              auto it = files.find(name);
+              if (it != files.end())
+                this->_files.insert(*it);
+            }
+        }
         ELLE_TRACE("Directory block fetch OK");
         ELLE_DUMP("%s", print_files(_files));
       }
       _block_version = dynamic_cast<ACLBlock&>(block).version();
     }
 
+    static
+    elle::Buffer
+    directory_data(DirectoryData& d, elle::Version const& version)
+    {
+      elle::Buffer data;
+      elle::IOStream os(data.ostreambuf());
+      auto versions =
+        elle::serialization::_details::dependencies<typename FileData::serialization_tag>(
+          version, 42);
+      versions.emplace(
+        elle::type_info<typename FileData::serialization_tag>(),
+        version);
+      elle::serialization::binary::SerializerOut output(os, versions, true);
+      output.serialize_forward(d);
+      return data;
+    }
+
     void
     DirectoryData::write(FileSystem& fs,
                          Operation op,
@@ -423,33 +818,56 @@ namespace infinit
       model::Model& model = *fs.block_store();
       ELLE_DEBUG("%s: write at %s", this, _address);
       ELLE_DUMP("%s", print_files(_files));
-      if (set_mtime)
-      {
-        ELLE_DEBUG_SCOPE("set mtime");
-        _header.mtime = time(nullptr);
-      }
-      elle::Buffer data;
-      {
-        elle::IOStream os(data.ostreambuf());
-        auto version = model.version();
-        auto versions =
-          elle::serialization::_details::dependencies<typename FileData::serialization_tag>(
-            version, 42);
-        versions.emplace(
-          elle::type_info<typename FileData::serialization_tag>(),
-          version);
-        elle::serialization::binary::SerializerOut output(os, versions, true);
-        output.serialize_forward(*this);
-      }
       try
       {
+        if (!this->_shards.empty() && entry_operation(op))
+        {
+          this->_write_shard(fs, op);
+          // The root block only holds the header and the shard table: only
+          // rewrite it when the (second-grained) mtime changes or when stray
+          // entries must be moved to their shard.
+          if (this->_unsharded.empty() &&
+              (!set_mtime ||
+               this->_header.mtime == static_cast<uint64_t>(time(nullptr))))
+            return;
+          op = Operation{OperationType::update, ""};
+        }
+        if (!this->_shards.empty() && !this->_unsharded.empty())
+        {
+          ELLE_DEBUG_SCOPE("%s: move %s stray entries to their shard",
+                           this, this->_unsharded.size());
+          for (auto const& name: this->_unsharded)
+          {
+            auto it = this->_files.find(name);
+            if (it != this->_files.end())
+              this->_write_shard(
+                fs,
+                {OperationType::insert, name,
+                 it->second.first, it->second.second});
+          }
+          this->_unsharded.clear();
+        }
+        if (set_mtime)
+        {
+          ELLE_DEBUG_SCOPE("set mtime");
+          _header.mtime = time(nullptr);
+        }
+        if (this->_shards.empty() && !first_write && entry_operation(op) &&
+            signed(this->_files.size()) > fs.directory_shard_size() &&
+            model.version() >= elle::Version(0, 10, 0) &&
+            this->_shard(fs))
+          return;
+        auto data = directory_data(*this, model.version());
         int version = 0;
+        auto world = boost::optional<std::pair<bool, bool>>{};
         auto resolver =
           std::make_unique<DirectoryConflictResolver>(model, op, _address);
         if (block)
         {
           block->data(data);
           version = block->version();
+          if (op.target == "/perms")
+            world = block->get_world_permissions();
           if (first_write)
             model.seal_and_insert(*block, std::move(resolver));
           else
@@ -471,6 +889,8 @@ namespace infinit
           else
             b->data(data);
           version = b->version();
+          if (op.target == "/perms")
+            world = b->get_world_permissions();
           if (first_write)
             model.insert(std::move(b), std::move(resolver));
           else
@@ -478,6 +898,13 @@ namespace infinit
         }
         ELLE_TRACE("stored version %s of %f", version, _address);
         _block_version = version + 1;
+        if (world && !this->_shards.empty())
+          this->update_shards_permissions(
+            fs,
+            [&] (ACLBlock& shard)
+            {
+              shard.set_world_permissions(world->first, world->second);
+            });
       }
       catch (infinit::model::doughnut::ValidationFailed const& e)
       {
@@ -500,6 +927,292 @@ namespace infinit
       }
     }
 
+    bool
+    DirectoryData::_store_root(FileSystem& fs, ACLBlock& root)
+    {
+      auto& model = *fs.block_store();
+      root.data(directory_data(*this, model.version()));
+      auto const version = root.version();
+      try
+      {
+        model.seal_and_update(root);
+      }
+      catch (model::Conflict const& e)
+      {
+        ELLE_TRACE("%s: conflict storing shard table: %s", this, e);
+        return false;
+      }
+      ELLE_TRACE("stored version %s of %f", version, _address);
+      this->_block_version = version + 1;
+      return true;
+    }
+
+    void
+    DirectoryData::_write_shard(FileSystem& fs, Operation const& op)
+    {
+      auto& model = *fs.block_store();
+      auto const index = this->shard_of(op.target);
+      auto const address = this->_shards[index].address;
+      ELLE_DEBUG_SCOPE("%s: write shard %s at %f", this, index, address);
+      auto block = elle::cast<ACLBlock>::runtime(model.fetch(address));
+      auto files = shard_entries(*block);
+      apply_entry_operation(files, nullptr, op, false);
+      block->data(shard_data(files));
+      model.seal_and_update(
+        *block, std::make_unique<DirectoryShardConflictResolver>(op));
+      this->_loaded_shard(index, *block);
+      if (signed(files.size()) > fs.directory_shard_size())
+        this->_split_shard(fs);
+    }
+
+    bool
+    DirectoryData::_shard(FileSystem& fs)
+    {
+      auto& model = *fs.block_store();
+      auto root = elle::cast<ACLBlock>::runtime(model.fetch(this->_address));
+      if (root->version() != this->_block_version)
+        // Let the regular write path resolve the conflict first.
+        return false;
+      // Shards only hold entries, move inlined files out first.
+      this->_promote_inlined(fs, false);
+      auto const count = std::max(
+        2, 2 * signed(this->_files.size()) / fs.directory_shard_size());
+      ELLE_TRACE_SCOPE("%s: shard %s entries in %s blocks",
+                       this, this->_files.size(), count);
+      auto blocks = std::vector<std::unique_ptr<ACLBlock>>{};
+      for (int i = 0; i < count; ++i)
+      {
+        blocks.emplace_back(model.make_block<ACLBlock>());
+        root->copy_permissions(*blocks.back());
+        this->_shards.emplace_back(blocks.back()->address());
+      }
+      auto inserted = 0;
+      elle::SafeFinally rollback(
+        [&]
+        {
+          for (int i = 0; i < inserted; ++i)
+            filesystem::unchecked_remove(model, blocks[i]->address());
+          this->_shards.clear();
+        });
+      auto contents = std::vector<Files>(count);
+      for (auto const& f: this->_files)
+        contents[this->shard_of(f.first)].insert(f);
+      for (int i = 0; i < count; ++i)
+      {
+        blocks[i]->data(shard_data(contents[i]));
+        model.seal_and_insert(*blocks[i]);
+        ++inserted;
+      }
+      if (!this->_store_root(fs, *root))
+        return false;
+      rollback.abort();
+      for (int i = 0; i < count; ++i)
+        this->_loaded_shard(i, *blocks[i]);
+      return true;
+    }
+
+    void
+    DirectoryData::_split_shard(FileSystem& fs)
+    {
+      auto& model = *fs.block_store();
+      auto root = elle::cast<ACLBlock>::runtime(model.fetch(this->_address));
+      if (root->version() != this->_block_version)
+      {
+        ELLE_TRACE("%s: root block changed, postpone split", this);
+        return;
+      }
+      // Linear hashing: split the shard under the split pointer, whichever
+      // overflowed.
+      auto const count = signed(this->_shards.size());
+      auto level = 1;
+      while (level * 2 <= count)
+        level *= 2;
+      auto const split = count - level;
+      ELLE_TRACE_SCOPE("%s: split shard %s into new shard %s",
+                       this, split, count);
+      auto source = elle::cast<ACLBlock>::runtime(
+        model.fetch(this->_shards[split].address));
+      auto files = shard_entries(*source);
+      auto target = model.make_block<ACLBlock>();
+      root->copy_permissions(*target);
+      this->_shards.emplace_back(target->address());
+      elle::SafeFinally rollback([&] { this->_shards.pop_back(); });
+      auto moved_files = Files{};
+      auto moved = std::vector<std::string>{};
+      for (auto it = files.begin(); it != files.end();)
+        if (this->shard_of(it->first) == count)
+        {
+          moved.push_back(it->first);
+          moved_files.insert(*it);
+          it = files.erase(it);
+        }
+        else
+          ++it;
+      target->data(shard_data(moved_files));
+      model.seal_and_insert(*target);
+      elle::SafeFinally remove_target(
+        [&] { filesystem::unchecked_remove(model, target->address()); });
+      if (!this->_store_root(fs, *root))
+        return;
+      remove_target.abort();
+      rollback.abort();
+      source->data(shard_data(files));
+      model.seal_and_update(
+        *source, std::make_unique<DirectoryShardSplitResolver>(moved));
+      this->_loaded_shard(split, *source);
+      this->_loaded_shard(count, *target);
+    }
+
+    void
+    DirectoryData::update_shards_permissions(
+      FileSystem& fs,
+      std::function<void (ACLBlock&)> const& edit)
+    {
+      auto& model = *fs.block_store();
+      for (auto const& shard: this->_shards)
+      {
+        ELLE_DEBUG_SCOPE("%s: update permissions of shard %f",
+                         this, shard.address);
+        while (true)
+          try
+          {
+            auto block = elle::cast<ACLBlock>::runtime(
+              model.fetch(shard.address));
+            edit(*block);
+            model.seal_and_update(*block);
+            break;
+          }
+          catch (model::Conflict const& e)
+          {
+            ELLE_TRACE("conflict updating shard permissions, retry: %s", e);
+          }
+      }
+    }
+
+    void
+    DirectoryData::remove_shards(FileSystem& fs)
+    {
+      for (auto const& shard: this->_shards)
+        filesystem::unchecked_remove(*fs.block_store(), shard.address);
+      this->_shards.clear();
+    }
+
+    /*--------------.
+    | Inlined files |
+    `--------------*/
+
+    InlineFile::InlineFile(FileHeader header, elle::Buffer data)
+      : header(std::move(header))
+      , data(std::move(data))
+    {}
+
+    InlineFile::InlineFile(elle::serialization::SerializerIn& s,
+                           elle::Version const& v)
+    {
+      this->serialize(s, v);
+    }
+
+    void
+    InlineFile::serialize(elle::serialization::Serializer& s,
+                          elle::Version const& v)
+    {
+      s.serialize("header", this->header);
+      s.serialize("data", this->data);
+    }
+
+    bool
+    DirectoryData::can_inline(FileSystem& fs, ACLBlock& block) const
+    {
+      auto& model = *fs.block_store();
+      if (fs.inline_size() <= 0 ||
+          model.version() < elle::Version(0, 10, 0) ||
+          !this->_shards.empty())
+        return false;
+      if (this->_inherit_auth)
+        return true;
+      auto const world = block.get_world_permissions();
+      if (world.first || world.second)
+        return false;
+      auto const perms = block.list_permissions({});
+      if (perms.size() != 1 || !perms[0].owner)
+        return false;
+      auto const& dht = dynamic_cast<model::doughnut::Doughnut&>(model);
+      auto const user =
+        dynamic_cast<model::doughnut::User const*>(perms[0].user.get());
+      return user && user->key() == dht.keys().K();
+    }
+
+    void
+    DirectoryData::promoted(FileSystem& fs, Address inlined, Address address)
+    {
+      // Look the entry up by address, the file may have been renamed.
+      auto it = std::find_if(
+        this->_files.begin(), this->_files.end(),
+        [&] (auto const& f) { return f.second.second == inlined; });
+      if (it == this->_files.end() || !this->_inlined.count(it->first))
+      {
+        ELLE_TRACE("%s: inlined file %f was removed, drop its block %f",
+                   this, inlined, address);
+        filesystem::unchecked_remove(*fs.block_store(), address);
+        return;
+      }
+      auto const name = it->first;
+      ELLE_TRACE_SCOPE("%s: move inlined file %s to %f", this, name, address);
+      it->second = std::make_pair(EntryType::file, address);
+      this->_inlined.erase(name);
+      this->write(fs, {OperationType::insert, name, EntryType::file, address});
+    }
+
+    void
+    DirectoryData::promote_inlined(FileSystem& fs)
+    {
+      this->_promote_inlined(fs, true);
+    }
+
+    void
+    DirectoryData::_promote_inlined(FileSystem& fs, bool link)
+    {
+      if (this->_inlined.empty())
+        return;
+      ELLE_TRACE_SCOPE("%s: move %s inlined files to their own block",
+                       this, this->_inlined.size());
+      auto const names = elle::make_vector(
+        this->_inlined, [] (auto const& f) { return f.first; });
+      for (auto const& name: names)
+      {
+        // Entries may change while we store blocks.
+        auto it = this->_inlined.find(name);
+        auto entry = this->_files.find(name);
+        if (it == this->_inlined.end() || entry == this->_files.end())
+          continue;
+        auto const inlined = entry->second.second;
+        auto address = Address::null;
+        auto buffer = std::shared_ptr<FileBuffer>{};
+        auto open = fs.file_buffers().find(inlined);
+        if (open != fs.file_buffers().end())
+          buffer = open->second.lock();
+        // Open files hold the latest content, and must learn their address.
+        if (buffer && buffer->_file.inlined())
+        {
+          buffer->_promote(false);
+          address = buffer->_file.address();
+        }
+        else
+        {
+          auto data = FileData(this->_path / name, inlined, it->second, {});
+          data.promote(fs, *this);
+          address = data.address();
+        }
+        if (link)
+          this->promoted(fs, inlined, address);
+        else
+        {
+          this->_files[name] = std::make_pair(EntryType::file, address);
+          this->_inlined.erase(name);
+        }
+      }
+    }
+
     FileHeader&
     Directory::_header()
     {
@@ -627,10 +1340,12 @@ namespace infinit
       fs.prefetching()++;
       auto files = std::make_shared<std::vector<PrefetchEntry>>();
       for (auto const& f: this->_files)
-        files->emplace_back(
-          f.first, f.second.second, 0,
-          f.second.first == EntryType::directory,
-          cached_version(fs, f.second.second, f.second.first));
+        // Inlined files have no block.
+        if (!this->_inlined.count(f.first))
+          files->emplace_back(
+            f.first, f.second.second, 0,
+            f.second.first == EntryType::directory,
+            cached_version(fs, f.second.second, f.second.first));
       this->_prefetching = true;
       auto running = std::make_shared<int>(nthreads);
       auto parked = std::make_shared<int>(0);
@@ -701,6 +1416,8 @@ namespace infinit
                     d = *(fs->directory_cache().find(addr));
                   for (auto const& f: d->_files)
                   {
+                    if (d->_inlined.count(f.first))
+                      continue;
                     files->emplace_back(
                       f.first, f.second.second, recurse.at(addr) + 1,
                       f.second.first == EntryType::directory,
@@ -742,10 +1459,12 @@ namespace infinit
                           d = *it;
                         }
                         for (auto const& f: d->_files)
-                          files->emplace_back(
-                            f.first, f.second.second, recurse.at(addr) + 1,
-                            f.second.first == EntryType::directory,
-                            cached_version(*fs, f.second.second, f.second.first));
+                          if (!d->_inlined.count(f.first))
+                            files->emplace_back(
+                              f.first, f.second.second, recurse.at(addr) + 1,
+                              f.second.first == EntryType::directory,
+                              cached_version(*fs, f.second.second,
+                                             f.second.first));
                         available->open();
                       }
                       catch (elle::Error const& e)
@@ -794,6 +1513,7 @@ namespace infinit
     Directory::list_directory(rfs::OnDirectoryEntry cb)
     {
       ELLE_TRACE_SCOPE("%s: list", *this);
+      _data->load_shards(_owner);
       _data->_prefetch(_owner, _data);
       struct stat st;
       st.st_size  = 0;
@@ -832,6 +1552,7 @@ namespace infinit
     Directory::rmdir()
     {
       ELLE_TRACE_SCOPE("%s: remove", *this);
+      _data->load_shards(_owner);
       if (!_data->_files.empty())
         throw rfs::Error(ENOTEMPTY, "Directory not empty");
       if (_parent.get() == nullptr)
@@ -841,6 +1562,7 @@ namespace infinit
         THROW_ACCES();
       _parent->_files.erase(_name);
       _parent->write(_owner, {OperationType::remove, _name});
+      umbrella([&] {_data->remove_shards(_owner);});
       umbrella([&] {_owner.block_store()->remove(_data->address());});
     }
 
@@ -903,6 +1625,10 @@ namespace infinit
     void
     Directory::chmod(mode_t mode)
     {
+      // Inlined files would follow the new world permissions.
+      if (this->_owner.map_other_permissions() &&
+          (mode & 06) != (this->_data->_header.mode & 06))
+        umbrella([&] { this->_data->promote_inlined(this->_owner); });
       Node::chmod(mode);
     }
 
@@ -950,6 +1676,7 @@ namespace infinit
         }
         else if (*special == "fsck.deref")
         {
+          this->_data->load_shard(_owner, value);
           this->_data->_files.erase(value);
           this->_data->write(_owner,
                              {OperationType::remove, value},
@@ -990,6 +1717,7 @@ namespace infinit
         }
         else if (*special == "fsck.unlink")
         {
+          this->_data->load_shard(_owner, value);
           auto it = _data->_files.find(value);
           if (it == _data->_files.end())
             THROW_NOENT();
@@ -1010,6 +1738,9 @@ namespace infinit
           }
           return;
         }
+        else if (*special == "auth_others" ||
+                 boost::starts_with(*special, "auth."))
+          umbrella([&] { this->_data->promote_inlined(this->_owner); });
       }
       Node::setxattr(name, value, flags);
     }
@@ -1058,6 +1789,7 @@ namespace infinit
                 [&]
                 {
                   std::string file = special->substr(strlen("blockof."));
+                  this->_data->load_shard(this->_owner, file);
                   auto addr = this->_data->files().at(file).second;
                   auto block = this->_owner.block_store()->fetch(addr);
                   return elle::serialization::json::serialize(block).string();
@@ -148,7 +148,20 @@ namespace infinit
     File::chmod(mode_t mode)
     {
       ELLE_DEBUG("chmod to %s", print_mode(mode));
-      Node::chmod(mode);
+      this->_fetch();
+      // Inlined files only own their executable bits, others move the file
+      // to a block of its own.
+      if (this->_filedata->inlined() &&
+          (!this->_owner.map_other_permissions() ||
+           (mode & 06) == (this->_filedata->_header.mode & 06)))
+      {
+        auto& header = this->_filedata->_header;
+        header.mode = (header.mode & ~0111) | (mode & 0111);
+        header.ctime = time(nullptr);
+        this->_commit(WriteTarget::perms);
+      }
+      else
+        Node::chmod(mode);
       ELLE_DEBUG("current mode: %s", print_mode(_filedata->_header.mode));
     }
 
@@ -200,6 +213,18 @@ namespace infinit
     {
       if (this->_filedata)
         return;
+      if (this->_parent)
+      {
+        auto it = this->_parent->_inlined.find(this->_name);
+        if (it != this->_parent->_inlined.end())
+        {
+          ELLE_DEBUG("%s: inlined in its directory", *this);
+          this->_filedata = std::make_shared<FileData>(
+            this->_parent->_path / this->_name, this->_address, it->second,
+            this->_parent);
+          return;
+        }
+      }
       this->_first_block = std::dynamic_pointer_cast<ACLBlock>(
         this->_owner.fetch_or_die(_address, {}, this->full_path()));
 
@@ -344,6 +369,18 @@ namespace infinit
       ELLE_DEBUG("%s: write at %f: sz=%s, links=%s, mode=%s, fatsize=%s, firstblocksize=%s",
                  this, _address,
                  _header.size, _header.links, print_mode(_header.mode), _fat.size(), _data.size());
+      if (auto directory = this->_inlined_in)
+      {
+        if (this->inline_fits(fs))
+          this->_write_inline(fs);
+        else
+        {
+          auto const inlined = this->_address;
+          this->promote(fs, *directory);
+          directory->promoted(fs, inlined, this->_address);
+        }
+        return;
+      }
       auto& model = *fs.block_store();
       std::unique_ptr<ACLBlock> myblock_;
       auto& block = (&block_ == &DirectoryData::null_block) ? myblock_ : block_;
@@ -427,11 +464,118 @@ namespace infinit
       }
     }
 
+    /*-------------.
+    | Inlined file |
+    `-------------*/
+
+    FileData::FileData(bfs::path path,
+                       Address address,
+                       InlineFile const& file,
+                       std::shared_ptr<DirectoryData> directory)
+      : _address(address)
+      , _block_version(-1)
+      , _last_used(FileSystem::now())
+      , _header(file.header)
+      , _data(file.data)
+      , _path(std::move(path))
+      , _inlined_in(std::move(directory))
+    {
+      // Inlined files have the permissions of their directory.
+      if (this->_inlined_in)
+      {
+        this->_header.mode &= ~0606;
+        this->_header.mode |= this->_inlined_in->header().mode & 0606;
+      }
+    }
+
+    bool
+    FileData::inlined() const
+    {
+      return bool(this->_inlined_in);
+    }
+
+    bool
+    FileData::inline_fits(FileSystem& fs) const
+    {
+      return this->_fat.empty() &&
+        this->_header.size <= uint64_t(std::max(fs.inline_size(), 0));
+    }
+
+    void
+    FileData::promote(FileSystem& fs, DirectoryData& directory)
+    {
+      auto& model = *fs.block_store();
+      auto block = model.make_block<ACLBlock>();
+      ELLE_TRACE_SCOPE("%s: move inlined file %f to %f",
+                       this, this->_address, block->address());
+      if (directory.inherit_auth())
+        umbrella(
+          [&]
+          {
+            elle::cast<ACLBlock>::runtime(model.fetch(directory.address()))
+              ->copy_permissions(*block);
+          });
+      this->_address = block->address();
+      this->_block_version = -1;
+      this->_inlined_in.reset();
+      this->write(fs, WriteTarget::all, block, true);
+    }
+
+    void
+    FileData::_write_inline(FileSystem& fs)
+    {
+      auto& directory = *this->_inlined_in;
+      // Look the entry up by address, the file may have been renamed.
+      auto it = std::find_if(
+        directory._files.begin(), directory._files.end(),
+        [&] (auto const& f) { return f.second.second == this->_address; });
+      if (it == directory._files.end() || !directory._inlined.count(it->first))
+      {
+        ELLE_WARN("%s: unable to commit as file was deleted", this);
+        return;
+      }
+      auto const name = it->first;
+      ELLE_DEBUG("%s: write inlined in %s as %s", this, directory, name);
+      auto file = InlineFile(this->_header, this->_data);
+      directory._inlined[name] = file;
+      directory.write(
+        fs,
+        {OperationType::update, name, EntryType::file, this->_address,
+         std::move(file)});
+    }
+
+    void
+    File::_promote()
+    {
+      ELLE_TRACE_SCOPE("%s: move to a block of its own", *this);
+      auto it = this->_owner.file_buffers().find(this->_address);
+      auto buffer = it != this->_owner.file_buffers().end()
+        ? it->second.lock()
+        : nullptr;
+      // Open handles hold the latest content.
+      if (buffer && buffer->_file.inlined())
+      {
+        buffer->_promote();
+        this->_address = buffer->_file.address();
+      }
+      else
+      {
+        auto const inlined = this->_address;
+        this->_filedata->promote(this->_owner, *this->_parent);
+        this->_parent->promoted(
+          this->_owner, inlined, this->_filedata->address());
+        this->_address = this->_filedata->address();
+      }
+      this->_filedata.reset();
+    }
+
     void
     File::_commit(WriteTarget target)
     {
       ELLE_ASSERT(this->_filedata);
       _filedata->write(_owner, target, _first_block);
+      // Inlined files move to a block of their own once too large.
+      this->_address = this->_filedata->address();
     }
 
     void
@@ -440,7 +584,12 @@ namespace infinit
       if (this->_first_block)
         return;
       this->_filedata.reset();
-     _fetch();
+      this->_fetch();
+      if (this->_filedata->inlined())
+      {
+        this->_promote();
+        this->_fetch();
+      }
     }
 
     void
@@ -450,6 +599,7 @@ namespace infinit
       bfs::path newpath = where.parent_path();
       auto dir = std::dynamic_pointer_cast<Directory>(
         _owner.filesystem()->path(newpath.string()));
+      dir->_data->load_shard(_owner, newname);
       if (dir->_data->_files.find(newname) != dir->_data->_files.end())
         throw rfs::Error(EEXIST, "target file exists");
       // we need a place to store the link count
@@ -468,6 +618,34 @@ namespace infinit
     void
     File::unlink()
     {
+      this->_fetch();
+      if (this->_filedata->inlined())
+      {
+        if (!(_parent->_header.mode & 0200))
+          THROW_ACCES();
+        auto info = _parent->_files.at(_name);
+        auto inlined = _parent->_inlined.at(_name);
+        elle::SafeFinally revert(
+          [&]
+          {
+            _parent->_files[_name] = info;
+            _parent->_inlined[_name] = inlined;
+          });
+        _parent->_files.erase(_name);
+        _parent->_inlined.erase(_name);
+        _parent->write(
+          _owner,
+          {OperationType::remove, _name},
+          DirectoryData::null_block,
+          true);
+        revert.abort();
+        // Keep open handles from storing the file again.
+        auto it = this->_owner.file_buffers().find(this->_address);
+        if (it != this->_owner.file_buffers().end())
+          if (auto file_buffer = it->second.lock())
+            file_buffer->_remove_data = true;
+        return;
+      }
       _ensure_first_block();
       if ( !(_filedata->_header.mode & 0200)
         || !(_parent->_header.mode & 0200))
@@ -503,7 +681,8 @@ namespace infinit
           for (unsigned i=0; i<_filedata->_fat.size(); ++i)
           {
             ELLE_DEBUG_SCOPE("removing %s: %f", i, _filedata->_fat[i].first);
-            _owner.unchecked_remove(_filedata->_fat[i].first);
+            unchecked_remove_chb(*_owner.block_store(),
+                                 _filedata->_fat[i].first, _address, i);
           }
           ELLE_DEBUG_SCOPE("removing first block at %f", _first_block->address());
           _owner.unchecked_remove(_first_block->address());
@@ -515,6 +694,10 @@ namespace infinit
     File::rename(bfs::path const& where)
     {
       ELLE_TRACE_SCOPE("%s: rename to %s", *this, where);
+      // Inlined files only stay inlined within their directory.
+      if (this->_parent->_inlined.count(this->_name) &&
+          where.parent_path() != this->_parent->_path)
+        this->_ensure_first_block();
       Node::rename(where);
     }
 
@@ -635,7 +818,7 @@ namespace infinit
           // kick the block
           ELLE_DEBUG("removing %f", _filedata->_fat[i].first);
           if (_filedata->_fat[i].first != Address::null)
-            unchecked_remove_chb(*_owner.block_store(), _filedata->_fat[i].first, _address);
+            unchecked_remove_chb(*_owner.block_store(), _filedata->_fat[i].first, _address, i);
           _filedata->_fat.pop_back();
         }
         else if (signed(offset + _filedata->_header.block_size) >= new_size)
@@ -652,7 +835,7 @@ namespace infinit
             buf.size(targetsize);
           auto newblock = _owner.block_store()->make_block<ImmutableBlock>(
             sk.encipher(buf), _address);
-          unchecked_remove_chb(*_owner.block_store(), _filedata->_fat[i].first, this->_address);
+          unchecked_remove_chb(*_owner.block_store(), _filedata->_fat[i].first, this->_address, i);
           _filedata->_fat[i].first = newblock->address();
           this->_owner.store_or_die(
             std::move(newblock), true,
@@ -792,6 +975,13 @@ namespace infinit
             }
             else if (*special == "auth")
             {
+              this->_fetch();
+              // Inlined files have the permissions of their directory.
+              if (this->_filedata->inlined())
+                return this->perms_to_json(
+                  *elle::cast<ACLBlock>::runtime(
+                    this->_owner.block_store()->fetch(
+                      this->_parent->address())));
               this->_ensure_first_block();
               return this->perms_to_json(
                 dynamic_cast<ACLBlock&>(*this->_first_block));
@@ -816,6 +1006,10 @@ namespace infinit
           _commit(WriteTarget::data);
           return;
         }
+        // Permissions of their own need a block of their own.
+        else if (*special == "auth_others" ||
+                 boost::starts_with(*special, "auth."))
+          this->_ensure_first_block();
       }
       Node::setxattr(name, value, flags);
     }
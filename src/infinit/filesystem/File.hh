@@ -65,6 +65,8 @@ namespace infinit
       ELLE_ATTRIBUTE_R(std::shared_ptr<FileData>, filedata);
 
       void _ensure_first_block();
+      /// Move the file, inlined in its directory, to a block of its own.
+      void _promote();
       void _fetch() override;
       void _commit(WriteTarget target) override;
       FileHeader& _header() override;
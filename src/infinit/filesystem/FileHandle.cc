@@ -1,5 +1,6 @@
 #include <infinit/filesystem/FileHandle.hh>
 
+#include <boost/range/algorithm/count_if.hpp>
 #include <boost/range/algorithm/find_if.hpp>
 #include <boost/range/algorithm/min_element.hpp>
 
@@ -11,6 +12,8 @@
 #include <elle/cast.hh>
 #include <elle/os/environ.hh>
 #include <elle/serialization/binary.hh>
+#include <infinit/model/doughnut/CCHB.hh>
+#include <infinit/model/doughnut/CHB.hh>
 #include <infinit/model/doughnut/Doughnut.hh>
 
 #include <infinit/model/MissingBlock.hh>
@@ -21,8 +24,6 @@ namespace
 {
   using elle::os::getenv;
   auto const max_embed_size = getenv("INFINIT_MAX_EMBED_SIZE", 8192);
-  auto const lookahead_blocks = getenv("INFINIT_LOOKAHEAD_BLOCKS", 5);
-  auto const max_lookahead_threads = getenv("INFINIT_LOOKAHEAD_THREADS", 3);
   using Size = elle::Buffer::Size;
   auto const default_first_block_size = Size(getenv("INFINIT_FIRST_BLOCK_DATA_SIZE", 0));
 }
@@ -38,6 +39,185 @@ namespace infinit
       {
         return std::chrono::high_resolution_clock::now();
       }
+
+      void
+      decipher(elle::Buffer& data, std::string const& key)
+      {
+        if (key.empty())
+          return;
+        auto const sk = elle::cryptography::SecretKey(key);
+        if (data.size() >= 262144)
+          elle::reactor::background([&] { data = sk.decipher(data); });
+        else
+          data = sk.decipher(data);
+      }
+
+      /// Decompress deciphered content `data` of `block`, and check it
+      /// against blocks storage nodes could not check.
+      ///
+      /// @return Whether the content is sound.
+      bool
+      decode(model::blocks::Block const& block, elle::Buffer& data)
+      {
+        using model::doughnut::Compressor;
+        auto const chb = dynamic_cast<model::doughnut::CHB const*>(&block);
+        auto const cchb = dynamic_cast<model::doughnut::CCHB const*>(&block);
+        auto const compression =
+          chb ? chb->compression()
+          : cchb ? cchb->compression()
+          : Compressor::Algorithm::none;
+        try
+        {
+          data = Compressor::instance().decompress(std::move(data), compression);
+        }
+        catch (elle::Error const& e)
+        {
+          ELLE_WARN("unable to decompress %f: %s", block.address(), e);
+          return false;
+        }
+        if (!cchb || model::doughnut::CCHB::check(block.address(), data))
+          return true;
+        ELLE_WARN("content of %f does not match its address", block.address());
+        return false;
+      }
+
+      /// Whether the convergent block at `address`, if already stored, holds
+      /// the content enciphered with `key`: junk stored there beforehand
+      /// must not be referenced in place of our copy.
+      bool
+      shareable(model::Model& model, model::Address address,
+                std::string const& key)
+      {
+        auto block = std::unique_ptr<model::blocks::Block>{};
+        try
+        {
+          block = model.fetch(address);
+        }
+        catch (model::MissingBlock const&)
+        {
+          return true;
+        }
+        auto data = block->take_data();
+        try
+        {
+          decipher(data, key);
+        }
+        catch (elle::Error const& e)
+        {
+          ELLE_WARN("unable to decipher %f: %s", address, e);
+          return false;
+        }
+        return decode(*block, data);
+      }
+    }
+
+    /*------------.
+    | ReadPattern |
+    `------------*/
+
+    bool
+    ReadPattern::access(int block, int max_window)
+    {
+      if (block == this->last)
+        return false;
+      auto const delta = block - this->last;
+      auto const initial = std::min(4, max_window);
+      if (this->hits && delta == this->stride)
+      {
+        ++this->hits;
+        this->window = std::min(max_window, this->window * 2);
+      }
+      else if (delta == 1 || delta == this->stride)
+      {
+        this->stride = delta;
+        this->hits = 1;
+        this->window = initial;
+      }
+      else
+      {
+        this->stride = delta;
+        this->hits = 0;
+        this->window = 0;
+      }
+      this->last = block;
+      return true;
+    }
+
+    ReadPattern::Kind
+    ReadPattern::kind() const
+    {
+      if (!this->window)
+        return Kind::random;
+      else if (this->stride == 1)
+        return Kind::sequential;
+      else
+        return Kind::strided;
+    }
+
+    std::ostream&
+    operator <<(std::ostream& out, ReadPattern::Kind kind)
+    {
+      switch (kind)
+      {
+        case ReadPattern::Kind::random:
+          return out << "random";
+        case ReadPattern::Kind::sequential:
+          return out << "sequential";
+        case ReadPattern::Kind::strided:
+          return out << "strided";
+      }
+      elle::unreachable();
+    }
+
+    /*------------.
+    | Reservation |
+    `------------*/
+
+    FileBuffer::Reservation::Reservation(FileSystem& fs,
+                                         int64_t size,
+                                         Release release)
+      : _fs(&fs)
+      , _size(size)
+      , _release(release)
+    {}
+
+    FileBuffer::Reservation::Reservation(Reservation&& source)
+      : _fs(source._fs)
+      , _size(source._size)
+      , _release(source._release)
+    {
+      source._fs = nullptr;
+    }
+
+    FileBuffer::Reservation&
+    FileBuffer::Reservation::operator =(Reservation&& source)
+    {
+      this->release();
+      std::swap(this->_fs, source._fs);
+      this->_size = source._size;
+      this->_release = source._release;
+      return *this;
+    }
+
+    FileBuffer::Reservation::~Reservation()
+    {
+      this->release();
+    }
+
+    void
+    FileBuffer::Reservation::release()
+    {
+      if (this->_fs)
+      {
+        auto fs = this->_fs;
+        this->_fs = nullptr;
+        (fs->*this->_release)(this->_size);
+      }
+    }
+
+    FileBuffer::Reservation::operator bool() const
+    {
+      return this->_fs;
     }
 
     FileHandle::FileHandle(FileSystem& owner,
@@ -72,9 +252,10 @@ namespace infinit
     {
       try
       {
-        auto addr = this->_buffer->_file.address();
         if (!this->_close_failure)
           this->_buffer->close(this);
+        // Closing may have promoted an inlined file to a new address.
+        auto addr = this->_buffer->_file.address();
         std::weak_ptr<FileBuffer> fb = this->_buffer;
         this->_buffer.reset();
         if (!fb.lock())
@@ -98,10 +279,14 @@ namespace infinit
         for (unsigned i = 0; i < this->_file._fat.size(); ++i)
         {
           ELLE_DEBUG_SCOPE("removing %s: %f", i, this->_file._fat[i].first);
-          unchecked_remove_chb(*this->_fs.block_store(), this->_file._fat[i].first, this->_file.address());
+          unchecked_remove_chb(*this->_fs.block_store(), this->_file._fat[i].first, this->_file.address(), i);
+        }
+        // Inlined files were removed along with their entry.
+        if (!this->_file.inlined())
+        {
+          ELLE_DEBUG_SCOPE("removing first block at %f", this->_file.address());
+          unchecked_remove(*this->_fs.block_store(), this->_file.address());
         }
-        ELLE_DEBUG_SCOPE("removing first block at %f", this->_file.address());
-        unchecked_remove(*this->_fs.block_store(), this->_file.address());
       }
     }
 
@@ -170,8 +355,8 @@ namespace infinit
       offset -= _file._data.size();
       auto end = offset + size;
       int start_block = offset ? (offset) / block_size : 0;
-      _last_read_block = start_block;
-      _check_prefetch();
+      if (src->_pattern.access(start_block, this->_fs.readahead_blocks()))
+        this->_read_ahead(src->_pattern);
       int end_block = end ? (end - 1) / block_size : 0;
       if (start_block == end_block)
       {
@@ -187,6 +372,7 @@ namespace infinit
           {
             block = it->second.block;
             it->second.last_use = now();
+            it->second.prefetched.release();
           }
           else
           {
@@ -267,6 +453,7 @@ namespace infinit
     {
       if (size == 0)
         return 0;
+      this->_fs.dirty_throttle();
       // figure out first block size for this file
       auto max_first_block_size =
         this->_file._fat.empty()
@@ -334,7 +521,7 @@ namespace infinit
       {
         elle::reactor::wait(it->second.ready);
         block = it->second.block;
-        it->second.dirty = true;
+        this->_dirty_block(it->second);
         it->second.last_use = now();
         it->second.writers.insert(src);
       }
@@ -351,7 +538,7 @@ namespace infinit
         }
         ELLE_ASSERT(it != _blocks.end());
         elle::reactor::wait(it->second.ready);
-        it->second.dirty = true;
+        this->_dirty_block(it->second);
         it->second.last_use = now();
         it->second.writers.insert(src);
       }
@@ -423,7 +610,7 @@ namespace infinit
         // Kick the block
         {
           ELLE_DEBUG("removing from fat at %s", i);
-          unchecked_remove_chb(*this->_fs.block_store(), _file._fat[i].first, _file._address);
+          unchecked_remove_chb(*this->_fs.block_store(), _file._fat[i].first, _file._address, i);
           _file._fat.pop_back();
           _blocks.erase(i);
         }
@@ -439,7 +626,7 @@ namespace infinit
             if (auto data = it->second.block)
             {
               data->size(targetsize);
-              it->second.dirty = true;
+              this->_dirty_block(it->second);
             }
           }
           else
@@ -449,7 +636,7 @@ namespace infinit
             {
               buf->size(targetsize);
             }
-            _blocks.at(i).dirty = true;
+            this->_dirty_block(_blocks.at(i));
           }
         }
       }
@@ -490,6 +677,7 @@ namespace infinit
       {
         elle::reactor::wait(it->second.ready);
         it->second.last_use = now();
+        it->second.prefetched.release();
         return it->second.block;
       }
       if (_file._fat.size() <= unsigned(index))
@@ -504,7 +692,7 @@ namespace infinit
       auto& c = p.first->second;
       if (_file._fat[index].first == Address::null)
       {
-        c.block = std::make_shared<elle::Buffer>();
+        c.block = std::make_shared<elle::Buffer>(this->_fs.block_buffer());
         c.ready.open();
       }
       else
@@ -519,14 +707,12 @@ namespace infinit
         });
         auto block = fetch_or_die(*_fs.block_store(), addr, {},
                                   this->_file.path() / elle::sprintf("<%f>", addr));
-        auto crypted = block->take_data();
-        if (secret.empty())
-          c.block = std::make_shared<elle::Buffer>(std::move(crypted));
-        else
-        {
-          auto const sk = elle::cryptography::SecretKey(secret);
-          c.block = std::make_shared<elle::Buffer>(sk.decipher(crypted));
-        }
+        auto data = block->take_data();
+        decipher(data, secret);
+        if (!decode(*block, data))
+          throw rfs::Error(
+            EIO, elle::sprintf("corrupted block %s at %f", index, addr));
+        c.block = std::make_shared<elle::Buffer>(std::move(data));
       }
       c.last_use = now();
       c.dirty = false; // we just fetched or inserted it
@@ -534,73 +720,206 @@ namespace infinit
     }
 
     void
-    FileBuffer::_check_prefetch()
-    {
-      // Check if we need to relaunch a prefetcher.
-      for (int nidx = _last_read_block + 1;
-           nidx < _last_read_block + lookahead_blocks
-             && nidx < signed(_file._fat.size())
-             && _prefetchers_count < max_lookahead_threads;
-           ++nidx)
-        if (_file._fat[nidx].first != Address::null
-            && !elle::contains(this->_blocks, nidx))
-        {
-          _prefetch(nidx);
+    FileBuffer::_read_ahead(ReadPattern const& pattern)
+    {
+      auto missing = std::vector<int>{};
+      for (int i = 1; i <= pattern.window; ++i)
+      {
+        auto const idx = pattern.last + i * pattern.stride;
+        if (idx < 0 || idx >= signed(this->_file._fat.size()))
           break;
-        }
+        if (this->_file._fat[idx].first != Address::null
+            && !elle::contains(this->_blocks, idx))
+          missing.push_back(idx);
+      }
+      // Rather than topping the window up block by block, fetch in batches
+      // once half of it was consumed, or when lagging behind the reader.
+      if (missing.empty() ||
+          (signed(missing.size()) * 2 < pattern.window &&
+           missing.front() != pattern.last + pattern.stride))
+        return;
+      ELLE_TRACE("%s: %s read ahead of %s blocks from %s",
+                 *this, pattern.kind(), missing.size(), missing.front());
+      this->_prefetch(std::move(missing));
     }
 
     void
-    FileBuffer::_prefetch(int idx)
+    FileBuffer::_prefetch(std::vector<int> indexes)
     {
-      ELLE_TRACE("%s: prefetch index %s", *this, idx);
-      auto p = this->_blocks.emplace(idx, CacheEntry{});
-      auto& c = p.first->second;
-      c.last_use = now();
-      c.dirty = false;
-      auto const addr = Address(this->_file._fat[idx].first.value(),
-                                model::flags::immutable_block, false);
-      auto const key = _file._fat[idx].second;
+      auto addresses = std::vector<model::Model::AddressVersion>{};
+      // Block index and key by address.
+      auto fetching = std::unordered_map<Address, std::pair<int, std::string>>{};
+      for (auto idx: indexes)
+      {
+        auto const size = this->_file._header.block_size;
+        if (!this->_fs.readahead_reserve(size))
+        {
+          ELLE_DEBUG("%s: read-ahead budget exhausted at block %s",
+                     *this, idx);
+          break;
+        }
+        auto& c = this->_blocks.emplace(idx, CacheEntry{}).first->second;
+        c.last_use = now();
+        c.dirty = false;
+        c.prefetched =
+          Reservation(this->_fs, size, &FileSystem::readahead_release);
+        auto const addr = Address(this->_file._fat[idx].first.value(),
+                                  model::flags::immutable_block, false);
+        addresses.emplace_back(addr, boost::none);
+        fetching.emplace(addr, std::make_pair(idx, _file._fat[idx].second));
+      }
+      if (addresses.empty())
+        return;
       ++_prefetchers_count;
-      new elle::reactor::Thread("prefetcher", [this, addr, idx, key] {
-          std::unique_ptr<model::blocks::Block> bl;
+      new elle::reactor::Thread(
+        "prefetcher",
+        [this, addresses = std::move(addresses),
+         fetching = std::move(fetching)]
+        {
+          elle::SafeFinally done([&] {
+              // Release whatever the fetch did not deliver.
+              for (auto const& f: fetching)
+              {
+                auto it = this->_blocks.find(f.second.first);
+                if (it != this->_blocks.end() && !it->second.ready.opened())
+                {
+                  it->second.prefetched.release();
+                  it->second.ready.open();
+                }
+              }
+              --this->_prefetchers_count;
+          });
           try
           {
-            bl = fetch_or_die(*_fs.block_store(), addr, {},
-                              this->_file.path() / elle::sprintf("<%f>", addr));
+            this->_fs.block_store()->multifetch(
+              addresses,
+              [&] (Address addr,
+                   std::unique_ptr<model::blocks::Block> block,
+                   std::exception_ptr e)
+              {
+                auto const& f = fetching.at(addr);
+                auto it = this->_blocks.find(f.first);
+                if (it == this->_blocks.end() || it->second.ready.opened())
+                  return;
+                auto& c = it->second;
+                auto data = elle::Buffer{};
+                if (block)
+                {
+                  data = block->take_data();
+                  decipher(data, f.second);
+                }
+                if (block && decode(*block, data))
+                {
+                  ELLE_TRACE("Prefetcher inserting value at %s", f.first);
+                  c.block = std::make_shared<elle::Buffer>(std::move(data));
+                  c.last_use = now();
+                }
+                else
+                {
+                  ELLE_TRACE("Prefetcher error fetching %x: %s", addr,
+                             e ? elle::exception_string(e) : "missing block");
+                  c.prefetched.release();
+                }
+                c.ready.open();
+              });
           }
           catch (elle::Error const& e)
           {
-            ELLE_TRACE("Prefetcher error fetching %x: %s", addr, e);
-            --this->_prefetchers_count;
-            this->_blocks[idx].ready.open();
-            return;
+            ELLE_TRACE("Prefetcher error: %s", e);
           }
-          ELLE_TRACE("Prefetcher inserting value at %s", idx);
-          auto crypted = bl->take_data();
-          std::shared_ptr<elle::Buffer> b;
-          if (key.empty())
-            b = std::make_shared<elle::Buffer>(std::move(crypted));
-          else
-            b = std::make_shared<elle::Buffer>(
-              elle::cryptography::SecretKey(key).decipher(crypted));
-          this->_blocks[idx].last_use = now();
-          this->_blocks[idx].block = b;
-          this->_blocks[idx].ready.open();
-          --this->_prefetchers_count;
-          this->_check_prefetch();
           this->check_cache(nullptr, this->max_cache_size);
-      }, true);
+        }, true);
+    }
+
+    void
+    FileBuffer::_dirty_block(CacheEntry& entry)
+    {
+      entry.dirty = true;
+      if (!entry.dirty_charge)
+      {
+        auto const size = this->_file._header.block_size;
+        this->_fs.dirty_charge(size);
+        entry.dirty_charge =
+          Reservation(this->_fs, size, &FileSystem::dirty_release);
+        entry.dirty_since = now();
+      }
+    }
+
+    bool
+    FileBuffer::_write_back(int index)
+    {
+      auto it = this->_blocks.find(index);
+      if (it == this->_blocks.end() ||
+          !it->second.dirty ||
+          !it->second.ready.opened())
+        return false;
+      ELLE_TRACE("%s: write back block %s", *this, index);
+      auto writers = std::move(it->second.writers);
+      it->second.writers.clear();
+      auto f = this->_flush_block(index, it->second, true);
+      it->second.dirty = false;
+      // Hold the block from the snapshot on, so later writes and flushes
+      // wait for this one.
+      it->second.ready.close();
+      this->_flushers.emplace_back(
+        new elle::reactor::Thread(
+          "write-back",
+          [this, f, index]
+          {
+            // Release the block even if we never got to write it.
+            elle::SafeFinally release([&] {
+                auto it = this->_blocks.find(index);
+                if (it != this->_blocks.end())
+                  it->second.ready.open();
+            });
+            elle::reactor::Lock slot(this->_fs.flush_slots());
+            f();
+          },
+          elle::reactor::managed = true),
+        std::move(writers));
+      return true;
     }
 
     void
     FileBuffer::_commit_first(FileHandle* src)
     {
+      if (this->_file.inlined())
+      {
+        // The entry was unlinked along with its data.
+        if (this->_remove_data)
+          return;
+        if (!this->_file.inline_fits(this->_fs))
+          this->_promote();
+      }
       _file.write(_fs, WriteTarget::data | WriteTarget::times,
                   DirectoryData::null_block, _first_block_new);
       _first_block_new = false;
     }
 
+    void
+    FileBuffer::_promote(bool link)
+    {
+      elle::reactor::Lock lock(this->_promotion);
+      if (!this->_file.inlined())
+        return;
+      ELLE_TRACE_SCOPE("%s: promote inlined file %s", this, this->_file.path());
+      auto const inlined = this->_file.address();
+      auto directory = this->_file.inlined_in();
+      this->_file.promote(this->_fs, *directory);
+      // Buffers are looked up by the address of their file.
+      auto& buffers = this->_fs.file_buffers();
+      auto it = buffers.find(inlined);
+      if (it != buffers.end())
+      {
+        auto buffer = it->second;
+        buffers.erase(it);
+        buffers.emplace(this->_file.address(), buffer);
+      }
+      this->_first_block_new = false;
+      if (link && !this->_remove_data)
+        directory->promoted(this->_fs, inlined, this->_file.address());
+    }
+
     void
     FileBuffer::_commit_all(FileHandle* src)
     {
@@ -654,19 +973,29 @@ namespace infinit
     Register<InsertBlockResolver> _register_insert_block_resolver("insert_block_resolver");
 
     std::function<void ()>
-    FileBuffer::_flush_block(int id, CacheEntry& entry)
+    FileBuffer::_flush_block(int id, CacheEntry& entry, bool locked)
     {
       if (entry.dirty)
-        return [this, id, data_ = elle::Buffer(*entry.block)] () mutable
+      {
+        auto data = this->_fs.block_buffer();
+        data.append(entry.block->contents(), entry.block->size());
+        // Stay charged to the write-back budget until written back.
+        auto charge =
+          std::make_shared<Reservation>(std::move(entry.dirty_charge));
+        return [this, id, data_ = std::move(data), charge, locked] () mutable
         {
-          auto ent = [this, id]() -> CacheEntry*
+          // Blocks are owned by the file, which needs a block of its own.
+          if (this->_file.inlined())
+            this->_promote();
+          auto ent = [this, id, locked]() -> CacheEntry*
             {
               auto it = this->_blocks.find(id);
               if (it != this->_blocks.end())
               {
                 auto res = &it->second;
                 // FIXME: is this safe?
-                elle::reactor::wait(res->ready);
+                if (!locked)
+                  elle::reactor::wait(res->ready);
                 return res;
               }
               else
@@ -679,24 +1008,60 @@ namespace infinit
               if (ent)
                 ent->ready.open();
           });
-          bool encrypt = dynamic_cast<model::doughnut::Doughnut const&>(*this->_fs.block_store())
-            .encrypt_options().encrypt_at_rest;
+          auto& dht = dynamic_cast<model::doughnut::Doughnut&>(
+            *this->_fs.block_store());
+          bool encrypt = dht.encrypt_options().encrypt_at_rest;
+          // Deduplicated blocks are enciphered with a key derived from their
+          // content, so that identical blocks end up identical.
+          auto const convergent = this->_fs.deduplicate()
+            ? boost::optional<elle::Buffer>(
+              model::doughnut::CCHB::key(data_))
+            : boost::none;
+          // Compress before enciphering, and after deriving the convergent
+          // key so that it does not depend on the compression level.
+          using model::doughnut::Compressor;
+          auto compression = Compressor::Algorithm::none;
+          if (dht.version() >= elle::Version(0, 10, 0))
+            if (auto compressed = Compressor::instance().compress(data_))
+            {
+              this->_fs.recycle_buffer(std::move(data_));
+              data_ = std::move(*compressed);
+              compression = Compressor::instance().algorithm();
+            }
           std::string key;
           elle::Buffer cdata;
           if (encrypt)
           {
-            key = elle::cryptography::random::generate<elle::Buffer>(32).string();
+            key = convergent
+              ? convergent->string()
+              : elle::cryptography::random::generate<elle::Buffer>(32).string();
             if (data_.size() >= 262144)
               elle::reactor::background([&] {
                 cdata = elle::cryptography::SecretKey(key).encipher(data_);
               });
             else
               cdata = elle::cryptography::SecretKey(key).encipher(data_);
+            this->_fs.recycle_buffer(std::move(data_));
           }
           else
-            cdata = elle::Buffer(data_.contents(), data_.size());
-          auto block = this->_fs.block_store()->make_block<ImmutableBlock>(
-            std::move(cdata), this->_file._address);
+            cdata = std::move(data_);
+          auto block = std::unique_ptr<ImmutableBlock>{};
+          if (convergent)
+          {
+            block = std::make_unique<model::doughnut::CCHB>(
+              &dht, std::move(cdata), *convergent, this->_file._address, id,
+              compression);
+            if (!shareable(dht, block->address(), key))
+            {
+              ELLE_WARN("%s: %f holds other content, storing a copy",
+                        this, block->address());
+              block = std::make_unique<model::doughnut::CHB>(
+                &dht, block->take_data(), this->_file._address, compression);
+            }
+          }
+          else
+            block = std::make_unique<model::doughnut::CHB>(
+              &dht, std::move(cdata), this->_file._address, compression);
           auto baddr = block->address();
           this->_fs.block_store()->insert(
             std::move(block),
@@ -706,12 +1071,15 @@ namespace infinit
             prev = _file._fat.at(id).first;
           this->_file._fat[id] = FileData::FatEntry(baddr, key);
           this->_fat_changed = true;
-          if (prev != Address::null)
-            unchecked_remove(*this->_fs.block_store(), prev);
+          // Rewriting the same content references the same block.
+          if (prev != Address::null && prev != baddr)
+            unchecked_remove_chb(
+              *this->_fs.block_store(), prev, this->_file._address, id);
           if (ent)
             ent->ready.open();
           interrupt_guard.abort();
         };
+      }
       else
         return {};
     }
@@ -800,16 +1168,28 @@ namespace infinit
       }
       else
       {
-        while (this->_blocks.size() > unsigned(cache_size))
+        // Blocks read ahead are accounted for by the read-ahead budget.
+        auto const limit = [&]
+          {
+            return cache_size + boost::count_if(
+              this->_blocks,
+              [] (auto const& b) { return bool(b.second.prefetched); });
+          };
+        while (signed(this->_blocks.size()) > limit())
         {
+          // Evict blocks that were read before those still ahead, ready
+          // blocks first and least recently used first.
           auto it = boost::min_element(this->_blocks,
             [](auto const& a, auto const& b)
             {
-              if (a.second.ready.opened() != b.second.ready.opened())
-                return a.second.ready.opened();
-              else
-                return (std::tie(a.second.last_use, a.first)
-                        < std::tie(b.second.last_use, b.first));
+              auto const key = [] (auto const& e)
+                {
+                  return std::make_tuple(bool(e.second.prefetched),
+                                         !e.second.ready.opened(),
+                                         e.second.last_use,
+                                         e.first);
+                };
+              return key(a) < key(b);
             });
           ELLE_TRACE("Removing block %s from cache", it->first);
           {
@@ -821,14 +1201,22 @@ namespace infinit
             auto entry = std::move(*it);
             auto writers = entry.second.writers;
             this->_blocks.erase(it);
-            if (auto f = this->_flush_block(entry.first, entry.second))
+            auto f = this->_flush_block(entry.first, entry.second);
+            if (entry.second.block && entry.second.block.use_count() == 1)
+              this->_fs.recycle_buffer(std::move(*entry.second.block));
+            if (f)
               if (cache_size == 0)
                 f();
               else
                 this->_flushers.emplace_back(
-                  new elle::reactor::Thread("flusher",
-                                      [f] { f(); },
-                                      elle::reactor::managed = true),
+                  new elle::reactor::Thread(
+                    "flusher",
+                    [this, f]
+                    {
+                      elle::reactor::Lock slot(this->_fs.flush_slots());
+                      f();
+                    },
+                    elle::reactor::managed = true),
                   writers);
           }
         }
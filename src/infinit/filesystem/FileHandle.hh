@@ -1,5 +1,7 @@
 #pragma once
 
+#include <elle/reactor/mutex.hh>
+
 #include <infinit/filesystem/umbrella.hh>
 #include <infinit/filesystem/File.hh>
 
@@ -9,6 +11,41 @@ namespace infinit
   {
     class FileBuffer;
 
+    /// Block access pattern of a handle, driving read-ahead.
+    ///
+    /// Like Linux readahead, the window opens when a handle reads
+    /// consecutive blocks, or blocks at a constant stride, and doubles as
+    /// long as the pattern holds, up to the maximum of the filesystem. Any
+    /// other access is deemed random and closes it until a pattern shows
+    /// up again.
+    struct ReadPattern
+    {
+      enum class Kind
+      {
+        random,
+        sequential,
+        strided,
+      };
+      /// Record an access to block `block`.
+      ///
+      /// @return Whether it is a different block than the previous access.
+      bool
+      access(int block, int max_window);
+      Kind
+      kind() const;
+      /// Last block accessed.
+      int last = -1;
+      /// Distance between the last two blocks accessed.
+      int stride = 0;
+      /// Consecutive accesses following the pattern.
+      int hits = 0;
+      /// Blocks to read ahead.
+      int window = 0;
+    };
+
+    std::ostream&
+    operator <<(std::ostream& out, ReadPattern::Kind kind);
+
     class FileHandle
       : public rfs::Handle
       , public elle::Printable
@@ -36,6 +73,8 @@ namespace infinit
       std::shared_ptr<FileBuffer> _buffer;
       FileSystem& _owner;
       bool _close_failure = false;
+      ReadPattern _pattern;
+      friend class FileBuffer;
     };
 
     class FileBuffer
@@ -57,6 +96,30 @@ namespace infinit
                          int start_block, int end_block);
       ELLE_ATTRIBUTE(bool, dirty);
 
+      /// Share of a filesystem budget held by a block, given back through
+      /// `release`: the read-ahead budget for a block fetched ahead until it
+      /// is read, the write-back budget for a dirty block until it is
+      /// written back.
+      class Reservation
+      {
+      public:
+        using Release = void (FileSystem::*)(int64_t);
+        Reservation() = default;
+        Reservation(FileSystem& fs, int64_t size, Release release);
+        Reservation(Reservation&& source);
+        Reservation&
+        operator =(Reservation&& source);
+        ~Reservation();
+        void
+        release();
+        explicit
+        operator bool() const;
+      private:
+        FileSystem* _fs = nullptr;
+        int64_t _size = 0;
+        Release _release = nullptr;
+      };
+
       struct CacheEntry
       {
         CacheEntry() = default;
@@ -65,14 +128,34 @@ namespace infinit
         std::chrono::high_resolution_clock::time_point last_use;
         elle::reactor::Barrier ready;
         std::unordered_set<FileHandle*> writers;
+        /// Set while the block was fetched ahead and not read yet.
+        Reservation prefetched;
+        /// Set from the first write until the block is being written back.
+        Reservation dirty_charge;
+        std::chrono::high_resolution_clock::time_point dirty_since;
       };
 
+      /// Mark `entry` dirty, charging it to the write-back budget.
+      void
+      _dirty_block(CacheEntry& entry);
+      /// Write block `index` back in the background if dirty.
+      bool
+      _write_back(int index);
+
       void _commit_first(FileHandle* src);
       void _commit_all(FileHandle* src);
+      /// Move the file, inlined in its directory, to a block of its own.
+      ///
+      /// @param link Whether to update the directory entry.
+      void _promote(bool link = true);
+      /// Snapshot dirty block `id` and return a function writing it back.
+      ///
+      /// @param locked Whether the caller already closed `entry.ready`.
       std::function<void ()>
-      _flush_block(int id, CacheEntry& entry);
-      void _prefetch(int idx);
-      void _check_prefetch();
+      _flush_block(int id, CacheEntry& entry, bool locked = false);
+      /// Fetch the blocks `pattern` predicts, within the budget.
+      void _read_ahead(ReadPattern const& pattern);
+      void _prefetch(std::vector<int> indexes);
       // check cached data size, remove entries if needed
       bool check_cache(FileHandle* src, int cache_size = -1);
       /* Get address for given block index.
@@ -89,11 +172,14 @@ namespace infinit
       bool _first_block_new = false;
       bool _fat_changed = false;
       int _prefetchers_count = 0; // number of running prefetchers
-      int _last_read_block = 0; // block hit by last read operation
       bool _remove_data = false; // there are no more links, remove data.
-      static const unsigned long max_cache_size = 20; // in blocks
+      elle::reactor::Mutex _promotion;
+      // in blocks, besides those fetched ahead and not read yet
+      static const unsigned long max_cache_size = 20;
+      friend class DirectoryData;
       friend class File;
       friend class FileHandle;
+      friend class FileSystem;
     };
   }
 }
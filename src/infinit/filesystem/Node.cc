@@ -182,6 +182,7 @@ namespace infinit
           THROW_NOTDIR();
       }
       dir->_fetch();
+      dir->_data->load_shard(this->_owner, newname);
       if (dir->_data->_files.find(newname) != dir->_data->_files.end())
       {
         ELLE_TRACE_SCOPE("%s: remove existing destination", *this);
@@ -205,13 +206,25 @@ namespace infinit
         ELLE_DEBUG("removed move target %s", where);
       }
       auto data = this->_parent->_files.at(this->_name);
+      // Inlined files move along with their content.
+      auto inlined = boost::optional<InlineFile>{};
+      {
+        auto it = this->_parent->_inlined.find(this->_name);
+        if (it != this->_parent->_inlined.end())
+          inlined = it->second;
+      }
 
       dir->_data->_files.insert(std::make_pair(newname, data));
+      if (inlined)
+        dir->_data->_inlined[newname] = *inlined;
+      else
+        dir->_data->_inlined.erase(newname);
       dir->_data->write(
         this->_owner,
-        {OperationType::insert, newname, data.first, data.second});
+        {OperationType::insert, newname, data.first, data.second, inlined});
 
       this->_parent->_files.erase(_name);
+      this->_parent->_inlined.erase(_name);
       this->_parent->write(this->_owner,
                             {OperationType::remove, this->_name});
 
@@ -907,6 +920,19 @@ namespace infinit
         std::make_unique<ACLConflictResolver>(
           this->_owner.block_store().get(), perms.first, perms.second, userkey
         ));
+      if (auto dir = dynamic_cast<Directory*>(this))
+        if (!dir->data()->shards().empty())
+          umbrella(
+            [&]
+            {
+              dir->data()->update_shards_permissions(
+                this->_owner,
+                [&] (ACLBlock& shard)
+                {
+                  shard.set_permissions(*user, perms.first, perms.second);
+                });
+            },
+            EACCES);
     }
 
     bfs::path
@@ -1,6 +1,7 @@
 #include <infinit/filesystem/Unknown.hh>
 
 #include <elle/cast.hh>
+#include <elle/cryptography/random.hh>
 
 #include <infinit/filesystem/FileHandle.hh>
 #include <infinit/filesystem/File.hh>
@@ -117,6 +118,9 @@ namespace infinit
       std::unique_ptr<rfs::Handle> handle;
       auto parent_block = this->_owner.block_store()->fetch(_parent->address());
       _owner.ensure_permissions(*parent_block, true, true);
+      if (this->_parent->can_inline(
+            this->_owner, dynamic_cast<ACLBlock&>(*parent_block)))
+        return this->_create_inline(flags, mode);
       auto b = _owner.block_store()->make_block<infinit::model::blocks::ACLBlock>();
       // Add pending entry to parent so we can't leak b
       _parent->_files.insert(
@@ -194,6 +198,36 @@ namespace infinit
       return handle;
     }
 
+    std::unique_ptr<rfs::Handle>
+    Unknown::_create_inline(int flags, mode_t mode)
+    {
+      ELLE_TRACE_SCOPE("%s: create inlined in %s", *this, *this->_parent);
+      // Inlined files have no block, their entry only needs a unique
+      // address to identify them.
+      auto const address = Address(
+        elle::cryptography::random::generate<elle::Buffer>(32).contents(),
+        model::flags::mutable_block, false);
+      auto header = FileData(
+        _parent->_path / _name, address, mode & 0700,
+        _owner.block_size().value_or(File::default_block_size)).header();
+      auto file = InlineFile(header, {});
+      FileData fd(_parent->_path / _name, address, file, this->_parent);
+      _parent->_files.insert(
+        std::make_pair(_name, std::make_pair(EntryType::file, address)));
+      _parent->_inlined[_name] = file;
+      elle::SafeFinally reset_cache([&] {
+          _parent->_files.erase(_name);
+          _parent->_inlined.erase(_name);
+      });
+      _parent->write(_owner,
+                     Operation{
+                       (flags & O_EXCL) ? OperationType::insert_exclusive : OperationType::insert,
+                       _name, EntryType::file, address, std::move(file)},
+                     DirectoryData::null_block,
+                     true);
+      reset_cache.abort();
+      return std::make_unique<FileHandle>(_owner, fd, true);
+    }
 
     std::unique_ptr<rfs::Handle>
     Unknown::create(int flags, mode_t mode)
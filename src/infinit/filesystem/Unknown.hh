@@ -46,6 +46,8 @@ namespace infinit
       print(std::ostream& stream) const override;
       std::unique_ptr<rfs::Handle> create_0_7(int flags, mode_t mode);
     private:
+      /// Create a file inlined in the entry of its directory.
+      std::unique_ptr<rfs::Handle> _create_inline(int flags, mode_t mode);
     };
   }
 }
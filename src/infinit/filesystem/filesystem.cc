@@ -38,11 +38,13 @@
 #include <infinit/model/doughnut/NB.hh>
 #include <infinit/model/doughnut/ACB.hh>
 #include <infinit/model/doughnut/CHB.hh>
+#include <infinit/model/doughnut/CCHB.hh>
 #include <infinit/model/doughnut/Cache.hh>
 #include <infinit/serialization.hh>
 
 #include <infinit/filesystem/Node.hh>
 #include <infinit/filesystem/File.hh>
+#include <infinit/filesystem/FileHandle.hh>
 #include <infinit/filesystem/Symlink.hh>
 #include <infinit/filesystem/Unknown.hh>
 
@@ -114,6 +116,22 @@ namespace infinit
       , _map_other_permissions(map_other_permissions)
       , _prefetching(0)
       , _block_size(block_size)
+      , _directory_shard_size(
+        elle::os::getenv("INFINIT_DIRECTORY_SHARD_SIZE", 4096))
+      , _deduplicate(elle::os::getenv("INFINIT_DEDUPLICATE", false))
+      , _inline_size(elle::os::getenv("INFINIT_INLINE_FILE_SIZE", 0))
+      , _readahead_blocks(elle::os::getenv("INFINIT_READAHEAD_BLOCKS", 32))
+      , _readahead_memory(
+        elle::os::getenv("INFINIT_READAHEAD_MEMORY", 128 * 1024 * 1024))
+      , _readahead_used(0)
+      , _dirty_used(0)
+      , _dirty_limit(
+        elle::os::getenv("INFINIT_DIRTY_LIMIT", 256 * 1024 * 1024))
+      , _dirty_background(
+        elle::os::getenv("INFINIT_DIRTY_BACKGROUND", 64 * 1024 * 1024))
+      , _dirty_expire(
+        boost::posix_time::seconds(elle::os::getenv("INFINIT_DIRTY_EXPIRE", 30)))
+      , _flush_slots(std::max(elle::os::getenv("INFINIT_FLUSH_THREADS", 16), 1))
       , _file_buffers()
     {
       auto& dht = dynamic_cast<model::doughnut::Doughnut&>(
@@ -123,6 +141,122 @@ namespace infinit
       this->_network_name = passport.network();
     }
 
+    bool
+    FileSystem::readahead_reserve(int64_t size)
+    {
+      if (this->_readahead_used + size > this->_readahead_memory)
+        return false;
+      this->_readahead_used += size;
+      return true;
+    }
+
+    void
+    FileSystem::readahead_release(int64_t size)
+    {
+      ELLE_ASSERT_GTE(this->_readahead_used, size);
+      this->_readahead_used -= size;
+    }
+
+    void
+    FileSystem::dirty_charge(int64_t size)
+    {
+      this->_dirty_used += size;
+      if (this->_dirty_used > this->_dirty_background)
+        this->_dirty_pressure.open();
+      if (!this->_flusher)
+        this->_flusher.reset(
+          new elle::reactor::Thread(elle::sprintf("%s write-back", this),
+                                    [this] { this->_write_back(); }));
+    }
+
+    void
+    FileSystem::dirty_release(int64_t size)
+    {
+      ELLE_ASSERT_GTE(this->_dirty_used, size);
+      this->_dirty_used -= size;
+      if (this->_dirty_used <= this->_dirty_background)
+        this->_dirty_pressure.close();
+      this->_dirty_released.signal();
+    }
+
+    void
+    FileSystem::dirty_throttle()
+    {
+      if (!this->_dirty_limit || this->_dirty_used < this->_dirty_limit)
+        return;
+      ELLE_TRACE_SCOPE("%s: throttle writer with %s dirty bytes",
+                       this, this->_dirty_used);
+      this->_dirty_pressure.open();
+      while (this->_dirty_used >= this->_dirty_limit)
+        elle::reactor::wait(this->_dirty_released);
+    }
+
+    elle::Buffer
+    FileSystem::block_buffer()
+    {
+      if (this->_spare_buffers.empty())
+        return {};
+      auto res = std::move(this->_spare_buffers.back());
+      this->_spare_buffers.pop_back();
+      return res;
+    }
+
+    void
+    FileSystem::recycle_buffer(elle::Buffer buffer)
+    {
+      if (signed(this->_spare_buffers.size()) >= max_spare_buffers ||
+          buffer.capacity() < File::default_block_size / 2)
+        return;
+      buffer.size(0);
+      this->_spare_buffers.emplace_back(std::move(buffer));
+    }
+
+    void
+    FileSystem::_write_back()
+    {
+      auto const expire = std::chrono::milliseconds(
+        this->_dirty_expire.total_milliseconds());
+      auto const period = this->_dirty_expire / 2;
+      while (true)
+      {
+        elle::reactor::wait(this->_dirty_pressure, period);
+        auto const cutoff = now() - expire;
+        // Dirty blocks not being written back yet, oldest first.
+        using Dirty = std::tuple<clock::time_point,
+                                 std::shared_ptr<FileBuffer>,
+                                 int>;
+        auto dirty = std::vector<Dirty>{};
+        auto pending = int64_t(0);
+        for (auto const& b: this->_file_buffers)
+          if (auto buffer = b.second.lock())
+            for (auto const& e: buffer->_blocks)
+              if (e.second.dirty && e.second.dirty_charge)
+              {
+                dirty.emplace_back(e.second.dirty_since, buffer, e.first);
+                pending += buffer->_file._header.block_size;
+              }
+        std::sort(dirty.begin(), dirty.end(),
+                  [] (Dirty const& a, Dirty const& b)
+                  {
+                    return std::get<0>(a) < std::get<0>(b);
+                  });
+        auto written = 0;
+        for (auto const& d: dirty)
+        {
+          if (std::get<0>(d) > cutoff && pending <= this->_dirty_background)
+            break;
+          pending -= std::get<1>(d)->_file._header.block_size;
+          if (std::get<1>(d)->_write_back(std::get<2>(d)))
+            ++written;
+        }
+        ELLE_DEBUG("%s: wrote back %s of %s dirty blocks",
+                   this, written, dirty.size());
+        // Let write-backs complete before looking for more.
+        if (this->_dirty_pressure.opened())
+          elle::reactor::wait(this->_dirty_released, period);
+      }
+    }
+
     void
     FileSystem::filesystem(elle::reactor::filesystem::FileSystem* fs)
     {
@@ -139,6 +273,7 @@ namespace infinit
     FileSystem::~FileSystem()
     {
       ELLE_DEBUG("%s: destroy", this);
+      this->_flusher.reset();
       while (!this->_running.empty())
       {
         auto t = std::move(this->_running.back());
@@ -175,11 +310,18 @@ namespace infinit
     void
     unchecked_remove_chb(model::Model& model,
                          model::Address chb,
-                         model::Address owner)
+                         model::Address owner,
+                         int index)
     {
       try
       {
-        model.remove(chb, model::doughnut::CHB::sign_remove(model, chb, owner));
+        // Convergent blocks are shared: only release this reference.
+        if (model::doughnut::CCHB::convergent(chb))
+          model.remove(
+            chb, model::doughnut::CCHB::sign_remove(model, chb, owner, index));
+        else
+          model.remove(
+            chb, model::doughnut::CHB::sign_remove(model, chb, owner));
       }
       catch (model::MissingBlock const&)
       {
@@ -657,6 +799,7 @@ namespace infinit
           return xroot;
         }
         ELLE_DEBUG_SCOPE("get sub-component %s", name);
+        d->load_shard(*this, name);
         auto const& files = d->files();
         auto it = files.find(name);
         if (it == files.end() || it->second.first != EntryType::directory)
@@ -692,6 +835,7 @@ namespace infinit
         return std::make_shared<XAttributeDirectory>(target);
       }
 
+      d->load_shard(*this, name);
       auto const& files = d->files();
       auto it = files.find(name);
       if (it == files.end())
@@ -706,6 +850,10 @@ namespace infinit
         return std::shared_ptr<rfs::Path>(new Symlink(*this, address, d, name));
       case EntryType::file:
         {
+          // Inlined files are served from their directory.
+          if (d->inlined().count(name))
+            return std::shared_ptr<rfs::Path>(
+              new File(*this, address, {}, d, name));
           static auto bench =
             elle::Bench("bench.filesystem.filecache.hit", std::chrono::seconds(1000));
           ELLE_DEBUG("fetching %f from file cache", address);
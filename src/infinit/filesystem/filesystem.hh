@@ -11,7 +11,11 @@
 
 #include <elle/cryptography/rsa/KeyPair.hh>
 
+#include <elle/reactor/Barrier.hh>
+#include <elle/reactor/duration.hh>
 #include <elle/reactor/filesystem.hh>
+#include <elle/reactor/semaphore.hh>
+#include <elle/reactor/signal.hh>
 #include <elle/reactor/Thread.hh>
 
 #include <infinit/filesystem/FileHeader.hh>
@@ -51,18 +55,51 @@ namespace infinit
     std::ostream&
     operator <<(std::ostream& out, OperationType operation);
 
+    /// Header and content of a file small enough to be stored in the entry
+    /// of its directory instead of a block of its own.
+    struct InlineFile
+    {
+      InlineFile() = default;
+      InlineFile(FileHeader header, elle::Buffer data);
+      InlineFile(elle::serialization::SerializerIn& s,
+                 elle::Version const& v);
+      void
+      serialize(elle::serialization::Serializer& s, elle::Version const& v);
+      using serialization_tag = infinit::serialization_tag;
+      FileHeader header;
+      elle::Buffer data;
+    };
+
     struct Operation
     {
       OperationType type;
       std::string target;
       EntryType entry_type;
       Address address;
+      /// Content of the entry, for files inlined in their directory.
+      boost::optional<InlineFile> inlined = boost::none;
     };
 
     class DirectoryData
     {
     public:
       using clock = std::chrono::high_resolution_clock;
+      /// A hash-partitioned child block holding part of the entries of a
+      /// large directory.
+      struct Shard
+      {
+        Shard(Address address);
+        Shard(elle::serialization::SerializerIn& s, elle::Version const& v);
+        void
+        serialize(elle::serialization::Serializer& s, elle::Version const& v);
+        using serialization_tag = infinit::serialization_tag;
+        Address address;
+        /// Version of the shard block we last loaded, -1 if never loaded.
+        int version;
+        /// Entries loaded from this shard.
+        std::vector<std::string> names;
+      };
+      using Shards = std::vector<Shard>;
       static std::unique_ptr<model::blocks::ACLBlock> null_block;
       DirectoryData(bfs::path path,
                     Block& block, std::pair<bool, bool> perms);
@@ -88,6 +125,82 @@ namespace infinit
       ELLE_ATTRIBUTE_R(FileHeader, header);
       ELLE_ATTRIBUTE_R(Files, files);
       ELLE_ATTRIBUTE_R(bool, inherit_auth);
+
+    /*--------------.
+    | Inlined files |
+    `--------------*/
+    public:
+      /// Content of the entries of `files` that are inlined, by name. Their
+      /// address is a placeholder no block lives at, until they are moved
+      /// to a block of their own.
+      using Inlined = elle::unordered_map<std::string, InlineFile>;
+      ELLE_ATTRIBUTE_R(Inlined, inlined);
+      /// Whether a new file can be inlined, given the block of the
+      /// directory.
+      ///
+      /// Inlined files are readable and writable by whoever can read and
+      /// write the directory: only inline them where they would get the
+      /// same permissions anyway, that is when they inherit them or when
+      /// the directory is private to us.
+      bool
+      can_inline(FileSystem& fs, ACLBlock& block) const;
+      /// Point the entry of inlined file `inlined` to its own block at
+      /// `address`.
+      void
+      promoted(FileSystem& fs, Address inlined, Address address);
+      /// Move all inlined files to blocks of their own, before the
+      /// permissions of the directory change.
+      void
+      promote_inlined(FileSystem& fs);
+    private:
+      /// Move all inlined files to blocks of their own.
+      ///
+      /// @param link Whether to update the entries of the directory one by
+      ///             one, instead of leaving it to the caller.
+      void
+      _promote_inlined(FileSystem& fs, bool link);
+
+    /*-------.
+    | Shards |
+    `-------*/
+    public:
+      /// Index of the shard holding @a name.
+      int
+      shard_of(std::string const& name) const;
+      /// Refresh the shard holding @a name, if the directory is sharded.
+      void
+      load_shard(FileSystem& fs, std::string const& name);
+      /// Refresh every shard, if the directory is sharded.
+      void
+      load_shards(FileSystem& fs);
+      /// Apply a permission change of the directory to its shards.
+      void
+      update_shards_permissions(FileSystem& fs,
+                                std::function<void (ACLBlock&)> const& edit);
+      /// Remove the shard blocks, once the directory is empty.
+      void
+      remove_shards(FileSystem& fs);
+    private:
+      void
+      _load_shards(FileSystem& fs, std::vector<int> const& indexes);
+      void
+      _loaded_shard(int index, Block& block);
+      void
+      _write_shard(FileSystem& fs, Operation const& op);
+      void
+      _split_shard(FileSystem& fs);
+      /// Move the entries of a single-block directory to shards.
+      bool
+      _shard(FileSystem& fs);
+      bool
+      _store_root(FileSystem& fs, ACLBlock& root);
+      /// Child blocks holding the entries, empty for single-block
+      /// directories.
+      ELLE_ATTRIBUTE_R(Shards, shards);
+      /// Entries found in the root block of a sharded directory, pending
+      /// their move to their shard.
+      ELLE_ATTRIBUTE(std::vector<std::string>, unsharded);
+    public:
       ELLE_ATTRIBUTE_R(bool, prefetching);
       ELLE_ATTRIBUTE_R(clock::time_point, last_prefetch);
       ELLE_ATTRIBUTE_R(clock::time_point, last_used);
@@ -98,6 +211,7 @@ namespace infinit
       friend class Node;
       friend class FileSystem;
       friend class Symlink;
+      friend class FileData;
       friend std::unique_ptr<Block>
       resolve_directory_conflict(Block& b,
                                  Block& current,
@@ -172,16 +286,43 @@ namespace infinit
       friend class FileHandle;
       friend class FileBuffer;
       friend class FileConflictResolver;
+
+    /*-------------.
+    | Inlined file |
+    `-------------*/
+    public:
+      /// A file inlined in `directory`.
+      FileData(bfs::path path,
+               model::Address address,
+               InlineFile const& file,
+               std::shared_ptr<DirectoryData> directory);
+      /// Directory whose entry holds the file, if inlined.
+      ELLE_ATTRIBUTE_R(std::shared_ptr<DirectoryData>, inlined_in);
+      bool
+      inlined() const;
+      /// Whether the file is small enough to stay inlined.
+      bool
+      inline_fits(FileSystem& fs) const;
+      /// Move the content of the file, inlined in `directory`, to a block of
+      /// its own. The entry of the directory is left to the caller.
+      void
+      promote(FileSystem& fs, DirectoryData& directory);
+    private:
+      void
+      _write_inline(FileSystem& fs);
     };
 
     class Node;
     void
     unchecked_remove(model::Model& model,
                      model::Address address);
+    /// Remove the block at position `index` of file `owner`, or only
+    /// release this position's reference to it if it is shared.
     void
     unchecked_remove_chb(model::Model& model,
                          model::Address chb,
-                         model::Address owner);
+                         model::Address owner,
+                         int index);
     std::unique_ptr<model::blocks::Block>
     fetch_or_die(model::Model& model,
                  model::Address address,
@@ -324,9 +465,67 @@ namespace infinit
       ELLE_ATTRIBUTE_RX(std::vector<elle::reactor::Thread::unique_ptr>, running);
       ELLE_ATTRIBUTE_RX(int, prefetching);
       ELLE_ATTRIBUTE_RW(boost::optional<int>, block_size);
+      /// Maximum number of entries of a directory block or shard before it
+      /// gets split.
+      ELLE_ATTRIBUTE_RW(int, directory_shard_size);
+      /// Whether file blocks are stored convergently, so that files sharing
+      /// content share blocks.
+      ELLE_ATTRIBUTE_RW(bool, deduplicate);
+      /// Size up to which new files are stored in the entry of their
+      /// directory, 0 to disable.
+      ELLE_ATTRIBUTE_RW(int, inline_size);
+      /// Maximum number of blocks a file handle reads ahead.
+      ELLE_ATTRIBUTE_RW(int, readahead_blocks);
+      /// Maximum bytes of blocks read ahead and not read yet, shared by all
+      /// open files.
+      ELLE_ATTRIBUTE_RW(int64_t, readahead_memory);
+      ELLE_ATTRIBUTE_R(int64_t, readahead_used);
+      /// Take `size` bytes from the read-ahead budget, if available.
+      bool
+      readahead_reserve(int64_t size);
+      void
+      readahead_release(int64_t size);
       using FileBuffers = std::unordered_map<Address, std::weak_ptr<FileBuffer>>;
       ELLE_ATTRIBUTE_RX(FileBuffers, file_buffers);
       static const int max_cache_size = 10000;
+
+    /*-----------.
+    | Write-back |
+    `-----------*/
+    public:
+      /// Bytes of dirty blocks of all open files, until written back.
+      ELLE_ATTRIBUTE_R(int64_t, dirty_used);
+      /// Writers wait once dirty blocks reach that many bytes.
+      ELLE_ATTRIBUTE_RW(int64_t, dirty_limit);
+      /// Dirty blocks are written back in the background, oldest first,
+      /// beyond that many bytes ...
+      ELLE_ATTRIBUTE_RW(int64_t, dirty_background);
+      /// ... or once dirty for that long.
+      ELLE_ATTRIBUTE_RW(elle::reactor::Duration, dirty_expire);
+      /// Bound on blocks being written back concurrently.
+      ELLE_ATTRIBUTE_RX(elle::reactor::Semaphore, flush_slots);
+    public:
+      void
+      dirty_charge(int64_t size);
+      void
+      dirty_release(int64_t size);
+      /// Wait until dirty blocks are below the limit.
+      void
+      dirty_throttle();
+      /// An empty block buffer, reusing the memory of a recycled one.
+      elle::Buffer
+      block_buffer();
+      void
+      recycle_buffer(elle::Buffer buffer);
+    private:
+      void
+      _write_back();
+      ELLE_ATTRIBUTE(std::vector<elle::Buffer>, spare_buffers);
+      static const int max_spare_buffers = 16;
+      ELLE_ATTRIBUTE(elle::reactor::Signal, dirty_released);
+      /// Open while dirty blocks are beyond the background threshold.
+      ELLE_ATTRIBUTE(elle::reactor::Barrier, dirty_pressure);
+      ELLE_ATTRIBUTE(elle::reactor::Thread::unique_ptr, flusher);
       friend class FileData;
       friend class DirectoryData;
     };
@@ -19,6 +19,8 @@ namespace infinit
     {
       static const uint8_t mutable_block = 0;
       static const uint8_t immutable_block = 1;
+      /// Immutable blocks shared by the files referencing them.
+      static const uint8_t convergent_block = 3;
     }
 
     class Address
@@ -35,7 +35,10 @@ namespace infinit
     enum StoreMode
     {
       STORE_INSERT,
-      STORE_UPDATE
+      STORE_UPDATE,
+      /// Copy a block from one storage node to another, along with the
+      /// state they maintain about it.
+      STORE_REPLICATE
     };
 
     enum class Squash
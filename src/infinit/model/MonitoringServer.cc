@@ -9,6 +9,8 @@
 #include <elle/reactor/network/Error.hh>
 #include <elle/reactor/Scope.hh>
 
+#include <infinit/model/doughnut/Compressor.hh>
+#include <infinit/model/doughnut/CryptoPool.hh>
 #include <infinit/model/doughnut/Doughnut.hh>
 
 ELLE_LOG_COMPONENT("infinit.model.MonitoringServer");
@@ -211,7 +213,9 @@ namespace infinit
               case Query::Stats:
               {
                 auto res = elle::json::Object{
+                  {"compression", doughnut::Compressor::instance().stats()},
                   {"consensus", this->_owner.consensus()->stats()},
+                  {"crypto", doughnut::CryptoPool::instance().stats()},
                   {"overlay", this->_owner.overlay()->stats()},
                   {"peers", this->_owner.overlay()->peer_list()},
                   {"protocol", elle::sprintf("%s", this->_owner.protocol())},
@@ -26,6 +26,7 @@
 #include <infinit/model/MissingBlock.hh>
 #include <infinit/model/blocks/ImmutableBlock.hh>
 #include <infinit/model/blocks/GroupBlock.hh>
+#include <infinit/model/doughnut/CryptoPool.hh>
 #include <infinit/model/doughnut/Doughnut.hh>
 #include <infinit/model/doughnut/Group.hh>
 #include <infinit/model/doughnut/ValidationFailed.hh>
@@ -159,6 +160,7 @@ namespace infinit
         , _world_writable(false)
         , _deleted(false)
         , _seal_version(owner->version())
+        , _compression(Compressor::Algorithm::none)
       {}
 
       template <typename Block>
@@ -177,6 +179,7 @@ namespace infinit
         , _deleted(other._deleted)
         , _sign_key(other._sign_key)
         , _seal_version(other._seal_version)
+        , _compression(other._compression)
       {}
 
       /*--------.
@@ -191,47 +194,54 @@ namespace infinit
       }
 
       static
-      void
-      background_open(elle::Buffer & target,
-                      elle::Buffer const& src,
-                      elle::cryptography::rsa::PrivateKey const& k,
-                      bool use_encrypt)
+      elle::Buffer
+      token_open(elle::Buffer const& token,
+                 elle::cryptography::rsa::PrivateKey const& k,
+                 bool use_encrypt)
       {
-        static bool bg = !elle::os::getenv("INFINIT_NO_BACKGROUND_DECODE", false);
-        if (bg)
-        {
-          elle::With<elle::reactor::Thread::NonInterruptible>() << [&]
-          {
-            elle::reactor::background([&] {
-                target = use_encrypt ? k.decrypt(src, acb_padding) : k.open(src);
-              });
-          };
-        }
-        else
-          target = use_encrypt ? k.decrypt(src, acb_padding) : k.open(src);
+        return CryptoPool::instance().run(
+          CryptoPool::Operation::decrypt,
+          [&] {
+            return use_encrypt ? k.decrypt(token, acb_padding) : k.open(token);
+          });
+      }
+
+      static
+      elle::Buffer
+      token_seal(elle::Buffer const& secret,
+                 elle::cryptography::rsa::PublicKey const& k,
+                 bool use_encrypt)
+      {
+        return CryptoPool::instance().run(
+          CryptoPool::Operation::encrypt,
+          [&] {
+            return use_encrypt ? k.encrypt(secret, acb_padding) : k.seal(secret);
+          });
       }
 
       template <typename Block>
       elle::Buffer
       BaseACB<Block>::_decrypt_data(elle::Buffer const& data) const
       {
+        auto& compressor = Compressor::instance();
         if (this->world_readable())
-          return this->_data;
+          return compressor.decompress(this->_data, this->_compression);
         bool use_encrypt = this->_seal_version >= elle::Version(0, 7, 0);
         elle::Buffer secret_buffer;
         if (this->owner_private_key())
         {
           ELLE_DEBUG("%s: we are owner", *this);
-          background_open(secret_buffer, this->_owner_token,
-                          *this->owner_private_key(), use_encrypt);
+          secret_buffer = token_open(this->_owner_token,
+                                     *this->owner_private_key(), use_encrypt);
         }
         else if (!this->_acl_entries.empty())
         {
           // FIXME: factor searching the token
           for (auto const& e: this->_acl_entries)
             if (e.key == this->doughnut()->keys().K())
-              background_open(secret_buffer, e.token,
-                              this->doughnut()->keys().k(), use_encrypt);
+              secret_buffer = token_open(e.token,
+                                         this->doughnut()->keys().k(),
+                                         use_encrypt);
         }
         if (secret_buffer.empty())
         {
@@ -250,7 +260,7 @@ namespace infinit
                 ++idx;
                 continue;
               }
-              background_open(secret_buffer, e.token, keys[v].k(), use_encrypt);
+              secret_buffer = token_open(e.token, keys[v].k(), use_encrypt);
             }
             catch (elle::Error const& e)
             {
@@ -272,7 +282,11 @@ namespace infinit
                <elle::cryptography::SecretKey>(secret_buffer);
         }();
         ELLE_DUMP("%s: secret: %s", *this, secret);
-        return secret.decipher(this->_data);
+        return compressor.decompress(
+          CryptoPool::instance().run(
+            CryptoPool::Operation::decipher, this->_data.size(),
+            [&] { return secret.decipher(this->_data); }),
+          this->_compression);
       }
 
       /*------------.
@@ -350,12 +364,9 @@ namespace infinit
             auto&& g = Group(*this->doughnut(), key);
             if (this->_owner_token.size())
             {
-              auto secret = use_encrypt?
-                this->owner_private_key()->decrypt(this->_owner_token, acb_padding)
-                : this->owner_private_key()->open(this->_owner_token);
-              token = use_encrypt ?
-                g.current_public_key().encrypt(secret, acb_padding)
-                : g.current_public_key().seal(secret);
+              auto secret = token_open(
+                this->_owner_token, *this->owner_private_key(), use_encrypt);
+              token = token_seal(secret, g.current_public_key(), use_encrypt);
             }
             acl_entries.emplace_back(ACLEntry(key, read, write, token));
             this->_group_version.push_back(g.version()-1);
@@ -425,9 +436,8 @@ namespace infinit
             auto okey = this->owner_private_key();
             if (!okey)
               elle::err("Owner key unavailable");
-            auto secret = use_encrypt ? okey->decrypt(this->_owner_token, acb_padding)
-                                      : okey->open(this->_owner_token);
-            token = use_encrypt ? key.encrypt(secret, acb_padding) : key.seal(secret);
+            auto secret = token_open(this->_owner_token, *okey, use_encrypt);
+            token = token_seal(secret, key, use_encrypt);
           }
           acl_entries.emplace_back(ACLEntry(key, read, write, token));
           this->_acl_changed = true;
@@ -660,7 +670,11 @@ namespace infinit
                   return blocks::ValidationResult::failure("group key out of range");
                 auto& key = pubkeys[key_index];
                 ELLE_DEBUG("validating with group key %s: %s", key_index, key);
-                if (!key.verify(this->data_signature(), *this->_data_sign()))
+                auto const& signature = this->data_signature();
+                auto sign = this->_data_sign();
+                if (!CryptoPool::instance().verify([&] {
+                      return key.verify(signature, *sign);
+                    }))
                 {
                   ELLE_DEBUG("%s: group author signature invalid", *this);
                   return blocks::ValidationResult::failure("Invalid group key signature");
@@ -675,7 +689,11 @@ namespace infinit
             else
             {
               auto& key = entry ? entry->key : *this->owner_key();
-              if (!key.verify(this->data_signature(), *this->_data_sign()))
+              auto const& signature = this->data_signature();
+              auto sign = this->_data_sign();
+              if (!CryptoPool::instance().verify([&] {
+                    return key.verify(signature, *sign);
+                  }))
               {
                 ELLE_DEBUG("%s: author signature invalid", *this);
                 return blocks::ValidationResult::failure
@@ -852,14 +870,13 @@ namespace infinit
             secret_buffer = key.get().password().string();
           this->_seal_version = seal_version;
           bool use_encrypt = seal_version >= elle::Version(0, 7, 0);
-          this->_owner_token = use_encrypt ?
-            this->owner_key()->encrypt(secret_buffer, acb_padding)
-            : this->owner_key()->seal(secret_buffer);
+          this->_owner_token =
+            token_seal(secret_buffer, *this->owner_key(), use_encrypt);
           int idx = 0;
           for (auto& e: this->_acl_entries)
           {
             if (e.read)
-              e.token = use_encrypt ? e.key.encrypt(secret_buffer, acb_padding) : e.key.seal(secret_buffer);
+              e.token = token_seal(secret_buffer, e.key, use_encrypt);
             if (!sign_key && e.key == this->doughnut()->keys().K())
             {
               ELLE_DEBUG("we are editor %s", idx);
@@ -875,9 +892,8 @@ namespace infinit
               Group g(*this->doughnut(), e.key);
               if (e.read)
               {
-                e.token = use_encrypt ?
-                 g.current_public_key().encrypt(secret_buffer, acb_padding)
-                 : g.current_public_key().seal(secret_buffer);
+                e.token =
+                  token_seal(secret_buffer, g.current_public_key(), use_encrypt);
                 this->_group_version[idx - this->_acl_entries.size()] =
                   g.version() - 1;
               }
@@ -907,11 +923,22 @@ namespace infinit
             ELLE_DEBUG("block is world writable");
             sign_key = this->doughnut()->keys().private_key();
           }
+          auto compressed = boost::optional<elle::Buffer>{};
+          if (seal_version >= elle::Version(0, 10, 0))
+            compressed = Compressor::instance().compress(this->data_plain());
+          this->_compression = compressed
+            ? Compressor::instance().algorithm()
+            : Compressor::Algorithm::none;
+          auto const& plain = compressed ? *compressed : this->data_plain();
           if (!this->_world_readable)
+          {
             this->blocks::MutableBlock::data(
-              key->encipher(this->data_plain()));
+              CryptoPool::instance().run(
+                CryptoPool::Operation::encipher, plain.size(),
+                [&] { return key->encipher(plain); }));
+          }
           else
-            this->blocks::MutableBlock::data(this->data_plain());
+            this->blocks::MutableBlock::data(plain);
           this->_data_changed = false;
         }
         else
@@ -1142,6 +1169,12 @@ namespace infinit
           s.serialize("group_version", this->_block.group_version());
           s.serialize("deleted", this->_block.deleted());
         }
+        // Only blocks sealed since compression exists may be compressed.
+        if (this->_block.seal_version() >= elle::Version(0, 10, 0))
+        {
+          auto compression = this->_block.compression();
+          Compressor::serialize(s, "compression", compression);
+        }
       }
 
       /*--------.
@@ -1186,6 +1219,7 @@ namespace infinit
         , _world_readable(false)
         , _world_writable(false)
         , _deleted(false)
+        , _compression(Compressor::Algorithm::none)
       {
         this->_serialize(input, version);
       }
@@ -1288,6 +1322,8 @@ namespace infinit
         else if (s.out() && this->_seal_version > version)
           ELLE_WARN("%s: seal version %s is above current version %s",
                     this, this->_seal_version, version);
+        if (version >= elle::Version(0, 10, 0))
+          Compressor::serialize(s, "compression", this->_compression);
       }
 
       template
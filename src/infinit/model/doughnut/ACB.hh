@@ -8,6 +8,7 @@
 
 #include <infinit/model/User.hh>
 #include <infinit/model/blocks/ACLBlock.hh>
+#include <infinit/model/doughnut/Compressor.hh>
 #include <infinit/model/doughnut/OKB.hh>
 
 namespace infinit
@@ -88,6 +89,8 @@ namespace infinit
         ELLE_ATTRIBUTE_R(std::shared_ptr<elle::cryptography::rsa::PrivateKey>, sign_key);
         // Version used for tokens and secrets. Can differ from block version
         ELLE_ATTRIBUTE_R(elle::Version, seal_version);
+        // Algorithm the data was compressed with before being enciphered.
+        ELLE_ATTRIBUTE_R(Compressor::Algorithm, compression);
       protected:
         elle::Buffer const& data_signature() const;
 
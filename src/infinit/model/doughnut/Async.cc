@@ -1,8 +1,6 @@
-#include <fstream>
+#include <algorithm>
 
 #include <boost/filesystem.hpp>
-#include <boost/filesystem/fstream.hpp>
-#include <boost/range/algorithm/sort.hpp>
 
 #include <elle/os/environ.hh>
 #include <elle/serialization/binary.hh>
@@ -13,6 +11,7 @@
 #include <elle/das/model.hh>
 #include <elle/das/serializer.hh>
 
+#include <elle/reactor/Scope.hh>
 #include <elle/reactor/exception.hh>
 #include <elle/reactor/scheduler.hh>
 
@@ -20,6 +19,7 @@
 
 #include <infinit/model/Conflict.hh>
 #include <infinit/model/MissingBlock.hh>
+#include <infinit/model/blocks/ImmutableBlock.hh>
 #include <infinit/model/doughnut/ACB.hh>
 #include <infinit/model/doughnut/Async.hh>
 #include <infinit/model/doughnut/Doughnut.hh>
@@ -40,6 +40,16 @@ namespace infinit
       {
         struct OpAddressOnly{};
 
+        namespace
+        {
+          bool
+          is_immutable_store(Async::Op const& op)
+          {
+            return op.mode &&
+              dynamic_cast<blocks::ImmutableBlock const*>(op.block.get());
+          }
+        }
+
         Async::Op::Op(elle::serialization::SerializerIn& ser)
         {
           this->serialize(ser);
@@ -62,6 +72,7 @@ namespace infinit
             else if (auto mb = dynamic_cast<blocks::MutableBlock*>(
               remove_signature.block.get()))
               version = mb->version();
+            ordered = !is_immutable_store(*this);
           }
         }
 
@@ -72,8 +83,8 @@ namespace infinit
           , _operations()
           , _queue()
           , _next_index(1)
-          , _last_processed_index(0)
           , _journal_dir(journal_dir)
+          , _journal()
           , _exit_requested(false)
           , _process_thread(
             new elle::reactor::Thread(elle::sprintf("%s loop", *this),
@@ -85,6 +96,8 @@ namespace infinit
                                 }))
           , _in_push(false)
           , _processed_op_count(0)
+          , _workers(std::max(1, std::stoi(
+                                 elle::os::getenv("INFINIT_ASYNC_WORKERS", "8"))))
         {
           if (!this->_journal_dir.empty())
           {
@@ -92,6 +105,14 @@ namespace infinit
             bfs::permissions(this->_journal_dir,
               bfs::remove_perms
               | bfs::others_all | bfs::group_all);
+            // Bound on the time an operation waits for others to share its
+            // fsync, in milliseconds.
+            auto sync = elle::reactor::DurationOpt(
+              boost::posix_time::milliseconds(std::stoi(
+                elle::os::getenv("INFINIT_ASYNC_SYNC_DELAY", "0"))));
+            if (!elle::os::getenv("INFINIT_ASYNC_NOSYNC", "").empty())
+              sync.reset();
+            this->_journal = std::make_unique<Journal>(this->_journal_dir, sync);
           }
           if (max_size)
             this->_queue.max_size(max_size);
@@ -106,20 +127,6 @@ namespace infinit
             this->_init_barrier.open();
         }
 
-        std::vector<bfs::path>
-        Async::entries(bfs::path const& root)
-        {
-          auto paths = std::vector<bfs::path>
-            {bfs::directory_iterator(root), bfs::directory_iterator()};
-          boost::sort(paths,
-                    [] (bfs::path const& a, bfs::path const& b)
-                    {
-                      return std::stoi(a.filename().string()) <
-                        std::stoi(b.filename().string());
-                    });
-          return paths;
-        }
-
         void
         Async::_init()
         {
@@ -128,11 +135,8 @@ namespace infinit
             });
           ELLE_TRACE_SCOPE("%s: restore journal from %s",
                            *this, this->_journal_dir);
-          bfs::path p(_journal_dir);
-          auto files = Async::entries(p);
-          for (auto const& p: files)
+          for (auto const id: this->_journal->indexes())
           {
-            auto id = std::stoi(p.filename().string());
             Op op;
             try
             {
@@ -163,6 +167,8 @@ namespace infinit
             }
             this->_operations.emplace(std::move(op));
           }
+          this->_next_index =
+            std::max(this->_journal->last_index(), this->_next_index);
           ELLE_TRACE("restored %s operations", this->_queue.size());
         }
 
@@ -173,6 +179,7 @@ namespace infinit
           // Wake up the thread if needed.
           if (this->_queue.size() == 0)
             this->_queue.put(0);
+          this->_progress.signal();
           if (!elle::reactor::wait(*this->_process_thread, 10_sec)
             || !elle::reactor::wait(*this->_init_thread, 10_sec))
             ELLE_WARN("forcefully kiling async process loop");
@@ -192,7 +199,8 @@ namespace infinit
         Async::sync()
         {
           int wait_id = _next_index-1;
-          while (_last_processed_index < wait_id)
+          auto const& operations = this->_operations.get<1>();
+          while (!operations.empty() && operations.begin()->index <= wait_id)
             elle::reactor::sleep(100_ms);
         }
 
@@ -232,15 +240,16 @@ namespace infinit
               o.mode = std::move(op.mode);
               o.resolver = std::move(op.resolver);
               o.remove_signature = std::move(op.remove_signature);
+              o.ordered = op.ordered;
               });
           }
           this->_first_disk_index.reset();
         }
 
         Async::Op
-        Async::_load_op(bfs::path const& p, bool signature)
+        Async::_load_op(elle::Buffer const& data, bool signature)
         {
-          bfs::ifstream is(p, std::ios::binary);
+          elle::IOStream is(data.istreambuf());
           elle::serialization::binary::SerializerIn sin(is);
           sin.set_context<Model*>(&this->doughnut()); // FIXME: needed ?
           sin.set_context<Doughnut*>(&this->doughnut());
@@ -261,11 +270,27 @@ namespace infinit
         Async::Op
         Async::_load_op(int id, bool signature)
         {
-          auto op = this->_load_op(this->_journal_dir / std::to_string(id), signature);
+          if (!this->_journal)
+            elle::err("operation %s is no longer in memory", id);
+          auto op = this->_load_op(this->_journal->read(id), signature);
           op.index = id;
           return op;
         }
 
+        void
+        Async::_journal_write(Op const& op)
+        {
+          auto data = elle::Buffer{};
+          {
+            elle::IOStream os(data.ostreambuf());
+            elle::serialization::binary::SerializerOut sout(os);
+            sout.set_context(ACBDontWaitForSignature{});
+            sout.set_context(OKBDontWaitForSignature{});
+            sout.serialize_forward(op);
+          }
+          this->_journal->write(op.index, data);
+        }
+
         void
         Async::_push_op(Op op)
         {
@@ -279,11 +304,10 @@ namespace infinit
             SquashOperation last_candidate_order = std::make_pair(
               Squash::stop, SquashConflictResolverOptions(0));
             // Check for squashability: we need resolvers, and we can't touch
-            // the head of the queue since it's currently being processed
-            int current = this->_operations.get<1>().begin()->index;
+            // operations currently being processed
             std::vector<int> candidates;
             for (auto it = its.first; it != its.second; ++it)
-              if (it->index != current)
+              if (!this->_in_flight.count(it->index))
                 candidates.push_back(it->index);
             std::sort(candidates.begin(), candidates.end(),
               [](int x, int y) { return x > y;});
@@ -348,16 +372,8 @@ namespace infinit
                       o.remove_signature = std::move(op.remove_signature);
                       o.resolver = std::move(cr);
                     });
-                  if (!this->_journal_dir.empty())
-                  {
-                    auto path =
-                      bfs::path(_journal_dir) / std::to_string(last_candidate_index);
-                    bfs::ofstream os(path, std::ios::binary);
-                    elle::serialization::binary::SerializerOut sout(os);
-                    sout.set_context(ACBDontWaitForSignature{});
-                    sout.set_context(OKBDontWaitForSignature{});
-                    sout.serialize_forward(*copit);
-                  }
+                  if (this->_journal)
+                    this->_journal_write(*copit);
                   return;
               }
               else
@@ -367,12 +383,8 @@ namespace infinit
                 int lastidx = this->_operations.get<1>().rbegin()->index;
                 ELLE_DEBUG("Erasing op at %s", last_candidate_index);
                 this->_operations.get<1>().erase(last_candidate_index);
-                if (!this->_journal_dir.empty())
-                {
-                  auto path = bfs::path(this->_journal_dir) /
-                  std::to_string(idx);
-                  bfs::remove(path);
-                }
+                if (this->_journal)
+                  this->_journal->remove(idx);
                 if (this->_first_disk_index
                   && this->_first_disk_index.get() == idx)
                 {
@@ -387,16 +399,8 @@ namespace infinit
           auto in_push = elle::scoped_assignment(this->_in_push, true);
           op.index = ++this->_next_index;
           ELLE_TRACE_SCOPE("%s: push %s", *this, op);
-          if (!this->_journal_dir.empty())
-          {
-            auto path =
-              bfs::path(_journal_dir) / std::to_string(op.index);
-            bfs::ofstream os(path, std::ios::binary);
-            elle::serialization::binary::SerializerOut sout(os);
-            sout.set_context(ACBDontWaitForSignature{});
-            sout.set_context(OKBDontWaitForSignature{});
-            sout.serialize_forward(op);
-          }
+          if (this->_journal)
+            this->_journal_write(op);
           if (reentered)
           {
             this->_reentered_ops.emplace_back(std::move(op));
@@ -420,6 +424,7 @@ namespace infinit
             else
               op.block.reset();
             this->_operations.emplace(std::move(op));
+            this->_progress.signal();
           };
           queue(std::move(op));
           for (auto& op: this->_reentered_ops)
@@ -436,6 +441,8 @@ namespace infinit
           this->_queue.open();
           this->_push_op(
             Op(block->address(), std::move(block), mode, std::move(resolver)));
+          if (this->_journal)
+            this->_journal->commit();
         }
 
         void
@@ -444,6 +451,8 @@ namespace infinit
           elle::reactor::wait(this->_init_barrier);
           this->_queue.open();
           this->_push_op(Op(address, nullptr, {}, {}, std::move(rs)));
+          if (this->_journal)
+            this->_journal->commit();
         }
 
         void
@@ -534,48 +543,94 @@ namespace infinit
         Async::_process_loop()
         {
           elle::reactor::wait(this->_init_barrier);
-          while (!this->_exit_requested)
+          // Operations taken from the queue, waiting for their dependencies.
+          auto pending = std::deque<int>{};
+          elle::With<elle::reactor::Scope>() << [&] (elle::reactor::Scope& s)
           {
-            try
+            while (!this->_exit_requested)
             {
-              if (this->_queue.size() <= this->_queue.max_size() / 2 &&
-                  this->_first_disk_index)
-                ELLE_TRACE(
-                  "%s: restore additional operations from disk at index %s",
-                  *this, *this->_first_disk_index)
-                  this->_load_operations();
-              int index = this->_queue.get();
-              if (this->_exit_requested)
-                break;
-              auto it = this->_operations.get<1>().begin();
-              while (it == this->_operations.get<1>().end() || it->index > index)
+              try
               {
-                ELLE_DEBUG("index %s in queue not in ops (have %s)", index,
-                           it->index);
-                index = this->_queue.get();
-                it = this->_operations.get<1>().begin();
+                if (this->_queue.size() <= this->_queue.max_size() / 2 &&
+                    this->_first_disk_index)
+                  ELLE_TRACE(
+                    "%s: restore additional operations from disk at index %s",
+                    *this, *this->_first_disk_index)
+                    this->_load_operations();
+                if (pending.empty())
+                  pending.push_back(this->_queue.get());
+                while (this->_queue.size() > 0 &&
+                       signed(pending.size()) < 4 * this->_workers)
+                  pending.push_back(this->_queue.get());
+                if (this->_exit_requested)
+                  break;
+                bool started = false;
+                for (auto it = pending.begin();
+                     it != pending.end() &&
+                       signed(this->_in_flight.size()) < this->_workers;)
+                {
+                  auto op = this->_operations.get<1>().find(*it);
+                  if (op == this->_operations.get<1>().end())
+                  {
+                    ELLE_DEBUG("index %s in queue not in ops", *it);
+                    it = pending.erase(it);
+                    continue;
+                  }
+                  if (!this->_ready(*op))
+                  {
+                    ++it;
+                    continue;
+                  }
+                  it = pending.erase(it);
+                  started = true;
+                  auto const index = op->index;
+                  this->_in_flight.insert(index);
+                  s.run_background(
+                    elle::sprintf("%s: process %s", *this, index),
+                    [this, index, op = &*op]
+                    {
+                      elle::SafeFinally done([&] {
+                          this->_in_flight.erase(index);
+                          this->_progress.signal();
+                        });
+                      this->_process_operation(
+                        elle::generic_unique_ptr<Op const>(
+                          op, [] (Op const*) {}));
+                      if (this->_journal)
+                        this->_journal->remove(index);
+                      this->_operations.get<1>().erase(index);
+                      this->_drained.push_back(
+                        std::chrono::steady_clock::now());
+                      if (this->_drained.size() > 64)
+                        this->_drained.pop_front();
+                    });
+                }
+                if (!started)
+                  elle::reactor::wait(this->_progress);
               }
-
-              elle::generic_unique_ptr<Op const> op(&*it, [] (Op const*) {});
-              ELLE_ASSERT_EQ(op->index, index);
-              this->_process_operation(std::move(op));
-              if (!this->_journal_dir.empty())
+              catch (elle::Error const& e)
               {
-                auto path = bfs::path(this->_journal_dir) / std::to_string(index);
-                bfs::remove(path);
-                this->_last_processed_index = index;
+                ELLE_ABORT("%s: async loop killed: %s\n",
+                           this, e.what(), e.backtrace());
               }
-              this->_operations.get<1>().erase(it);
-            }
-            catch (elle::Error const& e)
-            {
-              ELLE_ABORT("%s: async loop killed: %s\n",
-                         this, e.what(), e.backtrace());
             }
-          }
+            ELLE_TRACE("wait for %s operations in flight",
+                       this->_in_flight.size())
+              s.wait();
+          };
           ELLE_TRACE("exiting loop");
         }
 
+        bool
+        Async::_ready(Op const& op) const
+        {
+          if (op.ordered)
+            return this->_operations.get<1>().begin()->index == op.index;
+          auto its = this->_operations.get<0>().equal_range(op.address);
+          return std::none_of(its.first, its.second,
+                              [&] (Op const& o) { return o.index < op.index; });
+        }
+
         void
         Async::_process_operation(elle::generic_unique_ptr<Op const> op)
         {
@@ -681,7 +736,33 @@ namespace infinit
         elle::json::Object
         Async::stats()
         {
-          return this->_backend->stats();
+          auto res = this->_backend->stats();
+          auto rate = 0.;
+          if (!this->_drained.empty())
+          {
+            auto const elapsed = std::chrono::duration<double>(
+              std::chrono::steady_clock::now() - this->_drained.front());
+            if (elapsed.count() > 0)
+              rate = this->_drained.size() / elapsed.count();
+          }
+          res["async"] = elle::json::Object
+            {
+              {"queue", int64_t(this->_operations.size())},
+              {"in_memory", int64_t(this->_queue.size())},
+              {"in_flight", int64_t(this->_in_flight.size())},
+              {"workers", this->_workers},
+              {"processed", int64_t(this->_processed_op_count)},
+              {"drain_rate", rate},
+            };
+          if (this->_journal)
+            res["journal"] = elle::json::Object
+              {
+                {"operations", int64_t(this->_journal->indexes().size())},
+                {"size", this->_journal->size()},
+                {"segments", int64_t(this->_journal->segments().size())},
+                {"syncs", this->_journal->syncs()},
+              };
+          return res;
         }
 
         /*----------.
@@ -700,6 +781,7 @@ namespace infinit
           , remove_signature(remove_signature_)
           , version(-1)
         {
+          this->ordered = !is_immutable_store(*this);
           if (auto mb = dynamic_cast<blocks::MutableBlock*>(block.get()))
             version = mb->version();
           else if (auto mb = dynamic_cast<blocks::MutableBlock*>(
@@ -722,6 +804,7 @@ namespace infinit
           resolver = std::move(b.resolver);
           remove_signature = std::move(b.remove_signature);
           index = b.index;
+          ordered = b.ordered;
           if (auto mb = dynamic_cast<blocks::MutableBlock*>(block.get()))
             version = mb->version();
           else if (auto mb = dynamic_cast<blocks::MutableBlock*>(
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <chrono>
+#include <deque>
 #include <functional>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/hashed_index.hpp>
@@ -10,10 +13,12 @@
 
 #include <elle/reactor/Channel.hh>
 #include <elle/reactor/Thread.hh>
+#include <elle/reactor/signal.hh>
 
 #include <elle/optional.hh>
 
 #include <infinit/model/doughnut/Consensus.hh>
+#include <infinit/model/doughnut/Journal.hh>
 
 namespace infinit
 {
@@ -26,6 +31,15 @@ namespace infinit
         ELLE_DAS_SYMBOL(remove_signature);
 
         namespace bmi = boost::multi_index;
+
+        /// Queue operations in a journal and apply them in the background.
+        ///
+        /// Up to `INFINIT_ASYNC_WORKERS` operations are applied concurrently.
+        /// Operations on the same address are applied in order, and so are
+        /// mutable block stores and removals with respect to all previous
+        /// operations, so a directory or file is never updated before the
+        /// blocks it references are stored. Only immutable block stores thus
+        /// overtake each other.
         class Async
           : public StackedConsensus
         {
@@ -67,11 +81,6 @@ namespace infinit
           elle::json::Object
           stats() override;
 
-        public:
-          static
-          std::vector<boost::filesystem::path>
-          entries(boost::filesystem::path const& root);
-
           /*----------.
           | Operation |
           `----------*/
@@ -98,6 +107,8 @@ namespace infinit
             blocks::RemoveSignature remove_signature;
             int index;
             int version;
+            /// Whether all previous operations must complete first.
+            bool ordered = true;
             using Model = elle::das::Model<
               Op,
               decltype(elle::meta::list(symbols::address,
@@ -113,6 +124,9 @@ namespace infinit
                        bool& hit);
           void
           _process_loop();
+          /// Whether `op` does not depend on pending operations.
+          bool
+          _ready(Op const& op) const;
           void
           _process_operation(elle::generic_unique_ptr<Op const> op);
           void
@@ -120,10 +134,12 @@ namespace infinit
           void
           _push_op(Op op);
           Async::Op
-          _load_op(boost::filesystem::path const& path, bool signature = true);
+          _load_op(elle::Buffer const& data, bool signature = true);
           Async::Op
           _load_op(int id, bool signature = true);
           void
+          _journal_write(Op const& op);
+          void
           _load_operations();
           using Operations = bmi::multi_index_container<
             Op,
@@ -136,8 +152,8 @@ namespace infinit
           ELLE_ATTRIBUTE(Operations, operations);
           ELLE_ATTRIBUTE(elle::reactor::Channel<int>, queue);
           ELLE_ATTRIBUTE(int, next_index);
-          ELLE_ATTRIBUTE(int, last_processed_index);
           ELLE_ATTRIBUTE(boost::filesystem::path, journal_dir);
+          ELLE_ATTRIBUTE(std::unique_ptr<Journal>, journal);
           /// Index of the first operation stored on disk because memory is at
           /// capacity.
           ELLE_ATTRIBUTE(boost::optional<int>, first_disk_index);
@@ -149,6 +165,14 @@ namespace infinit
           ELLE_ATTRIBUTE(bool, in_push);
           ELLE_ATTRIBUTE(std::vector<Op>, reentered_ops);
           ELLE_ATTRIBUTE_R(unsigned long, processed_op_count);
+          /// Maximum number of operations applied concurrently.
+          ELLE_ATTRIBUTE_R(int, workers);
+          ELLE_ATTRIBUTE(std::unordered_set<int>, in_flight);
+          /// Signaled when operations are pushed or complete.
+          ELLE_ATTRIBUTE(elle::reactor::Signal, progress);
+          /// Completion time of the last operations.
+          ELLE_ATTRIBUTE(std::deque<std::chrono::steady_clock::time_point>,
+                         drained);
           void
           print_queue();
         };
@@ -0,0 +1,230 @@
+#include <elle/log.hh>
+
+#include <elle/cryptography/hash.hh>
+
+#include <infinit/model/doughnut/CCHB.hh>
+#include <infinit/model/doughnut/CHB.hh>
+#include <infinit/model/doughnut/CryptoPool.hh>
+#include <infinit/model/doughnut/Doughnut.hh>
+
+ELLE_LOG_COMPONENT("infinit.model.doughnut.CCHB")
+
+namespace infinit
+{
+  namespace model
+  {
+    namespace doughnut
+    {
+      /*-------------.
+      | Construction |
+      `-------------*/
+
+      CCHB::CCHB(Doughnut* d, elle::Buffer data, elle::Buffer const& key,
+                 Address owner, int index, Compressor::Algorithm compression)
+        : Super(CCHB::_address(key), std::move(data))
+        , _owner(owner)
+        , _index(index)
+        , _referrers({this->referrer()})
+        , _compression(compression)
+      {}
+
+      CCHB::CCHB(Address address, Address owner, int index)
+        : Super(address)
+        , _owner(owner)
+        , _index(index)
+        , _referrers()
+        , _compression(Compressor::Algorithm::none)
+      {}
+
+      CCHB::CCHB(CCHB const& other)
+        : Super(other)
+        , _owner(other._owner)
+        , _index(other._index)
+        , _referrers(other._referrers)
+        , _compression(other._compression)
+      {}
+
+      CCHB::CCHB(CCHB&& other)
+        : Super(std::move(other))
+        , _owner(other._owner)
+        , _index(other._index)
+        , _referrers(std::move(other._referrers))
+        , _compression(other._compression)
+      {}
+
+      elle::Buffer
+      CCHB::key(elle::ConstWeakBuffer content)
+      {
+        return CryptoPool::instance().run(
+          CryptoPool::Operation::hash, content.size(),
+          [&] {
+            return elle::cryptography::hash(
+              content, elle::cryptography::Oneway::sha256);
+          });
+      }
+
+      bool
+      CCHB::check(Address address, elle::ConstWeakBuffer content)
+      {
+        return equal_unflagged(address, CCHB::_address(CCHB::key(content)));
+      }
+
+      bool
+      CCHB::convergent(Address address)
+      {
+        return address.value()[Address::flag_byte] == flags::convergent_block;
+      }
+
+      /*-----------.
+      | References |
+      `-----------*/
+
+      Address
+      CCHB::referrer() const
+      {
+        return CCHB::_referrer(this->_owner, this->_index);
+      }
+
+      bool
+      CCHB::reference(Address referrer)
+      {
+        return this->_referrers.insert(referrer).second;
+      }
+
+      bool
+      CCHB::release(Address referrer)
+      {
+        return this->_referrers.erase(referrer);
+      }
+
+      blocks::RemoveSignature
+      CCHB::sign_remove(Model& model, Address cchb, Address owner, int index)
+      {
+        auto res = CHB::sign_for_owner(
+          model, owner, CCHB::_release_data(cchb, owner, index));
+        res.block.reset(new CCHB(cchb, owner, index));
+        return res;
+      }
+
+      Address
+      CCHB::releaser(blocks::RemoveSignature const& sig)
+      {
+        if (auto request = dynamic_cast<CCHB const*>(sig.block.get()))
+          return request->referrer();
+        else
+          return Address::null;
+      }
+
+      /*---------.
+      | Clonable |
+      `---------*/
+
+      std::unique_ptr<blocks::Block>
+      CCHB::clone() const
+      {
+        return std::unique_ptr<blocks::Block>(new CCHB(*this));
+      }
+
+      /*-----------.
+      | Validation |
+      `-----------*/
+
+      void
+      CCHB::_seal(boost::optional<int>)
+      {}
+
+      blocks::ValidationResult
+      CCHB::_validate(Model const& model, bool writing) const
+      {
+        if (!CCHB::convergent(this->address()))
+          return blocks::ValidationResult::failure(
+            "not a convergent block address");
+        if (!this->_owner)
+          return blocks::ValidationResult::failure("missing owner");
+        return blocks::ValidationResult::success();
+      }
+
+      blocks::ValidationResult
+      CCHB::_validate_remove(Model& model,
+                             blocks::RemoveSignature const& sig) const
+      {
+        ELLE_TRACE("%s: validate_remove", *this);
+        auto request = dynamic_cast<CCHB const*>(sig.block.get());
+        if (!request || request->address() != this->address() ||
+            !request->_owner)
+          return blocks::ValidationResult::failure(
+            "missing releasing owner");
+        return CHB::validate_for_owner(
+          model, request->_owner, sig,
+          CCHB::_release_data(
+            this->address(), request->_owner, request->_index));
+      }
+
+      /*--------------.
+      | Serialization |
+      `--------------*/
+
+      CCHB::CCHB(elle::serialization::Serializer& input,
+                 elle::Version const& version)
+        : Super(input, version)
+        , _index(0)
+        , _compression(Compressor::Algorithm::none)
+      {
+        input.serialize("owner", this->_owner);
+        input.serialize("index", this->_index);
+        input.serialize("referrers", this->_referrers);
+        Compressor::serialize(input, "compression", this->_compression);
+      }
+
+      void
+      CCHB::serialize(elle::serialization::Serializer& s,
+                      elle::Version const& version)
+      {
+        Super::serialize(s, version);
+        s.serialize("owner", this->_owner);
+        s.serialize("index", this->_index);
+        s.serialize("referrers", this->_referrers);
+        Compressor::serialize(s, "compression", this->_compression);
+      }
+
+      /*--------.
+      | Details |
+      `--------*/
+
+      Address
+      CCHB::_address(elle::Buffer const& key)
+      {
+        // Hash the key again so the address does not disclose it.
+        auto salted = elle::Buffer("CCHB", 4);
+        salted.append(key.contents(), key.size());
+        auto const hash = elle::cryptography::hash(
+          salted, elle::cryptography::Oneway::sha256);
+        return {hash.contents(), flags::convergent_block, true};
+      }
+
+      elle::Buffer
+      CCHB::_release_data(Address address, Address owner, int index)
+      {
+        // Bind the referrer, so the signature cannot release another one.
+        auto res = elle::Buffer(address.value(), sizeof(Address::Value));
+        res.append(CCHB::_referrer(owner, index).value(),
+                   sizeof(Address::Value));
+        return res;
+      }
+
+      Address
+      CCHB::_referrer(Address owner, int index)
+      {
+        auto data = elle::Buffer(owner.value(), sizeof(Address::Value));
+        auto const position = elle::sprintf("%s", index);
+        data.append(position.data(), position.size());
+        auto const hash = elle::cryptography::hash(
+          data, elle::cryptography::Oneway::sha256);
+        return hash.contents();
+      }
+
+      static const elle::serialization::Hierarchy<blocks::Block>::
+      Register<CCHB> _register_cchb_serialization("CCHB");
+    }
+  }
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <boost/container/flat_set.hpp>
+
+#include <infinit/model/blocks/ImmutableBlock.hh>
+#include <infinit/model/doughnut/Compressor.hh>
+#include <infinit/model/doughnut/fwd.hh>
+
+namespace infinit
+{
+  namespace model
+  {
+    namespace doughnut
+    {
+      /// Convergent content hash block.
+      ///
+      /// The content is enciphered with a key derived from the plain
+      /// content, and the block lives at an address derived from that key,
+      /// so identical content written by any file lands on the same block.
+      /// Storage nodes cannot check the content against the address since
+      /// they do not know the key: readers do, with `check`.
+      ///
+      /// Every copy is stored on behalf of a referrer: a position in an
+      /// owner, the file referencing it. Storage nodes keep the set of
+      /// referrers: storing a block that already exists adds one instead of
+      /// failing, and removing it, signed with a key allowed to write the
+      /// owner, drops one, the block being erased along with its last
+      /// referrer. Both are idempotent, so retried or partially applied
+      /// operations do not unbalance references. Replicas copied between
+      /// storage nodes carry the referrers along, see `Local::_store`.
+      class CCHB
+        : public blocks::ImmutableBlock
+      {
+      /*------.
+      | Types |
+      `------*/
+      public:
+        using Self = CCHB;
+        using Super = blocks::ImmutableBlock;
+
+      /*-------------.
+      | Construction |
+      `-------------*/
+      public:
+        /// @param data        The content, enciphered with `key` or not.
+        /// @param key         The convergent key of the plain content.
+        /// @param owner       The file referencing the block.
+        /// @param index       The position of the block in `owner`.
+        /// @param compression The algorithm the content was compressed with
+        ///                    before being enciphered.
+        CCHB(Doughnut* d, elle::Buffer data, elle::Buffer const& key,
+             Address owner, int index,
+             Compressor::Algorithm compression = Compressor::Algorithm::none);
+        CCHB(CCHB const& other);
+        CCHB(CCHB&& other);
+        /// The convergent key of plain content `content`.
+        static
+        elle::Buffer
+        key(elle::ConstWeakBuffer content);
+        /// Whether `content` is the plain content of the block at `address`.
+        static
+        bool
+        check(Address address, elle::ConstWeakBuffer content);
+        /// Whether `address` is the address of a convergent block.
+        static
+        bool
+        convergent(Address address);
+        /// The file this copy is stored or released on behalf of.
+        ELLE_ATTRIBUTE_R(Address, owner);
+        /// The position of the block in `owner`.
+        ELLE_ATTRIBUTE_R(int, index);
+        /// The referrers of the block, as maintained by storage nodes.
+        ELLE_ATTRIBUTE_RW(boost::container::flat_set<Address>, referrers);
+        ELLE_ATTRIBUTE_R(Compressor::Algorithm, compression);
+
+      /*-----------.
+      | References |
+      `-----------*/
+      public:
+        /// The referrer this copy is stored or released on behalf of.
+        Address
+        referrer() const;
+        /// Add `referrer` to the referrers.
+        ///
+        /// @return Whether it was not one already.
+        bool
+        reference(Address referrer);
+        /// Remove `referrer` from the referrers.
+        ///
+        /// @return Whether it was one.
+        bool
+        release(Address referrer);
+        /// Sign the release of the block at `cchb` by position `index` of
+        /// `owner`.
+        static
+        blocks::RemoveSignature
+        sign_remove(Model& model, Address cchb, Address owner, int index);
+        /// The referrer `sig` releases the block on behalf of, if any.
+        static
+        Address
+        releaser(blocks::RemoveSignature const& sig);
+
+      /*---------.
+      | Clonable |
+      `---------*/
+      public:
+        std::unique_ptr<blocks::Block>
+        clone() const override;
+
+      /*-----------.
+      | Validation |
+      `-----------*/
+      protected:
+        void
+        _seal(boost::optional<int> version) override;
+        blocks::ValidationResult
+        _validate(Model const& model, bool writing) const override;
+        blocks::ValidationResult
+        _validate_remove(Model& model,
+                         blocks::RemoveSignature const& sig) const override;
+
+      /*--------------.
+      | Serialization |
+      `--------------*/
+      public:
+        CCHB(elle::serialization::Serializer& input,
+             elle::Version const& v);
+        void
+        serialize(elle::serialization::Serializer& s,
+                  elle::Version const& v) override;
+
+      /*--------.
+      | Details |
+      `--------*/
+      private:
+        /// A release request of the block at `address` by position `index`
+        /// of `owner`.
+        CCHB(Address address, Address owner, int index);
+        static
+        Address
+        _address(elle::Buffer const& key);
+        static
+        elle::Buffer
+        _release_data(Address address, Address owner, int index);
+        static
+        Address
+        _referrer(Address owner, int index);
+      };
+    }
+  }
+}
@@ -8,6 +8,7 @@
 
 #include <infinit/model/doughnut/CHB.hh>
 #include <infinit/model/doughnut/ACB.hh>
+#include <infinit/model/doughnut/CryptoPool.hh>
 #include <infinit/model/doughnut/Doughnut.hh>
 #include <infinit/model/doughnut/Group.hh>
 
@@ -23,14 +24,19 @@ namespace infinit
       | Construction |
       `-------------*/
 
-      CHB::CHB(Doughnut* d, elle::Buffer data, Address owner)
-        : CHB(d, std::move(data), this->_make_salt(), owner)
+      CHB::CHB(Doughnut* d, elle::Buffer data, Address owner,
+               Compressor::Algorithm compression)
+        : CHB(d, std::move(data), this->_make_salt(), owner, compression)
       {}
 
-      CHB::CHB(Doughnut* d, elle::Buffer data, elle::Buffer salt, Address owner)
-        : Super(CHB::_hash_address(data, owner, salt, d->version()), data)
+      CHB::CHB(Doughnut* d, elle::Buffer data, elle::Buffer salt, Address owner,
+               Compressor::Algorithm compression)
+        : Super(CHB::_hash_address(data, owner, salt, d->version(),
+                                   compression),
+                data)
         , _salt(std::move(salt))
         , _owner(owner)
+        , _compression(compression)
       {
         if (d->version() < elle::Version(0, 4, 0))
           this->_owner = Address::null;
@@ -40,12 +46,14 @@ namespace infinit
         : Super(other)
         , _salt(other._salt)
         , _owner(other._owner)
+        , _compression(other._compression)
       {}
 
       CHB::CHB(CHB&& other)
        : Super(std::move(other))
        , _salt(std::move(other._salt))
        , _owner(std::move(other._owner))
+       , _compression(other._compression)
       {}
 
       /*---------.
@@ -72,7 +80,8 @@ namespace infinit
         ELLE_DEBUG_SCOPE("%s: validate", *this);
         auto expected_address =
           CHB::_hash_address(this->data(), this->_owner,
-                             this->_salt, model.version());
+                             this->_salt, model.version(),
+                             this->_compression);
         if (!equal_unflagged(this->address(), expected_address))
         {
           auto reason =
@@ -95,10 +104,13 @@ namespace infinit
       CHB::CHB(elle::serialization::Serializer& input,
                elle::Version const& version)
         : Super(input, version)
+        , _compression(Compressor::Algorithm::none)
       {
         input.serialize("salt", _salt);
         if (version >= elle::Version(0, 4, 0))
           input.serialize("owner", _owner);
+        if (version >= elle::Version(0, 10, 0))
+          Compressor::serialize(input, "compression", this->_compression);
       }
 
       void
@@ -109,6 +121,8 @@ namespace infinit
         s.serialize("salt", _salt);
         if (version >= elle::Version(0, 4, 0))
           s.serialize("owner", _owner);
+        if (version >= elle::Version(0, 10, 0))
+          Compressor::serialize(s, "compression", this->_compression);
       }
 
       /*--------.
@@ -134,11 +148,17 @@ namespace infinit
 
       blocks::RemoveSignature
       CHB::sign_remove(Model& model, Address chb, Address owner)
+      {
+        return CHB::sign_for_owner(model, owner, elle::Buffer(chb.value()));
+      }
+
+      blocks::RemoveSignature
+      CHB::sign_for_owner(Model& model, Address owner,
+                          elle::Buffer const& to_sign)
       {
         auto& dht = dynamic_cast<Doughnut&>(model);
         blocks::RemoveSignature res;
         // we need to figure out which key to use, the one giving us access to the owner
-        elle::Buffer to_sign(chb.value());
         elle::Buffer signature;
         auto& keys = dht.keys();
         auto block = dht.fetch(owner);
@@ -198,29 +218,40 @@ namespace infinit
       CHB::_validate_remove(Model& model,
                             blocks::RemoveSignature const& sig) const
       {
-        auto& dht = dynamic_cast<Doughnut&>(model);
         ELLE_TRACE("%s: validate_remove", *this);
         if (!this->_owner)
           return blocks::ValidationResult::success();
+        return CHB::validate_for_owner(
+          model, this->_owner, sig,
+          elle::ConstWeakBuffer(this->address().value()));
+      }
+
+      blocks::ValidationResult
+      CHB::validate_for_owner(Model& model, Address owner,
+                              blocks::RemoveSignature const& sig,
+                              elle::ConstWeakBuffer signed_data)
+      {
+        auto& dht = dynamic_cast<Doughnut&>(model);
         if (!sig.signature_key || !sig.signature)
           return blocks::ValidationResult::failure("Missing field in signature");
         auto& key = *sig.signature_key;
-        bool ok = key.verify(*sig.signature,
-          elle::ConstWeakBuffer(this->address().value()));
+        bool ok = CryptoPool::instance().verify([&] {
+            return key.verify(*sig.signature, signed_data);
+          });
         if (!ok)
           return blocks::ValidationResult::failure("Invalid signature");
         // now verify that this key has access to owner
-        auto block = model.fetch(this->_owner);
+        auto block = model.fetch(owner);
         if (!block)
         {
           ELLE_WARN("CHB owner %x not found, cannot validate remove request",
-            this->_owner);
+            owner);
           return blocks::ValidationResult::success();
         }
         auto* acb = dynamic_cast<ACB*>(block.get());
         if (!acb)
         {
-          ELLE_WARN("CHB owner %x is not an ACB", this->_owner);
+          ELLE_WARN("CHB owner %x is not an ACB", owner);
           return blocks::ValidationResult::success();
         }
         if (acb->get_world_permissions().second)
@@ -258,7 +289,8 @@ namespace infinit
       Address
       CHB::_hash_address(elle::Buffer const& content,
                          Address owner, elle::Buffer const& salt,
-                         elle::Version const& version)
+                         elle::Version const& version,
+                         Compressor::Algorithm compression)
       {
         static elle::Bench bench("bench.chb.hash", std::chrono::seconds(10000));
         elle::Bench::BenchScope bs(bench);
@@ -267,17 +299,19 @@ namespace infinit
           owner = Address::null;
         if (owner)
           saltowner.append(owner.value(), sizeof(Address::Value));
-        elle::IOStream stream(saltowner.istreambuf_combine(content));
-        elle::Buffer hash;
-        // FIXME: scheduler::run?
-        if (content.size() > 262144 && elle::reactor::Scheduler::scheduler())
+        // Bind the algorithm to the content, leaving other addresses as is.
+        if (compression != Compressor::Algorithm::none)
         {
-          elle::reactor::background([&] {
-              hash = elle::cryptography::hash(stream, elle::cryptography::Oneway::sha256);
-            });
+          auto const algorithm = uint8_t(compression);
+          saltowner.append(&algorithm, 1);
         }
-        else
-          hash = elle::cryptography::hash(stream, elle::cryptography::Oneway::sha256);
+        elle::IOStream stream(saltowner.istreambuf_combine(content));
+        auto hash = CryptoPool::instance().run(
+          CryptoPool::Operation::hash, content.size(),
+          [&] {
+            return elle::cryptography::hash(
+              stream, elle::cryptography::Oneway::sha256);
+          });
         return {hash.contents(),
                 flags::immutable_block,
                 version >= elle::Version(0, 5, 0)};
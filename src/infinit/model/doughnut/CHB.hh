@@ -1,4 +1,7 @@
+#pragma once
+
 #include <infinit/model/blocks/ImmutableBlock.hh>
+#include <infinit/model/doughnut/Compressor.hh>
 #include <infinit/model/doughnut/fwd.hh>
 
 namespace infinit
@@ -21,13 +24,17 @@ namespace infinit
       | Construction |
       `-------------*/
       public:
+        /// @param compression The algorithm `data` was compressed with,
+        ///                    before being enciphered.
         CHB(Doughnut* d,
             elle::Buffer data,
-            Address owner = Address::null);
+            Address owner = Address::null,
+            Compressor::Algorithm compression = Compressor::Algorithm::none);
         CHB(Doughnut* d,
             elle::Buffer data,
             elle::Buffer salt,
-            Address owner = Address::null);
+            Address owner = Address::null,
+            Compressor::Algorithm compression = Compressor::Algorithm::none);
         CHB(CHB const& other);
         CHB(CHB&& other);
 
@@ -58,6 +65,18 @@ namespace infinit
         static
         blocks::RemoveSignature
         sign_remove(Model& model, Address chb, Address owner);
+        /// Sign `to_sign` with a key allowed to write `owner`.
+        static
+        blocks::RemoveSignature
+        sign_for_owner(Model& model, Address owner,
+                       elle::Buffer const& to_sign);
+        /// Whether `sig` signs `signed_data` with a key allowed to write
+        /// `owner`.
+        static
+        blocks::ValidationResult
+        validate_for_owner(Model& model, Address owner,
+                           blocks::RemoveSignature const& sig,
+                           elle::ConstWeakBuffer signed_data);
       protected:
         blocks::RemoveSignature
         _sign_remove(Model& model) const override;
@@ -76,9 +95,11 @@ namespace infinit
         Address
         _hash_address(elle::Buffer const& content, Address owner,
                       elle::Buffer const& salt,
-                      elle::Version const& version);
+                      elle::Version const& version,
+                      Compressor::Algorithm compression);
         ELLE_ATTRIBUTE(elle::Buffer, salt);
         ELLE_ATTRIBUTE_R(Address, owner); // owner ACB address or null
+        ELLE_ATTRIBUTE_R(Compressor::Algorithm, compression);
       };
     }
   }
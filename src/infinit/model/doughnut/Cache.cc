@@ -1,3 +1,5 @@
+#include <cstring>
+
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 
@@ -8,6 +10,7 @@
 #include <elle/bench.hh>
 #include <elle/bytes.hh>
 #include <elle/os/environ.hh>
+#include <elle/reactor/scheduler.hh>
 #include <elle/serialization/json.hh>
 #include <elle/serialization/binary.hh>
 
@@ -35,6 +38,114 @@ namespace infinit
           return Cache::clock::now();
         }
 
+        /// Approximate memory footprint of a cached block: mutable blocks
+        /// keep both their sealed and clear payload, plus keys and
+        /// signatures.
+        static
+        std::size_t
+        footprint(blocks::Block const& b)
+        {
+          return 2 * b.blocks::Block::data().size() + 1024;
+        }
+
+        /*-----------------.
+        | Disk cache index |
+        `-----------------*/
+
+        // The disk cache index is a header followed by fixed size records:
+        // operation ('+' or '-'), address, size, version and a checksum of
+        // the preceding fields. A torn or corrupted tail is discarded on
+        // load.
+
+        static char const index_magic[8] =
+          {'I', 'N', 'F', 'I', 'D', 'X', '0', '1'};
+
+        static std::size_t const index_record_size =
+          1 + sizeof(Address::Value) + sizeof(uint64_t) + sizeof(int32_t)
+          + sizeof(uint32_t);
+
+        static
+        uint32_t
+        index_checksum(char const* data, std::size_t size)
+        {
+          // FNV-1a.
+          uint32_t res = 2166136261u;
+          for (std::size_t i = 0; i < size; ++i)
+          {
+            res ^= static_cast<uint8_t>(data[i]);
+            res *= 16777619u;
+          }
+          return res;
+        }
+
+        static
+        std::string
+        index_record(char op, Address const& address,
+                     uint64_t size, int32_t version)
+        {
+          auto res = std::string(index_record_size, '\0');
+          auto p = &res[0];
+          *p++ = op;
+          std::memcpy(p, address.value(), sizeof(Address::Value));
+          p += sizeof(Address::Value);
+          std::memcpy(p, &size, sizeof(size));
+          p += sizeof(size);
+          std::memcpy(p, &version, sizeof(version));
+          p += sizeof(version);
+          auto const sum = index_checksum(res.data(), p - res.data());
+          std::memcpy(p, &sum, sizeof(sum));
+          return res;
+        }
+
+        static
+        bool
+        index_record_parse(std::string const& record, char& op,
+                           Address& address, uint64_t& size, int32_t& version)
+        {
+          auto p = record.data();
+          uint32_t sum;
+          std::memcpy(&sum, p + index_record_size - sizeof(sum), sizeof(sum));
+          if (sum != index_checksum(p, index_record_size - sizeof(sum)))
+            return false;
+          op = *p++;
+          address = Address(reinterpret_cast<uint8_t const*>(p));
+          p += sizeof(Address::Value);
+          std::memcpy(&size, p, sizeof(size));
+          p += sizeof(size);
+          std::memcpy(&version, p, sizeof(version));
+          return op == '+' || op == '-';
+        }
+
+#if INFINIT_ENABLE_PROMETHEUS
+        static
+        prometheus::CounterPtr
+        make_cache_counter(Doughnut const& dht, std::string const& event)
+        {
+          static auto* family
+            = prometheus::instance().make_counter_family(
+              "infinit_block_cache_events",
+              "How many hits, misses and evictions the block cache had");
+          return prometheus::instance().make(
+            family,
+            {
+              {"id", elle::sprintf("%f", dht.id())},
+              {"event", event},
+            });
+        }
+
+        static
+        prometheus::GaugePtr
+        make_cache_bytes_gauge(Doughnut const& dht)
+        {
+          static auto* family
+            = prometheus::instance().make_gauge_family(
+              "infinit_block_cache_bytes",
+              "How many bytes of blocks the block cache holds in memory");
+          return prometheus::instance().make(
+            family, {{"id", elle::sprintf("%f", dht.id())}});
+        }
+#endif
+
         class CacheConflictResolver: public ConflictResolver
         {
         public:
@@ -105,17 +216,33 @@ namespace infinit
             cache_ttl ?
             cache_ttl.get() : std::chrono::seconds(60 * 5))
           , _cache_size(cache_size ? cache_size.get() : 64_mB)
+          , _cache_segmented(
+            elle::os::getenv("INFINIT_CACHE_SEGMENTED", true))
           , _disk_cache_path(disk_cache_path)
           , _disk_cache_size(
             disk_cache_size ? disk_cache_size.get() : 512_mB)
+          , _cache_used(0)
+          , _cache_hot_used(0)
+          , _hits(0)
+          , _misses(0)
+          , _evictions(0)
+#if INFINIT_ENABLE_PROMETHEUS
+          , _hits_counter(make_cache_counter(this->doughnut(), "hit"))
+          , _misses_counter(make_cache_counter(this->doughnut(), "miss"))
+          , _evictions_counter(
+            make_cache_counter(this->doughnut(), "eviction"))
+          , _bytes_gauge(make_cache_bytes_gauge(this->doughnut()))
+#endif
           , _disk_cache_used(0)
+          , _disk_cache_index_records(0)
           , _cleanup_thread(
             new elle::reactor::Thread(elle::sprintf("%s cleanup", *this),
                                 [this] { this->_cleanup();}))
         {
           ELLE_TRACE_SCOPE(
-            "%s: create with size %s, TTL %ss and invalidation %ss",
+            "%s: create with size %s%s, TTL %ss and invalidation %ss",
             *this, this->_cache_size,
+            this->_cache_segmented ? " (segmented)" : "",
             this->_cache_ttl.count(), this->_cache_invalidation.count());
           if (!this->_disk_cache_path)
             this->_disk_cache_size = 0;
@@ -151,21 +278,20 @@ namespace infinit
         Cache::_remove(Address address, blocks::RemoveSignature rs)
         {
           ELLE_TRACE_SCOPE("%s: remove %f", this, address);
-          if (this->_cache.erase(address) > 0)
+          auto hit = this->_cache.find(address);
+          if (hit != this->_cache.end())
+          {
             ELLE_DEBUG("drop block from cache");
+            this->_cache_forget(*hit, false);
+            this->_cache.erase(hit);
+          }
           else
           {
             auto it = this->_disk_cache.find(address);
             if (it != this->_disk_cache.end())
             {
               ELLE_DEBUG("drop block from disk cache");
-              this->_disk_cache_used -= it->size();
-              boost::system::error_code erc;
-              auto path = *this->_disk_cache_path / elle::sprintf("%x", it->address());
-              boost::filesystem::remove(path, erc);
-              if (erc)
-                ELLE_WARN("Error pruning %s from cache: %s", path, erc);
-              this->_disk_cache.erase(it);
+              this->_disk_cache_evict(it);
             }
             else
               ELLE_DEBUG("block was not in cache");
@@ -237,11 +363,10 @@ namespace infinit
             {
               ELLE_TRACE("%s: block %f is not readable: %s", this, b.address(), e);
             }
-          if (this->_disk_cache_size &&
-            dynamic_cast<blocks::ImmutableBlock*>(&b))
-          this->_disk_cache_push(b);
-          else if (dynamic_cast<blocks::MutableBlock*>(&b) && this->_cache_size)
-            this->_cache.emplace(b.clone());
+          if (dynamic_cast<blocks::MutableBlock*>(&b) && this->_cache_size)
+            this->_cache_emplace(b.clone());
+          if (this->_disk_cache_size)
+            this->_disk_cache_push(b);
 
         }
 
@@ -261,8 +386,9 @@ namespace infinit
           {
             cache_hit = true;
             ELLE_DEBUG("cache hit on %f", address);
-            this->_cache.modify(
-              hit, [] (CachedBlock& b) { b.last_used(now()); });
+            this->_cache_touch(hit);
+            ++this->_hits;
+            prometheus::increment(this->_hits_counter);
             bench_hit.add(1);
             if (local_version)
               if (auto mb =
@@ -284,24 +410,61 @@ namespace infinit
             bench_hit.add(0);
             // try disk cache
             auto disk_hit = this->_disk_cache.find(address);
-            if (disk_hit != this->_disk_cache.end())
+            // Mutable blocks must be checked against the network, which
+            // cache-only lookups cannot do.
+            auto const disk_version = disk_hit != this->_disk_cache.end() ?
+              disk_hit->version() : -1;
+            auto block = disk_hit != this->_disk_cache.end() &&
+              (disk_version < 0 || !cache_only) ?
+              this->_disk_cache_load(address) : nullptr;
+            if (block && disk_version < 0)
             {
               cache_hit = true;
               ELLE_DEBUG("disk cache hit on %f", address);
               bench_disk_hit.add(1);
-              auto path = *this->_disk_cache_path / elle::sprintf("%x", address);
-              boost::filesystem::ifstream is(path, std::ios::binary);
-              elle::serialization::binary::SerializerIn sin(is);
-              sin.set_context<Doughnut*>(&this->doughnut());
-              auto block = sin.deserialize<std::unique_ptr<blocks::Block>>();
-              this->_disk_cache.modify(disk_hit,
-                [](CachedCHB& b) { b.last_used(now());});
+              ++this->_hits;
+              prometheus::increment(this->_hits_counter);
+              return block;
+            }
+            else if (block)
+            {
+              ELLE_DEBUG("disk cache hit on %f at version %s, revalidate",
+                         address, disk_version);
+              std::unique_ptr<blocks::Block> res;
+              try
+              {
+                res = this->_backend->fetch(address, disk_version);
+              }
+              catch (MissingBlock const&)
+              {
+                auto it = this->_disk_cache.find(address);
+                if (it != this->_disk_cache.end())
+                  this->_disk_cache_evict(it);
+                throw;
+              }
+              cache_hit = true;
+              bench_disk_hit.add(1);
+              ++this->_hits;
+              prometheus::increment(this->_hits_counter);
+              if (res)
+              {
+                ELLE_DEBUG("block was updated");
+                this->_insert_cache(*res);
+                block = std::move(res);
+              }
+              else if (this->_cache_size)
+                this->_cache_emplace(block->clone());
+              auto mb = dynamic_cast<blocks::MutableBlock*>(block.get());
+              if (local_version && mb && mb->version() == *local_version)
+                return nullptr;
               return block;
             }
             else
             {
               ELLE_DEBUG("cache miss on %f", address);
               bench_disk_hit.add(0);
+              ++this->_misses;
+              prometheus::increment(this->_misses_counter);
             }
             if (cache_only)
               return {};
@@ -346,18 +509,104 @@ namespace infinit
           if (hit != this->_cache.end())
           {
             this->_cache.modify(
-              hit, [&] (CachedBlock& b) {
-                b.block() = std::move(cloned);
-                b.last_used(now());
-                b.last_fetched(now());
-              });
+              hit, [&] (CachedBlock& b) { b.last_used(now()); });
+            this->_cache_replace(hit, std::move(cloned));
           }
           else
+            this->_cache_emplace(std::move(cloned));
+        }
+
+        void
+        Cache::_cache_emplace(std::unique_ptr<blocks::Block> block)
+        {
+          auto it = this->_cache.emplace(std::move(block));
+          if (!it.second)
+            return;
+          this->_cache_used += it.first->size();
+          this->_cache_evict();
+        }
+
+        void
+        Cache::_cache_replace(BlockCache::iterator it,
+                              std::unique_ptr<blocks::Block> block)
+        {
+          this->_cache_forget(*it, false);
+          this->_cache.modify(
+            it, [&] (CachedBlock& b)
+            {
+              b.block(std::move(block));
+              b.last_fetched(now());
+            });
+          this->_cache_used += it->size();
+          if (it->hot())
+            this->_cache_hot_used += it->size();
+          this->_cache_evict();
+        }
+
+        void
+        Cache::_cache_touch(BlockCache::iterator it)
+        {
+          auto const promote = this->_cache_segmented && !it->hot();
+          this->_cache.modify(
+            it, [&] (CachedBlock& b)
+            {
+              b.last_used(now());
+              if (promote)
+                b.hot(true);
+            });
+          if (!promote)
+            return;
+          ELLE_DUMP("promote %f to protected segment", it->address());
+          this->_cache_hot_used += it->size();
+          // Keep the protected segment under 80% of the cache so newcomers
+          // still get a chance to be hit twice.
+          auto const limit = std::size_t(this->_cache_size) / 5 * 4;
+          auto& order = this->_cache.get<1>();
+          while (this->_cache_hot_used > limit)
+          {
+            auto demoted = order.lower_bound(boost::make_tuple(true));
+            ELLE_ASSERT(demoted != order.end());
+            ELLE_DUMP("demote %f to probationary segment",
+                      demoted->address());
+            this->_cache_hot_used -= demoted->size();
+            order.modify(demoted, [] (CachedBlock& b) { b.hot(false); });
+          }
+        }
+
+        void
+        Cache::_cache_forget(CachedBlock const& b, bool evicted)
+        {
+          this->_cache_used -= b.size();
+          if (b.hot())
+            this->_cache_hot_used -= b.size();
+          if (evicted)
           {
-            this->_cache.emplace(std::move(cloned));
+            ++this->_evictions;
+            prometheus::increment(this->_evictions_counter);
           }
         }
 
+        void
+        Cache::_cache_evict()
+        {
+          // Probationary blocks sort first, so one sequential scan only
+          // flushes blocks that were never hit again.
+          auto& order = this->_cache.get<1>();
+          while (this->_cache_used > std::size_t(this->_cache_size) &&
+                 !order.empty())
+          {
+            auto it = order.begin();
+            ELLE_DUMP("evict %f (%s bytes) to fit cache size",
+                      it->address(), it->size());
+            this->_cache_forget(*it, true);
+            order.erase(it);
+          }
+#if INFINIT_ENABLE_PROMETHEUS
+          if (auto g = this->_bytes_gauge.get())
+            g->Set(this->_cache_used);
+#endif
+        }
+
         void
         Cache::_store(std::unique_ptr<blocks::Block> block,
                       StoreMode mode,
@@ -400,10 +649,26 @@ namespace infinit
         void
         Cache::_disk_cache_push(blocks::Block& block)
         {
-          if (!this->_disk_cache_path)
+          if (!this->_disk_cache_path || !this->_disk_cache_size)
             return;
-          auto path = *this->_disk_cache_path
-            / elle::sprintf("%x", block.address());
+          auto const address = block.address();
+          if (this->_disk_cache_reclaiming.count(address))
+          {
+            ELLE_DEBUG("skip %f, its previous copy is being removed", address);
+            return;
+          }
+          this->_disk_cache_trash.erase(address);
+          auto const mb = dynamic_cast<blocks::MutableBlock*>(&block);
+          auto const version = mb ? mb->version() : -1;
+          auto previous = this->_disk_cache.find(address);
+          if (previous != this->_disk_cache.end())
+          {
+            if (previous->version() == version && version >= 0)
+              return;
+            this->_disk_cache_used -= previous->size();
+            this->_disk_cache.erase(previous);
+          }
+          auto path = *this->_disk_cache_path / elle::sprintf("%x", address);
           {
             boost::filesystem::ofstream ofs(path, std::ios::binary);
             elle::serialization::binary::SerializerOut sout(ofs);
@@ -411,25 +676,117 @@ namespace infinit
             sout.serialize_forward(&block);
           }
           auto sz = boost::filesystem::file_size(path);
-          this->_disk_cache.emplace(CachedCHB{block.address(), sz, now()});
+          this->_disk_cache.emplace(DiskCachedBlock{address, sz, version, now()});
           this->_disk_cache_used += sz;
-          ELLE_DEBUG("add %f to disk cache (%s bytes)", block.address(), sz);
+          this->_disk_cache_record('+', address, sz, version);
+          ELLE_DEBUG("add %f to disk cache (%s bytes)", address, sz);
           while (this->_disk_cache_used > this->_disk_cache_size)
           {
             ELLE_ASSERT(!this->_disk_cache.empty());
             auto& order = this->_disk_cache.get<1>();
-            auto it = order.begin();
-            auto path = *this->_disk_cache_path / elle::sprintf("%x", it->address());
-            ELLE_DEBUG("Pruning %s of size %s from cache", path, it->size());
-            boost::system::error_code erc;
-            this->_disk_cache_used -= it->size();
-            boost::filesystem::remove(path, erc);
-            if (erc)
-              ELLE_WARN("Error pruning %s from cache: %s", path, erc);
-            order.erase(it);
+            this->_disk_cache_evict(
+              this->_disk_cache.project<0>(order.begin()));
+          }
+        }
+
+        void
+        Cache::_disk_cache_evict(DiskCache::iterator it)
+        {
+          ELLE_DEBUG("prune %f of size %s from disk cache",
+                     it->address(), it->size());
+          this->_disk_cache_used -= it->size();
+          // The file is removed, and the eviction recorded in the index, by
+          // the cleanup thread.
+          this->_disk_cache_trash.insert(it->address());
+          this->_disk_cache.erase(it);
+        }
+
+        std::unique_ptr<blocks::Block>
+        Cache::_disk_cache_load(Address address)
+        {
+          auto path = *this->_disk_cache_path / elle::sprintf("%x", address);
+          try
+          {
+            boost::filesystem::ifstream is(path, std::ios::binary);
+            if (!is.good())
+              elle::err("unable to open %s", path);
+            elle::serialization::binary::SerializerIn sin(is);
+            sin.set_context<Doughnut*>(&this->doughnut());
+            auto block = sin.deserialize<std::unique_ptr<blocks::Block>>();
+            auto it = this->_disk_cache.find(address);
+            if (it != this->_disk_cache.end())
+              this->_disk_cache.modify(
+                it, [] (DiskCachedBlock& b) { b.last_used(now()); });
+            return block;
+          }
+          catch (elle::Error const& e)
+          {
+            ELLE_WARN("%s: dropping unreadable disk cache entry %f: %s",
+                      this, address, e);
+            auto it = this->_disk_cache.find(address);
+            if (it != this->_disk_cache.end())
+              this->_disk_cache_evict(it);
+            return nullptr;
           }
         }
 
+        void
+        Cache::_disk_cache_record(char op, Address address,
+                                  uint64_t size, int version)
+        {
+          auto const record = index_record(op, address, size, version);
+          this->_disk_cache_index.write(record.data(), record.size());
+          this->_disk_cache_index.flush();
+          ++this->_disk_cache_index_records;
+        }
+
+        void
+        Cache::_disk_cache_reclaim()
+        {
+          if (this->_disk_cache_trash.empty())
+            return;
+          ELLE_TRACE_SCOPE("%s: reclaim %s disk cache entries",
+                           this, this->_disk_cache_trash.size());
+          std::swap(this->_disk_cache_reclaiming, this->_disk_cache_trash);
+          elle::SafeFinally clear([&] { this->_disk_cache_reclaiming.clear(); });
+          auto addresses = std::vector<Address>(
+            this->_disk_cache_reclaiming.begin(),
+            this->_disk_cache_reclaiming.end());
+          auto paths = std::vector<bfs::path>{};
+          for (auto const& address: addresses)
+            paths.emplace_back(
+              *this->_disk_cache_path / elle::sprintf("%x", address));
+          auto removed = std::vector<char>(paths.size(), false);
+          elle::reactor::background(
+            [&]
+            {
+              for (int i = 0; i < signed(paths.size()); ++i)
+              {
+                boost::system::error_code erc;
+                boost::filesystem::remove(paths[i], erc);
+                removed[i] = !erc;
+              }
+            });
+          // Only record removals once the files are gone, so a crash never
+          // leaves untracked files behind. Files that could not be removed
+          // are retried on the next reclaim.
+          int failures = 0;
+          for (int i = 0; i < signed(addresses.size()); ++i)
+            if (removed[i])
+              this->_disk_cache_record('-', addresses[i], 0, -1);
+            else
+            {
+              ++failures;
+              this->_disk_cache_trash.insert(addresses[i]);
+            }
+          if (failures)
+            ELLE_WARN("%s: unable to remove %s disk cache entries",
+                      this, failures);
+          if (this->_disk_cache_index_records >
+              2 * signed(this->_disk_cache.size()) + 1024)
+            this->_compact_disk_cache_index();
+        }
+
         /*------.
         | Cache |
         `------*/
@@ -440,17 +797,149 @@ namespace infinit
           if (!this->_disk_cache_path)
             return;
           ELLE_TRACE_SCOPE("%s: reload disk cache", this);
-          int count = 0;
+          auto const index = *this->_disk_cache_path / "index";
+          auto corrupted = false;
+          if (!bfs::exists(index))
+          {
+            this->_scan_disk_cache();
+            corrupted = true;
+          }
+          else
+          {
+            bfs::ifstream is(index, std::ios::binary);
+            char magic[sizeof(index_magic)];
+            if (!is.read(magic, sizeof(magic)) ||
+                std::memcmp(magic, index_magic, sizeof(magic)))
+            {
+              ELLE_WARN("%s: invalid disk cache index, rescanning", this);
+              is.close();
+              this->_scan_disk_cache();
+              corrupted = true;
+            }
+            else
+            {
+              auto record = std::string(index_record_size, '\0');
+              // Preserve the index order as an approximation of LRU order.
+              auto last_used = clock::time_point();
+              while (is.read(&record[0], index_record_size))
+              {
+                char op;
+                Address address;
+                uint64_t size;
+                int32_t version;
+                if (!index_record_parse(record, op, address, size, version))
+                {
+                  corrupted = true;
+                  break;
+                }
+                ++this->_disk_cache_index_records;
+                auto it = this->_disk_cache.find(address);
+                if (it != this->_disk_cache.end())
+                {
+                  this->_disk_cache_used -= it->size();
+                  this->_disk_cache.erase(it);
+                }
+                if (op == '+')
+                {
+                  last_used += clock::duration(1);
+                  this->_disk_cache.insert(
+                    DiskCachedBlock{address, size, version, last_used});
+                  this->_disk_cache_used += size;
+                }
+              }
+              if (is.gcount() != 0)
+                corrupted = true;
+              if (corrupted)
+                ELLE_WARN("%s: discard corrupted disk cache index tail", this);
+            }
+          }
+          ELLE_TRACE("loaded %s blocks totalling %s bytes",
+                     this->_disk_cache.size(), this->_disk_cache_used);
+          if (corrupted)
+            this->_compact_disk_cache_index();
+          else
+            this->_disk_cache_index.open(
+              index, std::ios::binary | std::ios::app);
+        }
+
+        void
+        Cache::_scan_disk_cache()
+        {
+          ELLE_TRACE_SCOPE("%s: scan disk cache directory", this);
+          this->_disk_cache.clear();
+          this->_disk_cache_used = 0;
           for (auto const& p: bfs::directory_iterator(*this->_disk_cache_path))
           {
+            auto const name = p.path().filename().string();
+            if (name == "index" || name == "index.tmp")
+              continue;
+            Address addr;
+            try
+            {
+              addr = Address::from_string(name);
+            }
+            catch (elle::Error const&)
+            {
+              ELLE_WARN("%s: ignore unexpected file %s", this, p.path());
+              continue;
+            }
+            // Without an index, the version of mutable blocks is unknown.
+            if (addr.mutable_block())
+            {
+              boost::system::error_code erc;
+              bfs::remove(p.path(), erc);
+              continue;
+            }
             auto sz = boost::filesystem::file_size(p);
-            auto addr = Address::from_string(p.path().filename().string());
-            this->_disk_cache.insert(CachedCHB{addr, sz, clock::time_point()});
+            this->_disk_cache.insert(
+              DiskCachedBlock{addr, sz, -1, clock::time_point()});
             this->_disk_cache_used += sz;
-            ++count;
           }
-          ELLE_TRACE("loaded %s blocks totalling %s bytes",
-                     count, this->_disk_cache_used);
+        }
+
+        void
+        Cache::_compact_disk_cache_index()
+        {
+          ELLE_TRACE_SCOPE("%s: compact disk cache index", this);
+          auto const index = *this->_disk_cache_path / "index";
+          auto const tmp = *this->_disk_cache_path / "index.tmp";
+          auto content = std::string(index_magic, sizeof(index_magic));
+          for (auto const& b: this->_disk_cache.get<1>())
+            content += index_record('+', b.address(), b.size(), b.version());
+          auto const records = signed(this->_disk_cache.size());
+          // Records appended while the snapshot is being written.
+          auto const backlog_start = this->_disk_cache_index.is_open() ?
+            this->_disk_cache_index_records : -1;
+          auto write = [&]
+            {
+              bfs::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+              out.write(content.data(), content.size());
+            };
+          if (elle::reactor::Scheduler::scheduler() && backlog_start >= 0)
+            elle::reactor::background(write);
+          else
+            write();
+          // Replay records appended to the old index in the meantime.
+          auto backlog = std::string{};
+          if (backlog_start >= 0 &&
+              this->_disk_cache_index_records > backlog_start)
+          {
+            this->_disk_cache_index.close();
+            bfs::ifstream is(index, std::ios::binary);
+            auto const count = this->_disk_cache_index_records - backlog_start;
+            backlog.resize(count * index_record_size);
+            is.seekg(-signed(backlog.size()), std::ios::end);
+            is.read(&backlog[0], backlog.size());
+          }
+          this->_disk_cache_index.close();
+          {
+            bfs::ofstream out(tmp, std::ios::binary | std::ios::app);
+            out.write(backlog.data(), backlog.size());
+          }
+          bfs::rename(tmp, index);
+          this->_disk_cache_index.open(index, std::ios::binary | std::ios::app);
+          this->_disk_cache_index_records =
+            records + backlog.size() / index_record_size;
         }
 
         void
@@ -458,6 +947,8 @@ namespace infinit
         {
           ELLE_TRACE_SCOPE("%s: clear", *this);
           this->_cache.clear();
+          this->_cache_used = 0;
+          this->_cache_hot_used = 0;
         }
 
         void
@@ -474,14 +965,19 @@ namespace infinit
               {
                 auto& order = this->_cache.get<1>();
                 auto deadline = now - this->_cache_ttl;
-                auto it = order.begin();
-                while (it != order.end() && it->last_used() < deadline)
+                for (auto hot: {false, true})
                 {
-                  ELLE_DUMP("evict %s", it->block()->address());
-                  it = order.erase(it);
+                  auto it = order.lower_bound(boost::make_tuple(hot));
+                  while (it != order.end() && it->hot() == hot &&
+                         it->last_used() < deadline)
+                  {
+                    ELLE_DUMP("evict %s", it->block()->address());
+                    this->_cache_forget(*it, true);
+                    it = order.erase(it);
+                  }
                 }
+                this->_cache_evict();
               }
-              // FIXME: take cache_size in account too
               ELLE_DEBUG("refresh obsolete blocks")
               {
                 auto& order = this->_cache.get<2>();
@@ -525,41 +1021,56 @@ namespace infinit
                       {
                         ELLE_TRACE("fetch error on %f: %s",
                                    a, elle::exception_string(e));
-                        this->_cache.erase(a);
+                        auto it = this->_cache.find(a);
+                        if (it != this->_cache.end())
+                        {
+                          this->_cache_forget(*it, false);
+                          this->_cache.erase(it);
+                        }
                       }
                       else
                       {
                         auto it = this->_cache.find(a);
                         if (it != this->_cache.end())
-                          this->_cache.modify(
-                            it,
-                            [&] (CachedBlock& cache)
-                            {
-                              if (b)
-                                cache.block() = std::move(b);
-                              cache.last_fetched(now);
-                            });
+                        {
+                          if (b)
+                            this->_cache_replace(it, std::move(b));
+                          else
+                            this->_cache.modify(
+                              it,
+                              [&] (CachedBlock& cache)
+                              {
+                                cache.last_fetched(now);
+                              });
+                        }
                       }
                     });
                   }
                 }
               }
+            if (this->_disk_cache_size)
+              ELLE_DEBUG("reclaim disk cache space")
+                this->_disk_cache_reclaim();
             elle::reactor::sleep(
               boost::posix_time::seconds(
                 this->_cache_invalidation.count()) / 10);
           }
         }
 
-        Cache::CachedCHB::CachedCHB(Address address,
-                                    uint64_t size,
-                                    clock::time_point last_used)
+        Cache::DiskCachedBlock::DiskCachedBlock(Address address,
+                                                uint64_t size,
+                                                int version,
+                                                clock::time_point last_used)
           : _address(address)
           , _size(size)
+          , _version(version)
           , _last_used(last_used)
         {}
 
         Cache::CachedBlock::CachedBlock(std::unique_ptr<blocks::Block> block)
           : _block(std::move(block))
+          , _size(footprint(*this->_block))
+          , _hot(false)
           , _last_used(now())
           , _last_fetched(now())
         {}
@@ -570,6 +1081,25 @@ namespace infinit
           return this->_block->address();
         }
 
+        void
+        Cache::CachedBlock::block(std::unique_ptr<blocks::Block> block)
+        {
+          this->_block = std::move(block);
+          this->_size = footprint(*this->_block);
+        }
+
+        bool
+        Cache::CachedBlock::hot() const
+        {
+          return this->_hot;
+        }
+
+        void
+        Cache::CachedBlock::hot(bool hot)
+        {
+          this->_hot = hot;
+        }
+
         /*-----------.
         | Monitoring |
         `-----------*/
@@ -583,7 +1113,17 @@ namespace infinit
         elle::json::Object
         Cache::stats()
         {
-          return this->_backend->stats();
+          auto res = this->_backend->stats();
+          res["cache"] = elle::json::Object{
+            {"blocks", this->_cache.size()},
+            {"bytes", this->_cache_used},
+            {"protected_bytes", this->_cache_hot_used},
+            {"size", this->_cache_size},
+            {"hits", this->_hits},
+            {"misses", this->_misses},
+            {"evictions", this->_evictions},
+          };
+          return res;
         }
       }
     }
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <unordered_map>
+#include <unordered_set>
 #include <chrono>
 
+#include <boost/filesystem/fstream.hpp>
+
 #include <boost/multi_index_container.hpp>
+#include <boost/multi_index/composite_key.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/identity.hpp>
 #include <boost/multi_index/mem_fun.hpp>
@@ -12,6 +16,7 @@
 
 #include <infinit/model/blocks/MutableBlock.hh>
 #include <infinit/model/doughnut/Consensus.hh>
+#include <infinit/model/prometheus.hh>
 
 namespace infinit
 {
@@ -91,7 +96,11 @@ namespace infinit
           _copy(blocks::Block& block);
           ELLE_ATTRIBUTE_R(std::chrono::seconds, cache_invalidation);
           ELLE_ATTRIBUTE_R(std::chrono::seconds, cache_ttl);
+          /// Maximum number of bytes of blocks held in memory.
           ELLE_ATTRIBUTE_R(int, cache_size);
+          /// Whether blocks must be hit twice before being protected from
+          /// eviction by newcomers (segmented LRU).
+          ELLE_ATTRIBUTE_R(bool, cache_segmented);
           ELLE_ATTRIBUTE_R(boost::optional<boost::filesystem::path>, disk_cache_path);
           ELLE_ATTRIBUTE_R(uint64_t, disk_cache_size);
           class CachedBlock
@@ -100,7 +109,18 @@ namespace infinit
             CachedBlock(std::unique_ptr<blocks::Block> block);
             Address
             address() const;
-            ELLE_ATTRIBUTE_RX(std::unique_ptr<blocks::Block>, block);
+            /// Replace the cached block, updating its footprint.
+            void
+            block(std::unique_ptr<blocks::Block> block);
+            ELLE_ATTRIBUTE_R(std::unique_ptr<blocks::Block>, block);
+            /// Approximate memory footprint of the block, in bytes.
+            ELLE_ATTRIBUTE_R(std::size_t, size);
+            /// Whether the block lives in the protected segment.
+            bool
+            hot() const;
+            void
+            hot(bool hot);
+            ELLE_ATTRIBUTE(bool, hot);
             ELLE_ATTRIBUTE_RW(clock::time_point, last_used);
             ELLE_ATTRIBUTE_RW(clock::time_point, last_fetched);
           };
@@ -118,42 +138,99 @@ namespace infinit
                 bmi::const_mem_fun<
                   CachedBlock,
                   Address, &CachedBlock::address> >,
+              // Eviction order: probationary blocks first, least recently
+              // used first.
               bmi::ordered_non_unique<
-                bmi::const_mem_fun<
+                bmi::composite_key<
                   CachedBlock,
-                  clock::time_point const&, &CachedBlock::last_used> >,
+                  bmi::const_mem_fun<
+                    CachedBlock, bool, &CachedBlock::hot>,
+                  bmi::const_mem_fun<
+                    CachedBlock,
+                    clock::time_point const&, &CachedBlock::last_used> > >,
               bmi::ordered_non_unique<
                 bmi::const_mem_fun<
                   CachedBlock,
                   clock::time_point const&, &CachedBlock::last_fetched> >
             > >;
           ELLE_ATTRIBUTE(BlockCache, cache);
-          class CachedCHB
+          /// Bytes held by the memory cache, and by its protected segment.
+          ELLE_ATTRIBUTE_R(std::size_t, cache_used);
+          ELLE_ATTRIBUTE_R(std::size_t, cache_hot_used);
+          ELLE_ATTRIBUTE_R(int64_t, hits);
+          ELLE_ATTRIBUTE_R(int64_t, misses);
+          ELLE_ATTRIBUTE_R(int64_t, evictions);
+          prometheus::CounterPtr _hits_counter;
+          prometheus::CounterPtr _misses_counter;
+          prometheus::CounterPtr _evictions_counter;
+          prometheus::GaugePtr _bytes_gauge;
+        private:
+          /// Add a block to the memory cache and evict as needed.
+          void
+          _cache_emplace(std::unique_ptr<blocks::Block> block);
+          /// Replace the block of a cached entry.
+          void
+          _cache_replace(BlockCache::iterator it,
+                         std::unique_ptr<blocks::Block> block);
+          /// Mark a cached entry as used, promoting it if needed.
+          void
+          _cache_touch(BlockCache::iterator it);
+          /// Account for an entry about to leave the memory cache.
+          void
+          _cache_forget(CachedBlock const& b, bool evicted);
+          /// Enforce cache_size, evicting the least valuable blocks.
+          void
+          _cache_evict();
+          class DiskCachedBlock
           {
           public:
-            CachedCHB(Address address, uint64_t size, clock::time_point last_used);
+            DiskCachedBlock(Address address,
+                            uint64_t size,
+                            int version,
+                            clock::time_point last_used);
             ELLE_ATTRIBUTE_R(Address, address);
             ELLE_ATTRIBUTE_R(uint64_t, size);
+            /// Version of mutable blocks, -1 for immutable ones.
+            ELLE_ATTRIBUTE_R(int, version);
             ELLE_ATTRIBUTE_RW(clock::time_point, last_used);
           };
-          using CHBDiskCache = bmi::multi_index_container<
-            CachedCHB,
+          using DiskCache = bmi::multi_index_container<
+            DiskCachedBlock,
             bmi::indexed_by<
               bmi::hashed_unique<
                 bmi::const_mem_fun<
-                  CachedCHB,
-                  Address const&, &CachedCHB::address> >,
+                  DiskCachedBlock,
+                  Address const&, &DiskCachedBlock::address> >,
               bmi::ordered_non_unique<
                 bmi::const_mem_fun<
-                  CachedCHB,
-                  clock::time_point const&, &CachedCHB::last_used> >
+                  DiskCachedBlock,
+                  clock::time_point const&, &DiskCachedBlock::last_used> >
           > >;
-          ELLE_ATTRIBUTE(CHBDiskCache, disk_cache);
+          ELLE_ATTRIBUTE(DiskCache, disk_cache);
           ELLE_ATTRIBUTE(uint64_t, disk_cache_used);
+          /// Append-only journal of the disk cache content.
+          ELLE_ATTRIBUTE(boost::filesystem::ofstream, disk_cache_index);
+          /// Number of records in the index, live or not.
+          ELLE_ATTRIBUTE(int64_t, disk_cache_index_records);
+          /// Evicted blocks whose file is yet to be removed.
+          ELLE_ATTRIBUTE(std::unordered_set<Address>, disk_cache_trash);
+          /// Blocks whose file is being removed.
+          ELLE_ATTRIBUTE(std::unordered_set<Address>, disk_cache_reclaiming);
           ELLE_ATTRIBUTE(elle::reactor::Thread::unique_ptr, cleanup_thread);
         private:
           void _load_disk_cache();
+          /// Rebuild the index from the cache directory content.
+          void _scan_disk_cache();
+          /// Rewrite the index with only live records.
+          void _compact_disk_cache_index();
+          /// Append a record to the index.
+          void _disk_cache_record(char op, Address address,
+                                  uint64_t size, int version);
+          /// Remove evicted block files, off the reactor thread.
+          void _disk_cache_reclaim();
           void _disk_cache_push(blocks::Block& block);
+          void _disk_cache_evict(DiskCache::iterator it);
+          std::unique_ptr<blocks::Block> _disk_cache_load(Address address);
           using Pending
             = std::unordered_map<Address, std::shared_ptr<elle::reactor::Barrier>>;
           ELLE_ATTRIBUTE(Pending, pending);
@@ -0,0 +1,429 @@
+#include <infinit/model/doughnut/Compressor.hh>
+
+#include <cstring>
+#include <vector>
+
+#include <elle/assert.hh>
+#include <elle/err.hh>
+#include <elle/log.hh>
+#include <elle/os/environ.hh>
+#include <elle/serialization/Serializer.hh>
+
+#include <infinit/model/doughnut/CryptoPool.hh>
+
+ELLE_LOG_COMPONENT("infinit.model.doughnut.Compressor");
+
+namespace infinit
+{
+  namespace model
+  {
+    namespace doughnut
+    {
+      namespace
+      {
+        /*----.
+        | LZ4 |
+        `----*/
+
+        int constexpr min_match = 4;
+        // The last bytes of a payload are always literals ...
+        int constexpr last_literals = 5;
+        // ... and no match starts that close to its end.
+        int constexpr match_limit = 12;
+        int constexpr max_offset = 65535;
+        int constexpr hash_log = 14;
+        // Misses after which positions are skipped faster.
+        int constexpr skip_trigger = 6;
+        // Bytes of the plain size prefixed to payloads.
+        int constexpr header_size = 4;
+        // Larger payloads are probed on their first bytes.
+        int constexpr sample_size = 16 * 1024;
+        // LZ4 expands each input byte to at most 255 output bytes.
+        int constexpr max_ratio = 255;
+        // No block is larger than an RPC message.
+        auto const max_size = std::size_t(elle::os::getenv(
+          "INFINIT_RPC_MAX_MESSAGE_SIZE", 256 * 1024 * 1024));
+
+        uint32_t
+        read32(uint8_t const* p)
+        {
+          uint32_t res;
+          std::memcpy(&res, p, sizeof res);
+          return res;
+        }
+
+        uint32_t
+        hash(uint8_t const* p)
+        {
+          return (read32(p) * 2654435761u) >> (32 - hash_log);
+        }
+
+        /// Output of the compressor, failing once full.
+        struct Output
+        {
+          uint8_t* pos;
+          uint8_t* end;
+
+          bool
+          put(uint8_t byte)
+          {
+            if (this->pos == this->end)
+              return false;
+            *this->pos++ = byte;
+            return true;
+          }
+
+          bool
+          put(uint8_t const* data, std::size_t size)
+          {
+            if (std::size_t(this->end - this->pos) < size)
+              return false;
+            std::memcpy(this->pos, data, size);
+            this->pos += size;
+            return true;
+          }
+
+          /// Bytes of a length that does not fit in its token nibble.
+          bool
+          length(std::size_t size)
+          {
+            for (; size >= 255; size -= 255)
+              if (!this->put(255))
+                return false;
+            return this->put(uint8_t(size));
+          }
+
+          /// `count` literals followed by a match, if `offset` is not null.
+          bool
+          sequence(uint8_t const* literals, std::size_t count,
+                   std::size_t offset, std::size_t match)
+          {
+            if (this->pos == this->end)
+              return false;
+            auto token = this->pos++;
+            *token = uint8_t(std::min<std::size_t>(count, 15) << 4);
+            if (count >= 15 && !this->length(count - 15))
+              return false;
+            if (!this->put(literals, count))
+              return false;
+            if (!offset)
+              return true;
+            if (!this->put(uint8_t(offset)) || !this->put(uint8_t(offset >> 8)))
+              return false;
+            match -= min_match;
+            *token |= uint8_t(std::min<std::size_t>(match, 15));
+            return match < 15 || this->length(match - 15);
+          }
+        };
+
+        /// Compress `size` bytes from `input` to `output`, searching up to
+        /// `depth` candidates for each match.
+        ///
+        /// @return The compressed size, or 0 if it exceeds `capacity`.
+        std::size_t
+        lz4_compress(uint8_t const* input, std::size_t size,
+                     uint8_t* output, std::size_t capacity,
+                     int depth)
+        {
+          auto out = Output{output, output + capacity};
+          auto anchor = std::size_t(0);
+          if (size > match_limit)
+          {
+            auto head = std::vector<int64_t>(1 << hash_log, -1);
+            // Previous position with the same hash, by position in the window.
+            auto chain =
+              std::vector<int64_t>(depth > 1 ? max_offset + 1 : 0, -1);
+            auto const insert = [&] (std::size_t pos)
+              {
+                auto& h = head[hash(input + pos)];
+                if (!chain.empty())
+                  chain[pos & max_offset] = h;
+                h = pos;
+              };
+            auto const limit = size - match_limit;
+            auto const match_end = size - last_literals;
+            auto misses = 0;
+            auto pos = std::size_t(0);
+            while (pos < limit)
+            {
+              auto best = std::size_t(0);
+              auto from = std::size_t(0);
+              auto candidate = head[hash(input + pos)];
+              for (int i = 0;
+                   i < depth && candidate >= 0 &&
+                     pos - candidate <= max_offset;
+                   ++i)
+              {
+                if (read32(input + candidate) == read32(input + pos))
+                {
+                  auto length = std::size_t(min_match);
+                  while (pos + length < match_end &&
+                         input[candidate + length] == input[pos + length])
+                    ++length;
+                  if (length > best)
+                  {
+                    best = length;
+                    from = candidate;
+                  }
+                }
+                if (chain.empty())
+                  break;
+                auto const next = chain[candidate & max_offset];
+                // Slots are reused beyond the window, stop at newer ones.
+                if (next >= candidate)
+                  break;
+                candidate = next;
+              }
+              insert(pos);
+              if (!best)
+              {
+                pos += 1 + (misses++ >> skip_trigger);
+                continue;
+              }
+              misses = 0;
+              while (pos > anchor && from > 0 &&
+                     input[pos - 1] == input[from - 1])
+              {
+                --pos;
+                --from;
+                ++best;
+              }
+              if (!out.sequence(input + anchor, pos - anchor, pos - from, best))
+                return 0;
+              if (!chain.empty())
+                for (auto i = pos + 1; i < pos + best && i < limit; ++i)
+                  insert(i);
+              pos += best;
+              anchor = pos;
+            }
+          }
+          if (!out.sequence(input + anchor, size - anchor, 0, 0))
+            return 0;
+          return out.pos - output;
+        }
+
+        void
+        lz4_decompress(uint8_t const* input, std::size_t size,
+                       uint8_t* output, std::size_t capacity)
+        {
+          auto in = input;
+          auto const in_end = input + size;
+          auto out = output;
+          auto const out_end = output + capacity;
+          auto const length = [&] (std::size_t res)
+            {
+              if (res == 15)
+              {
+                auto byte = uint8_t(255);
+                while (byte == 255)
+                {
+                  if (in == in_end)
+                    elle::err("truncated LZ4 length");
+                  byte = *in++;
+                  res += byte;
+                }
+              }
+              return res;
+            };
+          while (true)
+          {
+            if (in == in_end)
+              elle::err("truncated LZ4 sequence");
+            auto const token = *in++;
+            auto const literals = length(token >> 4);
+            if (std::size_t(in_end - in) < literals ||
+                std::size_t(out_end - out) < literals)
+              elle::err("LZ4 literals overflow");
+            std::memcpy(out, in, literals);
+            in += literals;
+            out += literals;
+            if (in == in_end)
+              break;
+            if (in_end - in < 2)
+              elle::err("truncated LZ4 offset");
+            auto const offset = std::size_t(in[0]) | std::size_t(in[1]) << 8;
+            in += 2;
+            if (!offset || offset > std::size_t(out - output))
+              elle::err("invalid LZ4 offset: %s", offset);
+            auto const match = length(token & 15) + min_match;
+            if (std::size_t(out_end - out) < match)
+              elle::err("LZ4 match overflow");
+            // Matches may overlap their own output.
+            auto const from = out - offset;
+            for (std::size_t i = 0; i < match; ++i)
+              out[i] = from[i];
+            out += match;
+          }
+          if (out != out_end)
+            elle::err("LZ4 payload is %s bytes, expected %s",
+                      out - output, capacity);
+        }
+      }
+
+      /*-------------.
+      | Construction |
+      `-------------*/
+
+      Compressor::Compressor(Algorithm algorithm, int level)
+        : _algorithm(algorithm)
+        , _level(std::min(std::max(level, 1), 9))
+        , _compressed(0)
+        , _bytes_in(0)
+        , _bytes_out(0)
+        , _skipped(0)
+        , _decompressed(0)
+      {
+        ELLE_TRACE("%s: compress with %s at level %s",
+                   this, this->_algorithm, this->_level);
+      }
+
+      Compressor&
+      Compressor::instance()
+      {
+        static Compressor compressor(
+          [] {
+            auto const name = elle::os::getenv("INFINIT_COMPRESSION", "none");
+            if (name == "lz4")
+              return Algorithm::lz4;
+            if (name != "none")
+              ELLE_WARN("unknown compression algorithm: %s", name);
+            return Algorithm::none;
+          }(),
+          elle::os::getenv("INFINIT_COMPRESSION_LEVEL", 1));
+        return compressor;
+      }
+
+      /*------------.
+      | Compression |
+      `------------*/
+
+      boost::optional<elle::Buffer>
+      Compressor::compress(elle::ConstWeakBuffer data)
+      {
+        auto const size = data.size();
+        if (this->_algorithm == Algorithm::none)
+          return boost::none;
+        auto res = boost::optional<elle::Buffer>{};
+        if (size >= min_size && size <= 0xffffffff)
+        {
+          auto const depth = 1 << (this->_level - 1);
+          // Only keep payloads that shrink by an eighth.
+          auto const capacity = size - size / 8;
+          res = CryptoPool::instance().run(
+            CryptoPool::Operation::compress, size,
+            [&] () -> boost::optional<elle::Buffer>
+            {
+              if (size >= 4 * sample_size)
+              {
+                auto sample = elle::Buffer(sample_size);
+                if (!lz4_compress(data.contents(), sample_size,
+                                  sample.mutable_contents(),
+                                  sample_size - sample_size / 8, depth))
+                  return boost::none;
+              }
+              auto buffer = elle::Buffer(capacity);
+              auto const compressed = lz4_compress(
+                data.contents(), size,
+                buffer.mutable_contents() + header_size,
+                capacity - header_size, depth);
+              if (!compressed)
+                return boost::none;
+              for (int i = 0; i < header_size; ++i)
+                buffer[i] = uint8_t(size >> (8 * i));
+              return elle::Buffer(buffer.contents(), header_size + compressed);
+            });
+        }
+        if (res)
+        {
+          ++this->_compressed;
+          this->_bytes_in += size;
+          this->_bytes_out += res->size();
+          ELLE_DUMP("%s: compressed %s bytes to %s",
+                    this, size, res->size());
+        }
+        else
+          ++this->_skipped;
+        return res;
+      }
+
+      elle::Buffer
+      Compressor::decompress(elle::Buffer data, Algorithm algorithm)
+      {
+        if (algorithm == Algorithm::none)
+          return data;
+        ELLE_ASSERT_EQ(algorithm, Algorithm::lz4);
+        if (data.size() < header_size)
+          elle::err("truncated compressed payload");
+        auto size = std::size_t(0);
+        for (int i = 0; i < header_size; ++i)
+          size |= std::size_t(data[i]) << (8 * i);
+        // The announced size is checked before allocating for it.
+        if (size > max_size ||
+            size > (data.size() - header_size) * max_ratio)
+          elle::err("invalid decompressed size: %s for %s bytes",
+                    size, data.size() - header_size);
+        ++this->_decompressed;
+        return CryptoPool::instance().run(
+          CryptoPool::Operation::decompress, size,
+          [&]
+          {
+            auto res = elle::Buffer(size);
+            lz4_decompress(data.contents() + header_size,
+                           data.size() - header_size,
+                           res.mutable_contents(), size);
+            return res;
+          });
+      }
+
+      void
+      Compressor::serialize(elle::serialization::Serializer& s,
+                            std::string const& name,
+                            Algorithm& algorithm)
+      {
+        auto value = int(algorithm);
+        s.serialize(name, value);
+        if (s.in())
+        {
+          if (value != int(Algorithm::none) && value != int(Algorithm::lz4))
+            elle::err("unknown compression algorithm: %s", value);
+          algorithm = Algorithm(value);
+        }
+      }
+
+      /*-----------.
+      | Statistics |
+      `-----------*/
+
+      elle::json::Object
+      Compressor::stats() const
+      {
+        return elle::json::Object
+          {
+            {"algorithm", elle::sprintf("%s", this->_algorithm)},
+            {"level", this->_level},
+            {"compressed", this->_compressed},
+            {"skipped", this->_skipped},
+            {"decompressed", this->_decompressed},
+            {"bytes_in", this->_bytes_in},
+            {"bytes_out", this->_bytes_out},
+            {"ratio", this->_bytes_out
+                ? double(this->_bytes_in) / this->_bytes_out
+                : 1.0},
+          };
+      }
+
+      std::ostream&
+      operator <<(std::ostream& o, Compressor::Algorithm algorithm)
+      {
+        switch (algorithm)
+        {
+          case Compressor::Algorithm::none:
+            return o << "none";
+          case Compressor::Algorithm::lz4:
+            return o << "lz4";
+        }
+        elle::unreachable();
+      }
+    }
+  }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+#include <boost/optional.hpp>
+
+#include <elle/Buffer.hh>
+#include <elle/attribute.hh>
+#include <elle/json/json.hh>
+#include <elle/serialization/fwd.hh>
+
+namespace infinit
+{
+  namespace model
+  {
+    namespace doughnut
+    {
+      /// Compression of block payloads before they are enciphered.
+      ///
+      /// Payloads are compressed in the LZ4 block format, prefixed with
+      /// their size. The level trades speed for ratio: level 1 keeps a
+      /// single candidate per hash, like LZ4, and every level above
+      /// doubles the length of the match chains searched.
+      ///
+      /// Compression is given up on payloads that do not shrink by at least
+      /// an eighth, large ones being probed on a sample first, so data that
+      /// is already compressed or enciphered costs little. The algorithm of
+      /// each payload is recorded by its block.
+      class Compressor
+      {
+      /*------.
+      | Types |
+      `------*/
+      public:
+        enum class Algorithm
+        {
+          none = 0,
+          lz4 = 1,
+        };
+
+      /*-------------.
+      | Construction |
+      `-------------*/
+      public:
+        Compressor(Algorithm algorithm, int level);
+        /// The process-wide compressor, configured from `INFINIT_COMPRESSION`
+        /// (`none` or `lz4`, default: none) and `INFINIT_COMPRESSION_LEVEL`
+        /// (1 to 9, default: 1).
+        static
+        Compressor&
+        instance();
+        /// Algorithm new payloads are compressed with.
+        ELLE_ATTRIBUTE_RW(Algorithm, algorithm);
+        ELLE_ATTRIBUTE_RW(int, level);
+
+      /*------------.
+      | Compression |
+      `------------*/
+      public:
+        /// `data` compressed with `algorithm`, unless not worth it.
+        boost::optional<elle::Buffer>
+        compress(elle::ConstWeakBuffer data);
+        /// Payload `data` compressed with `algorithm`, decompressed.
+        ///
+        /// @throw elle::Error if the payload is corrupted, or announces more
+        ///        than `INFINIT_RPC_MAX_MESSAGE_SIZE` bytes.
+        elle::Buffer
+        decompress(elle::Buffer data, Algorithm algorithm);
+        /// Serialize the algorithm of a payload.
+        ///
+        /// @throw elle::Error when reading an unknown algorithm.
+        static
+        void
+        serialize(elle::serialization::Serializer& s,
+                  std::string const& name,
+                  Algorithm& algorithm);
+        /// Smallest payload worth compressing.
+        static int constexpr min_size = 256;
+
+      /*-----------.
+      | Statistics |
+      `-----------*/
+      public:
+        /// Payloads compressed, and bytes before and after.
+        ELLE_ATTRIBUTE_R(int64_t, compressed);
+        ELLE_ATTRIBUTE_R(int64_t, bytes_in);
+        ELLE_ATTRIBUTE_R(int64_t, bytes_out);
+        /// Payloads left as is because they did not compress.
+        ELLE_ATTRIBUTE_R(int64_t, skipped);
+        ELLE_ATTRIBUTE_R(int64_t, decompressed);
+        /// Counters, along with the compression ratio. Time spent is
+        /// reported by the CryptoPool.
+        elle::json::Object
+        stats() const;
+      };
+
+      std::ostream&
+      operator <<(std::ostream& o, Compressor::Algorithm algorithm);
+    }
+  }
+}
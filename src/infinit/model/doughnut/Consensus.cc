@@ -52,6 +52,8 @@ namespace infinit
               elle::unreachable();
             case STORE_UPDATE:
               return this->doughnut().overlay()->lookup(block->address());
+            case STORE_REPLICATE:
+              break;
             }
             ELLE_ABORT("unrecognized store mode: %s", mode);
           }();
@@ -109,18 +111,35 @@ namespace infinit
         Consensus::_fetch(std::vector<AddressVersion> const& addresses,
                           ReceiveBlock res)
         {
-          for (auto const& a: addresses)
+          // Go through the single address fetch, which subclasses may
+          // override, from at most INFINIT_FETCH_PARALLELISM workers.
+          static auto const parallelism =
+            std::max(elle::os::getenv("INFINIT_FETCH_PARALLELISM", 16), 1);
+          auto next = 0u;
+          elle::With<elle::reactor::Scope>() << [&] (elle::reactor::Scope& s)
           {
-            try
-            {
-              auto block = this->fetch(a.first, a.second);
-              res(a.first, std::move(block), {});
-            }
-            catch (elle::Error const& e)
-            {
-              res(a.first, {}, std::current_exception());
-            }
-          }
+            for (int i = 0;
+                 i < std::min(parallelism, signed(addresses.size()));
+                 ++i)
+              s.run_background(
+                elle::sprintf("%s: fetch", this),
+                [&]
+                {
+                  while (next < addresses.size())
+                  {
+                    auto const& a = addresses[next++];
+                    try
+                    {
+                      res(a.first, this->_fetch(a.first, a.second), {});
+                    }
+                    catch (elle::Error const&)
+                    {
+                      res(a.first, {}, std::current_exception());
+                    }
+                  }
+                });
+            s.wait();
+          };
         }
 
         std::unique_ptr<blocks::Block>
@@ -0,0 +1,294 @@
+#include <infinit/model/doughnut/CryptoPool.hh>
+
+#include <atomic>
+#include <thread>
+
+#include <elle/With.hh>
+#include <elle/finally.hh>
+#include <elle/log.hh>
+#include <elle/os/environ.hh>
+#include <elle/reactor/Scope.hh>
+#include <elle/reactor/scheduler.hh>
+
+ELLE_LOG_COMPONENT("infinit.model.doughnut.CryptoPool");
+
+namespace infinit
+{
+  namespace model
+  {
+    namespace doughnut
+    {
+      /*----------.
+      | Histogram |
+      `----------*/
+
+      CryptoPool::Histogram::Histogram()
+        : _count(0)
+        , _total(Duration::zero())
+        , _max(Duration::zero())
+        , _buckets()
+      {}
+
+      void
+      CryptoPool::Histogram::add(Duration d)
+      {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(d)
+          .count();
+        int bucket = 0;
+        while (us > 0 && bucket < signed(this->_buckets.size()) - 1)
+        {
+          us >>= 1;
+          ++bucket;
+        }
+        ++this->_buckets[bucket];
+        ++this->_count;
+        this->_total += d;
+        this->_max = std::max(this->_max, d);
+      }
+
+      elle::json::Object
+      CryptoPool::Histogram::stats() const
+      {
+        using std::chrono::duration_cast;
+        using std::chrono::microseconds;
+        auto buckets = elle::json::Object{};
+        for (int i = 0; i < signed(this->_buckets.size()); ++i)
+          if (this->_buckets[i])
+            buckets[std::to_string(int64_t(1) << i)] = this->_buckets[i];
+        return elle::json::Object
+          {
+            {"count", this->_count},
+            {"mean_us", this->_count
+                ? duration_cast<microseconds>(this->_total).count() /
+                  this->_count
+                : 0},
+            {"max_us", int64_t(duration_cast<microseconds>(this->_max).count())},
+            {"buckets", buckets},
+          };
+      }
+
+      /*-------------.
+      | Construction |
+      `-------------*/
+
+      CryptoPool::CryptoPool(int workers, int verify_batch)
+        : _workers(std::max(workers, 0))
+        , _verify_batch(std::max(verify_batch, 1))
+        , _inline_size(
+          elle::os::getenv("INFINIT_CRYPTO_INLINE_SIZE", 65536))
+        , _semaphore(std::max(workers, 1))
+        , _batch()
+        , _histograms()
+        , _batches(0)
+        , _batched(0)
+      {
+        ELLE_TRACE("%s: start with %s workers", this, this->_workers);
+      }
+
+      CryptoPool&
+      CryptoPool::instance()
+      {
+        static CryptoPool pool(
+          // Legacy switch to keep block cryptography on the scheduler thread.
+          elle::os::getenv("INFINIT_NO_BACKGROUND_DECODE", false)
+          ? 0
+          : elle::os::getenv(
+            "INFINIT_CRYPTO_WORKERS",
+            std::max(int(std::thread::hardware_concurrency()), 1)),
+          elle::os::getenv("INFINIT_CRYPTO_VERIFY_BATCH", 32));
+        return pool;
+      }
+
+      /*----------.
+      | Execution |
+      `----------*/
+
+      void
+      CryptoPool::_run(Operation op,
+                       std::function<void ()> const& f,
+                       bool offload)
+      {
+        auto const start = Clock::now();
+        if (offload && this->_workers && elle::reactor::Scheduler::scheduler())
+          this->_offload(f);
+        else
+          f();
+        this->_record(op, Clock::now() - start);
+      }
+
+      void
+      CryptoPool::_offload(std::function<void ()> const& f)
+      {
+        auto const start = Clock::now();
+        elle::reactor::Lock lock(this->_semaphore);
+        this->_record(Operation::queue, Clock::now() - start);
+        // The job references the caller's stack: it must not unwind before
+        // the worker is done.
+        elle::With<elle::reactor::Thread::NonInterruptible>() << [&]
+        {
+          elle::reactor::background(f);
+        };
+      }
+
+      bool
+      CryptoPool::verify(Check check)
+      {
+        if (!this->_workers || !elle::reactor::Scheduler::scheduler())
+          return this->run(Operation::verify, check);
+        auto batch = this->_batch;
+        auto const leader = !batch;
+        if (leader)
+          batch = this->_batch = std::make_shared<Batch>();
+        auto const index = batch->checks.size();
+        batch->checks.emplace_back(std::move(check));
+        if (signed(batch->checks.size()) >= this->_verify_batch)
+          this->_batch.reset();
+        if (leader)
+        {
+          elle::SafeFinally release([&]
+            {
+              if (this->_batch == batch)
+                this->_batch.reset();
+              batch->done.open();
+            });
+          // Let concurrent coroutines join the batch until a worker is free.
+          elle::reactor::yield();
+          auto const start = Clock::now();
+          elle::reactor::Lock lock(this->_semaphore);
+          this->_record(Operation::queue, Clock::now() - start);
+          if (this->_batch == batch)
+            this->_batch.reset();
+          ELLE_DEBUG("%s: verify %s signatures", this, batch->checks.size());
+          auto results = std::vector<Result>(batch->checks.size());
+          auto const n = signed(results.size());
+          // Checks are claimed one at a time by the workers running the
+          // batch, so it is spread over those that go idle meanwhile.
+          auto next = std::atomic<int>(0);
+          auto const drain = [&]
+            {
+              elle::reactor::background([&] {
+                  for (int i = next++; i < n; i = next++)
+                  {
+                    auto const start = Clock::now();
+                    try
+                    {
+                      results[i].valid = batch->checks[i]();
+                    }
+                    catch (...)
+                    {
+                      results[i].error = std::current_exception();
+                    }
+                    results[i].duration = Clock::now() - start;
+                  }
+                });
+            };
+          elle::With<elle::reactor::Thread::NonInterruptible>() << [&]
+          {
+            elle::With<elle::reactor::Scope>() << [&] (elle::reactor::Scope& s)
+            {
+              for (int i = 1; i < std::min(n, this->_workers); ++i)
+                s.run_background(
+                  elle::sprintf("%s: verify", this),
+                  [&]
+                  {
+                    auto const start = Clock::now();
+                    elle::reactor::Lock lock(this->_semaphore);
+                    if (next >= n)
+                      return;
+                    this->_record(Operation::queue, Clock::now() - start);
+                    elle::With<elle::reactor::Thread::NonInterruptible>()
+                      << drain;
+                  });
+              drain();
+              // Helpers still waiting for a worker have nothing left to do,
+              // running ones finish their check first.
+              s.terminate_now();
+            };
+          };
+          ++this->_batches;
+          this->_batched += results.size();
+          for (auto const& r: results)
+            this->_record(Operation::verify, r.duration);
+          batch->results = std::move(results);
+        }
+        else
+          // Our check lives on this stack, stay until the batch is done.
+          elle::With<elle::reactor::Thread::NonInterruptible>() << [&]
+          {
+            elle::reactor::wait(batch->done);
+          };
+        if (index < batch->results.size())
+        {
+          auto const& r = batch->results[index];
+          if (r.error)
+            std::rethrow_exception(r.error);
+          return r.valid;
+        }
+        else
+          // The leader was interrupted before running the batch.
+          return this->run(Operation::verify, batch->checks[index]);
+      }
+
+      /*-----------.
+      | Statistics |
+      `-----------*/
+
+      void
+      CryptoPool::_record(Operation op, Duration d)
+      {
+        this->_histograms[int(op)].add(d);
+      }
+
+      CryptoPool::Histogram const&
+      CryptoPool::histogram(Operation op) const
+      {
+        return this->_histograms[int(op)];
+      }
+
+      elle::json::Object
+      CryptoPool::stats() const
+      {
+        auto operations = elle::json::Object{};
+        for (int i = 0; i < CryptoPool::operations; ++i)
+          if (this->_histograms[i].count())
+            operations[elle::sprintf("%s", Operation(i))] =
+              this->_histograms[i].stats();
+        return elle::json::Object
+          {
+            {"workers", this->_workers},
+            {"verify_batch", this->_verify_batch},
+            {"verify_batches", this->_batches},
+            {"verify_batched", this->_batched},
+            {"operations", operations},
+          };
+      }
+
+      std::ostream&
+      operator <<(std::ostream& o, CryptoPool::Operation op)
+      {
+        switch (op)
+        {
+          case CryptoPool::Operation::encrypt:
+            return o << "encrypt";
+          case CryptoPool::Operation::decrypt:
+            return o << "decrypt";
+          case CryptoPool::Operation::encipher:
+            return o << "encipher";
+          case CryptoPool::Operation::decipher:
+            return o << "decipher";
+          case CryptoPool::Operation::verify:
+            return o << "verify";
+          case CryptoPool::Operation::hash:
+            return o << "hash";
+          case CryptoPool::Operation::compress:
+            return o << "compress";
+          case CryptoPool::Operation::decompress:
+            return o << "decompress";
+          case CryptoPool::Operation::queue:
+            return o << "queue";
+        }
+        elle::unreachable();
+      }
+    }
+  }
+}
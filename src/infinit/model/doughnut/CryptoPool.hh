@@ -0,0 +1,155 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+#include <elle/attribute.hh>
+#include <elle/json/json.hh>
+#include <elle/reactor/Barrier.hh>
+#include <elle/reactor/semaphore.hh>
+
+namespace infinit
+{
+  namespace model
+  {
+    namespace doughnut
+    {
+      /// Pool of system threads block cryptography, and compression, is
+      /// offloaded to.
+      ///
+      /// RSA and AES operations are run through `elle::reactor::background`
+      /// so they no longer monopolize the scheduler thread. At most `workers`
+      /// operations run concurrently; with zero workers everything runs
+      /// inline, as it used to. Signature verifications submitted by
+      /// concurrent coroutines are coalesced into batches, whose checks are
+      /// shared by the workers that are or become idle while it runs.
+      ///
+      /// Per-operation latency histograms, including time spent waiting for a
+      /// worker, are kept to help size the pool.
+      class CryptoPool
+      {
+      /*------.
+      | Types |
+      `------*/
+      public:
+        using Clock = std::chrono::steady_clock;
+        using Duration = Clock::duration;
+        using Check = std::function<bool ()>;
+        enum class Operation
+        {
+          /// Asymmetric encryption or sealing of a secret.
+          encrypt,
+          /// Asymmetric decryption or opening of a secret.
+          decrypt,
+          /// Symmetric encryption of block content.
+          encipher,
+          /// Symmetric decryption of block content.
+          decipher,
+          /// Signature verification.
+          verify,
+          /// Content hashing.
+          hash,
+          /// Compression of block content.
+          compress,
+          /// Decompression of block content.
+          decompress,
+          /// Time spent waiting for a free worker.
+          queue,
+        };
+        static int constexpr operations = int(Operation::queue) + 1;
+
+        /// Latency histogram with power-of-two microsecond buckets.
+        class Histogram
+        {
+        public:
+          Histogram();
+          void
+          add(Duration d);
+          elle::json::Object
+          stats() const;
+          ELLE_ATTRIBUTE_R(int64_t, count);
+          ELLE_ATTRIBUTE_R(Duration, total);
+          ELLE_ATTRIBUTE_R(Duration, max);
+          /// Bucket i counts durations in [2^(i-1), 2^i[ microseconds.
+          ELLE_ATTRIBUTE_R((std::array<int64_t, 32>), buckets);
+        };
+
+      /*-------------.
+      | Construction |
+      `-------------*/
+      public:
+        /// Create a pool of `workers` threads, zero meaning inline execution.
+        CryptoPool(int workers, int verify_batch);
+        /// The process-wide pool, configured from `INFINIT_CRYPTO_WORKERS`
+        /// (default: hardware concurrency) and `INFINIT_CRYPTO_VERIFY_BATCH`.
+        static
+        CryptoPool&
+        instance();
+        ELLE_ATTRIBUTE_R(int, workers);
+        ELLE_ATTRIBUTE_R(int, verify_batch);
+        /// Symmetric operations on smaller payloads run inline, the thread
+        /// handoff costing more than the work.
+        ELLE_ATTRIBUTE_RW(std::size_t, inline_size);
+
+      /*----------.
+      | Execution |
+      `----------*/
+      public:
+        /// Run `f` on a worker and return its result.
+        template <typename F>
+        auto
+        run(Operation op, F const& f) -> decltype(f());
+        /// Run `f` on a worker if `size` exceeds `inline_size`.
+        template <typename F>
+        auto
+        run(Operation op, std::size_t size, F const& f) -> decltype(f());
+        /// Check a signature, batched with concurrent verifications.
+        bool
+        verify(Check check);
+      private:
+        void
+        _run(Operation op, std::function<void ()> const& f, bool offload);
+        void
+        _offload(std::function<void ()> const& f);
+        void
+        _record(Operation op, Duration d);
+        struct Result
+        {
+          bool valid = false;
+          std::exception_ptr error;
+          Duration duration = Duration::zero();
+        };
+        struct Batch
+        {
+          std::vector<Check> checks;
+          std::vector<Result> results;
+          elle::reactor::Barrier done;
+        };
+        ELLE_ATTRIBUTE(elle::reactor::Semaphore, semaphore);
+        ELLE_ATTRIBUTE(std::shared_ptr<Batch>, batch);
+        ELLE_ATTRIBUTE((std::array<Histogram, operations>), histograms);
+        ELLE_ATTRIBUTE_R(int64_t, batches);
+        ELLE_ATTRIBUTE_R(int64_t, batched);
+
+      /*-----------.
+      | Statistics |
+      `-----------*/
+      public:
+        Histogram const&
+        histogram(Operation op) const;
+        elle::json::Object
+        stats() const;
+      };
+
+      std::ostream&
+      operator <<(std::ostream& o, CryptoPool::Operation op);
+    }
+  }
+}
+
+#include <infinit/model/doughnut/CryptoPool.hxx>
@@ -0,0 +1,29 @@
+#include <boost/optional.hpp>
+
+namespace infinit
+{
+  namespace model
+  {
+    namespace doughnut
+    {
+      template <typename F>
+      auto
+      CryptoPool::run(Operation op, F const& f) -> decltype(f())
+      {
+        boost::optional<decltype(f())> res;
+        this->_run(op, [&] { res.emplace(f()); }, true);
+        return std::move(res.get());
+      }
+
+      template <typename F>
+      auto
+      CryptoPool::run(Operation op, std::size_t size, F const& f)
+        -> decltype(f())
+      {
+        boost::optional<decltype(f())> res;
+        this->_run(op, [&] { res.emplace(f()); }, size > this->_inline_size);
+        return std::move(res.get());
+      }
+    }
+  }
+}
@@ -250,6 +250,8 @@ namespace infinit
         : _dock(dock)
         , _location(l)
         , _socket(nullptr)
+        , _framing(false)
+        , _streaming(false)
         , _connected(false)
         , _disconnected(false)
         , _disconnected_since(std::chrono::system_clock::now())
@@ -315,6 +317,17 @@ namespace infinit
                 {
                   if (!disable_key)
                     this->_key_exchange(*channels);
+                  this->_procedures = rpc_procedures(
+                    *channels, this->_dock.doughnut().version(),
+                    &this->_credentials);
+                  // Streaming is negotiated first, as its call is not
+                  // framed.
+                  this->_streaming = rpc_streaming(
+                    *channels, this->_dock.doughnut().version(),
+                    &this->_credentials);
+                  this->_framing = !this->_credentials.empty() &&
+                    rpc_framing(*channels, this->_dock.doughnut().version(),
+                                &this->_credentials, this->_streaming);
                   ELLE_TRACE("connected");
                   this->_socket = std::move(socket);
                   this->_serializer = std::move(serializer);
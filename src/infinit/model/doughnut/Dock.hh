@@ -111,6 +111,12 @@ namespace infinit
                            channels, protected);
           ELLE_ATTRIBUTE_RX(RPCServer, rpc_server);
           ELLE_ATTRIBUTE_R(elle::Buffer, credentials, protected);
+          /// Procedure identifiers of the peer, fetched at handshake.
+          ELLE_ATTRIBUTE_R(RPCProcedures, procedures);
+          /// Whether the peer accepts framed messages, see `rpc_seal`.
+          ELLE_ATTRIBUTE_R(bool, framing);
+          /// Whether the peer accepts streamed messages, see `RPCWriter`.
+          ELLE_ATTRIBUTE_R(bool, streaming);
           ELLE_ATTRIBUTE(elle::reactor::Thread::unique_ptr, thread);
           /// Whether the remote has ever connected.
           ELLE_ATTRIBUTE_R(bool, connected);
@@ -2,6 +2,7 @@
 
 #include <elle/serialization/json.hh>
 
+#include <infinit/model/doughnut/CryptoPool.hh>
 #include <infinit/model/doughnut/Doughnut.hh>
 #include <infinit/model/doughnut/User.hh>
 #include <infinit/model/doughnut/ValidationFailed.hh>
@@ -27,7 +28,9 @@ namespace infinit
         this->_keys.push_back(first_group_key);
         auto const user_key = owner->keys();
         auto const ser_master = elle::serialization::binary::serialize(master.k());
-        auto sealed = user_key.K().seal(ser_master);
+        auto sealed = CryptoPool::instance().run(
+          CryptoPool::Operation::encrypt,
+          [&] { return user_key.K().seal(ser_master); });
         this->_admin_keys.emplace(user_key.K(), sealed);
         this->data(elle::serialization::binary::serialize(this->_keys));
         this->_acl_changed = true;
@@ -51,7 +54,9 @@ namespace infinit
             this->_owner_private_key =
               std::make_shared(elle::serialization::binary::deserialize<
                              elle::cryptography::rsa::PrivateKey>(
-                               keys.k().open(it->second)));
+                               CryptoPool::instance().run(
+                                 CryptoPool::Operation::decrypt,
+                                 [&] { return keys.k().open(it->second); })));
           }
           else
             ELLE_DEBUG("we are not group admin");
@@ -190,7 +195,10 @@ namespace infinit
             return;
           auto ser_master = elle::serialization::binary::serialize(
             *this->_owner_private_key);
-          this->_admin_keys.emplace(user.key(), user.key().seal(ser_master));
+          auto sealed = CryptoPool::instance().run(
+            CryptoPool::Operation::encrypt,
+            [&] { return user.key().seal(ser_master); });
+          this->_admin_keys.emplace(user.key(), std::move(sealed));
           this->_acl_changed = true;
         }
         catch (std::bad_cast const&)
@@ -0,0 +1,659 @@
+#include <infinit/model/doughnut/Journal.hh>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#ifdef INFINIT_WINDOWS
+# include <fcntl.h>
+# include <io.h>
+# include <sys/stat.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <elle/bench.hh>
+#include <elle/err.hh>
+#include <elle/log.hh>
+#include <elle/reactor/scheduler.hh>
+
+ELLE_LOG_COMPONENT("infinit.model.doughnut.consensus.Journal");
+
+namespace infinit
+{
+  namespace model
+  {
+    namespace doughnut
+    {
+      namespace consensus
+      {
+        namespace bfs = boost::filesystem;
+
+        namespace
+        {
+          auto const segment_extension = std::string(".journal");
+          auto const spare_extension = std::string(".free");
+          /// Segment files kept for reuse.
+          auto const max_spares = std::size_t(2);
+          /// Record header: magic, operation, segment, index, size and a
+          /// checksum of the header and data. The segment identifies stale
+          /// records left in reused files.
+          auto const record_magic = uint32_t(0x314e524a);
+          auto const header_size = 4 + 1 + 4 + 4 + 4 + 4;
+          auto const summed_size = header_size - 4;
+          auto const op_write = uint8_t(1);
+          auto const op_remove = uint8_t(2);
+
+          uint32_t
+          fnv1a(uint32_t hash, void const* data, std::size_t size)
+          {
+            auto const bytes = static_cast<uint8_t const*>(data);
+            for (std::size_t i = 0; i < size; ++i)
+            {
+              hash ^= bytes[i];
+              hash *= 16777619u;
+            }
+            return hash;
+          }
+
+          auto const fnv1a_basis = uint32_t(2166136261u);
+
+          template <typename T>
+          void
+          put(uint8_t*& p, T const& v)
+          {
+            std::memcpy(p, &v, sizeof v);
+            p += sizeof v;
+          }
+
+          template <typename T>
+          T
+          get(uint8_t const*& p)
+          {
+            T res;
+            std::memcpy(&res, p, sizeof res);
+            p += sizeof res;
+            return res;
+          }
+
+          int
+          open_file(bfs::path const& path, bool create)
+          {
+#ifdef INFINIT_WINDOWS
+            return ::_wopen(path.wstring().c_str(),
+                            _O_RDWR | _O_BINARY |
+                            (create ? _O_CREAT | _O_TRUNC : 0),
+                            _S_IREAD | _S_IWRITE);
+#else
+            return ::open(path.string().c_str(),
+                          O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0),
+                          0600);
+#endif
+          }
+
+          bool
+          write_at(int fd, uint8_t const* data, std::size_t size,
+                   int64_t offset)
+          {
+#ifdef INFINIT_WINDOWS
+            if (::_lseeki64(fd, offset, SEEK_SET) != offset)
+              return false;
+#endif
+            auto done = std::size_t(0);
+            while (done < size)
+            {
+#ifdef INFINIT_WINDOWS
+              auto const n = ::_write(fd, data + done, size - done);
+#else
+              auto const n =
+                ::pwrite(fd, data + done, size - done, offset + done);
+#endif
+              if (n < 0 && errno == EINTR)
+                continue;
+              if (n <= 0)
+                return false;
+              done += n;
+            }
+            return true;
+          }
+
+          bool
+          read_at(int fd, uint8_t* data, std::size_t size, int64_t offset)
+          {
+#ifdef INFINIT_WINDOWS
+            if (::_lseeki64(fd, offset, SEEK_SET) != offset)
+              return false;
+#endif
+            auto done = std::size_t(0);
+            while (done < size)
+            {
+#ifdef INFINIT_WINDOWS
+              auto const n = ::_read(fd, data + done, size - done);
+#else
+              auto const n =
+                ::pread(fd, data + done, size - done, offset + done);
+#endif
+              if (n < 0 && errno == EINTR)
+                continue;
+              if (n <= 0)
+                return false;
+              done += n;
+            }
+            return true;
+          }
+
+          bool
+          flush(int fd)
+          {
+#if defined INFINIT_WINDOWS
+            return ::_commit(fd) == 0;
+#elif defined INFINIT_LINUX
+            return ::fdatasync(fd) == 0;
+#else
+            return ::fsync(fd) == 0;
+#endif
+          }
+
+          /// Make file creations and renames in `dir` durable.
+          void
+          flush_directory(bfs::path const& dir)
+          {
+#ifndef INFINIT_WINDOWS
+            auto const fd = ::open(dir.string().c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd >= 0)
+            {
+              ::fsync(fd);
+              ::close(fd);
+            }
+#endif
+          }
+
+          elle::Buffer
+          read_file(bfs::path const& path)
+          {
+            auto&& input = bfs::ifstream(path, std::ios::binary);
+            if (!input.good())
+              elle::err("unable to open %s for reading", path);
+            auto res = elle::Buffer(std::size_t(bfs::file_size(path)));
+            input.read(reinterpret_cast<char*>(res.mutable_contents()),
+                       res.size());
+            res.size(input.gcount());
+            return res;
+          }
+
+          /// Call `f(op, index, offset, data)` on the valid records of
+          /// segment `id`.
+          ///
+          /// @return The size of the valid records.
+          template <typename F>
+          int64_t
+          scan(uint32_t id, elle::ConstWeakBuffer content, F const& f)
+          {
+            auto offset = std::size_t(0);
+            while (offset + header_size <= content.size())
+            {
+              auto p = content.contents() + offset;
+              auto const start = p;
+              if (get<uint32_t>(p) != record_magic)
+                break;
+              auto const op = get<uint8_t>(p);
+              auto const segment = get<uint32_t>(p);
+              auto const index = get<int32_t>(p);
+              auto const size = get<uint32_t>(p);
+              auto const sum = get<uint32_t>(p);
+              if (segment != id ||
+                  (op != op_write && op != op_remove) ||
+                  offset + header_size + size > content.size() ||
+                  fnv1a(fnv1a(fnv1a_basis, start, summed_size), p, size) != sum)
+                break;
+              f(op, index, offset + header_size, elle::ConstWeakBuffer(p, size));
+              offset += header_size + size;
+            }
+            return offset;
+          }
+
+          /// Segments, spares and operations stored one per file in `root`.
+          void
+          list(bfs::path const& root,
+               std::vector<uint32_t>& segments,
+               std::vector<uint32_t>& spares,
+               std::vector<std::pair<int, bfs::path>>& legacy)
+          {
+            for (auto const& entry: bfs::directory_iterator(root))
+            {
+              auto const path = entry.path();
+              auto const name = path.filename().string();
+              auto const ext = path.extension().string();
+              if (!name.empty() &&
+                  std::all_of(name.begin(), name.end(),
+                              [] (unsigned char c) { return std::isdigit(c); }))
+                legacy.emplace_back(std::stoi(name), path);
+              else if (ext == segment_extension || ext == spare_extension)
+                try
+                {
+                  auto const id =
+                    uint32_t(std::stoul(path.stem().string(), nullptr, 16));
+                  (ext == segment_extension ? segments : spares).push_back(id);
+                }
+                catch (std::logic_error const&)
+                {
+                  ELLE_WARN("ignore unexpected journal file %s", path);
+                }
+            }
+            std::sort(segments.begin(), segments.end());
+            std::sort(legacy.begin(), legacy.end());
+          }
+        }
+
+        struct Journal::File
+        {
+          File(bfs::path path_, bool create)
+            : path(std::move(path_))
+            , fd(open_file(this->path, create))
+          {
+            if (this->fd < 0)
+              elle::err("unable to open %s: %s",
+                        this->path, std::strerror(errno));
+          }
+
+          ~File()
+          {
+#ifdef INFINIT_WINDOWS
+            ::_close(this->fd);
+#else
+            ::close(this->fd);
+#endif
+          }
+
+          bfs::path path;
+          int fd;
+        };
+
+        /*-------------.
+        | Construction |
+        `-------------*/
+
+        Journal::Journal(bfs::path root,
+                         elle::reactor::DurationOpt sync,
+                         int64_t segment_size)
+          : _last_index(0)
+          , _size(0)
+          , _syncs(0)
+          , _root(std::move(root))
+          , _segment_size(segment_size)
+          , _active(0)
+          , _sync(std::move(sync))
+          , _appended(0)
+          , _durable(0)
+          , _directory_dirty(false)
+        {
+          ELLE_TRACE_SCOPE("%s: replay %s", this, this->_root);
+          static elle::Bench bench("bench.async.journal.replay",
+                                   std::chrono::seconds(10000));
+          elle::Bench::BenchScope bs(bench);
+          bfs::create_directories(this->_root);
+          auto segments = std::vector<uint32_t>{};
+          auto legacy = std::vector<std::pair<int, bfs::path>>{};
+          list(this->_root, segments, this->_spares, legacy);
+          for (auto const id: segments)
+            this->_replay(id);
+          auto next = uint32_t(0);
+          for (auto const id: segments)
+            next = std::max(next, id + 1);
+          for (auto const id: this->_spares)
+            next = std::max(next, id + 1);
+          // Never append to a possibly torn segment.
+          this->_open(next);
+          if (!legacy.empty())
+          {
+            ELLE_TRACE("import %s operations", legacy.size());
+            auto const first = this->_active;
+            for (auto const& l: legacy)
+              if (this->_index.find(l.first) == this->_index.end())
+                this->write(l.first, read_file(l.second));
+            for (auto id = first; id <= this->_active; ++id)
+            {
+              auto const file = id == this->_active ?
+                this->_file : std::make_shared<File>(this->_path(id), false);
+              if (!flush(file->fd))
+                elle::err("unable to flush %s: %s",
+                          file->path, std::strerror(errno));
+            }
+            flush_directory(this->_root);
+            this->_unsynced.clear();
+            this->_directory_dirty = false;
+            for (auto const& l: legacy)
+              bfs::remove(l.second);
+          }
+          this->_recycle();
+          ELLE_DEBUG("%s: %s operations (%s bytes) in %s segments",
+                     this, this->_index.size(), this->_size,
+                     this->_segments.size());
+          if (this->_sync && elle::reactor::Scheduler::scheduler())
+            this->_syncer.reset(
+              new elle::reactor::Thread(
+                elle::sprintf("%s sync", this),
+                [this] { this->_sync_loop(); }));
+        }
+
+        Journal::~Journal()
+        {
+          this->_syncer.reset();
+          if (this->_sync && !this->_unsynced.empty())
+            for (auto const& f: this->_unsynced)
+              flush(f->fd);
+        }
+
+        bfs::path
+        Journal::_path(uint32_t segment, bool spare) const
+        {
+          return this->_root / elle::sprintf(
+            "%08x%s", segment, spare ? spare_extension : segment_extension);
+        }
+
+        std::map<int, elle::Buffer>
+        Journal::load(bfs::path const& root)
+        {
+          auto res = std::map<int, elle::Buffer>{};
+          if (!bfs::exists(root))
+            return res;
+          auto segments = std::vector<uint32_t>{};
+          auto spares = std::vector<uint32_t>{};
+          auto legacy = std::vector<std::pair<int, bfs::path>>{};
+          list(root, segments, spares, legacy);
+          for (auto const& l: legacy)
+            res[l.first] = read_file(l.second);
+          for (auto const id: segments)
+          {
+            auto const content = read_file(
+              root / elle::sprintf("%08x%s", id, segment_extension));
+            scan(id, content,
+                 [&] (uint8_t op, int index, int64_t,
+                      elle::ConstWeakBuffer data)
+                 {
+                   if (op == op_write)
+                     res[index] = elle::Buffer(data.contents(), data.size());
+                   else
+                     res.erase(index);
+                 });
+          }
+          return res;
+        }
+
+        /*--------.
+        | Records |
+        `--------*/
+
+        void
+        Journal::_replay(uint32_t id)
+        {
+          auto const path = this->_path(id);
+          auto const content = read_file(path);
+          auto& segment = this->_segments[id];
+          segment.size = scan(
+            id, content,
+            [&] (uint8_t op, int index, int64_t offset,
+                 elle::ConstWeakBuffer data)
+            {
+              this->_last_index = std::max(this->_last_index, index);
+              this->_forget(index);
+              if (op == op_write)
+              {
+                this->_index[index] = Location{id, offset, uint32_t(data.size())};
+                ++segment.live;
+                this->_size += data.size();
+              }
+              else
+                this->_index.erase(index);
+            });
+          if (segment.size != int64_t(content.size()))
+            ELLE_WARN("%s: segment %s is corrupt past offset %s",
+                      this, path, segment.size);
+        }
+
+        void
+        Journal::_forget(int index)
+        {
+          auto it = this->_index.find(index);
+          if (it == this->_index.end())
+            return;
+          --this->_segments[it->second.segment].live;
+          this->_size -= it->second.size;
+        }
+
+        Journal::Location
+        Journal::_append(uint8_t op, int index, elle::ConstWeakBuffer data)
+        {
+          auto const size = header_size + data.size();
+          if (this->_segments[this->_active].size > 0 &&
+              this->_segments[this->_active].size + int64_t(size) >
+              this->_segment_size)
+            this->_open(this->_active + 1);
+          auto& segment = this->_segments[this->_active];
+          auto record = elle::Buffer(size);
+          {
+            auto p = record.mutable_contents();
+            put(p, record_magic);
+            put(p, op);
+            put(p, this->_active);
+            put(p, int32_t(index));
+            put(p, uint32_t(data.size()));
+            put(p, fnv1a(fnv1a(fnv1a_basis, record.contents(), summed_size),
+                         data.contents(), data.size()));
+            std::memcpy(p, data.contents(), data.size());
+          }
+          if (!write_at(this->_file->fd, record.contents(), size, segment.size))
+            // The next record overwrites whatever was partially written.
+            elle::err("unable to append to %s: %s",
+                      this->_file->path, std::strerror(errno));
+          auto const res = Location{
+            this->_active, segment.size + header_size, uint32_t(data.size())};
+          segment.size += size;
+          ++this->_appended;
+          if (this->_sync &&
+              std::find(this->_unsynced.begin(), this->_unsynced.end(),
+                        this->_file) == this->_unsynced.end())
+            this->_unsynced.emplace_back(this->_file);
+          return res;
+        }
+
+        void
+        Journal::write(int index, elle::ConstWeakBuffer data)
+        {
+          ELLE_DEBUG("%s: write %s (%s bytes)", this, index, data.size());
+          auto const location = this->_append(op_write, index, data);
+          this->_forget(index);
+          this->_index[index] = location;
+          ++this->_segments[location.segment].live;
+          this->_size += data.size();
+          this->_last_index = std::max(this->_last_index, index);
+        }
+
+        void
+        Journal::remove(int index)
+        {
+          if (this->_index.find(index) == this->_index.end())
+            return;
+          ELLE_DEBUG("%s: remove %s", this, index);
+          // Not flushed on its own: losing it merely replays the operation.
+          this->_append(op_remove, index, {});
+          this->_forget(index);
+          this->_index.erase(index);
+          this->_recycle();
+        }
+
+        elle::Buffer
+        Journal::read(int index) const
+        {
+          auto it = this->_index.find(index);
+          if (it == this->_index.end())
+            elle::err("operation %s is not in the journal", index);
+          auto const& location = it->second;
+          auto file = this->_file;
+          if (location.segment != this->_active)
+          {
+            if (!this->_reader.second ||
+                this->_reader.first != location.segment)
+              this->_reader = std::make_pair(
+                location.segment,
+                std::make_shared<File>(this->_path(location.segment), false));
+            file = this->_reader.second;
+          }
+          auto res = elle::Buffer(location.size);
+          if (!read_at(file->fd, res.mutable_contents(), res.size(),
+                       location.offset))
+            elle::err("unable to read operation %s from %s", index, file->path);
+          return res;
+        }
+
+        std::vector<int>
+        Journal::indexes() const
+        {
+          auto res = std::vector<int>{};
+          res.reserve(this->_index.size());
+          for (auto const& e: this->_index)
+            res.push_back(e.first);
+          return res;
+        }
+
+        /*---------.
+        | Segments |
+        `---------*/
+
+        void
+        Journal::_open(uint32_t id)
+        {
+          ELLE_TRACE_SCOPE("%s: open segment %s", this, id);
+          auto const path = this->_path(id);
+          if (!this->_spares.empty())
+          {
+            // Stale records do not bear this segment id and end replay.
+            bfs::rename(this->_path(this->_spares.back(), true), path);
+            this->_spares.pop_back();
+            this->_file = std::make_shared<File>(path, false);
+          }
+          else
+            this->_file = std::make_shared<File>(path, true);
+          this->_active = id;
+          this->_segments[id];
+          this->_directory_dirty = true;
+        }
+
+        void
+        Journal::_recycle()
+        {
+          // Removal records may refer to operations of older segments, which
+          // must thus be recycled first.
+          while (this->_segments.begin()->first != this->_active &&
+                 this->_segments.begin()->second.live == 0)
+          {
+            auto const id = this->_segments.begin()->first;
+            ELLE_TRACE_SCOPE("%s: recycle segment %s", this, id);
+            if (this->_reader.first == id)
+              this->_reader = {};
+            if (this->_spares.size() < max_spares)
+            {
+              bfs::rename(this->_path(id), this->_path(id, true));
+              this->_spares.push_back(id);
+            }
+            else
+              bfs::remove(this->_path(id));
+            this->_segments.erase(this->_segments.begin());
+          }
+        }
+
+        /*-------------.
+        | Group commit |
+        `-------------*/
+
+        void
+        Journal::commit()
+        {
+          if (!this->_sync)
+            return;
+          auto const target = this->_appended;
+          while (true)
+          {
+            if (this->_sync_error)
+              elle::err("unable to flush journal %s: %s",
+                        this->_root, *this->_sync_error);
+            if (this->_durable >= target)
+              return;
+            if (!this->_syncer)
+            {
+              for (auto const& f: this->_unsynced)
+                if (!flush(f->fd))
+                  elle::err("unable to flush %s: %s",
+                            f->path, std::strerror(errno));
+              if (this->_directory_dirty)
+                flush_directory(this->_root);
+              this->_unsynced.clear();
+              this->_directory_dirty = false;
+              this->_durable = target;
+              ++this->_syncs;
+              return;
+            }
+            this->_dirty.open();
+            elle::reactor::wait(this->_synced);
+          }
+        }
+
+        void
+        Journal::_sync_loop()
+        {
+          while (true)
+          {
+            elle::reactor::wait(this->_dirty);
+            // Let concurrent writers join this flush.
+            if (*this->_sync > elle::reactor::Duration())
+              elle::reactor::sleep(*this->_sync);
+            this->_dirty.close();
+            auto const target = this->_appended;
+            auto files = std::move(this->_unsynced);
+            this->_unsynced.clear();
+            auto const directory =
+              std::exchange(this->_directory_dirty, false);
+            auto const root = this->_root;
+            auto error = boost::optional<std::string>{};
+            ELLE_DEBUG("%s: flush %s records", this, target - this->_durable)
+            {
+              static elle::Bench bench("bench.async.journal.sync",
+                                       std::chrono::seconds(10000));
+              elle::Bench::BenchScope bs(bench);
+              elle::reactor::background(
+                [&]
+                {
+                  for (auto const& f: files)
+                    if (!flush(f->fd))
+                    {
+                      error = elle::sprintf("%s: %s",
+                                            f->path, std::strerror(errno));
+                      return;
+                    }
+                  if (directory)
+                    flush_directory(root);
+                });
+            }
+            if (error)
+            {
+              // Pages that failed to flush may be dropped from the cache, so
+              // later flushes cannot vouch for them: fail for good.
+              ELLE_ERR("%s: unable to flush: %s", this, *error);
+              this->_sync_error = error;
+            }
+            else
+              this->_durable = target;
+            ++this->_syncs;
+            this->_synced.signal();
+          }
+        }
+      }
+    }
+  }
+}
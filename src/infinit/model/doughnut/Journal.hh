@@ -0,0 +1,140 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/optional.hpp>
+
+#include <elle/Buffer.hh>
+#include <elle/attribute.hh>
+#include <elle/reactor/Barrier.hh>
+#include <elle/reactor/Thread.hh>
+#include <elle/reactor/duration.hh>
+#include <elle/reactor/signal.hh>
+
+namespace infinit
+{
+  namespace model
+  {
+    namespace doughnut
+    {
+      namespace consensus
+      {
+        /// Write-ahead journal of asynchronous operations.
+        ///
+        /// Serialized operations are appended to segment files as checksummed
+        /// records, along with markers for operations that were processed.
+        /// Replay scans segments in order and stops at the first invalid
+        /// record of each, so a torn write only loses the records that were
+        /// never committed.
+        ///
+        /// Appends are made durable by `commit`, which waits for the next
+        /// flush of the journal: a single fsync covers all records appended
+        /// meanwhile, `sync` bounding how long a flush waits for more records
+        /// to join it. Without `sync`, records are never flushed explicitly.
+        ///
+        /// Once every operation of the oldest segments was processed, their
+        /// files are kept aside to be reused for the next segments instead of
+        /// being unlinked and created again.
+        class Journal
+        {
+        public:
+          Journal(boost::filesystem::path root,
+                  elle::reactor::DurationOpt sync = elle::reactor::Duration(),
+                  int64_t segment_size = 16 * 1024 * 1024);
+          ~Journal();
+          /// Record the operation `index`, replacing any previous version.
+          void
+          write(int index, elle::ConstWeakBuffer data);
+          /// Record the operation `index` as processed.
+          void
+          remove(int index);
+          /// Wait until everything written so far is on disk.
+          void
+          commit();
+          /// The current version of operation `index`.
+          elle::Buffer
+          read(int index) const;
+          /// Indexes of pending operations, in order.
+          std::vector<int>
+          indexes() const;
+          /// Pending operations in `root`, without modifying it.
+          static
+          std::map<int, elle::Buffer>
+          load(boost::filesystem::path const& root);
+          /// Highest index ever recorded.
+          ELLE_ATTRIBUTE_R(int, last_index);
+          /// Bytes of pending operations.
+          ELLE_ATTRIBUTE_R(int64_t, size);
+          /// Number of flushes.
+          ELLE_ATTRIBUTE_R(int64_t, syncs);
+
+        /*---------.
+        | Segments |
+        `---------*/
+        public:
+          struct File;
+          struct Segment
+          {
+            /// Bytes of valid records.
+            int64_t size = 0;
+            /// Operations whose current version lives in this segment.
+            int live = 0;
+          };
+          struct Location
+          {
+            uint32_t segment;
+            int64_t offset;
+            uint32_t size;
+          };
+          ELLE_ATTRIBUTE_R(boost::filesystem::path, root);
+          ELLE_ATTRIBUTE_R(int64_t, segment_size);
+          ELLE_ATTRIBUTE_R((std::map<uint32_t, Segment>), segments);
+          /// Segment files waiting for reuse, by former id.
+          ELLE_ATTRIBUTE_R(std::vector<uint32_t>, spares);
+
+        private:
+          boost::filesystem::path
+          _path(uint32_t segment, bool spare = false) const;
+          void
+          _replay(uint32_t segment);
+          /// Start writing to segment `segment`, reusing a spare file.
+          void
+          _open(uint32_t segment);
+          void
+          _forget(int index);
+          /// Set aside the oldest segments once fully processed.
+          void
+          _recycle();
+          Location
+          _append(uint8_t op, int index, elle::ConstWeakBuffer data);
+          void
+          _sync_loop();
+          ELLE_ATTRIBUTE((std::map<int, Location>), index);
+          ELLE_ATTRIBUTE(uint32_t, active);
+          ELLE_ATTRIBUTE(std::shared_ptr<File>, file);
+          /// Last sealed segment read from.
+          ELLE_ATTRIBUTE((std::pair<uint32_t, std::shared_ptr<File>>), reader,
+                         mutable);
+
+        /*-------------.
+        | Group commit |
+        `-------------*/
+        private:
+          ELLE_ATTRIBUTE(elle::reactor::DurationOpt, sync);
+          /// Records appended, and records known to be on disk.
+          ELLE_ATTRIBUTE(int64_t, appended);
+          ELLE_ATTRIBUTE(int64_t, durable);
+          ELLE_ATTRIBUTE(std::vector<std::shared_ptr<File>>, unsynced);
+          ELLE_ATTRIBUTE(bool, directory_dirty);
+          ELLE_ATTRIBUTE(boost::optional<std::string>, sync_error);
+          ELLE_ATTRIBUTE(elle::reactor::Barrier, dirty);
+          ELLE_ATTRIBUTE(elle::reactor::Signal, synced);
+          ELLE_ATTRIBUTE(elle::reactor::Thread::unique_ptr, syncer);
+        };
+      }
+    }
+  }
+}
@@ -19,6 +19,7 @@
 #include <infinit/model/Model.hh>
 #include <infinit/model/blocks/MutableBlock.hh>
 #include <infinit/model/doughnut/ACB.hh>
+#include <infinit/model/doughnut/CCHB.hh>
 #include <infinit/model/doughnut/Doughnut.hh>
 #include <infinit/model/doughnut/OKB.hh>
 #include <infinit/model/doughnut/Remote.hh>
@@ -32,6 +33,17 @@ using Serializer = elle::serialization::Binary;
 
 namespace
 {
+  elle::Buffer
+  serialize_block(infinit::model::blocks::Block const& block)
+  {
+    elle::Buffer res;
+    elle::IOStream s(res.ostreambuf());
+    Serializer::SerializerOut output(s);
+    auto ptr = &block;
+    output.serialize_forward(ptr);
+    return res;
+  }
+
   auto const ipv4_enabled = !elle::os::getenv("INFINIT_NO_IPV4", false);
   auto const ipv6_enabled = !elle::os::getenv("INFINIT_NO_IPV6", false);
 }
@@ -185,6 +197,9 @@ namespace infinit
         ELLE_DEBUG("%s: validate block", *this)
           if (auto res = block.validate(this->doughnut(), true)); else
             throw ValidationFailed(res.reason());
+        auto const mutex = this->_lock(block.address());
+        elle::reactor::Lock lock(*mutex);
+        auto const cchb = dynamic_cast<CCHB const*>(&block);
         try
         {
           auto previous_buffer = this->_storage->get(block.address());
@@ -192,6 +207,9 @@ namespace infinit
           typename elle::serialization::binary::SerializerIn input(s);
           input.set_context<Doughnut*>(&this->_doughnut);
           auto previous = input.deserialize<std::unique_ptr<blocks::Block>>();
+          if (auto shared = dynamic_cast<CCHB const*>(previous.get()))
+            if (cchb)
+              return this->_store(*cchb, shared, mode);
           if (auto* mblock = dynamic_cast<blocks::MutableBlock const*>(&block))
           {
             auto mprevious =
@@ -213,20 +231,13 @@ namespace infinit
         }
         catch (silo::MissingKey const&)
         {}
-        elle::Buffer data = [&block]
-          {
-            elle::Buffer res;
-            elle::IOStream s(res.ostreambuf());
-            Serializer::SerializerOut output(s);
-            auto ptr = &block;
-            output.serialize_forward(ptr);
-            return res;
-          }();
+        if (cchb)
+          return this->_store(*cchb, nullptr, mode);
         try
         {
-          this->_storage->set(block.address(), data,
-                              mode == STORE_INSERT,
-                              mode == STORE_UPDATE);
+          this->_storage->set(block.address(), serialize_block(block),
+                              mode != STORE_UPDATE,
+                              mode != STORE_INSERT);
         }
         catch (silo::MissingKey const&)
         {
@@ -235,6 +246,73 @@ namespace infinit
         this->_on_store(block);
       }
 
+      elle::Buffer
+      Local::_serialize(blocks::Block const& block)
+      {
+        return serialize_block(block);
+      }
+
+      std::shared_ptr<elle::reactor::Mutex>
+      Local::_lock(Address address)
+      {
+        auto& weak = this->_locks[address];
+        if (auto res = weak.lock())
+          return res;
+        // Forget the lock along with its last holder.
+        auto res = std::shared_ptr<elle::reactor::Mutex>(
+          new elle::reactor::Mutex,
+          [this, address] (elle::reactor::Mutex* mutex)
+          {
+            this->_locks.erase(address);
+            delete mutex;
+          });
+        weak = res;
+        return res;
+      }
+
+      void
+      Local::_store(CCHB const& block, CCHB const* previous, StoreMode mode)
+      {
+        // Referrers are maintained here, not trusted from clients.
+        auto stored = CCHB(previous ? *previous : block);
+        if (!previous)
+          stored.referrers({});
+        auto changed = stored.reference(block.referrer());
+        if (mode == STORE_REPLICATE)
+          for (auto const& referrer: block.referrers())
+            changed = stored.reference(referrer) || changed;
+        if (changed)
+        {
+          ELLE_DEBUG("%s: %f now has %s referrers",
+                     *this, block.address(), stored.referrers().size());
+          try
+          {
+            this->_storage->set(block.address(), this->_serialize(stored),
+                                !previous && mode != STORE_UPDATE,
+                                previous || mode != STORE_INSERT);
+          }
+          catch (silo::MissingKey const&)
+          {
+            throw MissingBlock(block.address());
+          }
+        }
+        this->_on_store(stored);
+      }
+
+      bool
+      Local::_release(CCHB& previous, blocks::RemoveSignature const& rs)
+      {
+        auto const released = previous.release(CCHB::releaser(rs));
+        if (previous.referrers().empty())
+          return false;
+        ELLE_DEBUG("%s: %f has %s referrers left",
+                   *this, previous.address(), previous.referrers().size());
+        if (released)
+          this->_storage->set(previous.address(), this->_serialize(previous),
+                              false, true);
+        return true;
+      }
+
       std::unique_ptr<blocks::Block>
       Local::_fetch(Address address, boost::optional<int> local_version) const
       {
@@ -261,6 +339,8 @@ namespace infinit
       Local::remove(Address address, blocks::RemoveSignature rs)
       {
         ELLE_DEBUG("remove %x", address);
+        auto const mutex = this->_lock(address);
+        elle::reactor::Lock lock(*mutex);
         try
         {
           if (this->_doughnut.version() >= elle::Version(0, 4, 0))
@@ -276,6 +356,9 @@ namespace infinit
                 throw Conflict(val.reason(), previous->clone());
               else
                 throw ValidationFailed(val.reason());
+            if (auto shared = dynamic_cast<CCHB*>(previous.get()))
+              if (this->_release(*shared, rs))
+                return;
           }
           this->_storage->erase(address);
         }
@@ -286,6 +369,12 @@ namespace infinit
         this->_on_remove(address);
       }
 
+      std::vector<Address>
+      Local::addresses()
+      {
+        return this->_storage->list();
+      }
+
       /*-----.
       | Keys |
       `-----*/
@@ -390,6 +479,13 @@ namespace infinit
                    this->_require_auth(rpcs, false);
                    return this->fetch(address, local_version);
                  });
+        if (this->_doughnut.version() >= elle::Version(0, 10, 0))
+          rpcs.add("fetch_many",
+                   [this, &rpcs] (std::vector<AddressVersion> const& addresses)
+                   {
+                     this->_require_auth(rpcs, false);
+                     return this->fetch_reply(addresses);
+                   });
         if (this->_doughnut.version() >= elle::Version(0, 4, 0))
           rpcs.add("remove",
                    [this, &rpcs] (Address address, blocks::RemoveSignature rs)
@@ -5,6 +5,7 @@
 #include <boost/signals2.hpp>
 
 #include <elle/reactor/Barrier.hh>
+#include <elle/reactor/mutex.hh>
 #include <elle/reactor/network/tcp-server.hh>
 #include <elle/reactor/network/utp-socket.hh>
 
@@ -61,10 +62,39 @@ namespace infinit
         store(blocks::Block const& block, StoreMode mode) override;
         void
         remove(Address address, blocks::RemoveSignature rs) override;
+        /// Addresses of the blocks stored locally.
+        virtual
+        std::vector<Address>
+        addresses();
       protected:
         std::unique_ptr<blocks::Block>
         _fetch(Address address,
                boost::optional<int> local_version) const override;
+        /// Serialize `block` for storage.
+        virtual
+        elle::Buffer
+        _serialize(blocks::Block const& block);
+        /// Lock the block at `address` while an update depending on its
+        /// stored value, such as its CCHB referrers, is in progress.
+        std::shared_ptr<elle::reactor::Mutex>
+        _lock(Address address);
+        /// Store CCHB `block` with `mode` over `previous`, the copy kept so
+        /// far if any.
+        ///
+        /// Clients store a block on behalf of its own referrer only. Other
+        /// referrers are maintained by storage nodes, and merged when they
+        /// replicate the block to one another with `STORE_REPLICATE`.
+        void
+        _store(CCHB const& block, CCHB const* previous, StoreMode mode);
+        /// Release CCHB `previous` as `rs` requests.
+        ///
+        /// @return Whether referrers are left, in which case it is kept.
+        bool
+        _release(CCHB& previous, blocks::RemoveSignature const& rs);
+      private:
+        using Locks =
+          std::unordered_map<Address, std::weak_ptr<elle::reactor::Mutex>>;
+        ELLE_ATTRIBUTE(Locks, locks);
 
       /*-----.
       | Keys |
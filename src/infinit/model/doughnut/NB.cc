@@ -1,3 +1,4 @@
+#include <infinit/model/doughnut/CryptoPool.hh>
 #include <infinit/model/doughnut/Doughnut.hh>
 #include <infinit/model/doughnut/NB.hh>
 
@@ -121,7 +122,9 @@ namespace infinit
         ELLE_DEBUG("%s: check signature", *this)
         {
           auto signed_data = this->_data_sign();
-          if (!this->_owner->verify(this->signature(), signed_data))
+          if (!CryptoPool::instance().verify([&] {
+                return this->_owner->verify(this->signature(), signed_data);
+              }))
           {
             ELLE_DEBUG("%s: invalid signature", *this);
             return blocks::ValidationResult::failure("invalid signature");
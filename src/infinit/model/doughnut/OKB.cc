@@ -16,6 +16,7 @@
 #include <infinit/model/blocks/ACLBlock.hh>
 #include <infinit/model/blocks/MutableBlock.hh>
 #include <infinit/model/blocks/GroupBlock.hh>
+#include <infinit/model/doughnut/CryptoPool.hh>
 #include <infinit/model/doughnut/Doughnut.hh>
 #include <infinit/model/doughnut/Local.hh>
 #include <infinit/model/doughnut/Remote.hh>
@@ -367,7 +368,9 @@ namespace infinit
       {
         if (!this->_owner_private_key)
           elle::err("attempting to decrypt an unowned OKB");
-        return this->_owner_private_key->open(data);
+        return CryptoPool::instance().run(
+          CryptoPool::Operation::decrypt,
+          [&] { return this->_owner_private_key->open(data); });
       }
 
       /*-----------.
@@ -418,8 +421,10 @@ namespace infinit
         {
           ELLE_DEBUG_SCOPE("%s: data changed, seal", *this);
           ELLE_DUMP("%s: data: %s", *this, this->_data_plain);
-          auto encrypted =
-            this->doughnut()->keys().K().seal(this->_data_plain);
+          auto const& K = this->doughnut()->keys().K();
+          auto encrypted = CryptoPool::instance().run(
+            CryptoPool::Operation::encrypt,
+            [&] { return K.seal(this->_data_plain); });
           ELLE_DUMP("%s: encrypted data: %s", *this, encrypted);
           this->Block::data(std::move(encrypted));
           this->_seal_okb(version);
@@ -472,8 +477,11 @@ namespace infinit
           return blocks::ValidationResult::success();
         {
           ELLE_ASSERT(this->signature() != elle::Buffer());
+          auto const& signature = this->signature();
           auto sign = this->_sign();
-          if (!this->_owner_key->verify(this->signature(), *sign))
+          if (!CryptoPool::instance().verify([&] {
+                return this->_owner_key->verify(signature, *sign);
+              }))
           {
             ELLE_TRACE("invalid signature for version %s: %x",
               this->_version, this->signature());
@@ -497,7 +505,8 @@ namespace infinit
       {
         ELLE_DUMP("%s: check %f signs %s with %s",
                   *this, signature, data, key);
-        if (!key.verify(signature, data))
+        if (!CryptoPool::instance().verify(
+              [&] { return key.verify(signature, data); }))
         {
           ELLE_TRACE("%s: %s signature is invalid", *this, name);
           return false;
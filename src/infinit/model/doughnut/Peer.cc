@@ -1,6 +1,7 @@
 #include <elle/log.hh>
 
 #include <infinit/model/doughnut/Peer.hh>
+#include <infinit/model/MissingBlock.hh>
 #include <infinit/model/blocks/MutableBlock.hh>
 
 ELLE_LOG_COMPONENT("infinit.model.doughnut.Peer");
@@ -51,6 +52,99 @@ namespace infinit
         return res;
       }
 
+      void
+      Peer::fetch(std::vector<AddressVersion> const& addresses,
+                  ReceiveBlock res) const
+      {
+        ELLE_TRACE_SCOPE("%s: fetch %s blocks", this, addresses.size());
+        auto versions = std::unordered_map<Address, boost::optional<int>>{};
+        for (auto const& a: addresses)
+          versions[a.first] = a.second;
+        this->_fetch(
+          addresses,
+          [&] (Address address, std::unique_ptr<blocks::Block> block,
+               std::exception_ptr e)
+          {
+            auto const local_version = versions.at(address);
+            if (local_version)
+              if (auto mb = dynamic_cast<blocks::MutableBlock*>(block.get()))
+                if (mb->version() == local_version.get())
+                  block.reset();
+            res(address, std::move(block), e);
+          });
+      }
+
+      void
+      Peer::_fetch(std::vector<AddressVersion> const& addresses,
+                   ReceiveBlock res) const
+      {
+        for (auto const& a: addresses)
+        {
+          std::unique_ptr<blocks::Block> block;
+          try
+          {
+            block = this->_fetch(a.first, a.second);
+          }
+          catch (elle::Error const&)
+          {
+            res(a.first, nullptr, std::current_exception());
+            continue;
+          }
+          res(a.first, std::move(block), {});
+        }
+      }
+
+      /*------------.
+      | Fetch reply |
+      `------------*/
+
+      Peer::FetchReply::FetchReply(elle::serialization::SerializerIn& s,
+                                   elle::Version const& v)
+      {
+        this->serialize(s, v);
+      }
+
+      void
+      Peer::FetchReply::serialize(elle::serialization::Serializer& s,
+                                  elle::Version const&)
+      {
+        s.serialize("blocks", this->blocks);
+        s.serialize("current", this->current);
+        s.serialize("missing", this->missing);
+        s.serialize("errors", this->errors);
+      }
+
+      auto
+      Peer::fetch_reply(std::vector<AddressVersion> const& addresses) const
+        -> FetchReply
+      {
+        auto reply = FetchReply{};
+        this->fetch(
+          addresses,
+          [&] (Address address, std::unique_ptr<blocks::Block> block,
+               std::exception_ptr e)
+          {
+            if (block)
+              reply.blocks.emplace(address, std::move(block));
+            else if (!e)
+              reply.current.emplace_back(address);
+            else
+              try
+              {
+                std::rethrow_exception(e);
+              }
+              catch (MissingBlock const&)
+              {
+                reply.missing.emplace_back(address);
+              }
+              catch (elle::Error const& error)
+              {
+                reply.errors.emplace(address, error.what());
+              }
+          });
+        return reply;
+      }
+
       /*-----.
       | Keys |
       `-----*/
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/signals2.hpp>
 
@@ -45,12 +47,21 @@ namespace infinit
       | Blocks |
       `-------*/
       public:
+        using AddressVersion = Model::AddressVersion;
+        using ReceiveBlock = Model::ReceiveBlock;
         virtual
         void
         store(blocks::Block const& block, StoreMode mode) = 0;
         std::unique_ptr<blocks::Block>
         fetch(Address address,
               boost::optional<int> local_version) const;
+        /// Fetch several blocks at once.
+        ///
+        /// Blocks that are up to date with their local version are
+        /// reported as null.
+        void
+        fetch(std::vector<AddressVersion> const& addresses,
+              ReceiveBlock res) const;
         virtual
         void
         remove(Address address, blocks::RemoveSignature rs) = 0;
@@ -59,6 +70,38 @@ namespace infinit
         std::unique_ptr<blocks::Block>
         _fetch(Address address,
                boost::optional<int> local_version) const = 0;
+        /// Fetch blocks one by one, unless overriden.
+        virtual
+        void
+        _fetch(std::vector<AddressVersion> const& addresses,
+               ReceiveBlock res) const;
+
+      /*------------.
+      | Fetch reply |
+      `------------*/
+      public:
+        /// The reply to a batched fetch.
+        struct FetchReply
+        {
+          FetchReply() = default;
+          FetchReply(elle::serialization::SerializerIn& s,
+                     elle::Version const& v);
+          void
+          serialize(elle::serialization::Serializer& s,
+                    elle::Version const& v);
+          using serialization_tag = infinit::serialization_tag;
+          /// Fetched blocks.
+          std::unordered_map<Address, std::unique_ptr<blocks::Block>> blocks;
+          /// Blocks that are up to date with their local version.
+          std::vector<Address> current;
+          /// Blocks that do not exist.
+          std::vector<Address> missing;
+          /// Blocks that could not be fetched, with the reason.
+          std::unordered_map<Address, std::string> errors;
+        };
+        /// Run a batched fetch and gather the results.
+        FetchReply
+        fetch_reply(std::vector<AddressVersion> const& addresses) const;
 
       /*-----.
       | Keys |
@@ -10,10 +10,12 @@
 #include <elle/utils.hh>
 
 #include <elle/reactor/Scope.hh>
+#include <elle/reactor/for-each.hh>
 #include <elle/reactor/scheduler.hh>
 #include <elle/reactor/Thread.hh>
 
 #include <infinit/RPC.hh>
+#include <infinit/model/MissingBlock.hh>
 
 ELLE_LOG_COMPONENT("infinit.model.doughnut.Remote")
 
@@ -205,7 +207,7 @@ namespace infinit
         ELLE_ASSERT(&block);
         ELLE_TRACE_SCOPE("%s: store %f", *this, block);
         using Store = auto (blocks::Block const&, StoreMode) -> void;
-        auto store = this->make_rpc<Store>("store");
+        auto store = this->make_block_rpc<Store>("store");
         store.set_context<Doughnut*>(&this->_doughnut);
         store(block, mode);
       }
@@ -217,11 +219,68 @@ namespace infinit
         BENCH("fetch");
         using Fetch = auto (Address, boost::optional<int>)
           -> std::unique_ptr<blocks::Block>;
-        auto fetch = elle::unconst(this)->make_rpc<Fetch>("fetch");
+        auto fetch = elle::unconst(this)->make_block_rpc<Fetch>("fetch");
         fetch.set_context<Doughnut*>(&this->_doughnut);
         return fetch(std::move(address), std::move(local_version));
       }
 
+      void
+      Remote::_fetch(std::vector<AddressVersion> const& addresses,
+                     ReceiveBlock res) const
+      {
+        if (this->_doughnut.version() < elle::Version(0, 10, 0))
+          return Peer::_fetch(addresses, res);
+        BENCH("fetch_many");
+        ELLE_TRACE_SCOPE("%s: fetch %s blocks", *this, addresses.size());
+        // Split large requests so results start flowing back early and
+        // messages remain bounded.
+        static auto const batch_size =
+          std::max(elle::os::getenv("INFINIT_FETCH_BATCH_SIZE", 64), 1);
+        auto batches = std::vector<std::vector<AddressVersion>>{};
+        for (auto it = addresses.begin(); it != addresses.end();)
+        {
+          auto const end =
+            it + std::min<std::ptrdiff_t>(batch_size, addresses.end() - it);
+          batches.emplace_back(it, end);
+          it = end;
+        }
+        using FetchMany =
+          auto (std::vector<AddressVersion> const&) -> FetchReply;
+        elle::reactor::for_each_parallel(
+          batches,
+          [&] (std::vector<AddressVersion> const& batch)
+          {
+            auto fetch = elle::unconst(this)->make_block_rpc<FetchMany>("fetch_many");
+            fetch.set_context<Doughnut*>(&this->_doughnut);
+            auto reply = FetchReply{};
+            try
+            {
+              reply = fetch(batch);
+            }
+            catch (UnknownRPC const& e)
+            {
+              ELLE_DEBUG("%s: batched fetch unsupported: %s", this, e);
+              return Peer::_fetch(batch, res);
+            }
+            catch (elle::Error const&)
+            {
+              auto e = std::current_exception();
+              for (auto const& a: batch)
+                res(a.first, nullptr, e);
+              return;
+            }
+            for (auto& b: reply.blocks)
+              res(b.first, std::move(b.second), {});
+            for (auto const& a: reply.current)
+              res(a, nullptr, {});
+            for (auto const& a: reply.missing)
+              res(a, nullptr, std::make_exception_ptr(MissingBlock(a)));
+            for (auto const& e: reply.errors)
+              res(e.first, nullptr,
+                  std::make_exception_ptr(elle::Error(e.second)));
+          });
+      }
+
       void
       Remote::remove(Address address, blocks::RemoveSignature rs)
       {
@@ -102,6 +102,11 @@ namespace infinit
         template <typename F>
         RemoteRPC<F>
         make_rpc(std::string const& name);
+        /// Build a remote procedure exchanging blocks, which are only
+        /// authenticated in transit if they are encrypted at rest.
+        template <typename F>
+        RemoteRPC<F>
+        make_block_rpc(std::string const& name);
         template <typename Op>
         auto
         safe_perform(std::string const& name, Op op)
@@ -121,6 +126,10 @@ namespace infinit
         std::unique_ptr<blocks::Block>
         _fetch(Address address,
               boost::optional<int> local_version) const override;
+        /// Fetch blocks in batches of a single message each.
+        void
+        _fetch(std::vector<AddressVersion> const& addresses,
+               ReceiveBlock res) const override;
 
       /*-----.
       | Keys |
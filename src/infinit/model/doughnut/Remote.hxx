@@ -31,6 +31,9 @@ namespace infinit
             // disconnect/reconnect concurrently.
             auto connection = this->_remote->_connection;
             this->_channels = connection->channels().get();
+            this->procedures(&connection->procedures());
+            this->framing(connection->framing());
+            this->streaming(connection->streaming());
             auto creds = _remote->credentials();
             if (!creds.empty())
             {
@@ -166,6 +169,16 @@ namespace infinit
       {
         return RemoteRPC<F>(name, this);
       }
+
+      template <typename F>
+      RemoteRPC<F>
+      Remote::make_block_rpc(std::string const& name)
+      {
+        auto res = this->make_rpc<F>(name);
+        // Blocks encrypted at rest need not be enciphered again in transit.
+        res.ciphertext(this->doughnut().encrypt_options().encrypt_at_rest);
+        return res;
+      }
     }
   }
 }
@@ -8,6 +8,8 @@
 
 #include <elle/serialization/json.hh>
 
+#include <infinit/model/doughnut/CryptoPool.hh>
+
 ELLE_LOG_COMPONENT("infinit.model.doughnut.UB");
 
 namespace infinit
@@ -145,7 +147,9 @@ namespace infinit
         if (!sig.signature_key || !sig.signature)
           return blocks::ValidationResult::failure("Missing key or signature");
         auto to_sign = elle::serialization::binary::serialize((Block*)elle::unconst(this));
-        bool ok = sig.signature_key->verify(*sig.signature, to_sign);
+        bool ok = CryptoPool::instance().verify([&] {
+            return sig.signature_key->verify(*sig.signature, to_sign);
+          });
         if (!ok)
           return blocks::ValidationResult::failure("Invalid signature");
         if (*sig.signature_key != *dht.owner()
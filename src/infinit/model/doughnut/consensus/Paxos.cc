@@ -1,8 +1,11 @@
 #include <infinit/model/doughnut/consensus/Paxos.hh>
 
+#include <algorithm>
 #include <functional>
+#include <unordered_set>
 #include <utility>
 
+#include <boost/algorithm/cxx11/any_of.hpp>
 #include <boost/range/adaptor/filtered.hpp>
 #include <boost/range/adaptor/transformed.hpp>
 #include <boost/range/algorithm/sort.hpp>
@@ -30,6 +33,7 @@
 #include <infinit/model/doughnut/Remote.hh>
 #include <infinit/model/doughnut/DummyPeer.hh>
 #include <infinit/model/doughnut/ACB.hh>
+#include <infinit/model/doughnut/CCHB.hh>
 #include <infinit/model/blocks/ImmutableBlock.hh>
 #include <infinit/model/doughnut/OKB.hh>
 #include <infinit/model/doughnut/ValidationFailed.hh>
@@ -52,6 +56,26 @@ namespace infinit
         using boost::adaptors::filtered;
         using boost::adaptors::transformed;
 
+        namespace
+        {
+          /// Flag of the silo keys of phase records.
+          uint8_t constexpr phases_flag = 2;
+          /// Phases recorded apart before a decision is stored again.
+          int constexpr max_phases = 8;
+
+          /// The silo key of the phases recorded for the decision at
+          /// `address`.
+          Address
+          phases_key(Address address)
+          {
+            auto salted = elle::Buffer("paxos phases", 12);
+            salted.append(address.value(), sizeof(Address::Value));
+            auto const hash = elle::cryptography::hash(
+              salted, elle::cryptography::Oneway::sha256);
+            return {hash.contents(), phases_flag, true};
+          }
+        }
+
         /// Run `f`, translating possible network errors into Paxos
         /// exceptions.
         template<typename F>
@@ -152,12 +176,45 @@ namespace infinit
         | Construction |
         `-------------*/
 
+#if INFINIT_ENABLE_PROMETHEUS
+        static
+        prometheus::CounterPtr
+        make_read_lease_counter(Doughnut const& dht, std::string const& event)
+        {
+          static auto* family
+            = prometheus::instance().make_counter_family(
+              "infinit_paxos_read_lease_events",
+              "How many fetches hit or missed a Paxos read lease, "
+              "and how many read leases were acquired and revoked");
+          return prometheus::instance().make(
+            family,
+            {
+              {"id", elle::sprintf("%f", dht.id())},
+              {"event", event},
+            });
+        }
+#endif
+
+        static
+        std::chrono::system_clock::duration
+        duration_from_env(std::string const& name,
+                          std::chrono::system_clock::duration d)
+        {
+          return std::chrono::milliseconds(
+            elle::os::getenv(
+              name,
+              int(std::chrono::duration_cast<std::chrono::milliseconds>(
+                    d).count())));
+        }
+
         Paxos::Paxos(Doughnut& doughnut,
                      int factor,
                      bool lenient_fetch,
                      bool rebalance_auto_expand,
                      bool rebalance_inspect,
-                     std::chrono::system_clock::duration node_timeout)
+                     std::chrono::system_clock::duration node_timeout,
+                     std::chrono::system_clock::duration lease,
+                     std::chrono::system_clock::duration read_lease)
           : Super(doughnut)
           , _factor(factor)
           , _lenient_fetch(elle::os::getenv("INFINIT_PAXOS_LENIENT_FETCH",
@@ -165,6 +222,25 @@ namespace infinit
           , _rebalance_auto_expand(rebalance_auto_expand)
           , _rebalance_inspect(rebalance_inspect)
           , _node_timeout(node_timeout)
+          , _lease(duration_from_env("INFINIT_PAXOS_LEASE", lease))
+          , _read_lease(
+            duration_from_env("INFINIT_PAXOS_READ_LEASE", read_lease))
+          , _leased(0)
+          , _lease_fallbacks(0)
+          , _leases_sweep(64)
+          , _read_lease_hits(0)
+          , _read_lease_misses(0)
+          , _read_leases_acquired(0)
+#if INFINIT_ENABLE_PROMETHEUS
+          , _read_lease_hits_counter(
+            make_read_lease_counter(this->doughnut(), "hit"))
+          , _read_lease_misses_counter(
+            make_read_lease_counter(this->doughnut(), "miss"))
+          , _read_lease_acquired_counter(
+            make_read_lease_counter(this->doughnut(), "acquired"))
+          , _read_lease_revoked_counter(
+            make_read_lease_counter(this->doughnut(), "revoked"))
+#endif
         {}
 
         /*--------.
@@ -216,13 +292,18 @@ namespace infinit
           PaxosPeer(overlay::Overlay::WeakMember member,
                     Address address,
                     boost::optional<int> local_version,
-                    bool insert)
+                    bool insert,
+                    boost::optional<Paxos::Peer::GetResult> prefetched = {},
+                    Paxos::Grants* grants = nullptr)
             : Paxos::PaxosClient::Peer((ELLE_ASSERT(member.lock()),
                                         member.lock()->id()))
             , _member(std::dynamic_pointer_cast<Paxos::Peer>(std::move(member)))
             , _address(address)
             , _local_version(local_version)
             , _insert(insert)
+            , _prefetched(std::move(prefetched))
+            , _grants(grants)
+            , _read_grants(nullptr)
           {
             if (!this->_member.lock())
               ELLE_ABORT("invalid paxos peer: %s", member);
@@ -276,7 +357,20 @@ namespace infinit
             return translate_exceptions("confirm",
               [&]
               {
-                if (member->doughnut().version() >= elle::Version(0, 5, 0))
+                if (member->doughnut().version() < elle::Version(0, 5, 0))
+                  return;
+                // Only promises of our own next version make a lease.
+                if (this->_grants && p.sender == member->doughnut().id())
+                {
+                  auto next = p;
+                  ++next.version;
+                  if (member->confirm_lease(q, this->_address, p, next))
+                  {
+                    this->_grants->granted.insert(this->id());
+                    this->_grants->next = next;
+                  }
+                }
+                else
                   member->confirm(q, this->_address, p);
               });
           }
@@ -285,11 +379,31 @@ namespace infinit
           get(Paxos::PaxosClient::Quorum const& q) override
           {
             BENCH("get");
+            // Use the state obtained by a batched get, if it was read with
+            // the same quorum.
+            if (this->_prefetched)
+            {
+              auto prefetched = std::move(*this->_prefetched);
+              this->_prefetched.reset();
+              if (prefetched.first == q)
+                return std::move(prefetched.second);
+            }
             auto member = this->_lock_member();
             return translate_exceptions("get",
               [&]
               {
-                return member->get(q, this->_address, this->_local_version);
+                if (!this->_read_grants)
+                  return member->get(q, this->_address, this->_local_version);
+                auto res = member->get_lease(
+                  q, this->_address, this->_local_version,
+                  this->_read_grants->holder);
+                if (res.first > std::chrono::system_clock::duration::zero())
+                {
+                  this->_read_grants->granted.insert(this->id());
+                  this->_read_grants->duration =
+                    std::min(this->_read_grants->duration, res.first);
+                }
+                return std::move(res.second);
               });
           }
 
@@ -297,6 +411,11 @@ namespace infinit
           ELLE_ATTRIBUTE(Address, address);
           ELLE_ATTRIBUTE(boost::optional<int>, local_version);
           ELLE_ATTRIBUTE(bool, insert);
+          ELLE_ATTRIBUTE(boost::optional<Paxos::Peer::GetResult>, prefetched);
+          /// Where to collect the promises of the next version, if leasing.
+          ELLE_ATTRIBUTE(Paxos::Grants*, grants);
+          /// Where to collect the read leases granted, if acquiring one.
+          ELLE_ATTRIBUTE_RW(Paxos::ReadGrants*, read_grants);
         };
 
         static
@@ -329,6 +448,38 @@ namespace infinit
           : Super(dht, id)
         {}
 
+        auto
+        Paxos::Peer::get_many(std::vector<AddressVersion> const&)
+          -> GetResults
+        {
+          return {};
+        }
+
+        bool
+        Paxos::Peer::confirm_lease(PaxosServer::Quorum const& peers,
+                                   Address address,
+                                   PaxosClient::Proposal const& p,
+                                   PaxosClient::Proposal const&)
+        {
+          this->confirm(peers, address, p);
+          return false;
+        }
+
+        auto
+        Paxos::Peer::get_lease(PaxosServer::Quorum const& peers,
+                               Address address,
+                               boost::optional<int> local_version,
+                               Address)
+          -> ReadLeased
+        {
+          return {std::chrono::system_clock::duration::zero(),
+                  this->get(peers, address, local_version)};
+        }
+
+        void
+        Paxos::Peer::revoke_read_lease(Address)
+        {}
+
         /*-----------.
         | RemotePeer |
         `-----------*/
@@ -390,7 +541,7 @@ namespace infinit
                         Paxos::PaxosClient::Proposal const&,
                         std::shared_ptr<blocks::Block>)
                   -> Paxos::PaxosClient::Proposal;
-                auto accept = this->make_rpc<Accept>("accept");
+                auto accept = this->make_block_rpc<Accept>("accept");
                 accept.set_context<Doughnut*>(&this->_doughnut);
                 return accept(peers, address, p,
                               value.get<std::shared_ptr<blocks::Block>>());
@@ -429,6 +580,37 @@ namespace infinit
             });
         }
 
+        bool
+        Paxos::RemotePeer::confirm_lease(PaxosServer::Quorum const& peers,
+                                         Address address,
+                                         PaxosClient::Proposal const& p,
+                                         PaxosClient::Proposal const& next)
+        {
+          if (this->doughnut().version() < elle::Version(0, 10, 0))
+            return Paxos::Peer::confirm_lease(peers, address, p, next);
+          try
+          {
+            return translate_exceptions("confirm_lease",
+              [&]
+              {
+                using ConfirmLease =
+                  auto (PaxosServer::Quorum,
+                        Address,
+                        PaxosClient::Proposal const&,
+                        PaxosClient::Proposal const&)
+                  -> bool;
+                auto confirm = this->make_rpc<ConfirmLease>("confirm_lease");
+                confirm.set_context<Doughnut*>(&this->_doughnut);
+                return confirm(peers, address, p, next);
+              });
+          }
+          catch (UnknownRPC const& e)
+          {
+            ELLE_DEBUG("%s: leases unsupported, confirm only: %s", this, e);
+            return Paxos::Peer::confirm_lease(peers, address, p, next);
+          }
+        }
+
         boost::optional<Paxos::PaxosClient::Accepted>
         Paxos::RemotePeer::get(PaxosServer::Quorum const& peers,
                                Address address,
@@ -440,12 +622,85 @@ namespace infinit
               using Get =
                 auto (PaxosServer::Quorum, Address, boost::optional<int>)
                 -> boost::optional<PaxosClient::Accepted>;
-              auto get = this->make_rpc<Get>("get");
+              auto get = this->make_block_rpc<Get>("get");
               get.set_context<Doughnut*>(&this->_doughnut);
               return get(peers, address, local_version);
             });
         }
 
+        auto
+        Paxos::RemotePeer::get_lease(PaxosServer::Quorum const& peers,
+                                     Address address,
+                                     boost::optional<int> local_version,
+                                     Address holder)
+          -> ReadLeased
+        {
+          if (this->doughnut().version() < elle::Version(0, 10, 0))
+            return Paxos::Peer::get_lease(peers, address, local_version, holder);
+          try
+          {
+            return translate_exceptions("get_lease",
+              [&]
+              {
+                using GetLease =
+                  auto (PaxosServer::Quorum,
+                        Address,
+                        boost::optional<int>,
+                        Address)
+                  -> ReadLeased;
+                auto get = this->make_block_rpc<GetLease>("get_lease");
+                get.set_context<Doughnut*>(&this->_doughnut);
+                return get(peers, address, local_version, holder);
+              });
+          }
+          catch (UnknownRPC const& e)
+          {
+            ELLE_DEBUG("%s: read leases unsupported, get only: %s", this, e);
+            return Paxos::Peer::get_lease(
+              peers, address, local_version, holder);
+          }
+        }
+
+        void
+        Paxos::RemotePeer::revoke_read_lease(Address address)
+        {
+          if (this->doughnut().version() < elle::Version(0, 10, 0))
+            return;
+          translate_exceptions("revoke_read_lease",
+            [&]
+            {
+              using Revoke = auto (Address) -> void;
+              auto revoke = this->make_rpc<Revoke>("revoke_read_lease");
+              revoke.set_context<Doughnut*>(&this->_doughnut);
+              revoke(address);
+            });
+        }
+
+        auto
+        Paxos::RemotePeer::get_many(std::vector<AddressVersion> const& addresses)
+          -> GetResults
+        {
+          if (this->doughnut().version() < elle::Version(0, 10, 0))
+            return {};
+          try
+          {
+            return translate_exceptions("get_many",
+              [&]
+              {
+                using GetMany =
+                  auto (std::vector<AddressVersion> const&) -> GetResults;
+                auto get_many = this->make_block_rpc<GetMany>("get_many");
+                get_many.set_context<Doughnut*>(&this->_doughnut);
+                return get_many(addresses);
+              });
+          }
+          catch (UnknownRPC const& e)
+          {
+            ELLE_DEBUG("%s: batched get unsupported: %s", this, e);
+            return {};
+          }
+        }
+
         void
         Paxos::RemotePeer::store(blocks::Block const& block, StoreMode mode)
         {
@@ -507,7 +762,7 @@ namespace infinit
                   {
                     ELLE_TRACE_SCOPE("%s: inspect disk blocks for rebalancing",
                                      this);
-                    for (auto const& address: this->storage()->list())
+                    for (auto const& address: this->addresses())
                     {
                       elle::reactor::sleep(100_ms);
                       try
@@ -589,8 +844,11 @@ namespace infinit
               return stored;
             }
             else if (stored.paxos)
+            {
+              this->_replay(address, *stored.paxos);
               return BlockOrPaxos(
                 &this->_load_paxos(address, std::move(*stored.paxos)));
+            }
             else
               ELLE_ABORT("no block and no paxos?");
           }
@@ -809,8 +1067,12 @@ namespace infinit
           send_immutable_block(Paxos& self,
                                Peers&& peers,
                                blocks::Block const& b,
-                               PaxosClient::Quorum current)
+                               PaxosClient::Quorum current,
+                               bool replica = false)
           {
+            // Replicas carry the CCHB referrers kept by storage nodes.
+            auto const mode = replica && dynamic_cast<CCHB const*>(&b) ?
+              STORE_REPLICATE : STORE_INSERT;
             std::vector<std::shared_ptr<Paxos::Peer>> reached;
             std::vector<std::shared_ptr<Paxos::Peer>> to_confirm;
             ELLE_TRACE_SCOPE("send block to {}", peers);
@@ -836,7 +1098,7 @@ namespace infinit
                 try
                 {
                   ELLE_DEBUG_SCOPE("send block to {}", peer);
-                  peer->store(b, STORE_INSERT);
+                  peer->store(b, mode);
                   reached.emplace_back(peer);
                   to_confirm.emplace_back(peer);
                   current.insert(peer->id());
@@ -932,7 +1194,8 @@ namespace infinit
                         this->paxos(),
                         this->doughnut().overlay()->lookup_nodes(new_q),
                         *block.block,
-                        q))
+                        q,
+                        true))
                       this->_rebalanced(address);
                 }
               }
@@ -987,7 +1250,8 @@ namespace infinit
                           this->paxos(),
                           this->doughnut().overlay()->lookup_nodes(quorum_new),
                           *b.block,
-                          quorum_current))
+                          quorum_current,
+                          true))
                     {
                       ELLE_TRACE("successfully duplicated %f to %f",
                                  target.address, address);
@@ -1063,11 +1327,7 @@ namespace infinit
             address, insert ? boost::optional<PaxosServer::Quorum>(peers)
                             : boost::optional<PaxosServer::Quorum>());
           auto res = decision.paxos.propose(peers, p);
-          BlockOrPaxos data(&decision);
-          this->storage()->set(
-            address,
-            elle::serialization::binary::serialize(data, this->doughnut().version()),
-            true, true);
+          this->_record(address, decision, Phase(false, peers, p));
           return res;
         }
 
@@ -1100,16 +1360,12 @@ namespace infinit
               if (!valres)
                 throw Conflict("peer validation failed", block->clone());
             }
+          // Nobody may read the previous value locally once it is replaced.
+          if (paxos.current_value())
+            this->_revoke_read_leases(address);
           auto res = paxos.accept(std::move(peers), p, value);
-          {
-            ELLE_DEBUG_SCOPE("store accepted paxos");
-            BlockOrPaxos data(&decision);
-            this->storage()->set(
-              address,
-              elle::serialization::binary::serialize(
-                data, this->doughnut().version()),
-              true, true);
-          }
+          ELLE_DEBUG("store accepted paxos")
+            this->_write(address, decision, "accept");
           if (block)
             this->on_store()(*block);
           return res;
@@ -1139,15 +1395,8 @@ namespace infinit
             decision.paxos.confirm(peers, p);
             ELLE_DEBUG("store confirmed paxos")
             {
-              BlockOrPaxos data(&decision);
-              auto ser = [&]
-              {
-                BENCH("confirm.storage");
-                auto res = elle::serialization::binary::serialize(
-                  data, this->doughnut().version());
-                return res;
-              }();
-              this->storage()->set(address, ser, true, true);
+              BENCH("confirm.storage");
+              this->_record(address, decision, Phase(true, peers, p));
             }
             auto const& quorum = decision.paxos.current_quorum();
             if (!contains(quorum, this->doughnut().id()))
@@ -1181,6 +1430,39 @@ namespace infinit
           }
         }
 
+        bool
+        Paxos::LocalPeer::confirm_lease(PaxosServer::Quorum const& peers,
+                                        Address address,
+                                        Paxos::PaxosClient::Proposal const& p,
+                                        Paxos::PaxosClient::Proposal const& next)
+        {
+          this->confirm(peers, address, p);
+          ELLE_TRACE_SCOPE("%s: promise %s on %f for lease", *this, next, address);
+          if (next.version != p.version + 1 || next.sender != p.sender)
+            return false;
+          // Immutable, or evicted from the quorum.
+          auto decision = elle::find(this->_addresses, address);
+          if (!decision)
+            return false;
+          try
+          {
+            // The next version being promised ahead, its proposer can pick
+            // any value as long as nothing was accepted yet.
+            if (auto accepted = decision->second.paxos.propose(peers, next))
+            {
+              ELLE_DEBUG("refuse lease, %s was accepted", accepted->proposal);
+              return false;
+            }
+          }
+          catch (elle::Error const& e)
+          {
+            ELLE_DEBUG("refuse lease: %s", e);
+            return false;
+          }
+          this->_record(address, decision->second, Phase(false, peers, next));
+          return true;
+        }
+
         boost::optional<Paxos::PaxosClient::Accepted>
         Paxos::LocalPeer::get(PaxosServer::Quorum const& peers,
                               Address address,
@@ -1203,6 +1485,27 @@ namespace infinit
           return res;
         }
 
+        auto
+        Paxos::LocalPeer::get_many(std::vector<AddressVersion> const& addresses)
+          -> GetResults
+        {
+          ELLE_TRACE_SCOPE("%s: get %s blocks", *this, addresses.size());
+          auto res = GetResults{};
+          for (auto const& a: addresses)
+            try
+            {
+              auto quorum = this->_load_paxos(a.first).paxos.current_quorum();
+              auto accepted = this->get(quorum, a.first, a.second);
+              res.emplace(a.first,
+                          GetResult(std::move(quorum), std::move(accepted)));
+            }
+            catch (elle::Error const& e)
+            {
+              ELLE_DEBUG("omit %f: %s", a.first, e);
+            }
+          return res;
+        }
+
         void
         Paxos::LocalPeer::_register_rpcs(Connection& connection)
         {
@@ -1259,6 +1562,17 @@ namespace infinit
             {
               return this->confirm(q, a, p);
             });
+          if (this->doughnut().version() >= elle::Version(0, 10, 0))
+            rpcs.add(
+              "confirm_lease",
+              [this, &rpcs](PaxosServer::Quorum q,
+                            Address a,
+                            Paxos::PaxosClient::Proposal const& p,
+                            Paxos::PaxosClient::Proposal const& next)
+              {
+                this->_require_auth(rpcs, true);
+                return this->confirm_lease(std::move(q), a, p, next);
+              });
           rpcs.add(
             "get",
             [this](PaxosServer::Quorum q, Address a,
@@ -1266,6 +1580,39 @@ namespace infinit
             {
               return this->get(q, a, v);
             });
+          if (this->doughnut().version() >= elle::Version(0, 10, 0))
+          {
+            rpcs.add(
+              "get_lease",
+              [this, &rpcs, &connection](PaxosServer::Quorum q,
+                                         Address a,
+                                         boost::optional<int> v,
+                                         Address holder)
+              {
+                // A lease delays writes until revoked: only grant it to
+                // writers, for themselves.
+                this->_require_auth(rpcs, true);
+                if (holder != connection.id())
+                  elle::err("read lease requested by %f for %f",
+                            connection.id(), holder);
+                return this->get_lease(std::move(q), a, v, holder);
+              });
+            rpcs.add(
+              "revoke_read_lease",
+              [this, &rpcs](Address a)
+              {
+                this->_require_auth(rpcs, false);
+                this->revoke_read_lease(a);
+              });
+          }
+          if (this->doughnut().version() >= elle::Version(0, 10, 0))
+            rpcs.add(
+              "get_many",
+              [this, &rpcs](std::vector<AddressVersion> const& addresses)
+              {
+                this->_require_auth(rpcs, false);
+                return this->get_many(addresses);
+              });
         }
 
         std::unique_ptr<blocks::Block>
@@ -1347,15 +1694,8 @@ namespace infinit
               // FIXME: factor with the end of doughnut::Local::store
               ELLE_DEBUG("%s: store chosen block", *this)
               elle::unconst(decision->second).chosen = version;
-              {
-                BlockOrPaxos data(const_cast<Decision*>(&decision->second));
-                this->storage()->set(
-                  address,
-                  elle::serialization::binary::serialize(
-                    data,
-                    this->doughnut().version()),
-                  true, true);
-              }
+              const_cast<LocalPeer*>(this)->_write(
+                address, elle::unconst(decision->second), "choose");
               // ELLE_ASSERT(block.unique());
               // FIXME: Don't clone, it's useless, find a way to steal
               // ownership from the shared_ptr.
@@ -1379,6 +1719,9 @@ namespace infinit
               throw ValidationFailed(res.reason());
           if (!dynamic_cast<blocks::ImmutableBlock const*>(&block))
             throw ValidationFailed("bypassing Paxos for a mutable block");
+          auto const mutex = this->_lock(block.address());
+          elle::reactor::Lock lock(*mutex);
+          auto const cchb = dynamic_cast<CCHB const*>(&block);
           // validate with previous version
           try
           {
@@ -1393,6 +1736,12 @@ namespace infinit
               throw ValidationFailed(
                 elle::sprintf("storing immutable block on mutable block %f",
                               block.address()));
+            else if (auto shared =
+                     dynamic_cast<CCHB const*>(stored.block.get()))
+            {
+              if (cchb)
+                return this->_store(*cchb, shared, mode);
+            }
             else
             {
               auto vr = stored.block->validate(this->doughnut(), block);
@@ -1405,18 +1754,11 @@ namespace infinit
           }
           catch (silo::MissingKey const&)
           {}
-          elle::Buffer data =
-            [&]
-            {
-              BlockOrPaxos b(const_cast<blocks::Block&>(block));
-              auto res = elle::serialization::binary::serialize(
-                b, this->doughnut().version());
-              b.block.release();
-              return res;
-            }();
-          this->storage()->set(block.address(), data,
-                              mode == STORE_INSERT,
-                              mode == STORE_UPDATE);
+          if (cchb)
+            return this->_store(*cchb, nullptr, mode);
+          this->storage()->set(block.address(), this->_serialize(block),
+                              mode != STORE_UPDATE,
+                              mode != STORE_INSERT);
           this->on_store()(block);
         }
 
@@ -1424,6 +1766,8 @@ namespace infinit
         Paxos::LocalPeer::remove(Address address, blocks::RemoveSignature rs)
         {
           ELLE_TRACE_SCOPE("%s: remove %f", this, address);
+          auto const mutex = this->_lock(address);
+          elle::reactor::Lock lock(*mutex);
           if (this->doughnut().version() >= elle::Version(0, 4, 0))
           {
             try
@@ -1455,6 +1799,9 @@ namespace infinit
                     throw Conflict(valres.reason(), previous.clone());
                   else
                     throw ValidationFailed(valres.reason());
+                if (auto shared = dynamic_cast<CCHB*>(&previous))
+                  if (this->_release(*shared, rs))
+                    return;
               }
             }
             catch (silo::MissingKey const& k)
@@ -1465,9 +1812,133 @@ namespace infinit
           this->_remove(address);
         }
 
+        elle::Buffer
+        Paxos::LocalPeer::_serialize(blocks::Block const& block)
+        {
+          BlockOrPaxos b(const_cast<blocks::Block&>(block));
+          auto res = elle::serialization::binary::serialize(
+            b, this->doughnut().version());
+          b.block.release();
+          return res;
+        }
+
+        void
+        Paxos::LocalPeer::_write(Address address,
+                                 Decision& decision,
+                                 std::string phase)
+        {
+          // Phases recorded so far are obsolete once stored again.
+          ++decision.sequence;
+          elle::SafeFinally restore([&] { --decision.sequence; });
+          BlockOrPaxos data(&decision);
+          auto const buffer = elle::serialization::binary::serialize(
+            data, this->doughnut().version());
+          this->storage()->set(address, buffer, true, true);
+          restore.abort();
+          decision.stored = true;
+          decision.phases.clear();
+          this->_written[phase] += buffer.size();
+        }
+
+        void
+        Paxos::LocalPeer::_record(Address address,
+                                  Decision& decision,
+                                  Phase phase)
+        {
+          auto const name = phase.confirm ? "confirm" : "propose";
+          // Phases are replayed on top of the stored decision, which older
+          // nodes do not know about.
+          if (this->doughnut().version() < elle::Version(0, 10, 0) ||
+              !decision.stored ||
+              signed(decision.phases.size()) >= max_phases)
+          {
+            this->_write(address, decision, name);
+            return;
+          }
+          ELLE_DEBUG_SCOPE("%s: record %s of %f at %s",
+                           this, name, address, phase.proposal);
+          decision.phases.emplace_back(std::move(phase));
+          elle::SafeFinally restore([&] { decision.phases.pop_back(); });
+          auto const buffer = elle::serialization::binary::serialize(
+            Phases(decision.sequence, decision.phases),
+            this->doughnut().version());
+          this->storage()->set(phases_key(address), buffer, true, true);
+          restore.abort();
+          this->_written[name] += buffer.size();
+        }
+
+        void
+        Paxos::LocalPeer::_replay(Address address, Decision& decision)
+        {
+          decision.stored = true;
+          if (this->doughnut().version() < elle::Version(0, 10, 0))
+            return;
+          auto buffer = elle::Buffer();
+          try
+          {
+            buffer = this->storage()->get(phases_key(address));
+          }
+          catch (silo::MissingKey const&)
+          {
+            return;
+          }
+          auto phases =
+            elle::serialization::binary::deserialize<Phases>(buffer, true);
+          if (phases.sequence != decision.sequence)
+          {
+            ELLE_DEBUG("%s: drop phases of %f recorded before it was stored",
+                       this, address);
+            return;
+          }
+          ELLE_DEBUG_SCOPE("%s: replay %s phases of %f",
+                           this, phases.phases.size(), address);
+          for (auto& phase: phases.phases)
+          {
+            if (phase.confirm)
+              decision.paxos.confirm(phase.quorum, phase.proposal);
+            else
+              decision.paxos.propose(phase.quorum, phase.proposal);
+            decision.phases.emplace_back(std::move(phase));
+          }
+        }
+
+        std::vector<Address>
+        Paxos::LocalPeer::addresses()
+        {
+          auto res = Super::addresses();
+          // Older addresses may bear any flag: phase records are the ones
+          // whose decision is stored too.
+          if (boost::algorithm::any_of(
+                res,
+                [] (Address const& a)
+                {
+                  return a.value()[Address::flag_byte] == phases_flag;
+                }))
+          {
+            auto phases = std::unordered_set<Address>{};
+            for (auto const& a: res)
+              phases.emplace(phases_key(a));
+            res.erase(
+              std::remove_if(
+                res.begin(), res.end(),
+                [&] (Address const& a) { return elle::contains(phases, a); }),
+              res.end());
+          }
+          return res;
+        }
+
         void
         Paxos::LocalPeer::_remove(Address address)
         {
+          // Holders must stop serving the block before it is gone.
+          this->_revoke_read_leases(address);
+          if (this->doughnut().version() >= elle::Version(0, 10, 0))
+            try
+            {
+              this->storage()->erase(phases_key(address));
+            }
+            catch (silo::MissingKey const&)
+            {}
           try
           {
             this->storage()->erase(address);
@@ -1481,6 +1952,215 @@ namespace infinit
           this->_addresses.erase(address);
         }
 
+        /*------------------------.
+        | LocalPeer: read leases |
+        `------------------------*/
+
+        auto
+        Paxos::LocalPeer::get_lease(PaxosServer::Quorum const& peers,
+                                    Address address,
+                                    boost::optional<int> local_version,
+                                    Address holder)
+          -> ReadLeased
+        {
+          ELLE_TRACE_SCOPE("%s: get %f for %f under read lease",
+                           *this, address, holder);
+          auto duration = this->_paxos.read_lease();
+          // Only replicas can read locally, and must be told when the value
+          // changes.
+          if (duration > std::chrono::system_clock::duration::zero() &&
+              address.mutable_block() &&
+              holder != this->id() &&
+              contains(this->_load_paxos(address).paxos.current_quorum(),
+                       holder))
+          {
+            this->_sweep_read_leases();
+            // Granted before reading, so any value accepted afterwards
+            // revokes it.
+            auto& expiry = this->_read_granted[address][holder];
+            expiry = std::max(
+              expiry, std::chrono::steady_clock::now() + duration);
+          }
+          else
+            duration = std::chrono::system_clock::duration::zero();
+          return {duration, this->get(peers, address, local_version)};
+        }
+
+        void
+        Paxos::LocalPeer::revoke_read_lease(Address address)
+        {
+          ELLE_TRACE("%s: drop read lease on %f", *this, address);
+          this->_read_leases.erase(address);
+        }
+
+        int64_t
+        Paxos::LocalPeer::read_lease_request(Address address)
+        {
+          this->_sweep_read_leases();
+          auto const token = ++this->_read_lease_tokens;
+          this->_read_leases[address] =
+            ReadLease{token, false, std::chrono::steady_clock::time_point()};
+          return token;
+        }
+
+        bool
+        Paxos::LocalPeer::read_lease_hold(
+          Address address,
+          int64_t token,
+          PaxosClient::Proposal const& chosen,
+          Quorum const& granted,
+          std::chrono::steady_clock::time_point expiry)
+        {
+          auto lease = this->_read_leases.find(address);
+          if (lease == this->_read_leases.end() || lease->second.token != token)
+          {
+            ELLE_DEBUG("%s: read lease on %f was revoked", *this, address);
+            return false;
+          }
+          auto held = [&]
+          {
+            auto decision = elle::find(this->_addresses, address);
+            if (!decision)
+              return false;
+            auto& paxos = decision->second.paxos;
+            auto const current = paxos.current_value();
+            if (!current || !(current->proposal == chosen))
+            {
+              ELLE_DEBUG("%s: local replica of %f is behind", *this, address);
+              return false;
+            }
+            // Any majority accepting a new value must then revoke the lease,
+            // or include this node.
+            auto const& quorum = paxos.current_quorum();
+            auto const size = signed(quorum.size());
+            auto const revoking = std::count_if(
+              quorum.begin(), quorum.end(),
+              [&] (Address id)
+              {
+                return id == this->id() || contains(granted, id);
+              });
+            return contains(quorum, this->id()) &&
+              revoking >= size - size / 2;
+          }();
+          if (held)
+          {
+            ELLE_TRACE("%s: hold read lease on %f granted by %f",
+                       *this, address, granted);
+            lease->second.held = true;
+            lease->second.expiry = expiry;
+          }
+          else
+            this->_read_leases.erase(lease);
+          return held;
+        }
+
+        boost::optional<Paxos::PaxosClient::Accepted>
+        Paxos::LocalPeer::read_leased(Address address)
+        {
+          auto lease = this->_read_leases.find(address);
+          if (lease == this->_read_leases.end() || !lease->second.held)
+            return boost::none;
+          auto decision = elle::find(this->_addresses, address);
+          if (lease->second.expiry <= std::chrono::steady_clock::now() ||
+              !decision)
+          {
+            this->_read_leases.erase(lease);
+            return boost::none;
+          }
+          return decision->second.paxos.current_value();
+        }
+
+        void
+        Paxos::LocalPeer::_sweep_read_leases()
+        {
+          if (this->_read_granted.size() + this->_read_leases.size() <
+              this->_read_granted_sweep)
+            return;
+          auto const now = std::chrono::steady_clock::now();
+          for (auto it = this->_read_granted.begin();
+               it != this->_read_granted.end();)
+          {
+            auto& holders = it->second;
+            for (auto h = holders.begin(); h != holders.end();)
+              if (h->second <= now)
+                h = holders.erase(h);
+              else
+                ++h;
+            if (holders.empty())
+              it = this->_read_granted.erase(it);
+            else
+              ++it;
+          }
+          // Leases still being requested are not held yet.
+          for (auto it = this->_read_leases.begin();
+               it != this->_read_leases.end();)
+            if (it->second.held && it->second.expiry <= now)
+              it = this->_read_leases.erase(it);
+            else
+              ++it;
+          this->_read_granted_sweep = std::max(
+            std::size_t(64),
+            2 * (this->_read_granted.size() + this->_read_leases.size()));
+        }
+
+        void
+        Paxos::LocalPeer::_revoke_read_leases(Address address)
+        {
+          this->_read_leases.erase(address);
+          if (this->_paxos.read_lease() ==
+              std::chrono::system_clock::duration::zero())
+            return;
+          auto wait = [] (std::chrono::steady_clock::time_point until)
+          {
+            auto const now = std::chrono::steady_clock::now();
+            if (until > now)
+              elle::reactor::sleep(
+                boost::posix_time::milliseconds(
+                  std::chrono::duration_cast<std::chrono::milliseconds>(
+                    until - now).count() + 1));
+          };
+          if (this->_read_granted_unknown > std::chrono::steady_clock::now())
+            ELLE_DEBUG("wait for read leases granted before startup")
+              wait(this->_read_granted_unknown);
+          // Revoking yields, during which more leases can be granted.
+          while (true)
+          {
+            auto it = this->_read_granted.find(address);
+            if (it == this->_read_granted.end())
+              return;
+            auto holders = std::move(it->second);
+            this->_read_granted.erase(it);
+            auto const now = std::chrono::steady_clock::now();
+            elle::reactor::for_each_parallel(
+              holders,
+              [&] (std::pair<Address const,
+                             std::chrono::steady_clock::time_point> const& h)
+              {
+                if (h.second <= now)
+                  return;
+                ELLE_TRACE_SCOPE("%s: revoke read lease on %f held by %f",
+                                 *this, address, h.first);
+                ++this->_read_lease_revocations;
+                prometheus::increment(this->_paxos._read_lease_revoked_counter);
+                try
+                {
+                  if (auto holder = to_paxos_peer(
+                        this->doughnut().overlay()->lookup_node(h.first)))
+                  {
+                    holder->revoke_read_lease(address);
+                    return;
+                  }
+                }
+                catch (elle::Error const& e)
+                {
+                  ELLE_TRACE("unable to revoke: %s", e);
+                }
+                ELLE_DEBUG("wait for read lease to expire")
+                  wait(h.second);
+              });
+          }
+        }
+
         static
         std::shared_ptr<blocks::Block>
         resolve(blocks::Block& b,
@@ -1526,6 +2206,12 @@ namespace infinit
           ELLE_TRACE_SCOPE("%s: store %f", *this, *inblock);
           std::shared_ptr<blocks::Block> b(inblock.release());
           ELLE_ASSERT(b);
+          auto const leasing =
+            this->_lease > std::chrono::system_clock::duration::zero() &&
+            this->doughnut().version() >= elle::Version(0, 10, 0) &&
+            dynamic_cast<blocks::MutableBlock*>(b.get());
+          if (leasing && mode == STORE_UPDATE && this->_store_leased(b))
+            return;
           auto owners = [&]
           {
             switch (mode)
@@ -1544,6 +2230,9 @@ namespace infinit
           {
             Paxos::PaxosClient::Peers peers;
             PaxosServer::Quorum peers_id;
+            auto members = std::vector<std::weak_ptr<Paxos::Peer>>{};
+            auto grants = Grants{};
+            auto const expiry = std::chrono::steady_clock::now() + this->_lease;
             // FIXME: This void the "query on the fly" optimization as it forces
             // resolution of all peers to get their id. Any other way ?
             for (auto wpeer: owners)
@@ -1554,9 +2243,12 @@ namespace infinit
               else
               {
                 peers_id.insert(peer->id());
+                members.emplace_back(
+                  std::dynamic_pointer_cast<Paxos::Peer>(peer));
                 peers.push_back(
                   std::make_unique<PaxosPeer>(
-                    wpeer, b->address(), boost::none, mode == STORE_INSERT));
+                    wpeer, b->address(), boost::none, mode == STORE_INSERT,
+                    boost::none, leasing ? &grants : nullptr));
               }
             }
             if (peers.empty())
@@ -1606,7 +2298,12 @@ namespace infinit
                     }
                   }
                   else
+                  {
+                    if (leasing)
+                      this->_keep_lease(b->address(), peers_id,
+                                        std::move(members), grants, expiry);
                     break;
+                  }
                 }
               }
               catch (Paxos::PaxosServer::WrongQuorum const& e)
@@ -1617,6 +2314,10 @@ namespace infinit
                 peers_id.clear();
                 for (auto const& peer: peers)
                   peers_id.insert(static_cast<PaxosPeer&>(*peer).id());
+                // Members of the new quorum are not tracked: run full rounds
+                // until the next one.
+                members.clear();
+                grants.granted.clear();
                 continue;
               }
               break;
@@ -1627,6 +2328,126 @@ namespace infinit
             elle::err("no peer available for insertion of %f", b->address());
         }
 
+        /*-------.
+        | Leases |
+        `-------*/
+
+        bool
+        Paxos::_store_leased(std::shared_ptr<blocks::Block> const& b)
+        {
+          auto const address = b->address();
+          auto it = this->_leases.find(address);
+          if (it == this->_leases.end())
+            return false;
+          // Leases are renewed on confirmation, or dropped.
+          auto lease = std::move(it->second);
+          this->_leases.erase(it);
+          auto const version =
+            dynamic_cast<blocks::MutableBlock&>(*b).version();
+          auto const fallback = [&] (std::string const& reason)
+            {
+              ELLE_TRACE("%s: run a full round for %f: %s",
+                         this, address, reason);
+              ++this->_lease_fallbacks;
+              return false;
+            };
+          if (std::chrono::steady_clock::now() >= lease.expiry)
+            return fallback("lease expired");
+          if (version != lease.proposal.version)
+            return fallback(elle::sprintf("lease is for version %s, not %s",
+                                          lease.proposal.version, version));
+          auto peers = std::vector<std::shared_ptr<Paxos::Peer>>{};
+          for (auto const& member: lease.members)
+            if (auto peer = member.lock())
+              peers.emplace_back(std::move(peer));
+          auto const majority = signed(lease.quorum.size()) / 2 + 1;
+          if (signed(peers.size()) < majority)
+            return fallback("lease members are gone");
+          ELLE_TRACE_SCOPE("%s: store %f under lease %s",
+                           this, address, lease.proposal);
+          auto accepted = 0;
+          auto const value = Value(b);
+          elle::reactor::for_each_parallel(
+            peers,
+            [&] (std::shared_ptr<Paxos::Peer> const& peer)
+            {
+              try
+              {
+                BENCH("accept.leased");
+                auto const res =
+                  peer->accept(lease.quorum, address, lease.proposal, value);
+                if (res == lease.proposal)
+                  ++accepted;
+                else
+                  ELLE_DEBUG("%f was preempted by %s", peer, res);
+              }
+              catch (elle::Error const& e)
+              {
+                ELLE_DEBUG("%f did not accept: %s", peer, e);
+              }
+            });
+          // A minority accepting is harmless: the full round goes on with the
+          // value accepted under the highest proposal, ours or not.
+          if (accepted < majority)
+            return fallback(elle::sprintf("only %s members accepted", accepted));
+          auto grants = Grants{};
+          auto next = lease.proposal;
+          ++next.version;
+          elle::reactor::for_each_parallel(
+            peers,
+            [&] (std::shared_ptr<Paxos::Peer> const& peer)
+            {
+              try
+              {
+                if (peer->confirm_lease(
+                      lease.quorum, address, lease.proposal, next))
+                {
+                  grants.granted.insert(peer->id());
+                  grants.next = next;
+                }
+              }
+              catch (elle::Error const& e)
+              {
+                ELLE_DEBUG("%f did not confirm: %s", peer, e);
+              }
+            });
+          ++this->_leased;
+          this->_keep_lease(address, std::move(lease.quorum),
+                            std::move(lease.members), grants, lease.expiry);
+          return true;
+        }
+
+        void
+        Paxos::_keep_lease(Address address,
+                           PaxosServer::Quorum quorum,
+                           std::vector<std::weak_ptr<Paxos::Peer>> members,
+                           Grants const& grants,
+                           std::chrono::steady_clock::time_point expiry)
+        {
+          if (signed(grants.granted.size()) <= signed(quorum.size()) / 2)
+          {
+            ELLE_DEBUG("%s: no lease on %f, granted by %s of %s members",
+                       this, address, grants.granted.size(), quorum.size());
+            return;
+          }
+          // Drop expired leases as the table grows, so it only holds blocks
+          // recently written.
+          if (this->_leases.size() >= this->_leases_sweep)
+          {
+            auto const now = std::chrono::steady_clock::now();
+            for (auto it = this->_leases.begin(); it != this->_leases.end();)
+              if (it->second.expiry <= now)
+                it = this->_leases.erase(it);
+              else
+                ++it;
+            this->_leases_sweep =
+              std::max(std::size_t(64), 2 * this->_leases.size());
+          }
+          ELLE_DEBUG("%s: lease %f for %s", this, address, grants.next);
+          this->_leases[address] =
+            Lease{std::move(quorum), std::move(members), grants.next, expiry};
+        }
+
         class Hit
         {
         public:
@@ -1664,10 +2485,18 @@ namespace infinit
         };
 
         void
-        Paxos::_fetch(std::vector<AddressVersion> const& addresses,
+        Paxos::_fetch(std::vector<AddressVersion> const& requested,
                       ReceiveBlock res)
         {
           BENCH("multi_fetch");
+          auto addresses = std::vector<AddressVersion>{};
+          for (auto const& av: requested)
+            if (auto leased = this->_fetch_leased(av.first, av.second))
+              res(av.first, std::move(*leased), {});
+            else
+              addresses.emplace_back(av);
+          if (addresses.empty())
+            return;
           if (this->doughnut().version() < elle::Version(0, 5, 0))
           {
             for (auto av: addresses)
@@ -1692,24 +2521,126 @@ namespace infinit
           auto versions = std::unordered_map<Address, boost::optional<int>>{};
           for (auto a: addresses)
             versions[a.first] = a.second;
-          auto peers = std::unordered_map<Address, PaxosClient::Peers>{};
+          auto owners = std::unordered_map<
+            Address, std::vector<overlay::Overlay::WeakMember>>{};
           for (auto r: hits)
-            peers[r.first].emplace_back(
-              std::make_unique<PaxosPeer>(
-                r.second, r.first, versions.at(r.first), false));
+            owners[r.first].emplace_back(r.second);
+          // Query every member once for all the blocks it holds: the state
+          // of mutable blocks from all replicas, and each immutable block
+          // from a single one.
+          auto prefetched = std::unordered_map<
+            Address, std::unordered_map<Address, Paxos::Peer::GetResult>>{};
+          auto fetched =
+            std::unordered_map<Address, std::unique_ptr<blocks::Block>>{};
+          if (this->doughnut().version() >= elle::Version(0, 10, 0) &&
+              addresses.size() > 1)
+          {
+            using Batch = std::pair<std::shared_ptr<Paxos::Peer>,
+                                    std::vector<AddressVersion>>;
+            auto mutables = std::unordered_map<Address, Batch>{};
+            for (auto const& o: owners)
+              if (o.first.mutable_block())
+                for (auto const& m: o.second)
+                  if (auto member = to_paxos_peer(m))
+                  {
+                    auto& batch = mutables[member->id()];
+                    batch.first = member;
+                    batch.second.emplace_back(o.first, versions.at(o.first));
+                  }
+            BENCH("multi_fetch.batch");
+            elle::reactor::for_each_parallel(
+              mutables,
+              [&] (std::pair<Address const, Batch>& batch)
+              {
+                try
+                {
+                  for (auto& r: batch.second.first->get_many(
+                         batch.second.second))
+                    prefetched[r.first].emplace(batch.first,
+                                                std::move(r.second));
+                }
+                catch (elle::Error const& e)
+                {
+                  ELLE_TRACE("batched get from %f failed: %s",
+                             batch.first, e);
+                }
+              });
+            // Immutable blocks a replica missed are asked to the next one.
+            for (auto replica = 0u; true; ++replica)
+            {
+              auto immutables = std::unordered_map<Address, Batch>{};
+              auto remaining = false;
+              for (auto const& o: owners)
+                if (!o.first.mutable_block() && !fetched.count(o.first) &&
+                    replica < o.second.size())
+                {
+                  remaining = true;
+                  if (auto member = to_paxos_peer(o.second[replica]))
+                  {
+                    auto& batch = immutables[member->id()];
+                    batch.first = member;
+                    batch.second.emplace_back(o.first, versions.at(o.first));
+                  }
+                }
+              if (!remaining)
+                break;
+              elle::reactor::for_each_parallel(
+                immutables,
+                [&] (std::pair<Address const, Batch>& batch)
+                {
+                  batch.second.first->fetch(
+                    batch.second.second,
+                    [&] (Address a, std::unique_ptr<blocks::Block> b,
+                         std::exception_ptr e)
+                    {
+                      if (b)
+                        fetched.emplace(a, std::move(b));
+                      else if (e)
+                        ELLE_TRACE("batched fetch of %f from %f failed: %s",
+                                   a, batch.first,
+                                   elle::exception_string(e));
+                    });
+                });
+            }
+          }
+          // Finish each read from the prefetched states, falling back to
+          // individual requests.
           elle::reactor::for_each_parallel(
-            peers,
-            [&] (std::pair<Address const, PaxosClient::Peers>& p)
+            owners,
+            [&] (std::pair<Address const,
+                           std::vector<overlay::Overlay::WeakMember>>& o)
             {
+              auto const address = o.first;
+              auto const version = versions.at(address);
               try
               {
-                auto block = this->_fetch(
-                  p.first, std::move(p.second), versions.at(p.first));
-                res(p.first, std::move(block), {});
+                auto it = fetched.find(address);
+                if (it != fetched.end())
+                {
+                  res(address, std::move(it->second), {});
+                  return;
+                }
+                auto states = prefetched.find(address);
+                auto peers = PaxosClient::Peers{};
+                for (auto const& m: o.second)
+                  if (auto member = m.lock())
+                  {
+                    auto state = boost::optional<Paxos::Peer::GetResult>{};
+                    if (states != prefetched.end())
+                    {
+                      auto it = states->second.find(member->id());
+                      if (it != states->second.end())
+                        state = std::move(it->second);
+                    }
+                    peers.emplace_back(std::make_unique<PaxosPeer>(
+                      m, address, version, false, std::move(state)));
+                  }
+                auto block = this->_fetch(address, std::move(peers), version);
+                res(address, std::move(block), {});
               }
               catch (elle::Error const& e)
               {
-                res(p.first, {}, std::current_exception());
+                res(address, {}, std::current_exception());
               }
             });
         }
@@ -1723,6 +2654,8 @@ namespace infinit
               this->doughnut().overlay()->lookup(address, this->_factor);
             return fetch_from_members(peers, address, std::move(local_version));
           }
+          if (auto leased = this->_fetch_leased(address, local_version))
+            return std::move(*leased);
           auto peers = this->_peers(address, local_version);
           return _fetch(address, std::move(peers), local_version);
         }
@@ -1744,9 +2677,40 @@ namespace infinit
               {
                 BENCH("_fetch.run");
                 ELLE_DEBUG_SCOPE("run paxos");
+                // Quorum members acquire a read lease while reading.
+                auto local = std::shared_ptr<LocalPeer>();
+                auto grants = ReadGrants{
+                  this->doughnut().id(), {}, this->_read_lease};
+                auto token = int64_t(0);
+                if (this->_read_lease >
+                    std::chrono::system_clock::duration::zero() &&
+                    this->doughnut().version() >= elle::Version(0, 10, 0) &&
+                    boost::algorithm::any_of(
+                      peers,
+                      [&] (auto const& peer)
+                      {
+                        return peer->id() == this->doughnut().id();
+                      }))
+                  local = std::dynamic_pointer_cast<LocalPeer>(
+                    this->doughnut().local());
+                if (local)
+                {
+                  for (auto& peer: peers)
+                    static_cast<PaxosPeer&>(*peer).read_grants(&grants);
+                  token = local->read_lease_request(address);
+                }
+                auto const start = std::chrono::steady_clock::now();
                 Paxos::PaxosClient client(
                   this->doughnut().id(), std::move(peers));
                 auto state = client.state();
+                if (local && state.proposal &&
+                    local->read_lease_hold(address, token, *state.proposal,
+                                           grants.granted,
+                                           start + grants.duration))
+                {
+                  ++this->_read_leases_acquired;
+                  prometheus::increment(this->_read_lease_acquired_counter);
+                }
                 if (state.value)
                   if (*state.value)
                   {
@@ -1815,6 +2779,38 @@ namespace infinit
             }
         }
 
+        boost::optional<std::unique_ptr<blocks::Block>>
+        Paxos::_fetch_leased(Address address,
+                             boost::optional<int> local_version)
+        {
+          if (this->_read_lease == std::chrono::system_clock::duration::zero() ||
+              this->doughnut().version() < elle::Version(0, 10, 0) ||
+              !address.mutable_block())
+            return boost::none;
+          auto accepted = boost::optional<PaxosClient::Accepted>{};
+          if (auto local = std::dynamic_pointer_cast<LocalPeer>(
+                this->doughnut().local()))
+            accepted = local->read_leased(address);
+          if (!accepted ||
+              !accepted->value.template is<std::shared_ptr<blocks::Block>>())
+          {
+            ++this->_read_lease_misses;
+            prometheus::increment(this->_read_lease_misses_counter);
+            return boost::none;
+          }
+          ++this->_read_lease_hits;
+          prometheus::increment(this->_read_lease_hits_counter);
+          ELLE_DEBUG("%s: read %f locally under read lease", this, address);
+          auto res = std::dynamic_pointer_cast<blocks::MutableBlock>(
+            accepted->value.template get<std::shared_ptr<blocks::Block>>()
+            ->clone());
+          if (local_version && res->version() == *local_version)
+            return std::unique_ptr<blocks::Block>();
+          if (accepted->proposal.version != res->version())
+            res->seal_version(accepted->proposal.version + 1);
+          return std::unique_ptr<blocks::Block>(std::move(res));
+        }
+
         Paxos::PaxosClient::Peers
         Paxos::_peers(Address const& address,
                       boost::optional<int> local_version)
@@ -2047,26 +3043,76 @@ namespace infinit
         void
         Paxos::_remove(Address address, blocks::RemoveSignature rs)
         {
+          this->_leases.erase(address);
           this->remove_many(address, std::move(rs), this->_factor);
         }
 
         Paxos::LocalPeer::Decision::Decision(PaxosServer paxos)
           : chosen(-1)
           , paxos(std::move(paxos))
+          , sequence(0)
+          , stored(false)
         {}
 
         Paxos::LocalPeer::Decision::Decision(
-          elle::serialization::SerializerIn& s)
+          elle::serialization::SerializerIn& s, elle::Version const& v)
           : chosen(s.deserialize<int>("chosen"))
           , paxos(s.deserialize<PaxosServer>("paxos"))
-        {}
+          , sequence(0)
+          , stored(false)
+        {
+          if (v >= elle::Version(0, 10, 0))
+            s.serialize("sequence", this->sequence);
+        }
 
         void
         Paxos::LocalPeer::Decision::serialize(
-          elle::serialization::Serializer& s)
+          elle::serialization::Serializer& s, elle::Version const& v)
         {
           s.serialize("chosen", this->chosen);
           s.serialize("paxos", this->paxos);
+          if (v >= elle::Version(0, 10, 0))
+            s.serialize("sequence", this->sequence);
+        }
+
+        Paxos::LocalPeer::Phase::Phase(bool confirm,
+                                       Quorum quorum,
+                                       PaxosClient::Proposal proposal)
+          : confirm(confirm)
+          , quorum(std::move(quorum))
+          , proposal(std::move(proposal))
+        {}
+
+        Paxos::LocalPeer::Phase::Phase(elle::serialization::SerializerIn& s)
+          : confirm(s.deserialize<bool>("confirm"))
+          , quorum(s.deserialize<Quorum>("quorum"))
+          , proposal(s.deserialize<PaxosClient::Proposal>("proposal"))
+        {}
+
+        void
+        Paxos::LocalPeer::Phase::serialize(elle::serialization::Serializer& s)
+        {
+          s.serialize("confirm", this->confirm);
+          s.serialize("quorum", this->quorum);
+          s.serialize("proposal", this->proposal);
+        }
+
+        Paxos::LocalPeer::Phases::Phases(int64_t sequence,
+                                         std::vector<Phase> phases)
+          : sequence(sequence)
+          , phases(std::move(phases))
+        {}
+
+        Paxos::LocalPeer::Phases::Phases(elle::serialization::SerializerIn& s)
+          : sequence(s.deserialize<int64_t>("sequence"))
+          , phases(s.deserialize<std::vector<Phase>>("phases"))
+        {}
+
+        void
+        Paxos::LocalPeer::Phases::serialize(elle::serialization::Serializer& s)
+        {
+          s.serialize("sequence", this->sequence);
+          s.serialize("phases", this->phases);
         }
 
         /*-----.
@@ -2129,10 +3175,40 @@ namespace infinit
         elle::json::Object
         Paxos::stats()
         {
-          return {
-            {"type", "paxos"},
-            {"node_timeout", elle::sprintf("%s", this->node_timeout())},
-          };
+          auto res = elle::json::Object
+            {
+              {"type", "paxos"},
+              {"node_timeout", elle::sprintf("%s", this->node_timeout())},
+            };
+          if (auto local = std::dynamic_pointer_cast<LocalPeer>(
+                this->doughnut().local()))
+          {
+            auto written = elle::json::Object{};
+            for (auto const& w: local->written())
+              written[w.first] = w.second;
+            res["written"] = std::move(written);
+          }
+          if (this->_lease > std::chrono::system_clock::duration::zero())
+            res["leases"] = elle::json::Object
+              {
+                {"held", int64_t(this->_leases.size())},
+                {"leased", this->_leased},
+                {"fallbacks", this->_lease_fallbacks},
+              };
+          if (this->_read_lease > std::chrono::system_clock::duration::zero())
+          {
+            auto read_leases = elle::json::Object
+              {
+                {"hits", this->_read_lease_hits},
+                {"misses", this->_read_lease_misses},
+                {"acquired", this->_read_leases_acquired},
+              };
+            if (auto local = std::dynamic_pointer_cast<LocalPeer>(
+                  this->doughnut().local()))
+              read_leases["revoked"] = local->read_lease_revocations();
+            res["read_leases"] = std::move(read_leases);
+          }
+          return res;
         }
 
         /*--------------.
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <map>
+
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/mem_fun.hpp>
@@ -15,6 +17,7 @@
 #include <infinit/model/doughnut/Consensus.hh>
 #include <infinit/model/doughnut/Local.hh>
 #include <infinit/model/doughnut/Remote.hh>
+#include <infinit/model/prometheus.hh>
 
 namespace infinit
 {
@@ -30,6 +33,8 @@ namespace infinit
         ELLE_DAS_SYMBOL(block);
         ELLE_DAS_SYMBOL(doughnut);
         ELLE_DAS_SYMBOL(replication_factor);
+        ELLE_DAS_SYMBOL(lease);
+        ELLE_DAS_SYMBOL(read_lease);
         ELLE_DAS_SYMBOL(lenient_fetch);
         ELLE_DAS_SYMBOL(rebalance_auto_expand);
         ELLE_DAS_SYMBOL(rebalance_inspect);
@@ -63,7 +68,9 @@ namespace infinit
                 bool lenient_fetch,
                 bool rebalance_auto_expand,
                 bool rebalance_inspect,
-                std::chrono::system_clock::duration node_timeout);
+                std::chrono::system_clock::duration node_timeout,
+                std::chrono::system_clock::duration lease,
+                std::chrono::system_clock::duration read_lease);
           template <typename ... Args>
           Paxos(Args&& ... args);
           ELLE_ATTRIBUTE_R(int, factor);
@@ -71,6 +78,13 @@ namespace infinit
           ELLE_ATTRIBUTE_R(bool, rebalance_auto_expand);
           ELLE_ATTRIBUTE_R(bool, rebalance_inspect);
           ELLE_ATTRIBUTE_R(std::chrono::system_clock::duration, node_timeout);
+          /// How long winning a round on a mutable block lets later versions
+          /// skip the propose phase, zero to always run full rounds.
+          ELLE_ATTRIBUTE_R(std::chrono::system_clock::duration, lease);
+          /// How long reading a mutable block from its quorum lets a member
+          /// of that quorum read it locally, zero to always read from the
+          /// quorum.
+          ELLE_ATTRIBUTE_R(std::chrono::system_clock::duration, read_lease);
         private:
           struct _Details;
           friend struct _Details;
@@ -164,11 +178,53 @@ namespace infinit
             confirm(PaxosServer::Quorum const& peers,
                     Address address,
                     PaxosClient::Proposal const& p) = 0;
+            /// Confirm `p` and promise `next`, the proposal of the following
+            /// version by the same sender.
+            ///
+            /// @return Whether nothing was accepted for `next`, which can
+            ///         then skip the propose phase.
+            virtual
+            bool
+            confirm_lease(PaxosServer::Quorum const& peers,
+                          Address address,
+                          PaxosClient::Proposal const& p,
+                          PaxosClient::Proposal const& next);
             virtual
             boost::optional<PaxosClient::Accepted>
             get(PaxosServer::Quorum const& peers,
                 Address address,
                 boost::optional<int> local_version) = 0;
+            /// How long a read lease was granted for, zero if it was not,
+            /// and the accepted value.
+            using ReadLeased =
+              std::pair<std::chrono::system_clock::duration,
+                        boost::optional<PaxosClient::Accepted>>;
+            /// Get the accepted value like `get`, granting node `holder` a
+            /// lease to read `address` locally until this member revokes it
+            /// or the lease expires.
+            virtual
+            ReadLeased
+            get_lease(PaxosServer::Quorum const& peers,
+                      Address address,
+                      boost::optional<int> local_version,
+                      Address holder);
+            /// Drop the read lease held on `address`, a new value being
+            /// accepted.
+            virtual
+            void
+            revoke_read_lease(Address address);
+            /// A member's quorum and accepted value for a block.
+            using GetResult =
+              std::pair<PaxosServer::Quorum,
+                        boost::optional<PaxosClient::Accepted>>;
+            using GetResults = std::unordered_map<Address, GetResult>;
+            /// Get the state of several blocks in one exchange.
+            ///
+            /// Blocks that cannot be read are omitted, and must be read
+            /// individually.
+            virtual
+            GetResults
+            get_many(std::vector<AddressVersion> const& addresses);
           };
 
         /*------------------.
@@ -201,10 +257,24 @@ namespace infinit
             confirm(PaxosServer::Quorum const& peers,
                     Address address,
                     PaxosClient::Proposal const& p) override;
+            bool
+            confirm_lease(PaxosServer::Quorum const& peers,
+                          Address address,
+                          PaxosClient::Proposal const& p,
+                          PaxosClient::Proposal const& next) override;
             boost::optional<PaxosClient::Accepted>
             get(PaxosServer::Quorum const& peers,
                 Address address,
                 boost::optional<int> local_version) override;
+            ReadLeased
+            get_lease(PaxosServer::Quorum const& peers,
+                      Address address,
+                      boost::optional<int> local_version,
+                      Address holder) override;
+            void
+            revoke_read_lease(Address address) override;
+            GetResults
+            get_many(std::vector<AddressVersion> const& addresses) override;
             void
             store(blocks::Block const& block, StoreMode mode) override;
           };
@@ -270,24 +340,70 @@ namespace infinit
             confirm(PaxosServer::Quorum const& peers,
                     Address address,
                     PaxosClient::Proposal const& p) override;
+            bool
+            confirm_lease(PaxosServer::Quorum const& peers,
+                          Address address,
+                          PaxosClient::Proposal const& p,
+                          PaxosClient::Proposal const& next) override;
             boost::optional<PaxosClient::Accepted>
             get(PaxosServer::Quorum const& peers,
                 Address address,
                 boost::optional<int> local_version) override;
+            GetResults
+            get_many(std::vector<AddressVersion> const& addresses) override;
             void
             store(blocks::Block const& block, StoreMode mode) override;
             void
             remove(Address address, blocks::RemoveSignature rs) override;
+            /// A proposal promised or confirmed, recorded apart from the
+            /// value it applies to.
+            struct Phase
+            {
+              Phase(bool confirm, Quorum quorum, PaxosClient::Proposal proposal);
+              Phase(elle::serialization::SerializerIn& s);
+              void
+              serialize(elle::serialization::Serializer& s);
+              using serialization_tag = infinit::serialization_tag;
+              bool confirm;
+              Quorum quorum;
+              PaxosClient::Proposal proposal;
+            };
+            /// Phases run on a decision since it was stored for the
+            /// `sequence`th time.
+            struct Phases
+            {
+              Phases(int64_t sequence, std::vector<Phase> phases);
+              Phases(elle::serialization::SerializerIn& s);
+              void
+              serialize(elle::serialization::Serializer& s);
+              using serialization_tag = infinit::serialization_tag;
+              int64_t sequence;
+              std::vector<Phase> phases;
+            };
             struct Decision
             {
               Decision(PaxosServer paxos);
-              Decision(elle::serialization::SerializerIn& s);
+              Decision(elle::serialization::SerializerIn& s,
+                       elle::Version const& v);
               void
-              serialize(elle::serialization::Serializer& s);
+              serialize(elle::serialization::Serializer& s,
+                        elle::Version const& v);
               using serialization_tag = infinit::serialization_tag;
               int chosen;
               PaxosServer paxos;
+              /// Number of times the decision was stored with its value.
+              int64_t sequence;
+              /// Whether the decision is in storage.
+              bool stored;
+              /// Phases recorded since the decision was stored.
+              std::vector<Phase> phases;
             };
+            /// Addresses of the blocks stored locally, without the records
+            /// of Paxos phases.
+            std::vector<Address>
+            addresses() override;
+            /// Bytes written to the silo, by Paxos phase.
+            ELLE_ATTRIBUTE_R((std::map<std::string, int64_t>), written);
             bool
             rebalance(PaxosClient& client, Address address);
           protected:
@@ -301,6 +417,19 @@ namespace infinit
           private:
             void
             _remove(Address address);
+            /// Serialize immutable block `block` for storage.
+            elle::Buffer
+            _serialize(blocks::Block const& block) override;
+            /// Store `decision` along with its value.
+            void
+            _write(Address address, Decision& decision, std::string phase);
+            /// Store `phase` of `decision`, without rewriting its value when
+            /// the decision is already stored.
+            void
+            _record(Address address, Decision& decision, Phase phase);
+            /// Run the phases recorded since `decision` was stored.
+            void
+            _replay(Address address, Decision& decision);
             BlockOrPaxos
             _load(Address address);
             Decision&
@@ -402,11 +531,152 @@ namespace infinit
             using NodeTimeouts =
               std::unordered_map<Address, boost::asio::deadline_timer>;
             ELLE_ATTRIBUTE_R(NodeTimeouts, node_timeouts);
+
+          /*------------.
+          | Read leases |
+          `------------*/
+          public:
+            ReadLeased
+            get_lease(PaxosServer::Quorum const& peers,
+                      Address address,
+                      boost::optional<int> local_version,
+                      Address holder) override;
+            void
+            revoke_read_lease(Address address) override;
+            /// Start acquiring a read lease on `address`: revocations from
+            /// now on cancel it.
+            ///
+            /// @return The token to hold the lease with.
+            int64_t
+            read_lease_request(Address address);
+            /// Hold the read lease requested with `token` until `expiry`.
+            ///
+            /// @param chosen  The proposal read from the quorum, which the
+            ///                local replica must have accepted.
+            /// @param granted The members that granted the lease.
+            /// @return Whether the lease is held: it was not revoked in
+            ///         between, and every majority of the quorum includes
+            ///         this node or a member that must revoke it.
+            bool
+            read_lease_hold(Address address,
+                            int64_t token,
+                            PaxosClient::Proposal const& chosen,
+                            Quorum const& granted,
+                            std::chrono::steady_clock::time_point expiry);
+            /// The value accepted for `address`, if a read lease on it is
+            /// held.
+            boost::optional<PaxosClient::Accepted>
+            read_leased(Address address);
+            /// Read leases granted then revoked by this member.
+            ELLE_ATTRIBUTE_R(int64_t, read_lease_revocations);
+          private:
+            /// Revoke the read leases granted on `address`, waiting for
+            /// those that cannot be revoked to expire.
+            void
+            _revoke_read_leases(Address address);
+            struct ReadLease
+            {
+              int64_t token;
+              bool held;
+              std::chrono::steady_clock::time_point expiry;
+            };
+            ELLE_ATTRIBUTE((std::unordered_map<Address, ReadLease>),
+                           read_leases);
+            ELLE_ATTRIBUTE(int64_t, read_lease_tokens);
+            /// Expiry of the read leases granted, by block and holder.
+            using ReadGranted = std::unordered_map<
+              Address,
+              std::unordered_map<Address, std::chrono::steady_clock::time_point>>;
+            ELLE_ATTRIBUTE(ReadGranted, read_granted);
+            /// Leases granted before this node started are forgotten: they
+            /// are waited for before accepting.
+            ELLE_ATTRIBUTE(std::chrono::steady_clock::time_point,
+                           read_granted_unknown);
+            /// Drop the expired read leases granted or held, once
+            /// `read_granted_sweep` blocks have some.
+            void
+            _sweep_read_leases();
+            ELLE_ATTRIBUTE(std::size_t, read_granted_sweep);
           };
 
           using Transfers = std::unordered_map<Address, int>;
           ELLE_ATTRIBUTE(Transfers, transfers);
 
+        /*-------.
+        | Leases |
+        `-------*/
+        public:
+          /// Leadership on the quorum of a mutable block, kept after winning
+          /// a round: its members promised the next version to this node,
+          /// which can thus be accepted and confirmed right away.
+          struct Lease
+          {
+            PaxosServer::Quorum quorum;
+            std::vector<std::weak_ptr<Paxos::Peer>> members;
+            /// The proposal promised for the next version.
+            PaxosClient::Proposal proposal;
+            std::chrono::steady_clock::time_point expiry;
+          };
+          /// Promises of the next version collected while confirming.
+          struct Grants
+          {
+            PaxosServer::Quorum granted;
+            PaxosClient::Proposal next;
+          };
+          /// Versions stored by skipping the propose phase.
+          ELLE_ATTRIBUTE_R(int64_t, leased);
+          /// Versions that ran a full round although a lease was held,
+          /// because it expired or was preempted.
+          ELLE_ATTRIBUTE_R(int64_t, lease_fallbacks);
+        private:
+          /// Store `block` under the lease held on its address, if any.
+          ///
+          /// @return Whether the block was stored.
+          bool
+          _store_leased(std::shared_ptr<blocks::Block> const& block);
+          /// Keep the lease on `address` if a majority of `quorum` granted
+          /// it.
+          void
+          _keep_lease(Address address,
+                      PaxosServer::Quorum quorum,
+                      std::vector<std::weak_ptr<Paxos::Peer>> members,
+                      Grants const& grants,
+                      std::chrono::steady_clock::time_point expiry);
+          using Leases = std::unordered_map<Address, Lease>;
+          ELLE_ATTRIBUTE(Leases, leases);
+          /// Size of `leases` at which expired ones are dropped.
+          ELLE_ATTRIBUTE(std::size_t, leases_sweep);
+
+        /*------------.
+        | Read leases |
+        `------------*/
+        public:
+          /// Read leases granted to a quorum member reading a block.
+          struct ReadGrants
+          {
+            Address holder;
+            PaxosServer::Quorum granted;
+            /// The shortest lease granted.
+            std::chrono::system_clock::duration duration;
+          };
+          /// Fetches of mutable blocks answered locally under a read lease.
+          ELLE_ATTRIBUTE_R(int64_t, read_lease_hits);
+          /// Fetches of mutable blocks that had to run on the quorum.
+          ELLE_ATTRIBUTE_R(int64_t, read_lease_misses);
+          ELLE_ATTRIBUTE_R(int64_t, read_leases_acquired);
+        private:
+          /// Read `address` from the local replica, if it holds a read lease
+          /// on it.
+          ///
+          /// @return The block, null if `local_version` is the most recent,
+          ///         or nothing if no read lease is held.
+          boost::optional<std::unique_ptr<blocks::Block>>
+          _fetch_leased(Address address, boost::optional<int> local_version);
+          prometheus::CounterPtr _read_lease_hits_counter;
+          prometheus::CounterPtr _read_lease_misses_counter;
+          prometheus::CounterPtr _read_lease_acquired_counter;
+          prometheus::CounterPtr _read_lease_revoked_counter;
+
         /*-----.
         | Stat |
         `-----*/
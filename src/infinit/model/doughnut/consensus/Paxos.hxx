@@ -28,6 +28,11 @@ namespace infinit
           , _rebalanced()
           , _rebalance_thread(elle::sprintf("%s: rebalance", this),
                               [this] () { this->_rebalance(); })
+          , _read_lease_revocations(0)
+          , _read_lease_tokens(0)
+          , _read_granted_unknown(
+            std::chrono::steady_clock::now() + paxos.read_lease())
+          , _read_granted_sweep(64)
         {}
 
         static constexpr auto default_node_timeout =
@@ -43,14 +48,18 @@ namespace infinit
               consensus::lenient_fetch = false,
               consensus::rebalance_auto_expand = true,
               consensus::rebalance_inspect = true,
-              consensus::node_timeout = default_node_timeout
+              consensus::node_timeout = default_node_timeout,
+              consensus::lease = std::chrono::system_clock::duration::zero(),
+              consensus::read_lease = std::chrono::system_clock::duration::zero()
               ).call(
                 [] (Doughnut& doughnut,
                     int factor,
                     bool lenient_fetch,
                     bool rebalance_auto_expand,
                     bool rebalance_inspect,
-                    std::chrono::system_clock::duration node_timeout
+                    std::chrono::system_clock::duration node_timeout,
+                    std::chrono::system_clock::duration lease,
+                    std::chrono::system_clock::duration read_lease
                   ) -> Paxos
                 {
                   return Paxos(doughnut,
@@ -58,7 +67,9 @@ namespace infinit
                                lenient_fetch,
                                rebalance_auto_expand,
                                rebalance_inspect,
-                               node_timeout
+                               node_timeout,
+                               lease,
+                               read_lease
                     );
                 }, std::forward<Args>(args)...))
         {}
@@ -9,6 +9,7 @@ namespace infinit
   {
     namespace doughnut
     {
+      class CCHB;
       class Dock;
       class Doughnut;
       class Local;
@@ -455,7 +455,7 @@ namespace kademlia
       ELLE_TRACE("%s: Waiting for endpoint (ping)", *this);
       elle::reactor::sleep(500_ms);
     }
-    auto keys = l.storage()->list();
+    auto keys = l.addresses();
     for (auto const& k: keys)
     {
       _storage[k].push_back(Store{_local_endpoint, now()});
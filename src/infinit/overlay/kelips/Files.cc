@@ -0,0 +1,506 @@
+#include <infinit/overlay/kelips/Files.hh>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <unordered_set>
+
+#include <elle/assert.hh>
+#include <elle/random.hh>
+
+namespace infinit
+{
+  namespace overlay
+  {
+    namespace kelips
+    {
+      std::uint32_t const Files::none =
+        std::numeric_limits<std::uint32_t>::max();
+
+      /*-------------.
+      | Construction |
+      `-------------*/
+
+      Files::Files(Address self, int new_threshold)
+        : _self(self)
+        , _new_threshold(std::min(new_threshold, 255))
+        , _fresh(0)
+        , _own(0)
+        , _self_id(this->_intern(self))
+      {}
+
+      /*--------.
+      | Entries |
+      `--------*/
+
+      std::size_t
+      Files::size() const
+      {
+        return this->_entries.size();
+      }
+
+      auto
+      Files::begin() const
+        -> const_iterator
+      {
+        return {*this, 0};
+      }
+
+      auto
+      Files::end() const
+        -> const_iterator
+      {
+        return {*this, std::uint32_t(this->_entries.size())};
+      }
+
+      std::vector<Address>
+      Files::home_nodes(Address const& address) const
+      {
+        auto res = std::vector<Address>{};
+        if (this->_slots.empty())
+          return res;
+        auto const mask = this->_slots.size() - 1;
+        for (auto s = this->_slot(address.value());
+             this->_slots[s] != none;
+             s = (s + 1) & mask)
+        {
+          auto const& e = this->_entries[this->_slots[s]];
+          if (!std::memcmp(e.address, address.value(), sizeof e.address))
+            res.push_back(this->_homes[e.home]);
+        }
+        return res;
+      }
+
+      bool
+      Files::contains(Address const& address, Address const& home_node) const
+      {
+        return this->_find(address, home_node) != none;
+      }
+
+      bool
+      Files::insert(File const& file)
+      {
+        if (this->contains(file.address, file.home_node))
+          return false;
+        if ((this->_entries.size() + 1) * 4 > this->_slots.size() * 3)
+          this->_rehash(std::max<std::size_t>(16, this->_slots.size() * 2));
+        auto e = Entry{};
+        std::memcpy(e.address, file.address.value(), sizeof e.address);
+        e.home = this->_intern(file.home_node);
+        auto const own = e.home == this->_self_id;
+        e.time = _seconds(own ? file.last_gossip : file.last_seen);
+        e.gossip_count = std::max(0, std::min(file.gossip_count, 255));
+        auto const id = std::uint32_t(this->_entries.size());
+        this->_entries.push_back(e);
+        this->_link(id);
+        if (e.gossip_count < this->_new_threshold)
+          this->_swap(id, this->_fresh++);
+        if (own)
+        {
+          ++this->_own;
+          this->_enqueue(e.address, e.time);
+        }
+        return true;
+      }
+
+      bool
+      Files::seen(Address const& address, Address const& home_node, Time time)
+      {
+        auto const id = this->_find(address, home_node);
+        if (id == none)
+          return false;
+        auto& e = this->_entries[id];
+        if (e.home != this->_self_id)
+          e.time = std::max(e.time, _seconds(time));
+        return true;
+      }
+
+      bool
+      Files::erase(Address const& address, Address const& home_node)
+      {
+        auto const id = this->_find(address, home_node);
+        if (id == none)
+          return false;
+        this->_erase(id);
+        return true;
+      }
+
+      int
+      Files::expire(Time before)
+      {
+        auto const limit = _seconds(before);
+        int res = 0;
+        // Erasing moves entries from further in the vector, that were
+        // checked already.
+        for (auto id = this->_entries.size(); id-- > 0;)
+        {
+          auto const& e = this->_entries[id];
+          if (e.home != this->_self_id && e.time < limit)
+          {
+            this->_erase(id);
+            ++res;
+          }
+        }
+        if (res)
+          this->_shrink();
+        return res;
+      }
+
+      /*-------.
+      | Gossip |
+      `-------*/
+
+      std::vector<File>
+      Files::gossip(int fresh, int stale, Time time, Time before)
+      {
+        auto ids = std::vector<std::uint32_t>{};
+        auto const count = fresh + stale;
+        // Small tables are gossiped about whole.
+        if (signed(this->_entries.size()) <= count)
+          for (auto id = 0u; id < this->_entries.size(); ++id)
+            ids.push_back(id);
+        else
+        {
+          auto picked = std::unordered_set<std::uint32_t>{};
+          auto pick = [&] (std::uint32_t id)
+            {
+              if (picked.insert(id).second)
+                ids.push_back(id);
+            };
+          if (signed(this->_fresh) <= fresh)
+            for (auto id = 0u; id < this->_fresh; ++id)
+              pick(id);
+          else
+            while (signed(ids.size()) < fresh)
+              pick(elle::pick_one(this->_fresh));
+          auto const target = ids.size() + stale;
+          auto const limit = _seconds(before);
+          for (auto i = 0u; ids.size() < target && i < this->_queue.size();)
+          {
+            auto const& q = this->_queue[i];
+            if (!(q.time < limit))
+              break;
+            auto const id = this->_find(q.address, this->_self_id);
+            if (id != none && this->_entries[id].time == q.time)
+            {
+              pick(id);
+              ++i;
+            }
+            else if (i == 0)
+              this->_queue.pop_front();
+            else
+              ++i;
+          }
+          // Make up for missing entries with random ones and then, if
+          // unlucky, from the whole table.
+          for (int attempt = 0;
+               signed(ids.size()) < count && attempt < 4 * count;
+               ++attempt)
+            pick(elle::pick_one(this->_entries.size()));
+          for (auto id = 0u;
+               signed(ids.size()) < count && id < this->_entries.size();
+               ++id)
+            pick(id);
+          ELLE_ASSERT_EQ(signed(ids.size()), count);
+        }
+        auto res = std::vector<File>{};
+        res.reserve(ids.size());
+        for (auto id: ids)
+        {
+          res.push_back(this->_file(id));
+          if (res.back().home_node == this->_self)
+            res.back().last_seen = time;
+        }
+        // Entries leaving the new ones are swapped with the last new one:
+        // record from the back so the ones left to record do not move.
+        std::sort(ids.begin(), ids.end(), std::greater<std::uint32_t>());
+        for (auto id: ids)
+          this->_gossiped(id, _seconds(time));
+        return res;
+      }
+
+      std::size_t
+      Files::fresh() const
+      {
+        return this->_fresh;
+      }
+
+      /*--------.
+      | Details |
+      `--------*/
+
+      std::uint32_t
+      Files::_seconds(Time time)
+      {
+        auto const s = std::chrono::duration_cast<std::chrono::seconds>(
+          time.time_since_epoch()).count();
+        return std::uint32_t(
+          std::max<decltype(s)>(0, std::min<decltype(s)>(s, none)));
+      }
+
+      Time
+      Files::_time(std::uint32_t seconds)
+      {
+        return Time(std::chrono::seconds(seconds));
+      }
+
+      File
+      Files::_file(std::uint32_t id) const
+      {
+        auto const& e = this->_entries[id];
+        auto const own = e.home == this->_self_id;
+        return File{
+          Address(e.address),
+          this->_homes[e.home],
+          own ? Time() : _time(e.time),
+          own ? _time(e.time) : Time(),
+          int(e.gossip_count),
+        };
+      }
+
+      std::uint32_t
+      Files::_slot(Address::Value const& address) const
+      {
+        // The first bytes of addresses pick their group, use further ones.
+        std::uint64_t h;
+        std::memcpy(&h, address + 8, sizeof h);
+        return ((h * 0x9e3779b97f4a7c15ull) >> 32) & (this->_slots.size() - 1);
+      }
+
+      std::uint32_t
+      Files::_find(Address::Value const& address, std::uint32_t home) const
+      {
+        if (this->_slots.empty())
+          return none;
+        auto const mask = this->_slots.size() - 1;
+        for (auto s = this->_slot(address);
+             this->_slots[s] != none;
+             s = (s + 1) & mask)
+        {
+          auto const id = this->_slots[s];
+          auto const& e = this->_entries[id];
+          if (e.home == home &&
+              !std::memcmp(e.address, address, sizeof e.address))
+            return id;
+        }
+        return none;
+      }
+
+      std::uint32_t
+      Files::_find(Address const& address, Address const& home_node) const
+      {
+        auto it = this->_home_ids.find(home_node);
+        if (it == this->_home_ids.end())
+          return none;
+        return this->_find(address.value(), it->second);
+      }
+
+      std::uint32_t
+      Files::_position(std::uint32_t id) const
+      {
+        auto const mask = this->_slots.size() - 1;
+        auto s = this->_slot(this->_entries[id].address);
+        while (this->_slots[s] != id)
+          s = (s + 1) & mask;
+        return s;
+      }
+
+      void
+      Files::_link(std::uint32_t id)
+      {
+        auto const mask = this->_slots.size() - 1;
+        auto s = this->_slot(this->_entries[id].address);
+        while (this->_slots[s] != none)
+          s = (s + 1) & mask;
+        this->_slots[s] = id;
+      }
+
+      void
+      Files::_unlink(std::uint32_t id)
+      {
+        // Shift following slots back instead of leaving a tombstone, unless
+        // that would move them before their home slot.
+        auto const mask = this->_slots.size() - 1;
+        auto hole = this->_position(id);
+        for (auto s = (hole + 1) & mask;
+             this->_slots[s] != none;
+             s = (s + 1) & mask)
+        {
+          auto const home = this->_slot(this->_entries[this->_slots[s]].address);
+          if (hole <= s ? hole < home && home <= s : hole < home || home <= s)
+            continue;
+          this->_slots[hole] = this->_slots[s];
+          hole = s;
+        }
+        this->_slots[hole] = none;
+      }
+
+      void
+      Files::_rehash(std::size_t slots)
+      {
+        this->_slots.assign(slots, none);
+        for (auto id = 0u; id < this->_entries.size(); ++id)
+          this->_link(id);
+      }
+
+      void
+      Files::_shrink()
+      {
+        if (this->_entries.capacity() > 4 * this->_entries.size() + 16)
+          this->_entries.shrink_to_fit();
+        auto slots = this->_slots.size();
+        while (slots > 16 && this->_entries.size() * 8 < slots)
+          slots /= 2;
+        if (slots != this->_slots.size())
+          this->_rehash(slots);
+      }
+
+      void
+      Files::_swap(std::uint32_t a, std::uint32_t b)
+      {
+        if (a == b)
+          return;
+        auto const sa = this->_position(a);
+        auto const sb = this->_position(b);
+        std::swap(this->_entries[a], this->_entries[b]);
+        this->_slots[sa] = b;
+        this->_slots[sb] = a;
+      }
+
+      void
+      Files::_erase(std::uint32_t id)
+      {
+        this->_unlink(id);
+        auto const home = this->_entries[id].home;
+        if (home == this->_self_id)
+          --this->_own;
+        this->_release(home);
+        auto move = [this] (std::uint32_t from, std::uint32_t to)
+          {
+            if (from == to)
+              return;
+            this->_slots[this->_position(from)] = to;
+            this->_entries[to] = this->_entries[from];
+          };
+        if (id < this->_fresh)
+        {
+          move(--this->_fresh, id);
+          id = this->_fresh;
+        }
+        move(this->_entries.size() - 1, id);
+        this->_entries.pop_back();
+      }
+
+      void
+      Files::_gossiped(std::uint32_t id, std::uint32_t time)
+      {
+        auto& e = this->_entries[id];
+        if (e.gossip_count < 255)
+          ++e.gossip_count;
+        if (e.home == this->_self_id)
+        {
+          e.time = time;
+          this->_enqueue(e.address, time);
+        }
+        if (id < this->_fresh && e.gossip_count >= this->_new_threshold)
+          this->_swap(id, --this->_fresh);
+      }
+
+      void
+      Files::_enqueue(Address::Value const& address, std::uint32_t time)
+      {
+        auto q = Queued{};
+        std::memcpy(q.address, address, sizeof q.address);
+        q.time = time;
+        if (this->_queue.empty() || !(time < this->_queue.back().time))
+          this->_queue.push_back(q);
+        else
+          this->_queue.insert(
+            std::upper_bound(
+              this->_queue.begin(), this->_queue.end(), time,
+              [] (std::uint32_t t, Queued const& q) { return t < q.time; }),
+            q);
+        // Drop outdated records once they outnumber the live ones.
+        if (this->_queue.size() > 2 * this->_own + 16)
+        {
+          auto live = std::deque<Queued>{};
+          auto ids = std::unordered_set<std::uint32_t>{};
+          for (auto const& q: this->_queue)
+          {
+            auto const id = this->_find(q.address, this->_self_id);
+            if (id != none && this->_entries[id].time == q.time &&
+                ids.insert(id).second)
+              live.push_back(q);
+          }
+          this->_queue = std::move(live);
+        }
+      }
+
+      std::uint32_t
+      Files::_intern(Address const& home_node)
+      {
+        auto it = this->_home_ids.find(home_node);
+        if (it != this->_home_ids.end())
+        {
+          ++this->_home_references[it->second];
+          return it->second;
+        }
+        auto id = std::uint32_t(this->_homes.size());
+        if (this->_home_free.empty())
+        {
+          ELLE_ASSERT_LT(id, 1u << 24);
+          this->_homes.push_back(home_node);
+          this->_home_references.push_back(1);
+        }
+        else
+        {
+          id = this->_home_free.back();
+          this->_home_free.pop_back();
+          this->_homes[id] = home_node;
+          this->_home_references[id] = 1;
+        }
+        this->_home_ids.emplace(home_node, id);
+        return id;
+      }
+
+      void
+      Files::_release(std::uint32_t home)
+      {
+        if (--this->_home_references[home] == 0)
+        {
+          this->_home_ids.erase(this->_homes[home]);
+          this->_home_free.push_back(home);
+        }
+      }
+
+      /*---------.
+      | Iterator |
+      `---------*/
+
+      Files::const_iterator::const_iterator(Files const& files,
+                                            std::uint32_t id)
+        : _files(&files)
+        , _id(id)
+      {}
+
+      File
+      Files::const_iterator::dereference() const
+      {
+        return this->_files->_file(this->_id);
+      }
+
+      bool
+      Files::const_iterator::equal(const_iterator const& other) const
+      {
+        return this->_id == other._id;
+      }
+
+      void
+      Files::const_iterator::increment()
+      {
+        ++this->_id;
+      }
+    }
+  }
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/iterator/iterator_facade.hpp>
+
+#include <elle/attribute.hh>
+
+#include <infinit/model/Address.hh>
+
+namespace infinit
+{
+  namespace overlay
+  {
+    namespace kelips
+    {
+      using Address = infinit::model::Address;
+      using Time = std::chrono::time_point<std::chrono::system_clock>;
+
+      struct File
+      {
+        Address address;
+        Address home_node;
+        Time last_seen;
+        Time last_gossip;
+        int gossip_count;
+      };
+
+      /// The locations of the files of a group: the nodes each one is stored
+      /// on, as last heard of.
+      ///
+      /// Entries are kept compact, as there is one per replica of every block
+      /// of the group: home nodes are interned to small integer ids, times
+      /// are kept to the second and only the one that matters is kept, the
+      /// last time an entry was seen for files stored on other nodes, the
+      /// last time it was gossiped about for files stored on this one. They
+      /// are stored in a dense vector, new entries first, indexed by an open
+      /// addressing table of positions.
+      ///
+      /// An entry takes 40 bytes and its position 4 bytes in a table at most
+      /// three quarters full, about 45 bytes in all, and up to twice that
+      /// right after the vector or the table grew. Files stored on this node
+      /// also have one or two 36-byte records in the gossip queue, about 80
+      /// to 110 bytes in all. Both shrink back once expired entries leave
+      /// them mostly empty.
+      ///
+      /// Files to gossip about are picked in time proportional to the number
+      /// picked, not to the size of the table: new entries are sampled from
+      /// the front of the vector, and the entries of files stored on this
+      /// node are queued by the last time they were gossiped about.
+      class Files
+      {
+      /*------.
+      | Types |
+      `------*/
+      public:
+        class const_iterator;
+
+      /*-------------.
+      | Construction |
+      `-------------*/
+      public:
+        /// @param self          The node this table belongs to.
+        /// @param new_threshold The number of gossips below which an entry
+        ///                      is new.
+        Files(Address self, int new_threshold);
+        Files(Files&&) = default;
+        ELLE_ATTRIBUTE_R(Address, self);
+        ELLE_ATTRIBUTE_R(int, new_threshold);
+
+      /*--------.
+      | Entries |
+      `--------*/
+      public:
+        std::size_t
+        size() const;
+        const_iterator
+        begin() const;
+        const_iterator
+        end() const;
+        /// The nodes `address` is known to be stored on.
+        std::vector<Address>
+        home_nodes(Address const& address) const;
+        /// Whether `address` is known to be stored on `home_node`.
+        bool
+        contains(Address const& address, Address const& home_node) const;
+        /// Add `file`, unless it is already known on its home node.
+        ///
+        /// @return Whether it was added.
+        bool
+        insert(File const& file);
+        /// Record that `address` was seen on `home_node` at `time`.
+        ///
+        /// @return Whether it is known there.
+        bool
+        seen(Address const& address, Address const& home_node, Time time);
+        /// Remove the entry of `address` on `home_node`, if any.
+        ///
+        /// @return Whether an entry was removed.
+        bool
+        erase(Address const& address, Address const& home_node);
+        /// Remove the entries of files stored on other nodes that were not
+        /// seen since `before`.
+        ///
+        /// @return The number of entries removed.
+        int
+        expire(Time before);
+
+      /*-------.
+      | Gossip |
+      `-------*/
+      public:
+        /// Pick distinct files to gossip about at `time`: up to `fresh` new
+        /// entries at random, up to `stale` entries stored on this node that
+        /// were not gossiped about since `before`, oldest first, and random
+        /// entries to make up for missing ones. Files stored on this node
+        /// are reported as last seen at `time`.
+        std::vector<File>
+        gossip(int fresh, int stale, Time time, Time before);
+        /// Number of new entries.
+        std::size_t
+        fresh() const;
+
+      /*--------.
+      | Details |
+      `--------*/
+      private:
+        struct Entry
+        {
+          Address::Value address;
+          /// Seconds since the epoch the file was last seen at, or last
+          /// gossiped about at if stored on this node.
+          std::uint32_t time;
+          std::uint32_t home: 24;
+          std::uint32_t gossip_count: 8;
+        };
+        static_assert(sizeof(Entry) == 40, "unexpected Kelips entry size");
+        /// An entry stored on this node, as of its last gossip at `time`.
+        struct Queued
+        {
+          Address::Value address;
+          std::uint32_t time;
+        };
+        static std::uint32_t const none;
+        static std::uint32_t
+        _seconds(Time time);
+        static Time
+        _time(std::uint32_t seconds);
+        File
+        _file(std::uint32_t id) const;
+        std::uint32_t
+        _slot(Address::Value const& address) const;
+        std::uint32_t
+        _find(Address::Value const& address, std::uint32_t home) const;
+        std::uint32_t
+        _find(Address const& address, Address const& home_node) const;
+        std::uint32_t
+        _position(std::uint32_t id) const;
+        void
+        _link(std::uint32_t id);
+        void
+        _unlink(std::uint32_t id);
+        void
+        _rehash(std::size_t slots);
+        /// Release the memory of the vector and table if mostly unused.
+        void
+        _shrink();
+        void
+        _swap(std::uint32_t a, std::uint32_t b);
+        void
+        _erase(std::uint32_t id);
+        void
+        _gossiped(std::uint32_t id, std::uint32_t time);
+        void
+        _enqueue(Address::Value const& address, std::uint32_t time);
+        std::uint32_t
+        _intern(Address const& home_node);
+        void
+        _release(std::uint32_t home);
+        /// Entries, the `fresh` first ones being new.
+        ELLE_ATTRIBUTE(std::vector<Entry>, entries);
+        ELLE_ATTRIBUTE(std::size_t, fresh);
+        /// Positions in `entries` by address, linearly probed.
+        ELLE_ATTRIBUTE(std::vector<std::uint32_t>, slots);
+        /// Entries stored on this node, by last gossip. Entries gossiped
+        /// about or removed since are dropped as they are met.
+        ELLE_ATTRIBUTE(std::deque<Queued>, queue);
+        ELLE_ATTRIBUTE(std::size_t, own);
+        ELLE_ATTRIBUTE(std::vector<Address>, homes);
+        ELLE_ATTRIBUTE(std::vector<std::uint32_t>, home_references);
+        ELLE_ATTRIBUTE((std::unordered_map<Address, std::uint32_t>), home_ids);
+        ELLE_ATTRIBUTE(std::vector<std::uint32_t>, home_free);
+        ELLE_ATTRIBUTE(std::uint32_t, self_id);
+      };
+
+      class Files::const_iterator
+        : public boost::iterator_facade<const_iterator,
+                                        File,
+                                        boost::forward_traversal_tag,
+                                        File>
+      {
+      public:
+        const_iterator(Files const& files, std::uint32_t id);
+      private:
+        friend class boost::iterator_core_access;
+        File
+        dereference() const;
+        bool
+        equal(const_iterator const& other) const;
+        void
+        increment();
+        Files const* _files;
+        std::uint32_t _id;
+      };
+    }
+  }
+}
@@ -841,7 +841,9 @@ namespace infinit
                  std::shared_ptr<Local> local,
                  infinit::model::doughnut::Doughnut* doughnut)
         : Overlay(doughnut, local)
+        , _self(doughnut->id())
         , _config(config)
+        , _state{Files(this->_self, this->_config.gossip.new_threshold), {}, {}}
         , _next_id(1)
         , _port(0)
         , _observer(!local)
@@ -894,7 +896,7 @@ namespace infinit
                       res.first.emplace(c.second.address,
                                         to_endpoints(c.second.endpoints));
                   for (auto const& f: this->_state.files)
-                    res.second.emplace_back(f.second.address, f.second.home_node);
+                    res.second.emplace_back(f.address, f.home_node);
                   // OH THE UGLY HACK, we need a place to store our own address
                   res.second.emplace_back(Address::null, _self);
                   return res;
@@ -915,7 +917,7 @@ namespace infinit
                     }
                   auto ofiles = std::multimap<Address, Address>{}; // ordered fileId -> owner
                   for (auto const& f: this->_state.files)
-                    ofiles.emplace(f.second.address, f.second.home_node);
+                    ofiles.emplace(f.address, f.home_node);
                   auto prev = Address::null;
                   for (auto const& f: ofiles)
                   {
@@ -1634,29 +1636,6 @@ namespace infinit
         #undef CASE
       };
 
-      template <typename T, typename C, typename U>
-      void
-      filterAndInsert(std::vector<Address> files, int target_count,
-                      std::unordered_map<Address, std::pair<Time, T>>& res,
-                      C& data,
-                      T U::*access)
-      {
-        if (signed(files.size()) > target_count)
-        {
-          if (target_count < signed(files.size()) - target_count)
-            files = pick_n(files, target_count);
-          else
-            files = remove_n(files, files.size() - target_count);
-        }
-        for (auto const& f: files)
-        {
-          auto& fd = data.find(f)->second;
-          res.emplace(f, std::make_pair(fd.last_seen, fd.*access));
-          fd.last_gossip = now();
-          fd.gossip_count++;
-        }
-      }
-
       void
       Node::filterAndInsert(
         std::vector<Address> files, int target_count, int group,
@@ -1678,15 +1657,6 @@ namespace infinit
         }
       }
 
-      void
-      Node::filterAndInsert(
-        std::vector<Address> files, int target_count,
-        std::unordered_map<Address, std::pair<Time, Address>>& res)
-      {
-        kelips::filterAndInsert(files, target_count, res, _state.files,
-                                &File::home_node);
-      }
-
       void
       filterAndInsert2(
         std::vector<Contact*> new_contacts, unsigned int max_new,
@@ -1799,15 +1769,6 @@ namespace infinit
         return res;
       }
 
-      template<typename C, typename K, typename V>
-      bool
-      has(C const& c, K const& k, V const& v)
-      {
-        auto its = c.equal_range(k);
-        return boost::find_if(its,
-          [&](auto const& e) { return e.second.second == v;}) != its.second;
-      }
-
       std::unordered_multimap<Address, std::pair<Time, Address>>
       Node::pickFiles()
       {
@@ -1819,146 +1780,17 @@ namespace infinit
         int max_old = _config.gossip.files / 2 + (_config.gossip.files % 2);
         ELLE_ASSERT_EQ(max_new + max_old, _config.gossip.files);
         auto const timeout = std::chrono::milliseconds(_config.gossip.old_threshold_ms);
-        // update self file last seen, this will avoid us some ifs at other places
-        int new_candidates = 0;
-        int old_candidates = 0;
-        for (auto& f: _state.files)
-        {
-          if (f.second.home_node == _self)
-            f.second.last_seen = current_time;
-          if (f.second.gossip_count < _config.gossip.new_threshold)
-            new_candidates++;
-          if (f.second.home_node == _self
-              && current_time - f.second.last_gossip > timeout)
-            old_candidates++;
-        }
         {
           static auto bench_new_candidates
             = elle::Bench("kelips.newCandidates", 10s);
-          static auto bench_old_candidates
-            = elle::Bench("kelips.oldCandidates", 10s);
-          bench_new_candidates.add(new_candidates);
-          bench_old_candidates.add(old_candidates);
+          bench_new_candidates.add(_state.files.fresh());
         }
+        // New files, then our own ones not gossiped about for a while, for
+        // which we can update the last_seen value, and random ones.
         auto res = Res{};
-        if (new_candidates  >= max_new * 2)
-        {
-          // pick max_new indexes in 0..new_candidates
-          auto indexes = elle::pick_n(max_new, new_candidates);
-          int ipos = 0;
-          int idx = 0;
-          for (auto& f: _state.files)
-          {
-            if (ipos >= signed(indexes.size()))
-              break;
-            if (f.second.gossip_count < _config.gossip.new_threshold)
-            {
-              if (idx == indexes[ipos])
-              {
-                res.emplace(f.first,
-                            std::make_pair(f.second.last_seen, f.second.home_node));
-                ipos++;
-              }
-              ++idx;
-            }
-          }
-          ELLE_ASSERT_EQ(max_new, signed(res.size()));
-        }
-        else
-        {
-          // insert new files
-          auto new_files = std::vector<std::pair<Address, std::pair<Time, Address>>>{};
-          for (auto const& f: _state.files)
-          {
-            if (f.second.gossip_count < _config.gossip.new_threshold)
-            new_files.emplace_back(f.first,
-              std::make_pair(f.second.last_seen, f.second.home_node));
-          }
-          if (signed(new_files.size()) > max_new)
-          {
-            if (max_new < signed(new_files.size()) - max_new)
-              new_files = pick_n(new_files, max_new);
-            else
-              new_files = remove_n(new_files, new_files.size() - max_new);
-          }
-          for (auto const& nf: new_files)
-            res.insert(nf);
-        }
-        if (old_candidates >= max_old * 2)
-        {
-          // pick max_new indexes in 0..new_candidates
-          auto indexes = elle::pick_n(max_old, old_candidates);
-          int ipos = 0;
-          int idx = 0;
-          for (auto& f: _state.files)
-          {
-            if (ipos >= signed(indexes.size()))
-              break;
-            if (f.second.home_node == _self
-                && current_time - f.second.last_gossip > timeout)
-            {
-              if (idx == indexes[ipos])
-              {
-                res.emplace(f.first,
-                            std::make_pair(f.second.last_seen, f.second.home_node));
-                ipos++;
-              }
-              ++idx;
-            }
-          }
-        }
-        else
-        {
-          // insert old files, only our own for which we can update the last_seen value
-          auto old_files = std::vector<std::pair<Address, std::pair<Time, Address>>>{};
-          for (auto& f: _state.files)
-            if (f.second.home_node == _self
-                && (current_time - f.second.last_gossip > timeout)
-                && !has(res, f.first, f.second.home_node))
-              old_files.emplace_back(f.first, std::make_pair(f.second.last_seen, f.second.home_node));
-          if (signed(old_files.size()) > max_old)
-          {
-            if (max_old < signed(old_files.size()) - max_old)
-              old_files = pick_n(old_files, max_old);
-            else
-              old_files = remove_n(old_files, old_files.size() - max_old);
-          }
-          for (auto const& nf: old_files)
-          {
-            res.insert(nf);
-          }
-        }
-        // Check if we have room for more files
-        if (res.size() < (unsigned)_config.gossip.files)
-        {
-          int n = _config.gossip.files - res.size();
-          // Pick at random
-          std::vector<std::pair<Address, std::pair<Time, Address>>> available;
-          for (auto const& f: _state.files)
-          {
-            if (!has(res, f.first, f.second.home_node))
-              available.emplace_back(f.first, std::make_pair(f.second.last_seen, f.second.home_node));
-          }
-          if (available.size() > unsigned(n))
-          {
-            if (n < signed(available.size()) - n)
-              available = pick_n(available, n);
-            else
-              available = remove_n(available, available.size() - n);
-          }
-          for (auto const& nf: available)
-          {
-            res.insert(nf);
-          }
-        }
-        for (auto const& r: res)
-        {
-          auto its = _state.files.equal_range(r.first);
-          auto it = boost::find_if(its,
-            [&](auto const& e) { return r.second.second == e.second.home_node;});
-          it->second.gossip_count++;
-          it->second.last_gossip = current_time;
-        }
+        for (auto const& f: _state.files.gossip(
+               max_new, max_old, current_time, current_time - timeout))
+          res.emplace(f.address, std::make_pair(f.last_seen, f.home_node));
         assert(res.size() == unsigned(_config.gossip.files) || res.size() == _state.files.size());
         return res;
       }
@@ -2111,28 +1943,18 @@ namespace infinit
           bool changed = false;
           for (auto const& f: p->files)
           {
-            auto its = _state.files.equal_range(f.first);
-            auto it = boost::find_if(its, [&](auto const& i) {
-                return i.second.home_node == f.second.second;});
-            if (it == its.second)
+            if (_state.files.seen(f.first, f.second.second, f.second.first))
+              ELLE_DUMP("%s: refresh %x seen at %s", *this,
+                        f.first, serialize_time(f.second.first));
+            else if (_state.files.insert(
+                       File{f.first, f.second.second, f.second.first, Time(), 0}))
             {
               changed = true;
-              _state.files.emplace(f.first,
-                                   File{f.first, f.second.second, f.second.first, Time(), 0});
               ELLE_DUMP("%s: registering %f live since %s (%s)", *this,
                          f.first,
                          std::chrono::duration_cast<std::chrono::seconds>(now() - f.second.first).count(),
                          (now() - f.second.first).count());
             }
-            else
-            {
-              ELLE_DUMP("%s: %s %s %s %x", *this,
-                       it->second.last_seen < f.second.first,
-                       serialize_time(it->second.last_seen),
-                       serialize_time(f.second.first),
-                       f.first);
-              it->second.last_seen = std::max(it->second.last_seen, f.second.first);
-            }
           }
           if (changed)
             this->_update_reachable_blocks();
@@ -2256,30 +2078,22 @@ namespace infinit
         static elle::Bench nlocalhit("kelips.localhit", 10s);
         int nhit = 0;
         int const fg = group_of(p->fileAddress);
-        auto const iterators = [&]
-          {
-            auto its = _state.files.equal_range(p->fileAddress);
-            auto res = std::vector<decltype(its.first)>{};
-            for (auto it = its.first; it != its.second; ++it)
-              res.push_back(it);
-            // Shuffle the match list.
-            elle::shuffle(res);
-            return res;
-          }();
-        for (auto it: iterators)
+        auto home_nodes = _state.files.home_nodes(p->fileAddress);
+        // Shuffle the match list.
+        elle::shuffle(home_nodes);
+        for (auto const& home_node: home_nodes)
         {
           ++nhit;
-          auto& file = *it;
           // Check if this one is already in results
           if (any_of(p->result,
                      [&](NodeLocation const& r) {
-                       return r.id() == file.second.home_node;
+                       return r.id() == home_node;
                      }))
             continue;
           // find the corresponding endpoints
           auto endpoints = Endpoints{};
           bool found = false;
-          if (file.second.home_node == _self)
+          if (home_node == _self)
           {
             ELLE_DEBUG("%s: found self", *this);
             if (_local_endpoints.empty())
@@ -2294,18 +2108,18 @@ namespace infinit
             found = true;
           }
           else if (auto contact_it
-                     = elle::find(_state.contacts[fg], file.second.home_node))
+                     = elle::find(_state.contacts[fg], home_node))
           {
             endpoints = to_endpoints(contact_it->second.endpoints);
             ELLE_DEBUG("%s: found other at %f:%s",
-                       *this, file.second.home_node, endpoints);
+                       *this, home_node, endpoints);
             found = true;
           }
           else
             ELLE_TRACE("%s: have file but not node", *this);
           if (found)
           {
-            auto res = NodeLocation{file.second.home_node, endpoints};
+            auto res = NodeLocation{home_node, endpoints};
             p->result.push_back(res);
             if (yield)
               (*yield)(res);
@@ -2526,11 +2340,7 @@ namespace infinit
           // check if we didn't already accept this file
           {
             // Check if we already have the block
-            auto its = _state.files.equal_range(p->fileAddress);
-            auto it = boost::find_if(its, [&](auto const& i) {
-                return i.second.home_node == _self;
-              });
-            if (it == its.second)
+            if (!_state.files.contains(p->fileAddress, _self))
             { // Nope, insert here
               // That makes us a home node for this address, but
               // wait until we get the RPC to store anything
@@ -2723,12 +2533,8 @@ namespace infinit
           if (!query_node && fg == _group && !ignore_local_cache)
           {
             // check if we have it locally
-            auto its = _state.files.equal_range(file);
-            auto it_us = boost::find_if(its,
-              [&](std::pair<const infinit::model::Address, File> const& f) {
-                return f.second.home_node == _self;
-              });
-            if (it_us != its.second && (n == 1 || local_override || fast_mode))
+            if (_state.files.contains(file, _self) &&
+                (n == 1 || local_override || fast_mode))
             {
               ELLE_DEBUG("get satifsfied locally");
               yield(NodeLocation(this->id(), {}));
@@ -2796,16 +2602,8 @@ namespace infinit
               {
                 if (fg == _group && !query_node)
                 { // oportunistically add the entry to our tables
-                  auto its = _state.files.equal_range(file);
-                  auto it_r = boost::find_if(its,
-                    [&](std::pair<const infinit::model::Address, File> const& f) {
-                      return f.second.home_node == e.id();
-                    });
-                  if (it_r == its.second)
-                  {
-                    _state.files.emplace(file, File{file, e.id(), now(), Time(), 0});
+                  if (_state.files.insert(File{file, e.id(), now(), Time(), 0}))
                     this->_update_reachable_blocks();
-                  }
                 }
                 if (result_set.insert(e.id()).second)
                   yield(e);
@@ -3086,22 +2884,9 @@ namespace infinit
       Node::cleanup()
       {
         static auto bench = elle::Bench("kelips.cleared_files", 10s);
-        auto it = _state.files.begin();
-        auto t = now();
         auto file_timeout = std::chrono::milliseconds(_config.file_timeout_ms);
-        int cleared = 0;
-        while (it != _state.files.end())
-        {
-          if (it->second.home_node != _self
-              && t - it->second.last_seen > file_timeout)
-          {
-            ELLE_DUMP("%s: erase file %x", *this, it->first);
-            it = _state.files.erase(it);
-            ++cleared;
-          }
-          else
-            ++it;
-        }
+        int cleared = _state.files.expire(now() - file_timeout);
+        ELLE_DUMP("%s: erased %s files", *this, cleared);
         if (cleared)
           this->_update_reachable_blocks();
         bench.add(cleared);
@@ -3196,15 +2981,8 @@ namespace infinit
       void
       Node::store(infinit::model::blocks::Block const& block)
       {
-        if (none_of(elle::as_range(_state.files.equal_range(block.address())),
-                    [&](Files::value_type const& f) {
-                      return f.second.home_node == _self;
-                    }))
-        {
-          _state.files.emplace(block.address(),
-                               File{block.address(), _self, now(), Time(), 0});
+        if (_state.files.insert(File{block.address(), _self, now(), Time(), 0}))
           this->_update_reachable_blocks();
-        }
         auto itp = boost::range::find(_promised_files, block.address());
         if (itp != _promised_files.end())
         {
@@ -3216,16 +2994,8 @@ namespace infinit
       void
       Node::remove(Address address)
       {
-        auto its = _state.files.equal_range(address);
-        for (auto it = its.first; it != its.second; ++it)
-        {
-          if (it->second.home_node == _self)
-          {
-            _state.files.erase(it);
-            this->_update_reachable_blocks();
-            break;
-          }
-        }
+        if (_state.files.erase(address, _self))
+          this->_update_reachable_blocks();
       }
 
       Overlay::WeakMember
@@ -3345,10 +3115,10 @@ namespace infinit
       void
       Node::reload_state(Local& l)
       {
-        auto keys = l.storage()->list();
+        auto keys = l.addresses();
         for (auto const& k: keys)
         {
-          _state.files.emplace(k,
+          _state.files.insert(
             File{k, _self, now(), now(), _config.gossip.new_threshold + 1});
           //ELLE_DUMP("%s: reloaded %x", *this, k);
         }
@@ -3412,15 +3182,9 @@ namespace infinit
         for (auto const& f: s.second)
           if (group_of(f.first) == _group
               && f.second != _self)
-          {
-            auto its = _state.files.equal_range(f.first);
-            auto it = boost::find_if(its, [&](auto const& i) {
-                return i.second.home_node == f.second;});
-            if (it == its.second)
-              _state.files.emplace(f.first,
-                                   File{f.first, f.second, now(), now(),
-                                       this->_config.gossip.new_threshold + 1});
-          }
+            _state.files.insert(
+              File{f.first, f.second, now(), now(),
+                   this->_config.gossip.new_threshold + 1});
         this->_update_reachable_blocks();
       }
 
@@ -3664,10 +3428,10 @@ namespace infinit
           std::vector<int> counts;
           std::set<Address> processed;
           for (auto const& f: files)
-            if (!processed.count(f.first))
+            if (!processed.count(f.address))
             {
-              processed.insert(f.first);
-              auto const count = boost::size(files.equal_range(f.first));
+              processed.insert(f.address);
+              auto const count = files.home_nodes(f.address).size();
               if (counts.size() <= count)
                 counts.resize(count + 1, 0);
               counts[count]++;
@@ -3717,12 +3481,12 @@ namespace infinit
           std::set<Address> processed;
           // get addresses with copy count < factor
           for (auto const& f: files)
-            if (!processed.count(f.first))
+            if (!processed.count(f.address))
             {
-              processed.insert(f.first);
-              auto const count = boost::size(files.equal_range(f.first));
+              processed.insert(f.address);
+              auto const count = files.home_nodes(f.address).size();
               if (count < factor)
-                to_scan.push_back(f.first);
+                to_scan.push_back(f.address);
             }
           std::vector<int> counts;
           auto scanner = [&]
@@ -3871,10 +3635,10 @@ namespace infinit
         std::unordered_map<Address, int> ids_mutable, ids_immutable;
         for (auto const& entry: this->_state.files)
         {
-          if (entry.second.address.mutable_block())
-            ids_mutable[entry.second.address] += 1;
+          if (entry.address.mutable_block())
+            ids_mutable[entry.address] += 1;
           else
-            ids_immutable[entry.second.address] += 1;
+            ids_immutable[entry.address] += 1;
         }
         Overlay::ReachableBlocks res {0,0,0,0,0,0,0};
         res.total_blocks = ids_mutable.size() + ids_immutable.size();
@@ -15,6 +15,7 @@
 #include <infinit/model/doughnut/Local.hh>
 #include <infinit/model/doughnut/Remote.hh>
 #include <infinit/overlay/Overlay.hh>
+#include <infinit/overlay/kelips/Files.hh>
 #include <infinit/silo/Silo.hh>
 
 namespace std
@@ -36,8 +37,6 @@ namespace infinit
       using Endpoint = model::Endpoint;
       using Endpoints = model::Endpoints;
       using NodeLocation = model::NodeLocation;
-      using Address = infinit::model::Address;
-      using Time = std::chrono::time_point<std::chrono::system_clock>;
       using Duration = Time::duration;
       //using Duration = std::chrono::duration<long, std::ratio<1, 1000000>>;
 
@@ -62,16 +61,6 @@ namespace infinit
       std::ostream&
       operator << (std::ostream& output, Contact const& contact);
 
-      struct File
-      {
-        Address address;
-        Address home_node;
-        Time last_seen;
-        Time last_gossip;
-        int gossip_count;
-      };
-
-      using Files = std::unordered_multimap<Address, File>;
       using Contacts = std::unordered_map<Address, Contact>;
       struct State
       {
@@ -272,10 +261,6 @@ namespace infinit
         void
         onPutFileReply(packet::PutFileReply*);
         void
-        filterAndInsert(
-          std::vector<Address> files, int target_count,
-          std::unordered_map<Address, std::pair<Time, Address>>& p);
-        void
         filterAndInsert(
           std::vector<Address> files, int target_count, int group,
           std::unordered_map<Address, std::vector<TimedEndpoint>>& p);
@@ -196,7 +196,7 @@ namespace infinit
        ELLE_DEBUG("local endpoints: %s", local_endpoints);
        this->_infos.emplace(local->id(), local_endpoints, Clock::now(),
                             LamportAge(), this->storing());
-       for (auto const& key: local->storage()->list())
+       for (auto const& key: local->addresses())
          this->_address_book.emplace(this->id(), key);
        this->_update_reachable_blocks();
        ELLE_DEBUG("loaded %s entries from storage",
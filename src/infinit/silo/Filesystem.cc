@@ -1,13 +1,22 @@
 #include <infinit/silo/Filesystem.hh>
 
-#include <iterator>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
 
-#include <boost/filesystem/fstream.hpp>
+#ifdef INFINIT_WINDOWS
+# include <boost/filesystem/fstream.hpp>
+#else
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
 #include <boost/filesystem/operations.hpp>
 
 #include <elle/bench.hh>
 #include <elle/Duration.hh>
+#include <elle/finally.hh>
 #include <elle/log.hh>
 
 #include <infinit/silo/Collision.hh>
@@ -22,17 +31,137 @@ namespace infinit
   {
     namespace bfs = boost::filesystem;
 
+    namespace
+    {
+      auto const tmp_suffix = std::string(".tmp");
+
+#ifndef INFINIT_WINDOWS
+      /// Alignment of O_DIRECT transfers.
+      auto const direct_alignment = std::size_t(4096);
+
+      [[noreturn]]
+      void
+      system_error(std::string const& action, bfs::path const& path)
+      {
+        elle::err("unable to %s %s: %s", action, path, std::strerror(errno));
+      }
+
+      int
+      open_file(bfs::path const& path, int flags, bool& direct)
+      {
+#ifdef O_DIRECT
+        if (direct)
+        {
+          auto const fd = ::open(path.string().c_str(),
+                                 flags | O_CLOEXEC | O_DIRECT, 0666);
+          if (fd >= 0 || errno != EINVAL)
+            return fd;
+          ELLE_WARN("%s: direct I/O unsupported, using the page cache", path);
+          direct = false;
+        }
+#else
+        direct = false;
+#endif
+        return ::open(path.string().c_str(), flags | O_CLOEXEC, 0666);
+      }
+
+      /// Read up to \a size bytes, stopping at end of file.
+      ///
+      /// @return The number of bytes read, or -1 on error.
+      std::size_t
+      read_all(int fd, uint8_t* data, std::size_t size)
+      {
+        auto done = std::size_t(0);
+        while (done < size)
+        {
+          auto const wanted = size - done;
+          auto const n = ::pread(fd, data + done, wanted, done);
+          if (n < 0 && errno == EINTR)
+            continue;
+          if (n < 0)
+            return std::size_t(-1);
+          done += n;
+          // Short reads only happen at end of file, where O_DIRECT would
+          // reject a further unaligned read.
+          if (std::size_t(n) < wanted)
+            break;
+        }
+        return done;
+      }
+
+      bool
+      write_all(int fd, uint8_t const* data, std::size_t size)
+      {
+        auto done = std::size_t(0);
+        while (done < size)
+        {
+          auto const n = ::pwrite(fd, data + done, size - done, done);
+          if (n < 0 && errno == EINTR)
+            continue;
+          if (n < 0)
+            return false;
+          done += n;
+        }
+        return true;
+      }
+
+      /// Run \a f on a zeroed, O_DIRECT-aligned copy of \a size bytes.
+      template <typename F>
+      auto
+      with_aligned(std::size_t size, F const& f)
+      {
+        auto const padded =
+          (size + direct_alignment - 1) / direct_alignment * direct_alignment;
+        void* aligned = nullptr;
+        if (::posix_memalign(&aligned, direct_alignment,
+                             std::max(padded, direct_alignment)))
+          throw std::bad_alloc();
+        elle::SafeFinally release([&] { ::free(aligned); });
+        std::memset(aligned, 0, padded);
+        return f(static_cast<uint8_t*>(aligned), padded);
+      }
+
+      bool
+      flush(int fd)
+      {
+#ifdef INFINIT_LINUX
+        return ::fdatasync(fd) == 0;
+#else
+        return ::fsync(fd) == 0;
+#endif
+      }
+#endif
+    }
+
     Filesystem::Filesystem(bfs::path root,
-                           boost::optional<int64_t> capacity)
+                           boost::optional<int64_t> capacity,
+                           bool sync,
+                           bool direct)
       : Silo(std::move(capacity))
       , _root(std::move(root))
+      , _sync(sync)
+      , _direct(direct)
     {
       bfs::create_directories(this->_root);
       for (auto const& dir: bfs::directory_iterator(this->_root))
         if (is_directory(dir.path()))
+        {
+          auto const name = dir.path().filename().string();
+          if (name.size() == 2 && std::isxdigit(name[0]) &&
+              std::isxdigit(name[1]))
+            this->_directories.set(std::strtol(name.c_str(), nullptr, 16));
           for (auto const& block: bfs::directory_iterator(dir.path()))
           {
             auto const path = block.path();
+            if (!is_block(block))
+            {
+              if (path.extension() == tmp_suffix)
+              {
+                ELLE_DEBUG("remove interrupted write %s", path);
+                bfs::remove(path);
+              }
+              continue;
+            }
             auto const size = file_size(path);
             auto const name = path.filename().string();
             auto const addr = infinit::model::Address::from_string(name);
@@ -41,6 +170,7 @@ namespace infinit
             this->_block_count += 1;
             _notify_metrics();
           }
+        }
       ELLE_DEBUG("Recovering _usage (%s) and _size_cache (%s)",
                  this->_usage, this->_size_cache.size());
     }
@@ -48,19 +178,54 @@ namespace infinit
     elle::Buffer
     Filesystem::_get(Key key) const
     {
-      auto&& input = bfs::ifstream(this->_path(key), std::ios::binary);
+      auto const path = this->_path(key);
+#ifdef INFINIT_WINDOWS
+      auto&& input = bfs::ifstream(path, std::ios::binary);
       if (!input.good())
       {
-        ELLE_DEBUG("unable to open for reading: %s", this->_path(key));
+        ELLE_DEBUG("unable to open for reading: %s", path);
+        throw MissingKey(key);
+      }
+      static elle::Bench bench("bench.fsstorage.get", std::chrono::seconds(10000));
+      elle::Bench::BenchScope bs(bench);
+      input.seekg(0, std::ios::end);
+      auto res = elle::Buffer(std::size_t(input.tellg()));
+      input.seekg(0, std::ios::beg);
+      input.read(reinterpret_cast<char*>(res.mutable_contents()), res.size());
+      res.size(input.gcount());
+#else
+      auto direct = this->_direct;
+      auto const fd = open_file(path, O_RDONLY, direct);
+      this->_direct = direct;
+      if (fd < 0)
+      {
+        if (errno != ENOENT)
+          system_error("open for reading", path);
+        ELLE_DEBUG("unable to open for reading: %s", path);
         throw MissingKey(key);
       }
+      elle::SafeFinally close([fd] { ::close(fd); });
       static elle::Bench bench("bench.fsstorage.get", std::chrono::seconds(10000));
       elle::Bench::BenchScope bs(bench);
-      elle::Buffer res;
-      auto&& output = elle::IOStream(res.ostreambuf());
-      std::copy(std::istreambuf_iterator<char>(input),
-                std::istreambuf_iterator<char>(),
-                std::ostreambuf_iterator<char>(output));
+      struct stat st;
+      if (::fstat(fd, &st))
+        system_error("stat", path);
+      auto res = elle::Buffer(std::size_t(st.st_size));
+      auto const read = direct
+        ? with_aligned(res.size(), [&] (uint8_t* data, std::size_t padded)
+          {
+            auto const n = read_all(fd, data, padded);
+            if (n == std::size_t(-1))
+              return n;
+            std::memcpy(res.mutable_contents(), data, std::min(n, res.size()));
+            return std::min(n, res.size());
+          })
+        : read_all(fd, res.mutable_contents(), res.size());
+      if (read == std::size_t(-1))
+        system_error("read", path);
+      // The block may have been replaced by a smaller one meanwhile.
+      res.size(read);
+#endif
       ELLE_DUMP("content: %s", res);
       return res;
     }
@@ -73,8 +238,10 @@ namespace infinit
       static elle::Bench bench("bench.fsstorage.set", std::chrono::seconds(10000));
       elle::Bench::BenchScope bs(bench);
       auto const path = this->_path(key);
-      bool const exists = bfs::exists(path);
-      int const size = exists ? bfs::file_size(path) : 0;
+      boost::system::error_code erc;
+      auto const current = bfs::file_size(path, erc);
+      bool const exists = !erc;
+      int const size = exists ? current : 0;
       int delta = value.size() - size;
       if (this->capacity() && this->usage() + delta > this->capacity())
         throw InsufficientSpace(delta, this->usage(), this->capacity().get());
@@ -82,11 +249,63 @@ namespace infinit
         throw MissingKey(key);
       if (exists && !update)
         throw Collision(key);
-      auto&& output = bfs::ofstream(path, std::ios::binary);
-      if (!output.good())
-        elle::err("unable to open for writing: %s", path);
-      output.write(
-        reinterpret_cast<const char*>(value.contents()), value.size());
+      auto const index = key.value()[0];
+      if (!this->_directories.test(index))
+      {
+        bfs::create_directories(path.parent_path());
+        this->_directories.set(index);
+      }
+      // Write aside and rename over the block, so readers and crashes only
+      // ever see complete blocks.
+      auto const tmp = bfs::path(path.string() + tmp_suffix);
+      elle::SafeFinally cleanup([&] { bfs::remove(tmp, erc); });
+#ifdef INFINIT_WINDOWS
+      {
+        auto&& output = bfs::ofstream(tmp, std::ios::binary);
+        if (!output.good())
+          elle::err("unable to open for writing: %s", tmp);
+        output.write(
+          reinterpret_cast<const char*>(value.contents()), value.size());
+        if (!output.good())
+          elle::err("unable to write %s", tmp);
+      }
+#else
+      {
+        auto direct = this->_direct;
+        auto const fd = open_file(tmp, O_WRONLY | O_CREAT | O_TRUNC, direct);
+        this->_direct = direct;
+        if (fd < 0)
+          system_error("open for writing", tmp);
+        elle::SafeFinally close([fd] { ::close(fd); });
+        auto const written = direct
+          ? with_aligned(value.size(), [&] (uint8_t* data, std::size_t padded)
+            {
+              std::memcpy(data, value.contents(), value.size());
+              return write_all(fd, data, padded) &&
+                ::ftruncate(fd, value.size()) == 0;
+            })
+          : write_all(fd, value.contents(), value.size());
+        if (!written)
+          system_error("write", tmp);
+        if (this->_sync && !flush(fd))
+          system_error("flush", tmp);
+      }
+#endif
+      bfs::rename(tmp, path);
+      cleanup.abort();
+#ifndef INFINIT_WINDOWS
+      // Make the directory entry of new blocks durable too.
+      if (this->_sync && !exists)
+      {
+        auto const dir = ::open(path.parent_path().string().c_str(),
+                                O_RDONLY | O_CLOEXEC);
+        if (dir >= 0)
+        {
+          ::fsync(dir);
+          ::close(dir);
+        }
+      }
+#endif
       if (insert && update)
         ELLE_DEBUG("%s: block %s", *this, exists ? "updated" : "inserted");
 
@@ -132,26 +351,29 @@ namespace infinit
     {
       auto dirname = elle::sprintf("%x", elle::ConstWeakBuffer(
         key.value(), 1)).substr(2);
-      auto dir = this->root() / dirname;
-      if (!bfs::exists(dir))
-        bfs::create_directory(dir);
-      return dir / elle::sprintf("%x", key);
+      return this->root() / dirname / elle::sprintf("%x", key);
     }
 
     FilesystemSiloConfig::FilesystemSiloConfig(
         std::string name,
         std::string path,
         boost::optional<int64_t> capacity,
-        boost::optional<std::string> description)
+        boost::optional<std::string> description,
+        boost::optional<bool> sync,
+        boost::optional<bool> direct)
       : SiloConfig(
           std::move(name), std::move(capacity), std::move(description))
       , path(std::move(path))
+      , sync(std::move(sync))
+      , direct(std::move(direct))
     {}
 
     FilesystemSiloConfig::FilesystemSiloConfig(
       elle::serialization::SerializerIn& s)
       : SiloConfig(s)
       , path(s.deserialize<std::string>("path"))
+      , sync(s.deserialize<boost::optional<bool>>("sync"))
+      , direct(s.deserialize<boost::optional<bool>>("direct"))
     {}
 
     void
@@ -159,13 +381,16 @@ namespace infinit
     {
       SiloConfig::serialize(s);
       s.serialize("path", this->path);
+      s.serialize("sync", this->sync);
+      s.serialize("direct", this->direct);
     }
 
     std::unique_ptr<infinit::silo::Silo>
     FilesystemSiloConfig::make()
     {
-      return std::make_unique<infinit::silo::Filesystem>(this->path,
-                                                             this->capacity);
+      return std::make_unique<infinit::silo::Filesystem>(
+        this->path, this->capacity,
+        this->sync.value_or(false), this->direct.value_or(false));
     }
 
     static const elle::serialization::Hierarchy<SiloConfig>::
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <bitset>
+
 #include <boost/filesystem/path.hpp>
 
 #include <infinit/silo/Key.hh>
@@ -9,12 +11,21 @@ namespace infinit
 {
   namespace silo
   {
+    /// Store blocks as files, spread in subdirectories by first address byte.
+    ///
+    /// Blocks are read with a single pread into a buffer sized after the file
+    /// and written to a temporary file atomically renamed over the block, so a
+    /// crash never leaves a torn block behind.
     class Filesystem
       : public Silo
     {
     public:
+      /// @param sync   Flush blocks to the device before acknowledging writes.
+      /// @param direct Bypass the page cache where supported (O_DIRECT).
       Filesystem(boost::filesystem::path root,
-                 boost::optional<int64_t> capacity = {});
+                 boost::optional<int64_t> capacity = {},
+                 bool sync = false,
+                 bool direct = false);
       std::string
       type() const override { return "filesystem"; }
 
@@ -28,10 +39,15 @@ namespace infinit
       std::vector<Key>
       _list() override;
       ELLE_ATTRIBUTE_R(boost::filesystem::path, root);
+      ELLE_ATTRIBUTE_R(bool, sync);
+      /// Disabled on the fly if the filesystem does not support it.
+      ELLE_ATTRIBUTE_R(bool, direct, mutable);
 
     private:
       boost::filesystem::path
       _path(Key const& key) const;
+      /// Subdirectories known to exist, by first address byte.
+      ELLE_ATTRIBUTE(std::bitset<256>, directories);
     };
 
     struct FilesystemSiloConfig
@@ -40,13 +56,17 @@ namespace infinit
       FilesystemSiloConfig(std::string name,
                               std::string path,
                               boost::optional<int64_t> capacity,
-                              boost::optional<std::string> description);
+                              boost::optional<std::string> description,
+                              boost::optional<bool> sync = {},
+                              boost::optional<bool> direct = {});
       FilesystemSiloConfig(elle::serialization::SerializerIn& input);
       void
       serialize(elle::serialization::Serializer& s) override;
       std::unique_ptr<infinit::silo::Silo>
       make() override;
       std::string path;
+      boost::optional<bool> sync;
+      boost::optional<bool> direct;
     };
   }
 }
@@ -1,79 +1,509 @@
 #include <infinit/silo/Mirror.hh>
 #include <infinit/model/Address.hh>
 
+#include <algorithm>
+#include <numeric>
+
+#include <elle/With.hh>
+#include <elle/finally.hh>
+#include <elle/log.hh>
 #include <elle/reactor/Scope.hh>
+#include <elle/reactor/exception.hh>
+#include <elle/reactor/scheduler.hh>
 
 #include <boost/algorithm/string.hpp>
 
 #include <elle/factory.hh>
 
+#include <infinit/silo/MissingKey.hh>
+
 ELLE_LOG_COMPONENT("infinit.storage.Mirror");
 
 namespace infinit
 {
   namespace silo
   {
+    namespace
+    {
+      /// Weight of the latest read in latency averages.
+      auto const smoothing = 0.2;
+      /// Every that many reads, try another backend than the fastest.
+      auto const exploration = 16u;
+      /// Hedging delay until enough latencies are sampled.
+      auto const default_hedge_delay = std::chrono::milliseconds(50);
+      /// Delay between repairs, doubled while they fail.
+      auto const repair_delay = boost::posix_time::seconds(1);
+      auto const max_repair_delay = boost::posix_time::minutes(1);
+
+      int64_t
+      microseconds(Mirror::Clock::duration d)
+      {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d)
+          .count();
+      }
+    }
+
     Mirror::Mirror(std::vector<std::unique_ptr<Silo>> backend,
-                   bool balance_reads, bool parallel)
+                   bool balance_reads, bool parallel,
+                   int write_acks, bool hedge, double hedge_percentile)
       : _balance_reads(balance_reads)
       , _backend(std::move(backend))
       , _read_counter(0)
       , _parallel(parallel)
-    {}
+      , _write_acks(std::max(write_acks, 0))
+      , _hedge(hedge)
+      , _hedge_percentile(std::min(std::max(hedge_percentile, 0.), 1.))
+      , _statistics(this->_backend.size())
+      , _hedged(0)
+      , _lagging(this->_backend.size())
+      , _turns(this->_backend.size())
+      , _pending(0)
+      , _repairs(this->_backend.size())
+    {
+      this->_idle.open();
+    }
+
+    Mirror::~Mirror()
+    {
+      this->_repairer.reset();
+      // Background writes reference the backends.
+      if (this->_pending)
+        elle::With<elle::reactor::Thread::NonInterruptible>() << [&]
+        {
+          elle::reactor::wait(this->_idle);
+        };
+    }
+
+    /*--------.
+    | Reading |
+    `--------*/
 
     elle::Buffer
     Mirror::_get(Key k) const
     {
-      const_cast<Mirror*>(this)->_read_counter++;
-      int target = _balance_reads? _read_counter % _backend.size() : 0;
-      return _backend[target]->get(k);
+      auto const order = this->_read_order(k);
+      if (this->_hedge && order.size() > 1 &&
+          elle::reactor::Scheduler::scheduler())
+        return this->_hedged_read(k, order);
+      auto error = std::exception_ptr{};
+      for (auto i: order)
+        try
+        {
+          return this->_read(i, k);
+        }
+        catch (elle::reactor::Terminate const&)
+        {
+          throw;
+        }
+        catch (elle::Error const& e)
+        {
+          ELLE_TRACE("%s: reading %x from backend %s failed: %s",
+                     this, k, i, e);
+          if (!error)
+            error = std::current_exception();
+        }
+      std::rethrow_exception(error);
     }
 
+    std::vector<int>
+    Mirror::_read_order(Key k) const
+    {
+      auto res = std::vector<int>{};
+      for (int i = 0; i < signed(this->_backend.size()); ++i)
+        if (!this->_lagging[i].count(k) && !this->_repairs[i].count(k))
+          res.push_back(i);
+      // Concurrent writes are in flight everywhere.
+      if (res.empty())
+      {
+        res.resize(this->_backend.size());
+        std::iota(res.begin(), res.end(), 0);
+      }
+      if (!this->_balance_reads)
+        return res;
+      auto const& stats = this->_statistics;
+      std::stable_sort(
+        res.begin(), res.end(),
+        [&] (int a, int b) { return stats[a].average < stats[b].average; });
+      if (++this->_read_counter % exploration == 0)
+      {
+        auto const explore =
+          res.begin() + (this->_read_counter / exploration) % res.size();
+        std::rotate(res.begin(), explore, explore + 1);
+      }
+      return res;
+    }
+
+    elle::Buffer
+    Mirror::_read(int backend, Key k) const
+    {
+      auto& stats = this->_statistics[backend];
+      auto const start = Clock::now();
+      try
+      {
+        auto res = this->_backend[backend]->get(k);
+        stats.add(Clock::now() - start);
+        return res;
+      }
+      catch (MissingKey const&)
+      {
+        stats.add(Clock::now() - start);
+        throw;
+      }
+      catch (elle::reactor::Terminate const&)
+      {
+        // Hedged away: it took at least that long.
+        stats.add(Clock::now() - start);
+        throw;
+      }
+      catch (elle::Error const&)
+      {
+        ++stats.errors;
+        stats.add(Clock::now() - start);
+        throw;
+      }
+    }
+
+    elle::Buffer
+    Mirror::_hedged_read(Key k, std::vector<int> const& order) const
+    {
+      auto res = boost::optional<elle::Buffer>{};
+      auto errors = std::vector<std::exception_ptr>{};
+      auto launched = 0;
+      elle::reactor::Barrier changed;
+      elle::With<elle::reactor::Scope>() << [&] (elle::reactor::Scope& s)
+      {
+        auto const launch = [&]
+          {
+            auto const i = order[launched++];
+            s.run_background(
+              elle::sprintf("%s: read %x from %s", this, k, i),
+              [&, i]
+              {
+                try
+                {
+                  auto b = this->_read(i, k);
+                  if (!res)
+                    res.emplace(std::move(b));
+                }
+                catch (elle::reactor::Terminate const&)
+                {
+                  throw;
+                }
+                catch (elle::Error const& e)
+                {
+                  ELLE_TRACE("%s: reading %x from backend %s failed: %s",
+                             this, k, i, e);
+                  errors.emplace_back(std::current_exception());
+                }
+                changed.open();
+              });
+          };
+        launch();
+        while (!res)
+        {
+          auto const running = launched - signed(errors.size());
+          auto const remaining = launched < signed(order.size());
+          if (!running)
+          {
+            if (!remaining)
+              break;
+            // Fail over to the next backend.
+            launch();
+            continue;
+          }
+          changed.close();
+          if (remaining)
+          {
+            auto const delay = this->_statistics[order[launched - 1]]
+              .percentile(this->_hedge_percentile)
+              .value_or(default_hedge_delay);
+            if (!elle::reactor::wait(
+                  changed, boost::posix_time::microseconds(
+                    std::max<int64_t>(microseconds(delay), 1))))
+            {
+              ELLE_DEBUG("%s: hedge read of %x to backend %s",
+                         this, k, order[launched]);
+              ++this->_hedged;
+              launch();
+            }
+          }
+          else
+            elle::reactor::wait(changed);
+        }
+        // Leaving the scope cancels slower reads.
+      };
+      if (res)
+        return std::move(*res);
+      std::rethrow_exception(errors.front());
+    }
+
+    /*--------.
+    | Writing |
+    `--------*/
+
     int
     Mirror::_set(Key k, elle::Buffer const& value, bool insert, bool update)
     {
-      if (_parallel)
+      if (this->_acks() == signed(this->_backend.size()))
+        return this->_write(k, "set", [&] (Silo& s)
+          {
+            return s.set(k, value, insert, update);
+          });
+      // Writes may outlive the caller's buffer.
+      auto data = std::make_shared<elle::Buffer>(value);
+      return this->_write(k, "set", [data, k, insert, update] (Silo& s)
+        {
+          return s.set(k, *data, insert, update);
+        });
+    }
+
+    int
+    Mirror::_erase(Key k)
+    {
+      return this->_write(k, "erase", [k] (Silo& s) { return s.erase(k); });
+    }
+
+    int
+    Mirror::_write(Key k, std::string const& what,
+                   std::function<int (Silo&)> const& op)
+    {
+      auto const n = signed(this->_backend.size());
+      auto const acks = this->_acks();
+      if (!this->_parallel || !elle::reactor::Scheduler::scheduler())
+      {
+        auto res = 0;
+        for (int i = 0; i < n; ++i)
+        {
+          auto const delta = op(*this->_backend[i]);
+          if (i == 0)
+            res = delta;
+        }
+        return res;
+      }
+      if (acks == n)
+      {
+        auto res = 0;
         elle::With<elle::reactor::Scope>() << [&] (elle::reactor::Scope& s)
         {
-          for (auto& e: _backend)
+          for (int i = 0; i < n; ++i)
           {
-            Silo* ptr = e.get();
-            s.run_background("mirror set", [&,ptr] {
-                ptr->set(k, value, insert, update);
+            auto const done = std::make_shared<elle::reactor::Barrier>();
+            auto const previous = this->_enqueue(i, k, done);
+            s.run_background(
+              elle::sprintf("mirror %s", what), [&, i, previous, done]
+              {
+                elle::SafeFinally dequeue([&] { this->_dequeue(i, k, done); });
+                auto const delta = this->_ordered(i, k, previous, op);
+                if (i == 0)
+                  res = delta;
               });
           }
           s.wait();
         };
-      else
-        for (auto& e: _backend)
-          e->set(k, value, insert, update);
-      return 0;
+        return res;
+      }
+      // Acknowledge after `acks` backends, let the others finish alone.
+      struct Write
+      {
+        int acked = 0;
+        int failed = 0;
+        int delta = 0;
+        std::exception_ptr error;
+        std::vector<int> failures;
+        elle::reactor::Barrier changed;
+      };
+      auto w = std::make_shared<Write>();
+      for (int i = 0; i < n; ++i)
+      {
+        this->_lagging[i].insert(k);
+        if (this->_pending++ == 0)
+          this->_idle.close();
+        auto const done = std::make_shared<elle::reactor::Barrier>();
+        auto const previous = this->_enqueue(i, k, done);
+        new elle::reactor::Thread(
+          elle::sprintf("mirror %s %x on %s", what, k, i),
+          [this, w, k, op, i, what, acks, previous, done]
+          {
+            elle::SafeFinally finished([&]
+              {
+                this->_dequeue(i, k, done);
+                auto& lagging = this->_lagging[i];
+                lagging.erase(lagging.find(k));
+                if (--this->_pending == 0)
+                  this->_idle.open();
+                w->changed.open();
+              });
+            try
+            {
+              auto const delta = this->_ordered(i, k, previous, op);
+              if (!w->acked++)
+                w->delta = delta;
+            }
+            catch (elle::Error const& e)
+            {
+              if (!w->failed++)
+                w->error = std::current_exception();
+              w->failures.push_back(i);
+              if (w->acked >= acks)
+              {
+                ELLE_WARN("%s: %s %x on backend %s failed after "
+                          "acknowledgment, queue for repair: %s",
+                          this, what, k, i, e);
+                this->_failed(i, k);
+              }
+            }
+          },
+          true);
+      }
+      while (w->acked < acks && w->failed <= n - acks)
+      {
+        w->changed.close();
+        elle::reactor::wait(w->changed);
+      }
+      if (w->acked < acks)
+        std::rethrow_exception(w->error);
+      // Backends that failed before the acknowledgment lag behind too.
+      for (auto i: w->failures)
+        this->_failed(i, k);
+      return w->delta;
+    }
+
+    Mirror::Turn
+    Mirror::_enqueue(int backend, Key k, Turn const& done)
+    {
+      auto& last = this->_turns[backend][k];
+      auto res = std::move(last);
+      last = done;
+      return res;
+    }
+
+    void
+    Mirror::_dequeue(int backend, Key k, Turn const& done)
+    {
+      done->open();
+      auto& turns = this->_turns[backend];
+      auto it = turns.find(k);
+      if (it != turns.end() && it->second == done)
+        turns.erase(it);
     }
 
     int
-    Mirror::_erase(Key k)
+    Mirror::_ordered(int backend, Key k, Turn const& previous,
+                     std::function<int (Silo&)> const& op)
     {
-      if (_parallel)
+      if (previous)
+        elle::reactor::wait(*previous);
+      auto const res = op(*this->_backend[backend]);
+      // Any earlier failed write is superseded.
+      this->_repairs[backend].erase(k);
+      return res;
+    }
+
+    /*-------.
+    | Repair |
+    `-------*/
+
+    void
+    Mirror::_failed(int backend, Key k)
+    {
+      this->_repairs[backend].insert(k);
+      if (elle::reactor::Scheduler::scheduler() &&
+          (!this->_repairer || this->_repairer->done()))
+        this->_repairer.reset(new elle::reactor::Thread(
+          elle::sprintf("%s: repair", this),
+          [this] { this->_repair_loop(); }));
+    }
+
+    int
+    Mirror::repair()
+    {
+      auto res = 0;
+      for (int i = 0; i < signed(this->_backend.size()); ++i)
       {
-        elle::With<elle::reactor::Scope>() << [&] (elle::reactor::Scope& s)
-        {
-          for (auto& e: _backend)
+        auto const keys = std::vector<Key>(this->_repairs[i].begin(),
+                                           this->_repairs[i].end());
+        for (auto const& k: keys)
+          try
           {
-            Silo* ptr = e.get();
-            s.run_background("mirror erase", [&,ptr] { ptr->erase(k);});
+            this->_repair(i, k);
+          }
+          catch (elle::reactor::Terminate const&)
+          {
+            throw;
+          }
+          catch (elle::Error const& e)
+          {
+            ELLE_TRACE("%s: repairing %x on backend %s failed: %s",
+                       this, k, i, e);
+            ++res;
           }
-          s.wait();
-        };
       }
-      else
+      return res;
+    }
+
+    void
+    Mirror::_repair(int backend, Key k)
+    {
+      // Take a turn first, so writes issued meanwhile land after the copy.
+      auto const done = std::make_shared<elle::reactor::Barrier>();
+      auto const previous = this->_enqueue(backend, k, done);
+      elle::SafeFinally dequeue([&] { this->_dequeue(backend, k, done); });
+      if (previous)
+        elle::reactor::wait(*previous);
+      if (!this->_repairs[backend].count(k))
+        return;
+      ELLE_TRACE_SCOPE("%s: repair %x on backend %s", this, k, backend);
+      for (int i = 0; i < signed(this->_backend.size()); ++i)
       {
-        for (auto& e: _backend)
+        if (i == backend ||
+            this->_lagging[i].count(k) || this->_repairs[i].count(k))
+          continue;
+        auto value = boost::optional<elle::Buffer>{};
+        try
         {
-          e->erase(k);
+          value = this->_backend[i]->get(k);
         }
+        catch (MissingKey const&)
+        {}
+        this->_ordered(backend, k, {}, [&] (Silo& s)
+          {
+            if (value)
+              return s.set(k, *value, true, true);
+            try
+            {
+              return s.erase(k);
+            }
+            catch (MissingKey const&)
+            {
+              return 0;
+            }
+          });
+        return;
       }
+      elle::err("no up to date backend holds %x", k);
+    }
+
+    void
+    Mirror::_repair_loop()
+    {
+      auto delay = elle::reactor::Duration(repair_delay);
+      while (std::any_of(this->_repairs.begin(), this->_repairs.end(),
+                         [] (auto const& keys) { return !keys.empty(); }))
+      {
+        elle::reactor::sleep(delay);
+        if (this->repair())
+          delay = std::min<elle::reactor::Duration>(delay * 2,
+                                                    max_repair_delay);
+        else
+          delay = repair_delay;
+      }
+    }
 
-      return 0;
+    int
+    Mirror::_acks() const
+    {
+      auto const n = signed(this->_backend.size());
+      return this->_write_acks ? std::min(this->_write_acks, n) : n;
     }
 
     std::vector<Key>
@@ -82,6 +512,36 @@ namespace infinit
       return _backend.front()->list();
     }
 
+    /*-----------.
+    | Statistics |
+    `-----------*/
+
+    void
+    Mirror::Statistics::add(Clock::duration d)
+    {
+      auto const us = microseconds(d);
+      this->average = this->reads
+        ? smoothing * us + (1 - smoothing) * this->average
+        : us;
+      this->samples[this->reads % this->samples.size()] = us;
+      ++this->reads;
+    }
+
+    boost::optional<Mirror::Clock::duration>
+    Mirror::Statistics::percentile(double p) const
+    {
+      auto const count =
+        std::min<int64_t>(this->reads, this->samples.size());
+      if (count < 8)
+        return boost::none;
+      auto sorted = std::vector<int64_t>(this->samples.begin(),
+                                         this->samples.begin() + count);
+      auto const nth = sorted.begin() +
+        std::min<int64_t>(p * count, count - 1);
+      std::nth_element(sorted.begin(), nth, sorted.end());
+      return Clock::duration(std::chrono::microseconds(*nth));
+    }
+
     namespace
     {
       std::unique_ptr<Silo>
@@ -103,6 +563,9 @@ namespace infinit
       bool parallel;
       bool balance;
       std::vector<std::unique_ptr<SiloConfig>> storage;
+      boost::optional<int> write_acks;
+      boost::optional<bool> hedge;
+      boost::optional<double> hedge_percentile;
 
       MirrorSiloConfig(std::string name,
                           boost::optional<int64_t> capacity,
@@ -124,6 +587,9 @@ namespace infinit
         s.serialize("parallel", this->parallel);
         s.serialize("balance", this->balance);
         s.serialize("backend", this->storage);
+        s.serialize("write_acks", this->write_acks);
+        s.serialize("hedge", this->hedge);
+        s.serialize("hedge_percentile", this->hedge_percentile);
       }
 
       virtual
@@ -137,7 +603,10 @@ namespace infinit
           s.push_back(c->make());
         }
         return std::make_unique<infinit::silo::Mirror>(
-          std::move(s), balance, parallel);
+          std::move(s), balance, parallel,
+          this->write_acks.value_or(0),
+          this->hedge.value_or(false),
+          this->hedge_percentile.value_or(0.95));
       }
     };
 
@@ -1,18 +1,53 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <elle/reactor/Barrier.hh>
+#include <elle/reactor/Thread.hh>
+
+#include <infinit/silo/Key.hh>
 #include <infinit/silo/Silo.hh>
 
 namespace infinit
 {
   namespace silo
   {
+    /// Replicate blocks on all backends.
+    ///
+    /// With `balance_reads`, reads go to the backend with the lowest average
+    /// latency, other backends being tried now and then to refresh their
+    /// figures. With `hedge`, a read that takes longer than the
+    /// `hedge_percentile` of that backend's latencies is also sent to the
+    /// next backend, and the first answer wins.
+    ///
+    /// Writes return once `write_acks` backends acknowledged them, zero
+    /// meaning all of them. The other writes complete in the background,
+    /// and reads avoid their backends until then. Writes of a key are
+    /// applied to each backend in the order they were issued. Backends
+    /// that fail an acknowledged write are queued for repair: the block is
+    /// copied to them from an up to date backend, or erased, in the
+    /// background, and reads avoid them for that block until then.
     class Mirror: public Silo
     {
     public:
+      using Clock = std::chrono::steady_clock;
       Mirror(std::vector<std::unique_ptr<Silo>> backend, bool balance_reads,
-             bool parallel = true);
+             bool parallel = true,
+             int write_acks = 0,
+             bool hedge = false,
+             double hedge_percentile = 0.95);
+      ~Mirror() override;
       std::string
       type() const override { return "mirror"; }
+      /// Retry the acknowledged writes backends failed.
+      ///
+      /// @return The number of writes that still could not be repaired.
+      int
+      repair();
 
     protected:
       elle::Buffer
@@ -26,8 +61,79 @@ namespace infinit
 
       ELLE_ATTRIBUTE(bool, balance_reads);
       ELLE_ATTRIBUTE(std::vector<std::unique_ptr<Silo>>, backend);
-      ELLE_ATTRIBUTE(unsigned int, read_counter);
+      ELLE_ATTRIBUTE(unsigned int, read_counter, mutable);
       ELLE_ATTRIBUTE(bool, parallel);
+      ELLE_ATTRIBUTE_R(int, write_acks);
+      ELLE_ATTRIBUTE_R(bool, hedge);
+      ELLE_ATTRIBUTE_R(double, hedge_percentile);
+
+    /*-----------.
+    | Statistics |
+    `-----------*/
+    public:
+      /// Read latencies of a backend.
+      struct Statistics
+      {
+        void
+        add(Clock::duration d);
+        /// The `p` percentile of recent latencies, if enough were sampled.
+        boost::optional<Clock::duration>
+        percentile(double p) const;
+        /// Exponentially weighted moving average, in microseconds.
+        double average = 0;
+        int64_t reads = 0;
+        int64_t errors = 0;
+        /// Most recent latencies, in microseconds.
+        std::array<int64_t, 64> samples = {};
+      };
+      ELLE_ATTRIBUTE_R(std::vector<Statistics>, statistics, mutable);
+      /// Number of reads sent to a second backend.
+      ELLE_ATTRIBUTE_R(int64_t, hedged, mutable);
+
+    private:
+      /// Backends to read k from, by order of preference.
+      std::vector<int>
+      _read_order(Key k) const;
+      elle::Buffer
+      _read(int backend, Key k) const;
+      elle::Buffer
+      _hedged_read(Key k, std::vector<int> const& order) const;
+      /// Number of backends writes wait for.
+      int
+      _acks() const;
+      /// Apply `op` to all backends, return the first delta.
+      int
+      _write(Key k, std::string const& what,
+             std::function<int (Silo&)> const& op);
+      using Turn = std::shared_ptr<elle::reactor::Barrier>;
+      /// Queue a write of k on `backend`, which must wait for the returned
+      /// turn, if any, and open `done` through `_dequeue` once finished.
+      Turn
+      _enqueue(int backend, Key k, Turn const& done);
+      void
+      _dequeue(int backend, Key k, Turn const& done);
+      /// Apply `op` to `backend` in turn.
+      int
+      _ordered(int backend, Key k, Turn const& previous,
+               std::function<int (Silo&)> const& op);
+      /// Queue k for repair on `backend`.
+      void
+      _failed(int backend, Key k);
+      /// Copy k to `backend` from an up to date backend, or erase it.
+      void
+      _repair(int backend, Key k);
+      /// Repair backends until none lags behind.
+      void
+      _repair_loop();
+      /// Keys each backend has writes in flight for.
+      ELLE_ATTRIBUTE((std::vector<std::unordered_multiset<Key>>), lagging);
+      /// Last write queued for each key on each backend.
+      ELLE_ATTRIBUTE((std::vector<std::unordered_map<Key, Turn>>), turns);
+      ELLE_ATTRIBUTE(int, pending);
+      ELLE_ATTRIBUTE(elle::reactor::Barrier, idle);
+      /// Keys each backend failed an acknowledged write for.
+      ELLE_ATTRIBUTE_R((std::vector<std::unordered_set<Key>>), repairs);
+      ELLE_ATTRIBUTE(elle::reactor::Thread::unique_ptr, repairer);
     };
   }
 }
@@ -0,0 +1,668 @@
+#include <infinit/silo/Packed.hh>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+
+#ifndef INFINIT_WINDOWS
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+#include <boost/filesystem/operations.hpp>
+
+#include <elle/bench.hh>
+#include <elle/factory.hh>
+#include <elle/log.hh>
+#include <elle/reactor/scheduler.hh>
+
+#include <infinit/silo/Collision.hh>
+#include <infinit/silo/InsufficientSpace.hh>
+#include <infinit/silo/MissingKey.hh>
+
+ELLE_LOG_COMPONENT("infinit.silo.Packed");
+
+namespace infinit
+{
+  namespace silo
+  {
+    namespace
+    {
+      auto const segment_extension = std::string(".seg");
+      auto const hint_extension = std::string(".idx");
+      /// Record header: magic, operation, key, size, checksum.
+      auto const record_magic = uint32_t(0x314b4350);
+      auto const key_size = sizeof(Key::Value);
+      auto const header_size = 4 + 1 + key_size + 4 + 4;
+      /// Hint file: magic, then operation, key, offset and size per record,
+      /// then a checksum.
+      auto const hint_magic = std::string("PCKIDX01");
+      auto const hint_record_size = 1 + key_size + 8 + 4;
+
+      uint32_t
+      fnv1a(uint32_t hash, void const* data, std::size_t size)
+      {
+        auto const bytes = static_cast<uint8_t const*>(data);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+          hash ^= bytes[i];
+          hash *= 16777619u;
+        }
+        return hash;
+      }
+
+      auto const fnv1a_basis = uint32_t(2166136261u);
+
+      /// Flush `path`, a file or a directory, to disk.
+      void
+      sync_path(bfs::path const& path)
+      {
+#ifndef INFINIT_WINDOWS
+        auto const fd = ::open(path.string().c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+          elle::err("unable to open %s: %s", path, std::strerror(errno));
+        auto const synced = ::fsync(fd) == 0;
+        auto const error = errno;
+        ::close(fd);
+        if (!synced)
+          elle::err("unable to sync %s: %s", path, std::strerror(error));
+#endif
+      }
+
+      template <typename T>
+      void
+      write(char*& p, T const& v)
+      {
+        std::memcpy(p, &v, sizeof v);
+        p += sizeof v;
+      }
+
+      template <typename T>
+      T
+      read(char const*& p)
+      {
+        T res;
+        std::memcpy(&res, p, sizeof res);
+        p += sizeof res;
+        return res;
+      }
+
+      Key
+      read_key(char const*& p)
+      {
+        auto res = Key(reinterpret_cast<uint8_t const*>(p));
+        p += key_size;
+        return res;
+      }
+
+      void
+      write_key(char*& p, Key const& key)
+      {
+        std::memcpy(p, key.value(), key_size);
+        p += key_size;
+      }
+
+      uint32_t
+      checksum(Key const& key, elle::ConstWeakBuffer data)
+      {
+        return fnv1a(fnv1a(fnv1a_basis, key.value(), key_size),
+                     data.contents(), data.size());
+      }
+
+      struct Header
+      {
+        Packed::Operation op;
+        Key key;
+        uint32_t size;
+        uint32_t checksum;
+      };
+
+      boost::optional<Header>
+      parse_header(char const* p)
+      {
+        if (read<uint32_t>(p) != record_magic)
+          return boost::none;
+        auto const op = static_cast<Packed::Operation>(read<uint8_t>(p));
+        if (op != Packed::Operation::put && op != Packed::Operation::erase)
+          return boost::none;
+        auto key = read_key(p);
+        auto const size = read<uint32_t>(p);
+        auto const sum = read<uint32_t>(p);
+        return Header{op, std::move(key), size, sum};
+      }
+    }
+
+    /*-------------.
+    | Construction |
+    `-------------*/
+
+    Packed::Packed(bfs::path root,
+                   boost::optional<int64_t> capacity,
+                   int64_t segment_size,
+                   double compaction_threshold)
+      : Silo(std::move(capacity))
+      , _root(std::move(root))
+      , _segment_size(segment_size)
+      , _compaction_threshold(
+        std::min(std::max(compaction_threshold, 0.01), 1.))
+      , _active(0)
+    {
+      ELLE_TRACE_SCOPE("%s: load from %s", *this, this->_root);
+      bfs::create_directories(this->_root);
+      auto ids = std::vector<uint64_t>{};
+      for (auto const& entry: bfs::directory_iterator(this->_root))
+      {
+        auto const path = entry.path();
+        if (path.extension() == ".tmp")
+          bfs::remove(path);
+        else if (path.extension() == segment_extension)
+          try
+          {
+            ids.emplace_back(std::stoull(path.stem().string(), nullptr, 16));
+          }
+          catch (std::logic_error const&)
+          {
+            ELLE_WARN("%s: ignore unexpected file %s", *this, path);
+          }
+      }
+      std::sort(ids.begin(), ids.end());
+      for (auto const id: ids)
+      {
+        auto const last = id == ids.back();
+        this->_segments[id].size =
+          bfs::file_size(this->_segment_path(id, segment_extension));
+        auto const sealed = !last ||
+          bfs::exists(this->_segment_path(id, hint_extension));
+        auto records = this->_records(id, !sealed);
+        for (auto const& r: records)
+          this->_replay(id, r);
+        if (!sealed)
+        {
+          this->_active = id;
+          this->_active_records = std::move(records);
+        }
+        else if (!bfs::exists(this->_segment_path(id, hint_extension)))
+          this->_write_hint(id, records);
+        else if (last)
+          this->_active = id + 1;
+      }
+      this->_segments[this->_active];
+      this->_writer.open(this->_segment_path(this->_active, segment_extension),
+                         std::ios::binary | std::ios::app);
+      if (!this->_writer.good())
+        elle::err("unable to open segment %s for writing", this->_active);
+      for (auto const& e: this->_index)
+        this->_usage += e.second.size;
+      this->_block_count = this->_index.size();
+      ELLE_DEBUG("%s: loaded %s blocks (%s bytes) in %s segments",
+                 *this, this->_block_count, this->_usage,
+                 this->_segments.size());
+      _notify_metrics();
+      if (elle::reactor::Scheduler::scheduler())
+      {
+        this->_compactor.reset(
+          new elle::reactor::Thread(
+            elle::sprintf("%s compaction", *this),
+            [this]
+            {
+              while (true)
+              {
+                elle::reactor::wait(this->_compaction_needed);
+                this->_compaction_needed.close();
+                this->compact();
+              }
+            }));
+        this->_compaction_needed.open();
+      }
+    }
+
+    Packed::~Packed()
+    {
+      this->_compactor.reset();
+    }
+
+    bfs::path
+    Packed::_segment_path(uint64_t segment, std::string const& extension) const
+    {
+      return this->_root / (elle::sprintf("%016x", segment) + extension);
+    }
+
+    /*--------.
+    | Records |
+    `--------*/
+
+    std::vector<Packed::Record>
+    Packed::_records(uint64_t segment, bool truncate)
+    {
+      auto res = std::vector<Record>{};
+      auto const hint = this->_segment_path(segment, hint_extension);
+      if (bfs::exists(hint))
+      {
+        auto&& input = bfs::ifstream(hint, std::ios::binary);
+        auto const content = std::string(std::istreambuf_iterator<char>(input),
+                                         std::istreambuf_iterator<char>());
+        auto const count =
+          (content.size() - hint_magic.size() - 4) / hint_record_size;
+        if (content.size() >= hint_magic.size() + 4 &&
+            content.compare(0, hint_magic.size(), hint_magic) == 0 &&
+            hint_magic.size() + count * hint_record_size + 4 ==
+            content.size())
+        {
+          auto p = content.data() + hint_magic.size();
+          auto const sum = fnv1a(fnv1a_basis, p, count * hint_record_size);
+          for (std::size_t i = 0; i < count; ++i)
+          {
+            auto const op = static_cast<Operation>(read<uint8_t>(p));
+            auto key = read_key(p);
+            auto const offset = read<uint64_t>(p);
+            auto const size = read<uint32_t>(p);
+            res.push_back(Record{op, std::move(key), offset, size});
+          }
+          if (read<uint32_t>(p) == sum)
+            return res;
+        }
+        ELLE_WARN("%s: corrupt hint file for segment %s, rescan",
+                  *this, segment);
+        res.clear();
+        bfs::remove(hint);
+      }
+      ELLE_DEBUG_SCOPE("%s: scan segment %s", *this, segment);
+      auto const path = this->_segment_path(segment, segment_extension);
+      auto& info = this->_segments[segment];
+      auto&& input = bfs::ifstream(path, std::ios::binary);
+      auto offset = uint64_t(0);
+      char header[header_size];
+      auto data = elle::Buffer();
+      while (offset + header_size <= uint64_t(info.size))
+      {
+        if (!input.read(header, header_size))
+          break;
+        auto const h = parse_header(header);
+        if (!h || offset + header_size + h->size > uint64_t(info.size))
+          break;
+        data.size(h->size);
+        if (!input.read(reinterpret_cast<char*>(data.mutable_contents()),
+                        h->size))
+          break;
+        if (checksum(h->key, data) != h->checksum)
+          break;
+        res.push_back(Record{h->op, h->key, offset, h->size});
+        offset += header_size + h->size;
+      }
+      if (offset != uint64_t(info.size))
+      {
+        ELLE_WARN("%s: segment %s is corrupt past offset %s",
+                  *this, segment, offset);
+        if (truncate)
+        {
+          bfs::resize_file(path, offset);
+          info.size = offset;
+        }
+        else
+          info.garbage += info.size - offset;
+      }
+      return res;
+    }
+
+    void
+    Packed::_replay(uint64_t segment, Record const& record)
+    {
+      auto it = this->_index.find(record.key);
+      if (it != this->_index.end())
+        this->_forget(it->second);
+      if (record.op == Operation::put)
+      {
+        auto const location = Location{segment, record.offset, record.size};
+        if (it != this->_index.end())
+          it->second = location;
+        else
+          this->_index.emplace(record.key, location);
+      }
+      else
+      {
+        if (it != this->_index.end())
+          this->_index.erase(it);
+        this->_segments[segment].garbage += header_size;
+      }
+    }
+
+    void
+    Packed::_forget(Location const& location)
+    {
+      auto it = this->_segments.find(location.segment);
+      ELLE_ASSERT(it != this->_segments.end());
+      it->second.garbage += header_size + location.size;
+      if (this->_compactor &&
+          location.segment != this->_active &&
+          this->_compactable(it->second))
+        this->_compaction_needed.open();
+    }
+
+    Packed::Location
+    Packed::_append(Operation op, Key const& key, elle::ConstWeakBuffer data)
+    {
+      if (this->_segments[this->_active].size > 0 &&
+          this->_segments[this->_active].size + header_size + data.size() >
+          this->_segment_size)
+        this->_seal();
+      auto& segment = this->_segments[this->_active];
+      char header[header_size];
+      {
+        auto p = header;
+        write(p, record_magic);
+        write(p, static_cast<uint8_t>(op));
+        write_key(p, key);
+        write(p, uint32_t(data.size()));
+        write(p, checksum(key, data));
+      }
+      auto const offset = uint64_t(segment.size);
+      this->_writer.write(header, header_size);
+      this->_writer.write(reinterpret_cast<char const*>(data.contents()),
+                          data.size());
+      this->_writer.flush();
+      if (!this->_writer.good())
+      {
+        // Drop the partial record so the segment stays parseable.
+        auto const path =
+          this->_segment_path(this->_active, segment_extension);
+        this->_writer.close();
+        bfs::resize_file(path, offset);
+        this->_writer.open(path, std::ios::binary | std::ios::app);
+        elle::err("unable to append to segment %s", this->_active);
+      }
+      segment.size += header_size + data.size();
+      this->_active_records.push_back(
+        Record{op, key, offset, uint32_t(data.size())});
+      return Location{this->_active, offset, uint32_t(data.size())};
+    }
+
+    void
+    Packed::_write_hint(uint64_t segment, std::vector<Record> const& records)
+    {
+      auto const hint = this->_segment_path(segment, hint_extension);
+      auto const tmp = bfs::path(hint.string() + ".tmp");
+      {
+        auto&& output = bfs::ofstream(tmp, std::ios::binary);
+        output.write(hint_magic.data(), hint_magic.size());
+        auto sum = fnv1a_basis;
+        for (auto const& r: records)
+        {
+          char record[hint_record_size];
+          auto p = record;
+          write(p, static_cast<uint8_t>(r.op));
+          write_key(p, r.key);
+          write(p, r.offset);
+          write(p, r.size);
+          sum = fnv1a(sum, record, hint_record_size);
+          output.write(record, hint_record_size);
+        }
+        output.write(reinterpret_cast<char const*>(&sum), sizeof sum);
+        if (!output.good())
+          elle::err("unable to write hint file %s", tmp);
+      }
+      bfs::rename(tmp, hint);
+    }
+
+    void
+    Packed::_seal()
+    {
+      ELLE_TRACE_SCOPE("%s: seal segment %s", *this, this->_active);
+      this->_write_hint(this->_active, this->_active_records);
+      this->_writer.close();
+      this->_active_records.clear();
+      ++this->_active;
+      this->_segments[this->_active];
+      this->_writer.open(this->_segment_path(this->_active, segment_extension),
+                         std::ios::binary | std::ios::app);
+      if (!this->_writer.good())
+        elle::err("unable to open segment %s for writing", this->_active);
+    }
+
+    bfs::ifstream&
+    Packed::_reader(uint64_t segment) const
+    {
+      auto it = this->_readers.find(segment);
+      if (it == this->_readers.end())
+      {
+        // Bound open file descriptors.
+        if (this->_readers.size() >= 64)
+          this->_readers.erase(this->_readers.begin());
+        auto reader = std::make_unique<bfs::ifstream>(
+          this->_segment_path(segment, segment_extension), std::ios::binary);
+        if (!reader->good())
+          elle::err("unable to open segment %s for reading", segment);
+        it = this->_readers.emplace(segment, std::move(reader)).first;
+      }
+      return *it->second;
+    }
+
+    void
+    Packed::_close(uint64_t segment)
+    {
+      this->_readers.erase(segment);
+    }
+
+    /*-----------.
+    | Compaction |
+    `-----------*/
+
+    void
+    Packed::compact()
+    {
+      auto candidates = std::vector<uint64_t>{};
+      for (auto const& s: this->_segments)
+        if (s.first != this->_active && s.second.size &&
+            this->_compactable(s.second))
+          candidates.emplace_back(s.first);
+      for (auto const id: candidates)
+        this->_compact(id);
+    }
+
+    bool
+    Packed::_compactable(Segment const& segment) const
+    {
+      return segment.garbage >= this->_compaction_threshold * segment.size;
+    }
+
+    void
+    Packed::_compact(uint64_t segment)
+    {
+      ELLE_TRACE_SCOPE("%s: compact segment %s", *this, segment);
+      static elle::Bench bench("bench.packed.compact", std::chrono::seconds(10000));
+      elle::Bench::BenchScope bs(bench);
+      // Tombstones must outlive older segments that may hold the key.
+      auto const oldest = this->_segments.begin()->first == segment;
+      auto const yield = bool(elle::reactor::Scheduler::scheduler());
+      auto const first = this->_active;
+      for (auto const& r: this->_records(segment))
+      {
+        auto it = this->_index.find(r.key);
+        if (r.op == Operation::put)
+        {
+          if (it == this->_index.end() ||
+              it->second.segment != segment || it->second.offset != r.offset)
+            continue;
+          auto const data = this->_get(r.key);
+          it->second = this->_append(Operation::put, r.key, data);
+        }
+        else if (!oldest && it == this->_index.end())
+        {
+          this->_append(Operation::erase, r.key, {});
+          this->_segments[this->_active].garbage += header_size;
+        }
+        if (yield)
+          elle::reactor::yield();
+      }
+      // The copies must be durable before the originals go away.
+      this->_sync(first);
+      this->_close(segment);
+      bfs::remove(this->_segment_path(segment, hint_extension));
+      bfs::remove(this->_segment_path(segment, segment_extension));
+      this->_segments.erase(segment);
+    }
+
+    void
+    Packed::_sync(uint64_t from)
+    {
+      ELLE_DEBUG_SCOPE("%s: sync segments %s to %s",
+                       *this, from, this->_active);
+      for (auto it = this->_segments.lower_bound(from);
+           it != this->_segments.end(); ++it)
+      {
+        sync_path(this->_segment_path(it->first, segment_extension));
+        auto const hint = this->_segment_path(it->first, hint_extension);
+        if (bfs::exists(hint))
+          sync_path(hint);
+      }
+      // Segments and hints created meanwhile must be listed too.
+      sync_path(this->_root);
+    }
+
+    /*---------.
+    | Storage  |
+    `---------*/
+
+    elle::Buffer
+    Packed::_get(Key k) const
+    {
+      auto it = this->_index.find(k);
+      if (it == this->_index.end())
+        throw MissingKey(k);
+      static elle::Bench bench("bench.packed.get", std::chrono::seconds(10000));
+      elle::Bench::BenchScope bs(bench);
+      auto const& location = it->second;
+      auto& input = this->_reader(location.segment);
+      input.clear();
+      input.seekg(location.offset);
+      char header[header_size];
+      auto res = elle::Buffer(location.size);
+      input.read(header, header_size);
+      input.read(reinterpret_cast<char*>(res.mutable_contents()), res.size());
+      if (!input)
+        elle::err("unable to read %x from segment %s", k, location.segment);
+      auto const h = parse_header(header);
+      if (!h || !(h->key == k) || h->size != location.size)
+        elle::err("corrupt record for %x in segment %s", k, location.segment);
+      return res;
+    }
+
+    int
+    Packed::_set(Key k, elle::Buffer const& value, bool insert, bool update)
+    {
+      ELLE_TRACE("set %x", k);
+      static elle::Bench bench("bench.packed.set", std::chrono::seconds(10000));
+      elle::Bench::BenchScope bs(bench);
+      auto it = this->_index.find(k);
+      bool const exists = it != this->_index.end();
+      int const size = exists ? it->second.size : 0;
+      int const delta = value.size() - size;
+      if (this->capacity() && this->usage() + delta > this->capacity())
+        throw InsufficientSpace(delta, this->usage(), this->capacity().get());
+      if (!exists && !insert)
+        throw MissingKey(k);
+      if (exists && !update)
+        throw Collision(k);
+      auto const location = this->_append(Operation::put, k, value);
+      if (exists)
+      {
+        this->_forget(it->second);
+        it->second = location;
+      }
+      else
+      {
+        this->_index.emplace(k, location);
+        this->_block_count += 1;
+      }
+      return delta;
+    }
+
+    int
+    Packed::_erase(Key k)
+    {
+      ELLE_TRACE("erase %x", k);
+      auto it = this->_index.find(k);
+      if (it == this->_index.end())
+        throw MissingKey(k);
+      this->_append(Operation::erase, k, {});
+      this->_segments[this->_active].garbage += header_size;
+      auto const size = it->second.size;
+      this->_forget(it->second);
+      this->_index.erase(it);
+      this->_block_count -= 1;
+      return -int(size);
+    }
+
+    std::vector<Key>
+    Packed::_list()
+    {
+      auto res = std::vector<Key>{};
+      res.reserve(this->_index.size());
+      for (auto const& e: this->_index)
+        res.emplace_back(e.first);
+      return res;
+    }
+
+    BlockStatus
+    Packed::_status(Key k)
+    {
+      return this->_index.count(k) ? BlockStatus::exists : BlockStatus::missing;
+    }
+
+    /*-------.
+    | Config |
+    `-------*/
+
+    PackedSiloConfig::PackedSiloConfig(
+        std::string name,
+        std::string path,
+        boost::optional<int64_t> capacity,
+        boost::optional<std::string> description,
+        boost::optional<int64_t> segment_size,
+        boost::optional<double> compaction_threshold)
+      : SiloConfig(
+          std::move(name), std::move(capacity), std::move(description))
+      , path(std::move(path))
+      , segment_size(std::move(segment_size))
+      , compaction_threshold(std::move(compaction_threshold))
+    {}
+
+    PackedSiloConfig::PackedSiloConfig(elle::serialization::SerializerIn& s)
+      : SiloConfig(s)
+      , path(s.deserialize<std::string>("path"))
+      , segment_size(s.deserialize<boost::optional<int64_t>>("segment_size"))
+      , compaction_threshold(
+        s.deserialize<boost::optional<double>>("compaction_threshold"))
+    {}
+
+    void
+    PackedSiloConfig::serialize(elle::serialization::Serializer& s)
+    {
+      SiloConfig::serialize(s);
+      s.serialize("path", this->path);
+      s.serialize("segment_size", this->segment_size);
+      s.serialize("compaction_threshold", this->compaction_threshold);
+    }
+
+    std::unique_ptr<infinit::silo::Silo>
+    PackedSiloConfig::make()
+    {
+      return std::make_unique<infinit::silo::Packed>(
+        this->path, this->capacity,
+        this->segment_size.value_or(64 * 1024 * 1024),
+        this->compaction_threshold.value_or(0.5));
+    }
+
+    static const elle::serialization::Hierarchy<SiloConfig>::
+    Register<PackedSiloConfig>
+    _register_PackedSiloConfig("packed");
+
+    static
+    std::unique_ptr<Silo>
+    make(std::vector<std::string> const& args)
+    {
+      return std::make_unique<Packed>(args[0]);
+    }
+  }
+}
+
+FACTORY_REGISTER(infinit::silo::Silo, "packed", &infinit::silo::make);
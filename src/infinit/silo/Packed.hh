@@ -0,0 +1,154 @@
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <elle/reactor/Barrier.hh>
+#include <elle/reactor/Thread.hh>
+
+#include <infinit/silo/Key.hh>
+#include <infinit/silo/Silo.hh>
+
+namespace infinit
+{
+  namespace silo
+  {
+    /// Store blocks appended to large segment files.
+    ///
+    /// Small blocks stored one per file waste an inode each and make startup
+    /// walk the whole tree. Instead, records are appended to the active
+    /// segment, and an in-memory index maps keys to their location. When a
+    /// segment is full, a compact hint file listing its records is written
+    /// next to it, so startup only reads hints and scans the last segment.
+    ///
+    /// Overwritten and erased records become garbage; segments whose
+    /// garbage reaches `compaction_threshold` of their size are compacted
+    /// by copying their live records to the active segment, in a background
+    /// thread when a scheduler is running.
+    class Packed
+      : public Silo
+    {
+    public:
+      Packed(boost::filesystem::path root,
+             boost::optional<int64_t> capacity = {},
+             int64_t segment_size = 64 * 1024 * 1024,
+             double compaction_threshold = 0.5);
+      ~Packed() override;
+      std::string
+      type() const override { return "packed"; }
+      /// Compact segments whose garbage reached the compaction threshold.
+      void
+      compact();
+
+    protected:
+      elle::Buffer
+      _get(Key k) const override;
+      int
+      _set(Key k, elle::Buffer const& value, bool insert, bool update) override;
+      int
+      _erase(Key k) override;
+      std::vector<Key>
+      _list() override;
+      BlockStatus
+      _status(Key k) override;
+
+    /*--------.
+    | Records |
+    `--------*/
+    public:
+      enum class Operation: uint8_t
+      {
+        put = 1,
+        erase = 2,
+      };
+      /// A record as listed in hint files.
+      struct Record
+      {
+        Operation op;
+        Key key;
+        uint64_t offset;
+        uint32_t size;
+      };
+      /// Where the current value of a key lives.
+      struct Location
+      {
+        uint64_t segment;
+        uint64_t offset;
+        uint32_t size;
+      };
+      struct Segment
+      {
+        /// Bytes in the segment file.
+        int64_t size = 0;
+        /// Bytes of overwritten, erased or tombstone records.
+        int64_t garbage = 0;
+      };
+      ELLE_ATTRIBUTE_R(boost::filesystem::path, root);
+      ELLE_ATTRIBUTE_R(int64_t, segment_size);
+      /// Fraction of garbage at which a segment is compacted.
+      ELLE_ATTRIBUTE_R(double, compaction_threshold);
+      ELLE_ATTRIBUTE_R((std::map<uint64_t, Segment>), segments);
+
+    private:
+      boost::filesystem::path
+      _segment_path(uint64_t segment, std::string const& extension) const;
+      /// Records of a segment, from its hint file or by scanning it.
+      std::vector<Record>
+      _records(uint64_t segment, bool truncate = false);
+      void
+      _replay(uint64_t segment, Record const& record);
+      /// Account a superseded record as garbage.
+      void
+      _forget(Location const& location);
+      Location
+      _append(Operation op, Key const& key, elle::ConstWeakBuffer data);
+      void
+      _write_hint(uint64_t segment, std::vector<Record> const& records);
+      void
+      _seal();
+      /// Whether `segment` has enough garbage to be compacted.
+      bool
+      _compactable(Segment const& segment) const;
+      void
+      _compact(uint64_t segment);
+      /// Flush segments from `from` on, their hints and the root to disk.
+      void
+      _sync(uint64_t from);
+      bfs::ifstream&
+      _reader(uint64_t segment) const;
+      void
+      _close(uint64_t segment);
+      ELLE_ATTRIBUTE((std::unordered_map<Key, Location>), index);
+      ELLE_ATTRIBUTE(uint64_t, active);
+      ELLE_ATTRIBUTE(std::vector<Record>, active_records);
+      ELLE_ATTRIBUTE(bfs::ofstream, writer);
+      ELLE_ATTRIBUTE((std::map<uint64_t, std::unique_ptr<bfs::ifstream>>),
+                     readers, mutable);
+      ELLE_ATTRIBUTE(elle::reactor::Barrier, compaction_needed);
+      ELLE_ATTRIBUTE(elle::reactor::Thread::unique_ptr, compactor);
+    };
+
+    struct PackedSiloConfig
+      : public SiloConfig
+    {
+      PackedSiloConfig(std::string name,
+                       std::string path,
+                       boost::optional<int64_t> capacity,
+                       boost::optional<std::string> description,
+                       boost::optional<int64_t> segment_size = {},
+                       boost::optional<double> compaction_threshold = {});
+      PackedSiloConfig(elle::serialization::SerializerIn& input);
+      void
+      serialize(elle::serialization::Serializer& s) override;
+      std::unique_ptr<infinit::silo::Silo>
+      make() override;
+      std::string path;
+      boost::optional<int64_t> segment_size;
+      boost::optional<double> compaction_threshold;
+    };
+  }
+}
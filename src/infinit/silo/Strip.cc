@@ -1,74 +1,440 @@
 #include <infinit/silo/Strip.hh>
 
-#include <elle/algorithm.hh>
-
-#include <infinit/model/Address.hh>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
-#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/operations.hpp>
 
+#include <elle/algorithm.hh>
+#include <elle/err.hh>
 #include <elle/factory.hh>
+#include <elle/log.hh>
 #include <elle/reactor/Scope.hh>
+#include <elle/reactor/scheduler.hh>
+
+#include <infinit/model/Address.hh>
+#include <infinit/silo/Collision.hh>
+#include <infinit/silo/InsufficientSpace.hh>
+#include <infinit/silo/MissingKey.hh>
+
+ELLE_LOG_COMPONENT("infinit.silo.Strip");
 
 namespace infinit
 {
   namespace silo
   {
-    Strip::Strip(std::vector<std::unique_ptr<Silo>> backend)
+    namespace
+    {
+      /// Placement file: magic, then key and backend per record, -1
+      /// denoting an erasure and lower values a pending operation, see
+      /// `pending`.
+      auto const placement_magic = std::string("STRIPMAP");
+      auto const key_size = sizeof(Key::Value);
+      auto const record_size = key_size + sizeof(int16_t);
+      auto const erased = -1;
+
+      /// The record of a pending operation on `backend`.
+      int
+      pending(int backend)
+      {
+        return -2 - backend;
+      }
+
+      uint64_t
+      mix(uint64_t x)
+      {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+      }
+
+      /// Weighted rendezvous hashing score of `backend` for k.
+      double
+      score(Key const& k, int backend, double weight)
+      {
+        auto h = mix(uint64_t(backend) + 1);
+        for (std::size_t i = 0; i < key_size; i += sizeof(uint64_t))
+        {
+          uint64_t word;
+          std::memcpy(&word, k.value() + i, sizeof word);
+          h = mix(h ^ word);
+        }
+        // Uniform in ]0, 1[.
+        auto const u = ((h >> 11) + 0.5) / double(uint64_t(1) << 53);
+        return -weight / std::log(u);
+      }
+    }
+
+    Strip::Strip(std::vector<std::unique_ptr<Silo>> backend,
+                 std::vector<int64_t> weights,
+                 boost::optional<bfs::path> placement)
       : _backend(std::move(backend))
+      , _weights(std::move(weights))
+      , _placement(std::move(placement))
     {
+      if (this->_backend.empty())
+        elle::err("strip silo requires at least one backend");
+      if (!this->_weights.empty() &&
+          this->_weights.size() != this->_backend.size())
+        elle::err("strip silo has %s backends but %s weights",
+                  this->_backend.size(), this->_weights.size());
       // This assumes that the metrics are already correct in the
       // "backends".
       for (auto const& b: _backend)
-      {
         _usage += b->usage();
-        _block_count += b->block_count();
-      }
+      if (!this->_placement || !this->_load())
+        this->_rebuild();
+      this->_block_count = this->_locations.size();
+      if (this->_placement)
+        this->_snapshot();
+      ELLE_TRACE("%s: %s blocks on %s backends",
+                 this, this->_locations.size(), this->_backend.size());
     }
 
+    /*-----------.
+    | Operations |
+    `-----------*/
+
     elle::Buffer
     Strip::_get(Key k) const
     {
-      return _storage_of(k).get(k);
+      if (auto b = this->_backend_of(k))
+        return this->_backend[*b]->get(k);
+      else
+        throw MissingKey(k);
     }
 
     int
     Strip::_set(Key k, elle::Buffer const& value, bool insert, bool update)
     {
-      return _storage_of(k).set(k, value, insert, update);
+      if (auto b = this->_backend_of(k))
+      {
+        if (!update)
+          throw Collision(k);
+        try
+        {
+          return this->_backend[*b]->set(k, value, false, true);
+        }
+        catch (InsufficientSpace const&)
+        {
+          auto const target = this->place(k, value.size());
+          if (target == *b)
+            throw;
+          ELLE_DEBUG("%s: move %x from backend %s to %s",
+                     this, k, *b, target);
+          this->_record(k, pending(target));
+          int delta;
+          try
+          {
+            delta = this->_backend[target]->set(k, value, true, false);
+          }
+          catch (...)
+          {
+            this->_record(k, *b);
+            throw;
+          }
+          // Record the move first, so the block is never unmapped.
+          this->_locations[k] = target;
+          this->_record(k, target);
+          return delta + this->_backend[*b]->erase(k);
+        }
+      }
+      else
+      {
+        if (!insert)
+          throw MissingKey(k);
+        auto const target = this->place(k, value.size());
+        // Reserve the key so concurrent insertions collide.
+        this->_locations.emplace(k, target);
+        int delta;
+        try
+        {
+          this->_record(k, pending(target));
+          delta = this->_backend[target]->set(k, value, true, false);
+        }
+        catch (...)
+        {
+          this->_locations.erase(k);
+          this->_record(k, erased);
+          throw;
+        }
+        ++this->_block_count;
+        this->_record(k, target);
+        return delta;
+      }
     }
 
     int
     Strip::_erase(Key k)
     {
-      return _storage_of(k).erase(k);
+      auto b = this->_backend_of(k);
+      if (!b)
+        throw MissingKey(k);
+      auto const forget = [&]
+        {
+          if (this->_locations.erase(k))
+          {
+            --this->_block_count;
+            this->_record(k, erased);
+          }
+        };
+      this->_record(k, pending(*b));
+      try
+      {
+        auto const res = this->_backend[*b]->erase(k);
+        forget();
+        return res;
+      }
+      catch (MissingKey const&)
+      {
+        ELLE_WARN("%s: %x was not on backend %s", this, k, *b);
+        forget();
+        throw;
+      }
+      catch (...)
+      {
+        this->_record(k, *b);
+        throw;
+      }
+    }
+
+    std::vector<Key>
+    Strip::_list()
+    {
+      auto lists = std::vector<std::vector<Key>>(this->_backend.size());
+      this->_each([&] (int i) { lists[i] = this->_backend[i]->list(); });
+      auto res = std::vector<Key>{};
+      for (auto& l: lists)
+        elle::push_back(res, l);
+      return res;
     }
 
-    namespace
+    BlockStatus
+    Strip::_status(Key k)
     {
-      /// The sum of the digits of this address.
-      int
-      sum(Key k)
+      return this->_backend_of(k) ? BlockStatus::exists : BlockStatus::missing;
+    }
+
+    /*----------.
+    | Placement |
+    `----------*/
+
+    int
+    Strip::place(Key k, int size) const
+    {
+      auto const sized = std::all_of(
+        this->_backend.begin(), this->_backend.end(),
+        [] (auto const& b) { return bool(b->capacity()); });
+      auto best = -1;
+      auto best_score = 0.;
+      for (int i = 0; i < signed(this->_backend.size()); ++i)
       {
-        int res = 0;
-        for (auto c: k.value())
-          res += c;
-        return res;
+        auto const& b = *this->_backend[i];
+        auto const free = b.capacity()
+          ? boost::optional<int64_t>(*b.capacity() - b.usage())
+          : boost::none;
+        if (free && *free < size)
+          continue;
+        auto const weight = !this->_weights.empty()
+          ? this->_weights[i]
+          : sized ? *free : 1;
+        if (weight <= 0)
+          continue;
+        auto const s = score(k, i, weight);
+        if (best < 0 || s > best_score)
+        {
+          best = i;
+          best_score = s;
+        }
       }
+      if (best >= 0)
+        return best;
+      // Nothing fits: let the preferred backend report it.
+      for (int i = 0; i < signed(this->_backend.size()); ++i)
+      {
+        auto const s = score(k, i, 1);
+        if (best < 0 || s > best_score)
+        {
+          best = i;
+          best_score = s;
+        }
+      }
+      return best;
     }
 
-    Silo&
-    Strip::_storage_of(Key k) const
+    boost::optional<int>
+    Strip::_backend_of(Key k) const
     {
-      return *_backend[sum(k) % _backend.size()];
+      auto it = this->_locations.find(k);
+      if (it == this->_locations.end())
+        return boost::none;
+      else
+        return it->second;
     }
 
-    std::vector<Key>
-    Strip::_list()
+    void
+    Strip::_each(std::function<void (int)> const& f) const
     {
-      auto res = std::vector<Key>{};
-      for (auto const& b: _backend)
-        elle::push_back(res, b->list());
-      return res;
+      if (this->_backend.size() > 1 && elle::reactor::Scheduler::scheduler())
+        elle::With<elle::reactor::Scope>() << [&] (elle::reactor::Scope& s)
+        {
+          for (int i = 0; i < signed(this->_backend.size()); ++i)
+            s.run_background(elle::sprintf("%s: backend %s", this, i),
+                             [&f, i] { f(i); });
+          s.wait();
+        };
+      else
+        for (int i = 0; i < signed(this->_backend.size()); ++i)
+          f(i);
+    }
+
+    bool
+    Strip::_load()
+    {
+      auto const& path = *this->_placement;
+      if (!bfs::exists(path))
+        return false;
+      ELLE_TRACE_SCOPE("%s: load placement from %s", this, path);
+      auto input = bfs::ifstream(path, std::ios::binary);
+      auto magic = std::string(placement_magic.size(), '\0');
+      if (!input.read(&magic[0], magic.size()) || magic != placement_magic)
+      {
+        ELLE_WARN("%s: invalid placement file %s", this, path);
+        return false;
+      }
+      // Operations not known to have completed, by key.
+      auto pendings = std::unordered_map<Key, int>{};
+      char record[record_size];
+      while (input.read(record, record_size))
+      {
+        auto const k = Key(reinterpret_cast<uint8_t const*>(record));
+        int16_t backend;
+        std::memcpy(&backend, record + key_size, sizeof backend);
+        auto const target = backend < erased ? pending(backend) : backend;
+        if (target >= signed(this->_backend.size()))
+        {
+          ELLE_WARN("%s: placement file %s references backend %s",
+                    this, path, target);
+          this->_locations.clear();
+          return false;
+        }
+        else if (backend < erased)
+          pendings[k] = target;
+        else
+        {
+          pendings.erase(k);
+          if (backend == erased)
+            this->_locations.erase(k);
+          else
+            this->_locations[k] = backend;
+        }
+      }
+      if (input.gcount() != 0)
+      {
+        // The last placement may be missing.
+        ELLE_WARN("%s: truncated placement file %s", this, path);
+        this->_locations.clear();
+        return false;
+      }
+      for (auto const& p: pendings)
+        this->_reconcile(p.first, p.second);
+      return true;
+    }
+
+    void
+    Strip::_reconcile(Key k, int backend)
+    {
+      ELLE_TRACE_SCOPE("%s: reconcile interrupted operation on %x",
+                       this, k);
+      auto const previous = this->_backend_of(k);
+      auto& silo = *this->_backend[backend];
+      auto status = silo.status(k);
+      if (status == BlockStatus::unknown)
+        try
+        {
+          silo.get(k);
+          status = BlockStatus::exists;
+        }
+        catch (MissingKey const&)
+        {
+          status = BlockStatus::missing;
+        }
+      if (status == BlockStatus::exists)
+      {
+        this->_locations[k] = backend;
+        // An interrupted move leaves the block on both backends.
+        if (previous && *previous != backend)
+          try
+          {
+            this->_backend[*previous]->erase(k);
+          }
+          catch (MissingKey const&)
+          {}
+      }
+      else if (previous && *previous != backend)
+        ELLE_DEBUG("%s: %x stays on backend %s", this, k, *previous);
+      else
+        this->_locations.erase(k);
+    }
+
+    void
+    Strip::_rebuild()
+    {
+      ELLE_TRACE_SCOPE("%s: rebuild placement from backends", this);
+      auto lists = std::vector<std::vector<Key>>(this->_backend.size());
+      this->_each([&] (int i) { lists[i] = this->_backend[i]->list(); });
+      this->_locations.clear();
+      for (int i = 0; i < signed(lists.size()); ++i)
+        for (auto const& k: lists[i])
+          if (!this->_locations.emplace(k, i).second)
+            ELLE_WARN("%s: %x is on both backends %s and %s",
+                      this, k, this->_locations.at(k), i);
+    }
+
+    void
+    Strip::_snapshot()
+    {
+      auto const& path = *this->_placement;
+      ELLE_TRACE_SCOPE("%s: write placement to %s", this, path);
+      if (this->_journal.is_open())
+        this->_journal.close();
+      auto const tmp = bfs::path(path.string() + ".tmp");
+      {
+        auto output = bfs::ofstream(tmp, std::ios::binary | std::ios::trunc);
+        output.write(placement_magic.data(), placement_magic.size());
+        char record[record_size];
+        for (auto const& l: this->_locations)
+        {
+          auto const backend = int16_t(l.second);
+          std::memcpy(record, l.first.value(), key_size);
+          std::memcpy(record + key_size, &backend, sizeof backend);
+          output.write(record, record_size);
+        }
+        output.flush();
+        if (!output)
+          elle::err("unable to write placement file %s", tmp);
+      }
+      bfs::rename(tmp, path);
+      this->_journal.open(path, std::ios::binary | std::ios::app);
+      if (!this->_journal)
+        elle::err("unable to open placement file %s", path);
+    }
+
+    void
+    Strip::_record(Key k, int backend)
+    {
+      if (!this->_journal.is_open())
+        return;
+      char record[record_size];
+      auto const b = int16_t(backend);
+      std::memcpy(record, k.value(), key_size);
+      std::memcpy(record + key_size, &b, sizeof b);
+      this->_journal.write(record, record_size);
+      this->_journal.flush();
+      if (!this->_journal)
+        elle::err("unable to record placement of %x", k);
     }
 
     static
@@ -94,6 +460,9 @@ namespace infinit
     StripSiloConfig::StripSiloConfig(elle::serialization::SerializerIn& s)
       : SiloConfig(s)
       , storage(s.deserialize<Silos>("backend"))
+      , weights(s.deserialize<boost::optional<std::vector<int64_t>>>(
+                  "weights"))
+      , placement(s.deserialize<boost::optional<std::string>>("placement"))
     {}
 
     void
@@ -101,6 +470,8 @@ namespace infinit
     {
       SiloConfig::serialize(s);
       s.serialize("backend", this->storage);
+      s.serialize("weights", this->weights);
+      s.serialize("placement", this->placement);
     }
 
     std::unique_ptr<infinit::silo::Silo>
@@ -110,7 +481,11 @@ namespace infinit
       for(auto const& c: storage)
         s.push_back(c->make());
       return std::make_unique<infinit::silo::Strip>(
-        std::move(s));
+        std::move(s),
+        this->weights.value_or(std::vector<int64_t>{}),
+        this->placement
+        ? boost::optional<bfs::path>(*this->placement)
+        : boost::none);
     }
 
     static const elle::serialization::Hierarchy<SiloConfig>::
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <unordered_map>
+
+#include <boost/filesystem/fstream.hpp>
+
+#include <infinit/silo/Key.hh>
 #include <infinit/silo/Silo.hh>
 
 namespace infinit
@@ -8,16 +13,36 @@ namespace infinit
   {
     /// Balance blocks on the list of specified backend storages.
     /// This is really sharding actually.
-    /// 
+    ///
+    /// New blocks are placed by weighted rendezvous hashing: each backend
+    /// receives a share of the blocks proportional to its weight, which
+    /// defaults to its free space when all backends have a capacity, so a
+    /// small disk does not fill up before a large one.  Backends that cannot
+    /// hold a block are skipped.
+    ///
+    /// Where each block was placed is kept in a map, persisted to the
+    /// `placement` file if any, and rebuilt by listing the backends
+    /// otherwise. Placement decisions are thus never recomputed, and
+    /// weights or capacities can change freely. Operations are journaled
+    /// as pending before touching a backend, and those left pending by a
+    /// crash are checked against the backend when loading the file.
+    ///
     /// @warning The same list must be passed each time, in the same
-    /// order.
+    /// order. New backends may be appended.
     class Strip
       : public Silo
     {
     public:
-      Strip(std::vector<std::unique_ptr<Silo>> backend);
+      /// @param weights   Relative share of new blocks for each backend.
+      /// @param placement File to persist the placement map to.
+      Strip(std::vector<std::unique_ptr<Silo>> backend,
+            std::vector<int64_t> weights = {},
+            boost::optional<bfs::path> placement = {});
       std::string
       type() const override { return "strip"; }
+      /// The backend a new block of `size` bytes would be placed on.
+      int
+      place(Key k, int size) const;
 
     protected:
       elle::Buffer
@@ -28,9 +53,42 @@ namespace infinit
       _erase(Key k) override;
       std::vector<Key>
       _list() override;
+      BlockStatus
+      _status(Key k) override;
       ELLE_ATTRIBUTE(std::vector<std::unique_ptr<Silo>>, backend);
-      /// The storage holding k.
-      Silo& _storage_of(Key k) const;
+      ELLE_ATTRIBUTE_R(std::vector<int64_t>, weights);
+      ELLE_ATTRIBUTE_R(boost::optional<bfs::path>, placement);
+
+    /*----------.
+    | Placement |
+    `----------*/
+    private:
+      /// The index of the backend holding k.
+      boost::optional<int> _backend_of(Key k) const;
+      /// Run `f` on every backend, concurrently when a scheduler runs.
+      void
+      _each(std::function<void (int)> const& f) const;
+      /// Load the placement file, return whether it was usable.
+      bool
+      _load();
+      /// Rebuild the placement map by listing backends.
+      void
+      _rebuild();
+      /// Write the whole placement map and reopen the journal.
+      void
+      _snapshot();
+      /// Settle the placement of k after an interrupted operation on
+      /// `backend`, depending on whether it holds k.
+      void
+      _reconcile(Key k, int backend);
+      /// Record that k moved to `backend`, was erased if -1, or is about to
+      /// be written to or erased from a backend if lower.
+      ///
+      /// @throw elle::Error if the record cannot be written.
+      void
+      _record(Key k, int backend);
+      ELLE_ATTRIBUTE((std::unordered_map<Key, int>), locations);
+      ELLE_ATTRIBUTE(bfs::ofstream, journal);
     };
 
     struct StripSiloConfig
@@ -47,6 +105,8 @@ namespace infinit
       std::unique_ptr<infinit::silo::Silo>
       make() override;
       Silos storage;
+      boost::optional<std::vector<int64_t>> weights;
+      boost::optional<std::string> placement;
     };
   }
 }
@@ -3,6 +3,7 @@
 #include <boost/signals2.hpp>
 
 #include <infinit/model/MissingBlock.hh>
+#include <infinit/model/blocks/MutableBlock.hh>
 #include <infinit/model/doughnut/Consensus.hh>
 
 class InstrumentedConsensus
@@ -35,7 +36,7 @@ protected:
   {}
 
   std::unique_ptr<infinit::model::blocks::Block>
-  _fetch(Address addr, boost::optional<int>) override
+  _fetch(Address addr, boost::optional<int> local_version) override
   {
     auto it = this->_blocks.find(addr);
     if (it == this->_blocks.end())
@@ -43,6 +44,11 @@ protected:
     else
     {
       this->_fetched(addr);
+      if (local_version)
+        if (auto mb = dynamic_cast<infinit::model::blocks::MutableBlock*>(
+              it->second.get()))
+          if (mb->version() == *local_version)
+            return nullptr;
       return it->second->clone();
     }
   }
@@ -1,3 +1,5 @@
+#include <boost/filesystem/fstream.hpp>
+
 #include <elle/filesystem/TemporaryDirectory.hh>
 #include <elle/log.hh>
 #include <elle/memory.hh>
@@ -5,13 +7,16 @@
 
 #include <elle/cryptography/rsa/KeyPair.hh>
 
+#include <elle/reactor/Scope.hh>
 #include <elle/reactor/scheduler.hh>
 #include <elle/reactor/semaphore.hh>
 #include <elle/reactor/signal.hh>
 
+#include <infinit/model/blocks/ImmutableBlock.hh>
 #include <infinit/model/doughnut/Async.hh>
 #include <infinit/model/doughnut/Consensus.hh>
 #include <infinit/model/doughnut/Doughnut.hh>
+#include <infinit/model/doughnut/Journal.hh>
 #include <infinit/model/doughnut/Passport.hh>
 
 ELLE_LOG_COMPONENT("infinit.model.doughnut.consensus.Async.test");
@@ -89,6 +94,42 @@ public:
   }
 };
 
+class ConcurrentConsensus
+  : public dht::consensus::Consensus
+{
+public:
+  ConcurrentConsensus(infinit::model::doughnut::Doughnut& dht)
+    : dht::consensus::Consensus(dht)
+  {}
+
+  void
+  _store(std::unique_ptr<infinit::model::blocks::Block> block,
+         infinit::model::StoreMode,
+         std::unique_ptr<infinit::model::ConflictResolver>) override
+  {
+    this->order.push_back(block->address());
+    this->max_running = std::max(this->max_running, ++this->running);
+    elle::reactor::sleep(50_ms);
+    --this->running;
+  }
+
+  std::unique_ptr<infinit::model::blocks::Block>
+  _fetch(infinit::model::Address, boost::optional<int>) override
+  {
+    elle::unreachable();
+  }
+
+  void
+  _remove(infinit::model::Address, infinit::model::blocks::RemoveSignature) override
+  {
+    elle::unreachable();
+  }
+
+  std::vector<infinit::model::Address> order;
+  int running = 0;
+  int max_running = 0;
+};
+
 class DummyDoughnut
   : public dht::Doughnut
 {
@@ -176,9 +217,135 @@ ELLE_TEST_SCHEDULED(fetch_disk_queued_multiple)
   }
 }
 
+ELLE_TEST_SCHEDULED(journal)
+{
+  using Journal = dht::consensus::Journal;
+  namespace bfs = boost::filesystem;
+  auto const d = elle::filesystem::TemporaryDirectory{};
+  auto const data = [] (int i)
+    {
+      return elle::Buffer(elle::sprintf("operation %s", i));
+    };
+  auto const indexes = [] (int first, int last)
+    {
+      auto res = std::vector<int>{};
+      for (int i = first; i <= last; ++i)
+        res.push_back(i);
+      return res;
+    };
+  ELLE_LOG("write an operation the former way")
+  {
+    bfs::ofstream output(d.path() / "1", std::ios::binary);
+    output << data(1).string();
+  }
+  ELLE_LOG("import it and write more")
+  {
+    Journal j(d.path(), elle::reactor::Duration(), 256);
+    BOOST_CHECK(!bfs::exists(d.path() / "1"));
+    BOOST_CHECK(j.indexes() == indexes(1, 1));
+    BOOST_CHECK_EQUAL(j.read(1), data(1));
+    elle::With<elle::reactor::Scope>() << [&] (elle::reactor::Scope& s)
+    {
+      for (int i = 2; i <= 20; ++i)
+        s.run_background(elle::sprintf("write %s", i), [&, i]
+                         {
+                           j.write(i, data(i));
+                           j.commit();
+                         });
+      s.wait();
+    };
+    // Concurrent commits share flushes.
+    BOOST_CHECK_LT(j.syncs(), 19);
+    BOOST_CHECK(j.indexes() == indexes(1, 20));
+    BOOST_CHECK_EQUAL(j.read(15), data(15));
+    ELLE_LOG("overwrite and remove operations")
+    {
+      j.write(18, data(180));
+      for (int i = 1; i <= 16; ++i)
+        j.remove(i);
+      j.commit();
+      BOOST_CHECK(j.indexes() == indexes(17, 20));
+      BOOST_CHECK_EQUAL(j.read(18), data(180));
+      // Drained segments are kept for reuse.
+      BOOST_CHECK(!j.spares().empty());
+      BOOST_CHECK_GT(j.segments().begin()->first, 0);
+    }
+  }
+  ELLE_LOG("replay")
+  {
+    Journal j(d.path(), elle::reactor::Duration(), 256);
+    BOOST_CHECK(j.indexes() == indexes(17, 20));
+    BOOST_CHECK_EQUAL(j.read(18), data(180));
+    BOOST_CHECK_EQUAL(j.last_index(), 20);
+    j.write(21, data(21));
+    j.commit();
+  }
+  ELLE_LOG("replay a torn segment")
+  {
+    auto const torn = elle::filesystem::TemporaryDirectory{};
+    {
+      Journal j(torn.path());
+      j.write(1, data(1));
+      j.write(2, data(2));
+      j.commit();
+    }
+    auto const segment = bfs::directory_iterator(torn.path())->path();
+    bfs::resize_file(segment, bfs::file_size(segment) - 3);
+    {
+      bfs::ofstream output(segment, std::ios::binary | std::ios::app);
+      output << "garbage";
+    }
+    Journal j(torn.path());
+    BOOST_CHECK(j.indexes() == indexes(1, 1));
+    j.write(2, data(2));
+    j.commit();
+    BOOST_CHECK_EQUAL(Journal::load(torn.path()).size(), 2u);
+    BOOST_CHECK_EQUAL(Journal::load(torn.path()).at(2), data(2));
+  }
+}
+
+ELLE_TEST_SCHEDULED(concurrent_drain)
+{
+  DummyDoughnut dht;
+  auto cu = std::make_unique<ConcurrentConsensus>(dht);
+  auto& c = *cu;
+  auto&& async = dht::consensus::Async(std::move(cu), "", 100);
+  ELLE_LOG("store immutable blocks concurrently")
+  {
+    for (int i = 0; i < 8; ++i)
+      async.store(dht.make_block<infinit::model::blocks::ImmutableBlock>(
+                    elle::Buffer(elle::sprintf("chb %s", i))),
+                  infinit::model::STORE_INSERT, nullptr);
+    async.sync();
+    BOOST_CHECK_GT(c.max_running, 1);
+    BOOST_CHECK_LE(c.max_running, async.workers());
+    BOOST_CHECK_EQUAL(async.processed_op_count(), 8u);
+  }
+  ELLE_LOG("store other blocks in order")
+  {
+    c.order.clear();
+    c.max_running = 0;
+    auto addresses = std::vector<infinit::model::Address>{};
+    for (int i = 0; i < 4; ++i)
+    {
+      addresses.push_back(infinit::model::Address::random(0)); // FIXME
+      async.store(std::make_unique<infinit::model::blocks::Block>(
+                    addresses.back(), elle::Buffer("mb", 2)),
+                  infinit::model::STORE_INSERT, nullptr);
+    }
+    async.sync();
+    BOOST_CHECK_EQUAL(c.max_running, 1);
+    BOOST_CHECK(c.order == addresses);
+  }
+  auto const stats = async.stats();
+  BOOST_CHECK(stats.find("async") != stats.end());
+}
+
 ELLE_TEST_SUITE()
 {
   auto& suite = boost::unit_test::framework::master_test_suite();
   suite.add(BOOST_TEST_CASE(fetch_disk_queued), 0, 10);
   suite.add(BOOST_TEST_CASE(fetch_disk_queued_multiple), 0, 10);
+  suite.add(BOOST_TEST_CASE(journal), 0, 10);
+  suite.add(BOOST_TEST_CASE(concurrent_drain), 0, 10);
 }
@@ -1,3 +1,5 @@
+#include <boost/filesystem/fstream.hpp>
+
 #include <elle/test.hh>
 #include <elle/filesystem/TemporaryDirectory.hh>
 
@@ -88,9 +90,99 @@ ELLE_TEST_SCHEDULED(disk)
   }
 }
 
+ELLE_TEST_SCHEDULED(disk_mutable)
+{
+  elle::filesystem::TemporaryDirectory tmp;
+  std::unique_ptr<infinit::model::blocks::MutableBlock> okb;
+  ELLE_LOG("create and fetch OKB")
+  {
+    Recipe r(boost::optional<int>(),
+             boost::optional<std::chrono::seconds>(),
+             boost::optional<std::chrono::seconds>(),
+             tmp.path());
+    okb = r.dht.make_block<infinit::model::blocks::MutableBlock>(
+      elle::Buffer("data", 4));
+    okb->seal(1);
+    r.instrument.add(*okb);
+    BOOST_CHECK_EQUAL(r.cache.fetch(okb->address())->data(), okb->data());
+  }
+  ELLE_LOG("revalidate OKB from disk cache")
+  {
+    Recipe r(boost::optional<int>(),
+             boost::optional<std::chrono::seconds>(),
+             boost::optional<std::chrono::seconds>(),
+             tmp.path());
+    r.instrument.add(*okb);
+    auto fetched = 0;
+    r.instrument.fetched().connect(
+      [&] (infinit::model::Address const&) { ++fetched; });
+    BOOST_CHECK_EQUAL(r.cache.fetch(okb->address())->data(), okb->data());
+    BOOST_CHECK_EQUAL(fetched, 1);
+    BOOST_CHECK(!r.cache.fetch(okb->address(), 1));
+    BOOST_CHECK_EQUAL(fetched, 1);
+  }
+  ELLE_LOG("discard torn index records")
+  {
+    {
+      boost::filesystem::ofstream index(
+        tmp.path() / "index", std::ios::binary | std::ios::app);
+      index.write("+garbage", 8);
+    }
+    Recipe r(boost::optional<int>(),
+             boost::optional<std::chrono::seconds>(),
+             boost::optional<std::chrono::seconds>(),
+             tmp.path());
+    r.instrument.add(*okb);
+    BOOST_CHECK_EQUAL(r.cache.fetch(okb->address())->data(), okb->data());
+  }
+}
+
+ELLE_TEST_SCHEDULED(size)
+{
+  Recipe r(boost::optional<int>(16384));
+  auto const payload = std::string(1024, 'x');
+  auto make = [&]
+    {
+      auto b = r.dht.make_block<infinit::model::blocks::MutableBlock>(
+        elle::Buffer(payload.data(), payload.size()));
+      b->seal(1);
+      r.instrument.add(*b);
+      return b;
+    };
+  auto hot = make();
+  ELLE_LOG("promote hot block")
+  {
+    r.cache.fetch(hot->address());
+    r.cache.fetch(hot->address());
+  }
+  ELLE_LOG("scan through cold blocks")
+    for (int i = 0; i < 32; ++i)
+    {
+      r.cache.fetch(make()->address());
+      BOOST_CHECK_LE(r.cache.cache_used(), std::size_t(r.cache.cache_size()));
+    }
+  BOOST_CHECK_GT(r.cache.evictions(), 0);
+  BOOST_CHECK_EQUAL(r.cache.misses(), 33);
+  ELLE_LOG("check hot block survived the scan")
+  {
+    r.instrument.fetched().connect(
+      [] (infinit::model::Address const& addr)
+      {
+        BOOST_FAIL(elle::sprintf("block %f should have been cached", addr));
+      });
+    BOOST_CHECK_EQUAL(r.cache.fetch(hot->address())->data(), hot->data());
+  }
+  auto stats = boost::any_cast<elle::json::Object>(r.cache.stats()["cache"]);
+  BOOST_CHECK_EQUAL(boost::any_cast<int64_t>(stats["hits"]), r.cache.hits());
+  BOOST_CHECK_EQUAL(boost::any_cast<int64_t>(stats["evictions"]),
+                    r.cache.evictions());
+}
+
 ELLE_TEST_SUITE()
 {
   auto& suite = boost::unit_test::framework::master_test_suite();
   suite.add(BOOST_TEST_CASE(memory), 0, valgrind(1));
   suite.add(BOOST_TEST_CASE(disk), 0, valgrind(1));
+  suite.add(BOOST_TEST_CASE(disk_mutable), 0, valgrind(1));
+  suite.add(BOOST_TEST_CASE(size), 0, valgrind(1));
 }
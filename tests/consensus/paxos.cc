@@ -62,9 +62,215 @@ ELLE_TEST_SCHEDULED(availability_3)
   }
 }
 
+namespace
+{
+  dht::Doughnut::ConsensusBuilder
+  leasing(std::chrono::system_clock::duration lease)
+  {
+    return [lease] (dht::Doughnut& dht)
+      {
+        return std::make_unique<dht::consensus::Paxos>(
+          dht::consensus::doughnut = dht,
+          dht::consensus::replication_factor = 3,
+          dht::consensus::lease = lease);
+      };
+  }
+
+  dht::Doughnut::ConsensusBuilder
+  read_leasing(std::chrono::system_clock::duration read_lease)
+  {
+    return [read_lease] (dht::Doughnut& dht)
+      {
+        return std::make_unique<dht::consensus::Paxos>(
+          dht::consensus::doughnut = dht,
+          dht::consensus::replication_factor = 3,
+          dht::consensus::read_lease = read_lease);
+      };
+  }
+
+  dht::consensus::Paxos&
+  paxos(DHT& dht)
+  {
+    return dynamic_cast<dht::consensus::Paxos&>(*dht.dht->consensus());
+  }
+
+  int64_t
+  read_lease_revocations(DHT& dht)
+  {
+    auto local = std::dynamic_pointer_cast<dht::consensus::Paxos::LocalPeer>(
+      dht.dht->local());
+    BOOST_REQUIRE(local);
+    return local->read_lease_revocations();
+  }
+}
+
+ELLE_TEST_SCHEDULED(lease)
+{
+  auto a = std::make_unique<DHT>(
+    dht::consensus_builder = leasing(std::chrono::minutes(1)));
+  auto b = std::make_unique<DHT>(
+    dht::consensus_builder = leasing(std::chrono::minutes(1)));
+  auto c = std::make_unique<DHT>(
+    dht::consensus_builder = leasing(std::chrono::minutes(1)));
+  a->overlay->connect(*b->overlay);
+  a->overlay->connect(*c->overlay);
+  b->overlay->connect(*c->overlay);
+  auto block = a->dht->make_block<infinit::model::blocks::MutableBlock>();
+  block->data(elle::Buffer("foo"));
+  ELLE_LOG("insert block")
+    a->dht->seal_and_insert(*block);
+  ELLE_LOG("update block under lease")
+    for (auto data: {"foobar", "foobarbaz", "foobarbazquux"})
+    {
+      block->data(elle::Buffer(data));
+      a->dht->seal_and_update(*block);
+    }
+  BOOST_CHECK_EQUAL(paxos(*a).leased(), 3);
+  BOOST_CHECK_EQUAL(paxos(*a).lease_fallbacks(), 0);
+  BOOST_CHECK_EQUAL(c->dht->fetch(block->address())->data(), "foobarbazquux");
+  ELLE_LOG("update block from another node")
+  {
+    auto other = b->dht->fetch(block->address());
+    other->data(elle::Buffer("other"));
+    b->dht->seal_and_update(*other);
+  }
+  ELLE_LOG("update preempted lease")
+  {
+    block->data(elle::Buffer("stale"));
+    BOOST_CHECK_THROW(a->dht->seal_and_update(*block),
+                      infinit::model::Conflict);
+    BOOST_CHECK_EQUAL(paxos(*a).lease_fallbacks(), 1);
+    BOOST_CHECK_EQUAL(c->dht->fetch(block->address())->data(), "other");
+  }
+  ELLE_LOG("take the lease back")
+  {
+    block = elle::cast<infinit::model::blocks::MutableBlock>::runtime(
+      a->dht->fetch(block->address()));
+    block->data(elle::Buffer("back"));
+    a->dht->seal_and_update(*block);
+    block->data(elle::Buffer("leased"));
+    a->dht->seal_and_update(*block);
+    BOOST_CHECK_EQUAL(paxos(*a).leased(), 4);
+    BOOST_CHECK_EQUAL(b->dht->fetch(block->address())->data(), "leased");
+  }
+}
+
+ELLE_TEST_SCHEDULED(lease_expiry)
+{
+  auto a = std::make_unique<DHT>(
+    dht::consensus_builder = leasing(std::chrono::milliseconds(500)));
+  auto b = std::make_unique<DHT>(
+    dht::consensus_builder = leasing(std::chrono::milliseconds(500)));
+  a->overlay->connect(*b->overlay);
+  auto block = a->dht->make_block<infinit::model::blocks::MutableBlock>();
+  block->data(elle::Buffer("foo"));
+  a->dht->seal_and_insert(*block);
+  elle::reactor::sleep(std::chrono::seconds(1));
+  ELLE_LOG("update block once the lease expired")
+  {
+    block->data(elle::Buffer("foobar"));
+    a->dht->seal_and_update(*block);
+    BOOST_CHECK_EQUAL(paxos(*a).leased(), 0);
+    BOOST_CHECK_EQUAL(paxos(*a).lease_fallbacks(), 1);
+  }
+  ELLE_LOG("update block under the renewed lease")
+  {
+    block->data(elle::Buffer("foobarbaz"));
+    a->dht->seal_and_update(*block);
+    BOOST_CHECK_EQUAL(paxos(*a).leased(), 1);
+  }
+  BOOST_CHECK_EQUAL(b->dht->fetch(block->address())->data(), "foobarbaz");
+}
+
+ELLE_TEST_SCHEDULED(lease_failover)
+{
+  auto a = std::make_unique<DHT>(
+    dht::consensus_builder = leasing(std::chrono::minutes(1)));
+  auto b = std::make_unique<DHT>(
+    dht::consensus_builder = leasing(std::chrono::minutes(1)));
+  auto c = std::make_unique<DHT>(
+    dht::consensus_builder = leasing(std::chrono::minutes(1)));
+  a->overlay->connect(*b->overlay);
+  a->overlay->connect(*c->overlay);
+  b->overlay->connect(*c->overlay);
+  auto block = a->dht->make_block<infinit::model::blocks::MutableBlock>();
+  block->data(elle::Buffer("foo"));
+  a->dht->seal_and_insert(*block);
+  ELLE_LOG("stop third DHT")
+    c.reset();
+  ELLE_LOG("update block under lease with a majority")
+  {
+    block->data(elle::Buffer("foobar"));
+    a->dht->seal_and_update(*block);
+    BOOST_CHECK_EQUAL(paxos(*a).leased(), 1);
+    BOOST_CHECK_EQUAL(b->dht->fetch(block->address())->data(), "foobar");
+  }
+  ELLE_LOG("stop second DHT")
+    b.reset();
+  ELLE_LOG("update block without a majority")
+  {
+    block->data(elle::Buffer("foobarbaz"));
+    BOOST_CHECK_THROW(a->dht->seal_and_update(*block),
+                      elle::athena::paxos::TooFewPeers);
+    BOOST_CHECK_EQUAL(paxos(*a).leased(), 1);
+    BOOST_CHECK_EQUAL(paxos(*a).lease_fallbacks(), 1);
+  }
+}
+
+ELLE_TEST_SCHEDULED(read_lease)
+{
+  auto a = std::make_unique<DHT>(
+    dht::consensus_builder = read_leasing(std::chrono::seconds(1)));
+  auto b = std::make_unique<DHT>(
+    dht::consensus_builder = read_leasing(std::chrono::seconds(1)));
+  auto c = std::make_unique<DHT>(
+    dht::consensus_builder = read_leasing(std::chrono::seconds(1)));
+  a->overlay->connect(*b->overlay);
+  a->overlay->connect(*c->overlay);
+  b->overlay->connect(*c->overlay);
+  auto block = a->dht->make_block<infinit::model::blocks::MutableBlock>();
+  block->data(elle::Buffer("foo"));
+  a->dht->seal_and_insert(*block);
+  block->data(elle::Buffer("foobar"));
+  a->dht->seal_and_update(*block);
+  ELLE_LOG("acquire read lease")
+  {
+    BOOST_CHECK_EQUAL(b->dht->fetch(block->address())->data(), "foobar");
+    BOOST_CHECK_EQUAL(paxos(*b).read_leases_acquired(), 1);
+    BOOST_CHECK_EQUAL(paxos(*b).read_lease_misses(), 1);
+  }
+  ELLE_LOG("read block locally")
+  {
+    BOOST_CHECK_EQUAL(b->dht->fetch(block->address())->data(), "foobar");
+    BOOST_CHECK_EQUAL(b->dht->fetch(block->address())->data(), "foobar");
+    BOOST_CHECK_EQUAL(paxos(*b).read_lease_hits(), 2);
+  }
+  ELLE_LOG("update block from another node")
+  {
+    block->data(elle::Buffer("foobarbaz"));
+    a->dht->seal_and_update(*block);
+    BOOST_CHECK_GE(read_lease_revocations(*a) + read_lease_revocations(*c),
+                   1);
+    BOOST_CHECK_EQUAL(b->dht->fetch(block->address())->data(), "foobarbaz");
+    BOOST_CHECK_EQUAL(paxos(*b).read_lease_hits(), 2);
+    BOOST_CHECK_EQUAL(paxos(*b).read_lease_misses(), 2);
+    BOOST_CHECK_EQUAL(paxos(*b).read_leases_acquired(), 2);
+  }
+  ELLE_LOG("read block once the lease expired")
+  {
+    elle::reactor::sleep(std::chrono::milliseconds(1500));
+    BOOST_CHECK_EQUAL(b->dht->fetch(block->address())->data(), "foobarbaz");
+    BOOST_CHECK_EQUAL(paxos(*b).read_lease_misses(), 3);
+  }
+}
+
 ELLE_TEST_SUITE()
 {
   auto& suite = boost::unit_test::framework::master_test_suite();
   suite.add(BOOST_TEST_CASE(availability_2), 0, 10);
   suite.add(BOOST_TEST_CASE(availability_3), 0, 10);
+  suite.add(BOOST_TEST_CASE(lease), 0, 10);
+  suite.add(BOOST_TEST_CASE(lease_expiry), 0, 10);
+  suite.add(BOOST_TEST_CASE(lease_failover), 0, 10);
+  suite.add(BOOST_TEST_CASE(read_lease), 0, 10);
 }
@@ -5,6 +5,7 @@
 
 #include <elle/cast.hh>
 #include <elle/filesystem/TemporaryDirectory.hh>
+#include <elle/finally.hh>
 #include <elle/find.hh>
 #include <elle/log.hh>
 #include <elle/random.hh>
@@ -12,6 +13,8 @@
 #include <elle/utils.hh>
 #include <elle/Version.hh>
 
+#include <elle/cryptography/random.hh>
+
 #ifndef INFINIT_WINDOWS
 # include <elle/reactor/network/unix-domain-socket.hh>
 #endif
@@ -23,7 +26,11 @@
 #include <infinit/model/blocks/ImmutableBlock.hh>
 #include <infinit/model/blocks/MutableBlock.hh>
 #include <infinit/model/doughnut/ACB.hh>
+#include <infinit/model/doughnut/CCHB.hh>
+#include <infinit/model/doughnut/CHB.hh>
 #include <infinit/model/doughnut/Cache.hh>
+#include <infinit/model/doughnut/Compressor.hh>
+#include <infinit/model/doughnut/CryptoPool.hh>
 #include <infinit/model/doughnut/Doughnut.hh>
 #include <infinit/model/doughnut/Group.hh>
 #include <infinit/model/doughnut/Local.hh>
@@ -335,6 +342,79 @@ ELLE_TEST_SCHEDULED(CHB, (bool, paxos))
   }
 }
 
+ELLE_TEST_SCHEDULED(keyed_peers, (bool, paxos))
+{
+  auto dhts = DHTs(paxos);
+  // Larger than a piece, so it is streamed in framed pieces.
+  auto const data = elle::Buffer(std::string(1024 * 1024 + 1, 'k'));
+  auto block = dhts.dht_a->make_block<blocks::ImmutableBlock>(data);
+  block->seal();
+  for (auto const& dht: {dhts.dht_b, dhts.dht_c})
+  {
+    auto remote = std::dynamic_pointer_cast<dht::Remote>(
+      dht->overlay()->lookup_node(dhts.dht_a->id()).lock());
+    BOOST_REQUIRE(remote);
+    remote->connect();
+    BOOST_TEST(remote->connection()->streaming());
+    BOOST_TEST(remote->connection()->framing());
+    remote->store(*block, infinit::model::STORE_INSERT);
+    BOOST_CHECK_EQUAL(remote->fetch(block->address(), {})->data(), data);
+  }
+}
+
+ELLE_TEST_SCHEDULED(CCHB, (bool, paxos))
+{
+  auto dhts = DHTs(paxos);
+  auto& dht = *dhts.dht_a;
+  auto owner = dht.make_block<blocks::ACLBlock>();
+  dht.seal_and_insert(*owner);
+  auto const data = elle::Buffer("\\_o<");
+  auto const key = dht::CCHB::key(data);
+  auto const store = [&] (int index)
+    {
+      auto block = std::make_unique<dht::CCHB>(
+        &dht, elle::Buffer(data), key, owner->address(), index);
+      auto const address = block->address();
+      dht.insert(std::move(block));
+      return address;
+    };
+  auto const referrers = [&] (infinit::model::Address address)
+    {
+      auto block = dht.fetch(address);
+      return dynamic_cast<dht::CCHB const&>(*block).referrers().size();
+    };
+  auto const release = [&] (dht::Doughnut& d,
+                            infinit::model::Address address,
+                            int index)
+    {
+      d.remove(address,
+               dht::CCHB::sign_remove(d, address, owner->address(), index));
+    };
+  ELLE_LOG("store block twice at the same position")
+  {
+    auto const address = store(0);
+    BOOST_CHECK_EQUAL(store(0), address);
+    BOOST_CHECK_EQUAL(referrers(address), 1);
+  }
+  auto const address = store(1);
+  BOOST_CHECK_EQUAL(referrers(address), 2);
+  ELLE_LOG("release without signature")
+    BOOST_CHECK_THROW(dht.remove(address), elle::Error);
+  ELLE_LOG("release without write access")
+    BOOST_CHECK_THROW(release(*dhts.dht_b, address, 0), elle::Error);
+  BOOST_CHECK_EQUAL(referrers(address), 2);
+  ELLE_LOG("release first position twice")
+  {
+    release(dht, address, 0);
+    release(dht, address, 0);
+    BOOST_CHECK_EQUAL(dht.fetch(address)->data(), data);
+    BOOST_CHECK_EQUAL(referrers(address), 1);
+  }
+  ELLE_LOG("release second position")
+    release(dht, address, 1);
+  BOOST_CHECK_THROW(dht.fetch(address), infinit::model::MissingBlock);
+}
+
 ELLE_TEST_SCHEDULED(OKB, (bool, paxos))
 {
   DHTs dhts(paxos);
@@ -373,6 +453,65 @@ ELLE_TEST_SCHEDULED(missing_block, (bool, paxos))
                       MissingBlock);
 }
 
+ELLE_TEST_SCHEDULED(multifetch, (bool, paxos))
+{
+  using namespace infinit::model;
+  DHTs dhts(paxos);
+  auto addresses = std::vector<Model::AddressVersion>{};
+  auto expected = std::unordered_map<Address, elle::Buffer>{};
+  ELLE_LOG("store blocks")
+    for (int i = 0; i < 5; ++i)
+    {
+      auto data = elle::Buffer(elle::sprintf("block %s", i));
+      auto chb = dhts.dht_a->make_block<blocks::ImmutableBlock>(data);
+      dhts.dht_a->seal_and_insert(*chb);
+      addresses.emplace_back(chb->address(), boost::none);
+      expected.emplace(chb->address(), data);
+      auto okb = dhts.dht_a->make_block<blocks::MutableBlock>();
+      okb->data(elle::Buffer(data));
+      dhts.dht_a->seal_and_insert(*okb);
+      // Pretend the last one is already up to date locally.
+      if (i == 4)
+        addresses.emplace_back(okb->address(), okb->version());
+      else
+      {
+        addresses.emplace_back(okb->address(), boost::none);
+        expected.emplace(okb->address(), data);
+      }
+    }
+  auto missing = std::unordered_set<Address>{
+    Address::random(flags::immutable_block),
+    Address::random(flags::mutable_block),
+  };
+  for (auto const& a: missing)
+    addresses.emplace_back(a, boost::none);
+  auto fetched = 0;
+  auto current = 0;
+  ELLE_LOG("fetch blocks")
+    dhts.dht_b->multifetch(
+      addresses,
+      [&] (Address address, std::unique_ptr<blocks::Block> block,
+           std::exception_ptr e)
+      {
+        if (e)
+        {
+          BOOST_CHECK(missing.count(address));
+          BOOST_CHECK_THROW(std::rethrow_exception(e), MissingBlock);
+          missing.erase(address);
+        }
+        else if (block)
+        {
+          BOOST_CHECK_EQUAL(block->data(), expected.at(address));
+          ++fetched;
+        }
+        else
+          ++current;
+      });
+  BOOST_CHECK_EQUAL(fetched, 9);
+  BOOST_CHECK_EQUAL(current, 1);
+  BOOST_CHECK(missing.empty());
+}
+
 ELLE_TEST_SCHEDULED(async, (bool, paxos))
 {
   DHTs dhts(paxos);
@@ -845,6 +984,68 @@ namespace tests_paxos
     BOOST_CHECK_THROW(dht.dht->seal_and_insert(*chb),
                       elle::Error);
   }
+
+  /// Check promises and confirmations do not rewrite the block value, and
+  /// that they are replayed on restart.
+  ELLE_TEST_SCHEDULED(phases)
+  {
+    auto keys_a = elle::cryptography::rsa::keypair::generate(key_size());
+    auto keys_b = elle::cryptography::rsa::keypair::generate(key_size());
+    auto keys_c = elle::cryptography::rsa::keypair::generate(key_size());
+    auto id_a = infinit::model::Address::random(0); // FIXME
+    auto id_b = infinit::model::Address::random(0); // FIXME
+    auto id_c = infinit::model::Address::random(0); // FIXME
+    Memory::Blocks storage_a;
+    Memory::Blocks storage_b;
+    Memory::Blocks storage_c;
+    auto const payload = std::string(64 * 1024, 'p');
+    std::unique_ptr<blocks::MutableBlock> block;
+    ELLE_LOG("update block")
+    {
+      DHTs dhts(
+        true,
+        keys_a, keys_b, keys_c,
+        id_a, id_b, id_c,
+        std::make_unique<Memory>(storage_a),
+        std::make_unique<Memory>(storage_b),
+        std::make_unique<Memory>(storage_c));
+      block = dhts.dht_a->make_block<blocks::MutableBlock>(
+        elle::Buffer(payload));
+      dhts.dht_a->seal_and_insert(*block);
+      for (int i = 0; i < 4; ++i)
+      {
+        block->data(elle::Buffer(payload + std::to_string(i)));
+        dhts.dht_a->seal_and_update(*block);
+      }
+      auto& local =
+        dynamic_cast<dht::consensus::Paxos::LocalPeer&>(
+          *dhts.dht_a->local());
+      auto written = local.written();
+      auto const size = int64_t(payload.size());
+      BOOST_CHECK_GT(written["accept"], 5 * size);
+      BOOST_CHECK_LT(written["propose"], size);
+      BOOST_CHECK_LT(written["confirm"], size);
+      auto const addresses = local.addresses();
+      BOOST_CHECK_EQUAL(addresses.size(), 1);
+      BOOST_CHECK_GT(storage_a.size(), addresses.size());
+    }
+    ELLE_LOG("reload block")
+    {
+      DHTs dhts(
+        true,
+        keys_a, keys_b, keys_c,
+        id_a, id_b, id_c,
+        std::make_unique<Memory>(storage_a),
+        std::make_unique<Memory>(storage_b),
+        std::make_unique<Memory>(storage_c));
+      BOOST_CHECK_EQUAL(dhts.dht_a->fetch(block->address())->data(),
+                        block->data());
+      block->data(elle::Buffer(payload + "reloaded"));
+      dhts.dht_a->seal_and_update(*block);
+      BOOST_CHECK_EQUAL(dhts.dht_b->fetch(block->address())->data(),
+                        block->data());
+    }
+  }
 }
 
 ELLE_TEST_SCHEDULED(cache, (bool, paxos))
@@ -1572,6 +1773,51 @@ namespace rebalancing
       BOOST_CHECK_EQUAL(dht_b.dht->fetch(b->address())->data(), b->data());
   }
 
+  ELLE_TEST_SCHEDULED(expand_CCHB)
+  {
+    auto dht_a = DHT(dht::consensus_builder = instrument(2));
+    auto& local_a = dynamic_cast<Local&>(*dht_a.dht->local());
+    auto dht_b = DHT(dht::consensus_builder = instrument(2));
+    auto& local_b = dynamic_cast<Local&>(*dht_b.dht->local());
+    auto& dht = *dht_a.dht;
+    auto owner = dht.make_block<blocks::ACLBlock>();
+    dht.seal_and_insert(*owner);
+    auto const data = elle::Buffer("expand_CCHB");
+    auto const key = dht::CCHB::key(data);
+    auto const store = [&] (int index)
+      {
+        auto block = std::make_unique<dht::CCHB>(
+          &dht, elle::Buffer(data), key, owner->address(), index);
+        auto const address = block->address();
+        dht.insert(std::move(block));
+        return address;
+      };
+    auto const referrers = [&] (Local& local, Address address)
+      {
+        auto block = local.fetch(address, {});
+        return dynamic_cast<dht::CCHB const&>(*block).referrers().size();
+      };
+    auto const address = store(0);
+    // Wait until the first automatic expansion fails.
+    elle::reactor::wait(dht_a.overlay->looked_up(), address);
+    ELLE_LOG("write block at another position to first DHT")
+      store(1);
+    BOOST_CHECK_EQUAL(referrers(local_a, address), 2u);
+    ELLE_LOG("connect second DHT")
+      dht_b.overlay->connect(*dht_a.overlay);
+    ELLE_LOG("wait for rebalancing")
+      elle::reactor::wait(local_a.rebalanced(), address);
+    BOOST_CHECK_EQUAL(size(dht_a.overlay->lookup(address, 2)), 2u);
+    ELLE_LOG("check the replica kept both referrers")
+      BOOST_CHECK_EQUAL(referrers(local_b, address), 2u);
+    ELLE_LOG("release first position")
+      dht.remove(address,
+                 dht::CCHB::sign_remove(dht, address, owner->address(), 0));
+    BOOST_CHECK_EQUAL(referrers(local_a, address), 1u);
+    BOOST_CHECK_EQUAL(referrers(local_b, address), 1u);
+    BOOST_CHECK_EQUAL(dht_b.dht->fetch(address)->data(), data);
+  }
+
   ELLE_TEST_SCHEDULED(expand_concurrent)
   {
     auto dht_a = DHT(dht::consensus_builder = instrument(3));
@@ -2234,6 +2480,103 @@ ELLE_TEST_SCHEDULED(disabled_crypto)
   BOOST_CHECK_EQUAL(bic->data(), "canard");
 }
 
+ELLE_TEST_SCHEDULED(crypto_pool)
+{
+  using infinit::model::doughnut::CryptoPool;
+  CryptoPool pool(2, 8);
+  pool.inline_size(16);
+  auto results = std::vector<bool>(16);
+  elle::With<elle::reactor::Scope>() << [&] (elle::reactor::Scope& s)
+  {
+    for (int i = 0; i < signed(results.size()); ++i)
+      s.run_background(
+        elle::sprintf("verify %s", i),
+        [&, i]
+        {
+          results[i] = pool.verify([i] { return i % 2 == 0; });
+        });
+    elle::reactor::wait(s);
+  };
+  for (int i = 0; i < signed(results.size()); ++i)
+    BOOST_TEST(results[i] == (i % 2 == 0));
+  BOOST_TEST(pool.verify_batched() == 16);
+  BOOST_TEST(pool.verify_batches() >= 2);
+  BOOST_TEST(pool.verify_batches() < 16);
+  BOOST_TEST(pool.histogram(CryptoPool::Operation::verify).count() == 16);
+  BOOST_CHECK_THROW(
+    pool.verify([]() -> bool { elle::err("corrupted signature"); }),
+    elle::Error);
+  BOOST_TEST(pool.run(CryptoPool::Operation::decipher, 8, [] { return 8; })
+             == 8);
+  BOOST_TEST(pool.run(CryptoPool::Operation::decipher, 1024,
+                      [] { return 1024; }) == 1024);
+  BOOST_TEST(
+    pool.histogram(CryptoPool::Operation::decipher).count() == 2);
+  BOOST_TEST(pool.histogram(CryptoPool::Operation::queue).count() >= 3);
+}
+
+ELLE_TEST_SCHEDULED(compression, (bool, paxos))
+{
+  using dht::Compressor;
+  auto& compressor = Compressor::instance();
+  auto const algorithm = compressor.algorithm();
+  compressor.algorithm(Compressor::Algorithm::lz4);
+  elle::SafeFinally restore([&] { compressor.algorithm(algorithm); });
+  auto const compressed = compressor.compressed();
+  auto const skipped = compressor.skipped();
+  DHTs dhts(paxos);
+  auto text = std::string{};
+  while (text.size() < 64 * 1024)
+    text += elle::sprintf("{\"offset\": %s, \"level\": \"info\"}\n",
+                          text.size());
+  auto const compressible = elle::Buffer(text);
+  auto const random =
+    elle::cryptography::random::generate<elle::Buffer>(64 * 1024);
+  auto const acb = [&] (elle::Buffer const& data)
+    {
+      auto block = dhts.dht_a->make_block<blocks::ACLBlock>();
+      block->set_permissions(dht::User(dhts.keys_b->K(), ""), true, false);
+      block->data(elle::Buffer(data));
+      dhts.dht_a->seal_and_insert(*block);
+      auto fetched = dhts.dht_b->fetch(block->address());
+      BOOST_CHECK_EQUAL(fetched->data(), data);
+      return dynamic_cast<dht::ACB const&>(*block).compression();
+    };
+  ELLE_LOG("compressible ACB")
+    BOOST_CHECK_EQUAL(acb(compressible), Compressor::Algorithm::lz4);
+  ELLE_LOG("incompressible ACB")
+    BOOST_CHECK_EQUAL(acb(random), Compressor::Algorithm::none);
+  BOOST_CHECK_GE(compressor.compressed(), compressed + 1);
+  BOOST_CHECK_GE(compressor.skipped(), skipped + 1);
+  BOOST_CHECK_LT(compressor.bytes_out() * 4, compressor.bytes_in());
+  ELLE_LOG("compressed CHB")
+  {
+    auto compressed = compressor.compress(compressible);
+    BOOST_REQUIRE(compressed);
+    auto chb = std::make_unique<dht::CHB>(
+      dhts.dht_a.get(), std::move(*compressed),
+      infinit::model::Address::null, Compressor::Algorithm::lz4);
+    auto const address = chb->address();
+    dhts.dht_a->insert(std::move(chb));
+    auto fetched = dhts.dht_b->fetch(address);
+    auto const compression =
+      dynamic_cast<dht::CHB const&>(*fetched).compression();
+    BOOST_CHECK_EQUAL(compression, Compressor::Algorithm::lz4);
+    BOOST_CHECK_EQUAL(
+      compressor.decompress(fetched->take_data(), compression), compressible);
+  }
+  ELLE_LOG("corrupted payload")
+    BOOST_CHECK_THROW(
+      compressor.decompress(elle::Buffer("\x10\0\0\0\xf0", 5),
+                            Compressor::Algorithm::lz4),
+      elle::Error);
+  ELLE_LOG("oversized payload")
+    BOOST_CHECK_THROW(
+      compressor.decompress(elle::Buffer("\xff\xff\xff\x7f\xf0", 5),
+                            Compressor::Algorithm::lz4),
+      elle::Error);
+}
+
 ELLE_TEST_SUITE()
 {
   auto& suite = boost::unit_test::framework::master_test_suite();
@@ -2253,8 +2596,11 @@ ELLE_TEST_SUITE()
     plain->add(BOOST_TEST_CASE(Name));          \
   }
   TEST(CHB);
+  TEST(keyed_peers);
+  TEST(CCHB);
   TEST(OKB);
   TEST(missing_block);
+  TEST(multifetch);
   TEST(async);
   TEST(ACB);
   TEST(NB);
@@ -2263,6 +2609,7 @@ ELLE_TEST_SUITE()
   TEST(restart);
   TEST(cache);
   TEST(serialize);
+  TEST(compression);
 #ifndef INFINIT_WINDOWS
   TEST(monitoring);
 #endif
@@ -2280,10 +2627,12 @@ ELLE_TEST_SUITE()
 #undef TEST
   suite.add(BOOST_TEST_CASE(admin_keys), 0, valgrind(3));
   suite.add(BOOST_TEST_CASE(disabled_crypto), 0, valgrind(3));
+  suite.add(BOOST_TEST_CASE(crypto_pool), 0, valgrind(1));
   {
     paxos->add(ELLE_TEST_CASE(&tests_paxos::wrong_quorum, "wrong_quorum"));
     paxos->add(ELLE_TEST_CASE(&tests_paxos::batch_quorum, "batch_quorum"));
     paxos->add(ELLE_TEST_CASE(&tests_paxos::CHB_no_peer, "CHB_no_peer"));
+    paxos->add(ELLE_TEST_CASE(&tests_paxos::phases, "phases"));
   }
   {
     boost::unit_test::test_suite* rebalancing = BOOST_TEST_SUITE("rebalancing");
@@ -2307,6 +2656,7 @@ ELLE_TEST_SUITE()
       rebalancing->add(BOOST_TEST_CASE(expand_newcomer_CHB), 0, valgrind(3));
       rebalancing->add(BOOST_TEST_CASE(expand_newcomer_OKB), 0, valgrind(3));
     }
+    rebalancing->add(BOOST_TEST_CASE(expand_CCHB), 0, valgrind(3));
     rebalancing->add(BOOST_TEST_CASE(expand_concurrent), 0, valgrind(5));
     {
       auto expand_CHB_from_disk = [] () { expand_from_disk(true); };
@@ -37,6 +37,7 @@
 
 #include <elle/reactor/scheduler.hh>
 
+#include <infinit/filesystem/FileHandle.hh>
 #include <infinit/filesystem/filesystem.hh>
 #include <infinit/model/doughnut/Doughnut.hh>
 #include <infinit/model/doughnut/Local.hh>
@@ -313,6 +314,183 @@ ELLE_TEST_SCHEDULED(prefetcher_failure)
     16384);
 }
 
+ELLE_TEST_SCHEDULED(read_pattern)
+{
+  using Kind = infinit::filesystem::ReadPattern::Kind;
+  auto p = infinit::filesystem::ReadPattern{};
+  // Sequential reads open and grow the window up to the maximum.
+  BOOST_CHECK(p.access(0, 16));
+  BOOST_CHECK_EQUAL(p.kind(), Kind::sequential);
+  BOOST_CHECK_EQUAL(p.window, 4);
+  BOOST_CHECK(!p.access(0, 16));
+  BOOST_CHECK(p.access(1, 16));
+  BOOST_CHECK_EQUAL(p.window, 8);
+  BOOST_CHECK(p.access(2, 16));
+  BOOST_CHECK(p.access(3, 16));
+  BOOST_CHECK_EQUAL(p.window, 16);
+  // A jump closes it, until a stride shows up.
+  BOOST_CHECK(p.access(10, 16));
+  BOOST_CHECK_EQUAL(p.kind(), Kind::random);
+  BOOST_CHECK(p.access(13, 16));
+  BOOST_CHECK_EQUAL(p.kind(), Kind::random);
+  BOOST_CHECK(p.access(16, 16));
+  BOOST_CHECK_EQUAL(p.kind(), Kind::strided);
+  BOOST_CHECK_EQUAL(p.stride, 3);
+  BOOST_CHECK_EQUAL(p.window, 4);
+  BOOST_CHECK(p.access(2, 16));
+  BOOST_CHECK_EQUAL(p.kind(), Kind::random);
+  // No read-ahead at all.
+  auto disabled = infinit::filesystem::ReadPattern{};
+  for (int i = 0; i < 4; ++i)
+    disabled.access(i, 0);
+  BOOST_CHECK_EQUAL(disabled.kind(), Kind::random);
+}
+
+ELLE_TEST_SCHEDULED(read_ahead)
+{
+  auto servers = DHTs(1);
+  auto client = servers.client();
+  auto& fs = dynamic_cast<infinit::filesystem::FileSystem&>(
+    *client.fs->operations());
+  auto const block_size = 64 * 1024;
+  auto const blocks = 16;
+  fs.block_size(block_size);
+  fs.readahead_memory(3 * block_size);
+  auto root = client.fs->path("/");
+  auto content = std::string(block_size * blocks, 'a');
+  for (unsigned int i = 0; i < content.size(); ++i)
+    content[i] = i % 199;
+  {
+    auto h = root->child("file")->create(O_CREAT | O_RDWR, S_IFREG | 0644);
+    BOOST_CHECK_EQUAL(
+      h->write(elle::ConstWeakBuffer(content.data(), content.size()),
+               content.size(), 0),
+      signed(content.size()));
+    h->close();
+  }
+  auto check = [&] (elle::reactor::filesystem::Handle& h, int64_t offset)
+    {
+      char buf[16384];
+      BOOST_CHECK_EQUAL(h.read(elle::WeakBuffer(buf, sizeof buf),
+                               sizeof buf, offset),
+                        signed(sizeof buf));
+      BOOST_CHECK(!memcmp(buf, content.data() + offset, sizeof buf));
+      BOOST_CHECK_LE(fs.readahead_used(), fs.readahead_memory());
+    };
+  ELLE_LOG("sequential read")
+  {
+    auto h = root->child("file")->open(O_RDONLY, 0);
+    for (int64_t offset = 0; offset < signed(content.size()); offset += 16384)
+      check(*h, offset);
+    h->close();
+  }
+  BOOST_CHECK_EQUAL(fs.readahead_used(), 0);
+  ELLE_LOG("strided and random reads")
+  {
+    auto h = root->child("file")->open(O_RDONLY, 0);
+    for (int i = 0; i < blocks; i += 3)
+      check(*h, int64_t(i) * block_size + 1024);
+    for (int i: {7, 2, 12, 5})
+      check(*h, int64_t(i) * block_size);
+    h->close();
+  }
+  BOOST_CHECK_EQUAL(fs.readahead_used(), 0);
+}
+
+ELLE_TEST_SCHEDULED(write_back)
+{
+  auto servers = DHTs(1);
+  auto client = servers.client();
+  auto& fs = dynamic_cast<infinit::filesystem::FileSystem&>(
+    *client.fs->operations());
+  auto const block_size = 64 * 1024;
+  auto const blocks = 16;
+  fs.block_size(block_size);
+  fs.dirty_limit(4 * block_size);
+  fs.dirty_background(block_size);
+  auto root = client.fs->path("/");
+  auto content = std::string(block_size * blocks, 'a');
+  for (unsigned int i = 0; i < content.size(); ++i)
+    content[i] = i % 199;
+  auto const chunk = 16 * 1024;
+  ELLE_LOG("write")
+  {
+    auto h = root->child("file")->create(O_CREAT | O_RDWR, S_IFREG | 0644);
+    for (int64_t offset = 0; offset < signed(content.size()); offset += chunk)
+    {
+      BOOST_CHECK_EQUAL(
+        h->write(elle::ConstWeakBuffer(content.data() + offset, chunk),
+                 chunk, offset),
+        chunk);
+      // Writers are held back once at the limit.
+      BOOST_CHECK_LE(fs.dirty_used(), fs.dirty_limit() + block_size);
+    }
+    h->close();
+  }
+  BOOST_CHECK_EQUAL(fs.dirty_used(), 0);
+  ELLE_LOG("read back")
+  {
+    auto h = root->child("file")->open(O_RDONLY, 0);
+    char buf[chunk];
+    for (int64_t offset = 0; offset < signed(content.size()); offset += chunk)
+    {
+      BOOST_CHECK_EQUAL(
+        h->read(elle::WeakBuffer(buf, chunk), chunk, offset), chunk);
+      BOOST_CHECK(!memcmp(buf, content.data() + offset, chunk));
+    }
+    h->close();
+  }
+}
+
+ELLE_TEST_SCHEDULED(deduplicate)
+{
+  auto servers = DHTs(1);
+  auto client = servers.client();
+  auto& fs = dynamic_cast<infinit::filesystem::FileSystem&>(
+    *client.fs->operations());
+  auto const block_size = 64 * 1024;
+  fs.block_size(block_size);
+  fs.deduplicate(true);
+  auto root = client.fs->path("/");
+  auto content = std::string(block_size * 2, 'a');
+  for (unsigned int i = 0; i < content.size(); ++i)
+    content[i] = i % 199;
+  auto write = [&] (std::string const& name, std::string const& content)
+    {
+      auto h = root->child(name)->create(O_CREAT | O_RDWR, S_IFREG | 0644);
+      BOOST_CHECK_EQUAL(
+        h->write(elle::ConstWeakBuffer(content.data(), content.size()),
+                 content.size(), 0),
+        signed(content.size()));
+      h->close();
+    };
+  auto fat = [&] (std::string const& name)
+    {
+      return get_fat(root->child(name)->getxattr("user.infinit.fat"));
+    };
+  write("a", content);
+  write("b", content);
+  BOOST_CHECK_EQUAL(fat("a").size(), 2);
+  BOOST_CHECK_EQUAL(fat("a"), fat("b"));
+  content[0] = 'b';
+  write("c", content);
+  BOOST_CHECK_NE(fat("c")[0], fat("a")[0]);
+  BOOST_CHECK_EQUAL(fat("c")[1], fat("a")[1]);
+  ELLE_LOG("remove first copy")
+    root->child("a")->unlink();
+  ELLE_LOG("read second copy")
+  {
+    content[0] = 0;
+    auto h = root->child("b")->open(O_RDONLY, 0);
+    auto buf = std::string(content.size(), '\0');
+    BOOST_CHECK_EQUAL(
+      h->read(elle::WeakBuffer(&buf[0], buf.size()), buf.size(), 0),
+      signed(buf.size()));
+    BOOST_CHECK_EQUAL(buf, content);
+    h->close();
+  }
+}
+
 ELLE_TEST_SCHEDULED(paxos_race)
 {
   auto servers = DHTs(1);
@@ -1698,6 +1876,98 @@ ELLE_TEST_SCHEDULED(read_unlink_large)
   read_unlink_test(10 * 1024);
 }
 
+ELLE_TEST_SCHEDULED(sharded_directory)
+{
+  auto servers = DHTs(1);
+  auto client1 = servers.client();
+  auto client2 = servers.client();
+  dynamic_cast<infinit::filesystem::FileSystem*>(client1.fs->operations().get())
+    ->directory_shard_size(8);
+  client1.fs->path("/dir")->mkdir(0755);
+  for (int i = 0; i < 100; ++i)
+    write_file(client1.fs->path(elle::sprintf("/dir/%s", i)),
+               std::to_string(i));
+  BOOST_CHECK_EQUAL(directory_count(client1.fs->path("/dir")), 102);
+  BOOST_CHECK_EQUAL(directory_count(client2.fs->path("/dir")), 102);
+  for (int i = 0; i < 100; i += 7)
+    BOOST_CHECK_EQUAL(
+      read_file(client2.fs->path(elle::sprintf("/dir/%s", i))),
+      std::to_string(i));
+  write_file(client2.fs->path("/dir/other"), "other");
+  BOOST_CHECK_EQUAL(read_file(client1.fs->path("/dir/other")), "other");
+  client1.fs->path("/dir/other")->rename("/dir/renamed");
+  BOOST_CHECK_EQUAL(read_file(client2.fs->path("/dir/renamed")), "other");
+  BOOST_CHECK_THROW(client1.fs->path("/dir")->rmdir(), rfs::Error);
+  for (int i = 0; i < 100; ++i)
+    client2.fs->path(elle::sprintf("/dir/%s", i))->unlink();
+  client1.fs->path("/dir/renamed")->unlink();
+  BOOST_CHECK_EQUAL(directory_count(client1.fs->path("/dir")), 2);
+  BOOST_CHECK_EQUAL(directory_count(client2.fs->path("/dir")), 2);
+  client2.fs->path("/dir")->rmdir();
+  struct stat st;
+  BOOST_CHECK_THROW(client1.fs->path("/dir")->stat(&st), rfs::Error);
+}
+
+ELLE_TEST_SCHEDULED(inline_files)
+{
+  infinit::silo::Memory::Blocks blocks;
+  auto servers = DHTs(1, {},
+                      storage = std::make_unique<infinit::silo::Memory>(blocks));
+  auto client1 = servers.client();
+  auto client2 = servers.client();
+  for (auto client: {&client1, &client2})
+    dynamic_cast<infinit::filesystem::FileSystem*>(
+      client->fs->operations().get())->inline_size(1024);
+  client1.fs->path("/dir")->mkdir(0700);
+  auto const count = blocks.size();
+  ELLE_LOG("write small files")
+    for (int i = 0; i < 10; ++i)
+      write_file(client1.fs->path(elle::sprintf("/dir/%s", i)),
+                 std::to_string(i));
+  // Files live in the directory block.
+  BOOST_CHECK_EQUAL(blocks.size(), count);
+  ELLE_LOG("read from another client")
+    for (int i = 0; i < 10; ++i)
+      BOOST_CHECK_EQUAL(
+        read_file(client2.fs->path(elle::sprintf("/dir/%s", i))),
+        std::to_string(i));
+  BOOST_CHECK_EQUAL(file_size(client2.fs->path("/dir/3")), 1);
+  ELLE_LOG("overwrite")
+  {
+    write_file(client2.fs->path("/dir/3"), "three");
+    BOOST_CHECK_EQUAL(read_file(client1.fs->path("/dir/3")), "three");
+  }
+  ELLE_LOG("rename")
+  {
+    client1.fs->path("/dir/3")->rename("/dir/renamed");
+    BOOST_CHECK_EQUAL(read_file(client2.fs->path("/dir/renamed")), "three");
+  }
+  ELLE_LOG("unlink")
+    client2.fs->path("/dir/renamed")->unlink();
+  BOOST_CHECK_EQUAL(directory_count(client1.fs->path("/dir")), 11);
+  BOOST_CHECK_EQUAL(blocks.size(), count);
+  ELLE_LOG("move out of the directory")
+  {
+    client1.fs->path("/dir/4")->rename("/4");
+    BOOST_CHECK_EQUAL(read_file(client2.fs->path("/4")), "4");
+    // The file block, and the record of its Paxos phases.
+    BOOST_CHECK_EQUAL(blocks.size(), count + 2);
+  }
+  ELLE_LOG("grow")
+  {
+    auto const content = std::string(64 * 1024, 'a');
+    write_file(client1.fs->path("/dir/5"), content);
+    BOOST_CHECK_EQUAL(
+      read_file(client2.fs->path("/dir/5"), content.size()), content);
+    BOOST_CHECK_GT(blocks.size(), count + 2);
+  }
+  ELLE_LOG("other files are still inlined")
+    for (auto i: {0, 1, 2, 6, 7, 8, 9})
+      BOOST_CHECK_EQUAL(
+        read_file(client2.fs->path(elle::sprintf("/dir/%s", i))),
+        std::to_string(i));
+}
+
 ELLE_TEST_SCHEDULED(block_size)
 {
   int kchunks = 5 * 1024;
@@ -1805,6 +2075,10 @@ ELLE_TEST_SUITE()
   suite.add(BOOST_TEST_CASE(write_unlink), 0, valgrind(1));
   suite.add(BOOST_TEST_CASE(write_truncate), 0, valgrind(1));
   suite.add(BOOST_TEST_CASE(prefetcher_failure), 0, valgrind(5));
+  suite.add(BOOST_TEST_CASE(read_pattern), 0, valgrind(1));
+  suite.add(BOOST_TEST_CASE(read_ahead), 0, valgrind(10));
+  suite.add(BOOST_TEST_CASE(write_back), 0, valgrind(10));
+  suite.add(BOOST_TEST_CASE(deduplicate), 0, valgrind(10));
   suite.add(BOOST_TEST_CASE(paxos_race), 0, valgrind(5));
   suite.add(BOOST_TEST_CASE(data_embed), 0, valgrind(5));
   suite.add(BOOST_TEST_CASE(symlink_perms), 0, valgrind(5));
@@ -1823,5 +2097,7 @@ ELLE_TEST_SUITE()
   suite.add(BOOST_TEST_CASE(world_perm_mode), 0, valgrind(5));
   suite.add(BOOST_TEST_CASE(read_unlink_small), 0, valgrind(5));
   suite.add(BOOST_TEST_CASE(read_unlink_large), 0, valgrind(5));
+  suite.add(BOOST_TEST_CASE(sharded_directory), 0, valgrind(20));
+  suite.add(BOOST_TEST_CASE(inline_files), 0, valgrind(10));
   suite.add(BOOST_TEST_CASE(block_size), 0, valgrind(10));
 }
@@ -940,6 +940,80 @@ ELLE_TEST_SCHEDULED(beyond_storage)
         }));
 }
 
+ELLE_TEST_SCHEDULED(files_gossip)
+{
+  auto const self = infinit::model::Address::random();
+  auto const other = infinit::model::Address::random();
+  auto const start = std::chrono::system_clock::now();
+  auto const later = start + std::chrono::minutes(1);
+  auto files = iok::Files(self, 2);
+  auto addresses = std::vector<infinit::model::Address>{};
+  for (int i = 0; i < 100; ++i)
+  {
+    addresses.emplace_back(infinit::model::Address::random());
+    BOOST_CHECK(files.insert(
+      iok::File{addresses.back(), i % 2 ? self : other, start, {}, 0}));
+  }
+  BOOST_CHECK(!files.insert(
+    iok::File{addresses.front(), other, start, {}, 0}));
+  BOOST_CHECK_EQUAL(files.size(), 100);
+  BOOST_CHECK_EQUAL(files.fresh(), 100);
+  BOOST_CHECK(files.home_nodes(addresses.front()) ==
+              std::vector<infinit::model::Address>{other});
+  ELLE_LOG("gossip about new files")
+  {
+    int rounds = 0;
+    for (; files.fresh() && rounds < 100; ++rounds)
+    {
+      auto gossiped = files.gossip(5, 5, start, start);
+      BOOST_CHECK_EQUAL(gossiped.size(), 10);
+      auto distinct = std::set<infinit::model::Address>{};
+      for (auto const& f: gossiped)
+        distinct.insert(f.address);
+      BOOST_CHECK_EQUAL(distinct.size(), 10);
+    }
+    BOOST_CHECK_EQUAL(files.fresh(), 0);
+    // New files are gossiped about twice, at least 5 of them per round
+    // until fewer remain.
+    BOOST_CHECK_LE(rounds, 42);
+  }
+  ELLE_LOG("gossip about stale files, oldest first")
+  {
+    auto stale = std::set<infinit::model::Address>{};
+    for (int round = 0; round < 5; ++round)
+      for (auto const& f: files.gossip(0, 10, later, later))
+      {
+        BOOST_CHECK_EQUAL(f.home_node, self);
+        BOOST_CHECK(f.last_seen == later);
+        BOOST_CHECK(stale.insert(f.address).second);
+      }
+    BOOST_CHECK_EQUAL(stale.size(), 50);
+  }
+  ELLE_LOG("expire files")
+  {
+    BOOST_CHECK_EQUAL(files.expire(start), 0);
+    BOOST_CHECK(files.seen(addresses[0], other, later));
+    BOOST_CHECK_EQUAL(files.expire(later), 49);
+    BOOST_CHECK(files.contains(addresses[0], other));
+    BOOST_CHECK(files.contains(addresses[1], self));
+    BOOST_CHECK_EQUAL(files.size(), 51);
+  }
+  ELLE_LOG("remove files")
+  {
+    BOOST_CHECK(files.erase(addresses[1], self));
+    BOOST_CHECK(!files.erase(addresses[1], self));
+    BOOST_CHECK(!files.contains(addresses[1], self));
+    BOOST_CHECK(!files.seen(addresses[1], self, later));
+    BOOST_CHECK(files.contains(addresses[3], self));
+    BOOST_CHECK_EQUAL(files.size(), 50);
+    while (files.size() > 5)
+    {
+      auto const f = *files.begin();
+      BOOST_CHECK(files.erase(f.address, f.home_node));
+    }
+    BOOST_CHECK_EQUAL(files.gossip(5, 5, later, later).size(), 5);
+  }
+}
 
 ELLE_TEST_SUITE()
 {
@@ -961,6 +1035,7 @@ ELLE_TEST_SUITE()
   suite.add(BOOST_TEST_CASE(beyond_observer_1), 0, valgrind(120));
   suite.add(BOOST_TEST_CASE(beyond_observer_2), 0, valgrind(120));
   suite.add(BOOST_TEST_CASE(beyond_storage), 0, valgrind(120));
+  suite.add(BOOST_TEST_CASE(files_gossip), 0, valgrind(10));
   // suite.add(BOOST_TEST_CASE(killed_nodes), 0, 600);
   //suite.add(BOOST_TEST_CASE(killed_nodes_half_lenient), 0, 600);
   // suite.add(BOOST_TEST_CASE(killed_nodes_k2), 0, 600);
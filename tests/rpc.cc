@@ -1,10 +1,16 @@
 #include <elle/test.hh>
 
+#include <tuple>
+
+#include <elle/reactor/Barrier.hh>
 #include <elle/reactor/scheduler.hh>
 #include <elle/reactor/Scope.hh>
 #include <elle/reactor/network/tcp-server.hh>
 #include <elle/reactor/network/tcp-socket.hh>
 
+#include <elle/cryptography/SecretKey.hh>
+#include <elle/cryptography/hmac.hh>
+
 #include <elle/protocol/Serializer.hh>
 #include <elle/protocol/ChanneledStream.hh>
 
@@ -218,6 +224,212 @@ ELLE_TEST_SCHEDULED(parallel)
   }
 }
 
+ELLE_TEST_SCHEDULED(procedure_ids)
+{
+  Server s(
+    [] (infinit::RPCServer& s)
+    {
+      s.add("ping", [] (int a) { return a + 2; });
+      // Replacing a procedure keeps its identifier.
+      s.add("ping", [] (int a) { return a + 1; });
+    });
+  auto stream = s.connect();
+  elle::protocol::Serializer serializer(stream, infinit::version(), false);
+  auto&& channels = elle::protocol::ChanneledStream{serializer};
+  auto const ids = infinit::rpc_procedures(channels, infinit::version());
+  BOOST_TEST(ids.size() == 5u);
+  BOOST_TEST(ids.at("rpc_procedures") == 0);
+  BOOST_TEST(ids.at("rpc_framing") == 1);
+  BOOST_TEST(ids.at("rpc_streaming") == 2);
+  BOOST_TEST(ids.at("ping") == 3);
+  BOOST_TEST(ids.at("succ") == 4);
+  infinit::RPC<int (int)> ping("ping", channels, infinit::version());
+  ping.procedures(&ids);
+  BOOST_TEST(ping(1) == 2);
+  infinit::RPC<int (int)> succ("succ", channels, infinit::version());
+  succ.procedures(&ids);
+  BOOST_TEST(succ(1) == 2);
+  // Procedures missing from the table are still called by name.
+  infinit::RPC<int (int)> unknown("unknown", channels, infinit::version());
+  unknown.procedures(&ids);
+  BOOST_CHECK_THROW(unknown(0), infinit::UnknownRPC);
+  auto const bogus = infinit::RPCProcedures{{"succ", 42}};
+  succ.procedures(&bogus);
+  BOOST_CHECK_THROW(succ(0), infinit::UnknownRPC);
+}
+
+ELLE_TEST_SCHEDULED(pipeline)
+{
+  elle::reactor::Barrier release;
+  Server s(
+    [&] (infinit::RPCServer& s)
+    {
+      s.add("ping", [&] (int a) {
+          elle::reactor::wait(release);
+          return a + 1;
+        });
+    });
+  auto stream = s.connect();
+  elle::protocol::Serializer serializer(stream, infinit::version(), false);
+  auto&& channels = elle::protocol::ChanneledStream{serializer};
+  infinit::RPC<int (int)> ping("ping", channels, infinit::version());
+  auto calls = std::vector<infinit::RPC<int (int)>::Call>{};
+  for (int i = 0; i < 10; ++i)
+    calls.emplace_back(ping.send(i));
+  release.open();
+  for (int i = 9; i >= 0; --i)
+    BOOST_TEST(calls[i].get() == i + 1);
+}
+
+ELLE_TEST_SCHEDULED(framing)
+{
+  auto const key = elle::cryptography::secretkey::generate(256);
+  auto password = key.password();
+  auto const data = elle::Buffer(std::string(1024, 'x'));
+  infinit::RPCServer* server = nullptr;
+  Server s(
+    [&] (infinit::RPCServer& s)
+    {
+      server = &s;
+      s._key.emplace(key);
+      s.add("echo", [] (elle::Buffer const& b) { return b; });
+    });
+  auto stream = s.connect();
+  elle::protocol::Serializer serializer(stream, infinit::version(), false);
+  auto&& channels = elle::protocol::ChanneledStream{serializer};
+  infinit::RPC<elle::Buffer (elle::Buffer const&)>
+    echo("echo", &channels, infinit::version(), &password);
+  BOOST_TEST(echo(data) == data);
+  BOOST_TEST(infinit::rpc_framing(channels, infinit::version(), &password));
+  BOOST_REQUIRE(server);
+  BOOST_TEST(server->framing());
+  echo.framing(true);
+  BOOST_TEST(echo(data) == data);
+  echo.ciphertext(true);
+  BOOST_TEST(echo(data) == data);
+  // Authenticated messages are sent as is, but can't be altered.
+  auto message = elle::Buffer(data);
+  infinit::rpc_seal(message, key, false, false, 3, 1);
+  BOOST_TEST(message.size() == data.size() + 33);
+  BOOST_TEST(elle::Buffer(message.contents(), data.size()) == data);
+  // The tag is not keyed with the cipher key.
+  {
+    auto tagged = elle::Buffer(data);
+    uint8_t const header[14] = {2, 'Q', 3, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0};
+    tagged.append(header, sizeof header);
+    auto const tag = elle::cryptography::hmac::sign(
+      tagged, password, elle::cryptography::Oneway::sha256);
+    BOOST_TEST(elle::Buffer(message.contents() + data.size(), 32) != tag);
+  }
+  auto altered = elle::Buffer(message);
+  altered[0] ^= 1;
+  BOOST_CHECK_THROW(infinit::rpc_open(altered, key, false, 3, 1),
+                    elle::Error);
+  // Nor be replayed as responses, on other channels or out of order.
+  for (auto replay: {std::make_tuple(true, 3, 1),
+                     std::make_tuple(false, 4, 1),
+                     std::make_tuple(false, 3, 0)})
+  {
+    auto replayed = elle::Buffer(message);
+    BOOST_CHECK_THROW(
+      infinit::rpc_open(replayed, key, std::get<0>(replay),
+                        std::get<1>(replay), std::get<2>(replay)),
+      elle::Error);
+  }
+  BOOST_TEST(!infinit::rpc_open(message, key, false, 3, 1));
+  BOOST_TEST(message == data);
+  // Enciphered ones are not sent as is.
+  message = elle::Buffer(data);
+  infinit::rpc_seal(message, key, true, true, 3, 0);
+  BOOST_TEST(message.size() > data.size());
+  BOOST_TEST(infinit::rpc_open(message, key, true, 3, 0));
+  BOOST_TEST(message == data);
+}
+
+ELLE_TEST_SCHEDULED(streaming)
+{
+  auto const key = elle::cryptography::secretkey::generate(256);
+  auto password = key.password();
+  for (bool framing: {false, true})
+  {
+    ELLE_LOG_SCOPE("streaming, framing: %s", framing);
+    infinit::RPCServer* server = nullptr;
+    Server s(
+      [&] (infinit::RPCServer& s)
+      {
+        server = &s;
+        s._key.emplace(key);
+        s.add("echo", [] (elle::Buffer const& b) { return b; });
+      });
+    auto stream = s.connect();
+    elle::protocol::Serializer serializer(stream, infinit::version(), false);
+    auto&& channels = elle::protocol::ChanneledStream{serializer};
+    infinit::RPC<elle::Buffer (elle::Buffer const&)>
+      echo("echo", &channels, infinit::version(), &password);
+    BOOST_TEST(
+      infinit::rpc_streaming(channels, infinit::version(), &password));
+    BOOST_REQUIRE(server);
+    BOOST_TEST(server->streaming());
+    echo.streaming(true);
+    if (framing)
+    {
+      BOOST_TEST(
+        infinit::rpc_framing(channels, infinit::version(), &password, true));
+      BOOST_TEST(server->framing());
+      echo.framing(true);
+      echo.ciphertext(true);
+    }
+    // Small messages are sent whole, large ones in more pieces than are
+    // allowed in flight.
+    for (auto size: {0, 100, 128 * 1024, 1024 * 1024 + 1})
+    {
+      auto data = elle::Buffer(size);
+      for (int i = 0; i < size; ++i)
+        data[i] = i % 251;
+      BOOST_TEST(echo(data) == data);
+    }
+    // Streamed calls can be pipelined too, even when the server answers
+    // them one at a time and both exceed the pieces allowed in flight.
+    auto const large = elle::Buffer(std::string(1024 * 1024, 'y'));
+    auto first = echo.send(large);
+    auto second = echo.send(large);
+    BOOST_TEST(second.get() == large);
+    BOOST_TEST(first.get() == large);
+    BOOST_TEST(server->statistics().at("echo").request_bytes >
+               1024 * 1024 + 2 * large.size());
+  }
+}
+
+ELLE_TEST_SCHEDULED(statistics)
+{
+  infinit::RPCServer* server = nullptr;
+  Server s(
+    [&] (infinit::RPCServer& s)
+    {
+      server = &s;
+      s.add("check", [] (int a) {
+          if (a < 0)
+            elle::err("negative: %s", a);
+          return a;
+        });
+    });
+  auto stream = s.connect();
+  elle::protocol::Serializer serializer(stream, infinit::version(), false);
+  auto&& channels = elle::protocol::ChanneledStream{serializer};
+  infinit::RPC<int (int)> check("check", channels, infinit::version());
+  BOOST_TEST(check(1) == 1);
+  BOOST_TEST(check(2) == 2);
+  BOOST_CHECK_THROW(check(-1), elle::Error);
+  BOOST_REQUIRE(server);
+  auto const& stats = server->statistics().at("check");
+  BOOST_TEST(stats.calls == 3);
+  BOOST_TEST(stats.errors == 1);
+  BOOST_TEST(stats.request_bytes > 0);
+  BOOST_TEST(stats.response_bytes > 0);
+  BOOST_TEST(stats.max_duration <= stats.duration);
+  BOOST_TEST(!server->statistics().count("succ"));
+}
+
 ELLE_TEST_SUITE()
 {
   auto& suite = boost::unit_test::framework::master_test_suite();
@@ -226,4 +438,9 @@ ELLE_TEST_SUITE()
   suite.add(BOOST_TEST_CASE(bidirectional));
   suite.add(BOOST_TEST_CASE(simultaneous));
   suite.add(BOOST_TEST_CASE(parallel));
+  suite.add(BOOST_TEST_CASE(procedure_ids));
+  suite.add(BOOST_TEST_CASE(pipeline));
+  suite.add(BOOST_TEST_CASE(framing));
+  suite.add(BOOST_TEST_CASE(streaming));
+  suite.add(BOOST_TEST_CASE(statistics));
 }
@@ -1,13 +1,20 @@
+#include <boost/filesystem/fstream.hpp>
+
 #include <elle/filesystem/TemporaryDirectory.hh>
+#include <elle/reactor/Barrier.hh>
+#include <elle/reactor/Signal.hh>
 #include <elle/serialization/json.hh>
 #include <elle/test.hh>
 
 #include <infinit/silo/Collision.hh>
 #include <infinit/silo/Filesystem.hh>
 #include <infinit/silo/Memory.hh>
+#include <infinit/silo/Mirror.hh>
 #include <infinit/silo/MissingKey.hh>
+#include <infinit/silo/Packed.hh>
 #include <infinit/silo/S3.hh>
 #include <infinit/silo/Silo.hh>
+#include <infinit/silo/Strip.hh>
 
 ELLE_LOG_COMPONENT("tests.storage");
 
@@ -96,6 +103,320 @@ filesystem()
   tests(storage);
 }
 
+static
+void
+filesystem_durable()
+{
+  elle::filesystem::TemporaryDirectory d;
+  infinit::silo::Key::Value v = {
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1
+  };
+  infinit::silo::Key k(&v[0]);
+  auto const large = std::string(10000, 'x');
+  {
+    infinit::silo::Filesystem storage(d.path(), {}, true, true);
+    tests(storage);
+    storage.set(k, elle::Buffer(large));
+    BOOST_CHECK_EQUAL(storage.get(k).string(), large);
+    storage.set(k, elle::Buffer("small"), false, true);
+    BOOST_CHECK_EQUAL(storage.get(k), "small");
+    storage.set(k, elle::Buffer(large), false, true);
+  }
+  // Leave an interrupted write behind.
+  auto const block = d.path() / "01" / elle::sprintf("%x", k);
+  BOOST_CHECK(boost::filesystem::exists(block));
+  boost::filesystem::ofstream(block.string() + ".tmp") << "torn";
+  {
+    infinit::silo::Filesystem storage(d.path());
+    BOOST_CHECK(!boost::filesystem::exists(block.string() + ".tmp"));
+    BOOST_CHECK_EQUAL(storage.usage(), large.size());
+    BOOST_CHECK_EQUAL(storage.list().size(), 1u);
+    BOOST_CHECK_EQUAL(storage.get(k).string(), large);
+  }
+}
+
+static
+infinit::silo::Key
+numbered_key(int i)
+{
+  infinit::silo::Key::Value v = {
+    2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+  };
+  v[31] = i;
+  return infinit::silo::Key(&v[0]);
+}
+
+static
+void
+packed()
+{
+  elle::filesystem::TemporaryDirectory d;
+  {
+    infinit::silo::Packed storage(d.path());
+    tests(storage);
+  }
+  {
+    // One record per segment.
+    infinit::silo::Packed storage(d.path(), {}, 256);
+    for (int i = 0; i < 16; ++i)
+      storage.set(numbered_key(i), elle::Buffer(std::string(100, 'a' + i)));
+    for (int i = 0; i < 8; ++i)
+      storage.erase(numbered_key(i));
+    for (int i = 8; i < 12; ++i)
+      storage.set(numbered_key(i), elle::Buffer(std::string(50, 'A' + i)),
+                  false, true);
+    auto const segments = storage.segments().size();
+    storage.compact();
+    BOOST_CHECK_LT(storage.segments().size(), segments);
+    BOOST_CHECK_EQUAL(storage.usage(), 4 * 50 + 4 * 100);
+  }
+  {
+    infinit::silo::Packed storage(d.path(), {}, 256);
+    BOOST_CHECK_EQUAL(storage.list().size(), 8u);
+    BOOST_CHECK_EQUAL(storage.block_count(), 8);
+    BOOST_CHECK_EQUAL(storage.usage(), 4 * 50 + 4 * 100);
+    for (int i = 0; i < 8; ++i)
+      BOOST_CHECK_THROW(storage.get(numbered_key(i)),
+                        infinit::silo::MissingKey);
+    for (int i = 8; i < 12; ++i)
+      BOOST_CHECK_EQUAL(storage.get(numbered_key(i)).string(),
+                        std::string(50, 'A' + i));
+    for (int i = 12; i < 16; ++i)
+      BOOST_CHECK_EQUAL(storage.get(numbered_key(i)).string(),
+                        std::string(100, 'a' + i));
+  }
+}
+
+static
+void
+packed_compaction()
+{
+  namespace bfs = boost::filesystem;
+  elle::filesystem::TemporaryDirectory d;
+  auto const root = d.path() / "packed";
+  auto const saved = d.path() / "saved";
+  bfs::create_directories(saved);
+  {
+    // One record per segment.
+    infinit::silo::Packed storage(root, {}, 256);
+    for (int i = 0; i < 8; ++i)
+      storage.set(numbered_key(i), elle::Buffer(std::string(100, 'a' + i)));
+    for (int i = 0; i < 4; ++i)
+      storage.set(numbered_key(i), elle::Buffer(std::string(100, 'A' + i)),
+                  false, true);
+    storage.erase(numbered_key(7));
+    for (auto const& e: bfs::directory_iterator(root))
+      bfs::copy_file(e.path(), saved / e.path().filename());
+    auto const segments = storage.segments().size();
+    storage.compact();
+    BOOST_CHECK_EQUAL(storage.segments().size(), segments - 5);
+  }
+  auto const check = [&]
+    {
+      infinit::silo::Packed storage(root, {}, 256);
+      BOOST_CHECK_EQUAL(storage.block_count(), 7);
+      for (int i = 0; i < 4; ++i)
+        BOOST_CHECK_EQUAL(storage.get(numbered_key(i)).string(),
+                          std::string(100, 'A' + i));
+      for (int i = 4; i < 7; ++i)
+        BOOST_CHECK_EQUAL(storage.get(numbered_key(i)).string(),
+                          std::string(100, 'a' + i));
+      BOOST_CHECK_THROW(storage.get(numbered_key(7)),
+                        infinit::silo::MissingKey);
+    };
+  check();
+  // Compacted segments that outlive a crash are superseded by their copies.
+  for (auto const& e: bfs::directory_iterator(saved))
+    if (!bfs::exists(root / e.path().filename()))
+      bfs::copy_file(e.path(), root / e.path().filename());
+  check();
+}
+
+static
+void
+strip()
+{
+  elle::filesystem::TemporaryDirectory d;
+  infinit::silo::Silo* large = nullptr;
+  infinit::silo::Silo* small = nullptr;
+  auto const make = [&]
+    {
+      auto backends = std::vector<std::unique_ptr<infinit::silo::Silo>>{};
+      backends.emplace_back(std::make_unique<infinit::silo::Filesystem>(
+                              d.path() / "large", int64_t(8000)));
+      large = backends.back().get();
+      backends.emplace_back(std::make_unique<infinit::silo::Filesystem>(
+                              d.path() / "small", int64_t(1000)));
+      small = backends.back().get();
+      return std::make_unique<infinit::silo::Strip>(
+        std::move(backends), std::vector<int64_t>{}, d.path() / "placement");
+    };
+  {
+    auto storage = make();
+    tests(*storage);
+    // Fill 90% of the space without either backend overflowing.
+    for (int i = 0; i < 81; ++i)
+      storage->set(numbered_key(i), elle::Buffer(std::string(100, 'a')));
+    BOOST_CHECK_GT(small->usage(), 0);
+    BOOST_CHECK_GT(large->usage(), 4 * small->usage());
+    BOOST_CHECK_EQUAL(storage->usage(), 8100);
+    BOOST_CHECK_EQUAL(storage->block_count(), 81);
+    BOOST_CHECK_EQUAL(storage->list().size(), 81u);
+  }
+  BOOST_CHECK(boost::filesystem::exists(d.path() / "placement"));
+  {
+    auto storage = make();
+    BOOST_CHECK_EQUAL(storage->block_count(), 81);
+    for (int i = 0; i < 81; ++i)
+      BOOST_CHECK_EQUAL(storage->get(numbered_key(i)).string(),
+                        std::string(100, 'a'));
+    storage->erase(numbered_key(0));
+    BOOST_CHECK_THROW(storage->get(numbered_key(0)),
+                      infinit::silo::MissingKey);
+  }
+  // Operations interrupted by a crash are checked against the backends:
+  // an insertion that did not reach its backend, and an erasure that did
+  // not either.
+  {
+    auto journal = boost::filesystem::ofstream(
+      d.path() / "placement", std::ios::binary | std::ios::app);
+    for (auto k: {numbered_key(100), numbered_key(1)})
+      for (int16_t pending: {-2, -3})
+      {
+        journal.write(reinterpret_cast<char const*>(k.value()),
+                      sizeof(infinit::silo::Key::Value));
+        journal.write(reinterpret_cast<char const*>(&pending),
+                      sizeof pending);
+      }
+  }
+  {
+    auto storage = make();
+    BOOST_CHECK_EQUAL(storage->block_count(), 80);
+    BOOST_CHECK(storage->status(numbered_key(100)) ==
+                infinit::silo::BlockStatus::missing);
+    BOOST_CHECK_EQUAL(storage->get(numbered_key(1)).string(),
+                      std::string(100, 'a'));
+  }
+  // Without the placement map, blocks are found by listing backends.
+  boost::filesystem::remove(d.path() / "placement");
+  {
+    auto storage = make();
+    BOOST_CHECK_EQUAL(storage->block_count(), 80);
+    BOOST_CHECK(storage->status(numbered_key(0)) ==
+                infinit::silo::BlockStatus::missing);
+    for (int i = 1; i < 81; ++i)
+      BOOST_CHECK(storage->status(numbered_key(i)) ==
+                  infinit::silo::BlockStatus::exists);
+  }
+}
+
+namespace
+{
+  /// Memory whose reads and writes wait for `gate`, and whose writes fail
+  /// on demand.
+  class Gated
+    : public infinit::silo::Memory
+  {
+  public:
+    Gated()
+    {
+      this->gate.open();
+    }
+
+    /// Wait until `n` writes were attempted.
+    void
+    wait_writes(int n)
+    {
+      while (this->writes < n)
+        elle::reactor::wait(this->written);
+    }
+
+    bool failing = false;
+    int writes = 0;
+    mutable elle::reactor::Barrier gate;
+    elle::reactor::Signal written;
+
+  protected:
+    elle::Buffer
+    _get(infinit::silo::Key k) const override
+    {
+      elle::reactor::wait(this->gate);
+      return Memory::_get(k);
+    }
+
+    int
+    _set(infinit::silo::Key k, elle::Buffer const& value,
+         bool insert, bool update) override
+    {
+      elle::reactor::wait(this->gate);
+      auto const res =
+        this->failing ? 0 : Memory::_set(k, value, insert, update);
+      ++this->writes;
+      this->written.signal();
+      if (this->failing)
+        elle::err("gated backend failure");
+      return res;
+    }
+  };
+}
+
+ELLE_TEST_SCHEDULED(mirror)
+{
+  auto backends = std::vector<std::unique_ptr<infinit::silo::Silo>>{};
+  auto slow = new Gated;
+  backends.emplace_back(slow);
+  backends.emplace_back(std::make_unique<infinit::silo::Memory>());
+  infinit::silo::Mirror storage(std::move(backends), true, true, 1, true);
+  tests(storage);
+  auto const k = numbered_key(1);
+  // Writes return once a backend acknowledged them.
+  slow->gate.close();
+  auto const writes = slow->writes;
+  storage.set(k, elle::Buffer("data"));
+  BOOST_CHECK_EQUAL(slow->writes, writes);
+  // Let the slow replica catch up.
+  slow->gate.open();
+  slow->wait_writes(writes + 1);
+  // Reads stuck on the slow replica are hedged to the other one.
+  slow->gate.close();
+  for (int i = 0; i < 32; ++i)
+    BOOST_CHECK_EQUAL(storage.get(k), "data");
+  BOOST_CHECK_GE(storage.hedged(), 1);
+  BOOST_CHECK_GT(storage.statistics()[1].reads,
+                 storage.statistics()[0].reads);
+  slow->gate.open();
+}
+
+ELLE_TEST_SCHEDULED(mirror_repair)
+{
+  auto backends = std::vector<std::unique_ptr<infinit::silo::Silo>>{};
+  backends.emplace_back(std::make_unique<infinit::silo::Memory>());
+  auto flaky = new Gated;
+  backends.emplace_back(flaky);
+  infinit::silo::Mirror storage(std::move(backends), false, true, 1);
+  auto const k = numbered_key(1);
+  flaky->failing = true;
+  storage.set(k, elle::Buffer("data"));
+  flaky->wait_writes(1);
+  BOOST_CHECK(storage.repairs()[1].count(k));
+  // Reads avoid the backend missing the write.
+  for (int i = 0; i < 4; ++i)
+    BOOST_CHECK_EQUAL(storage.get(k), "data");
+  BOOST_CHECK_EQUAL(storage.repair(), 1);
+  flaky->failing = false;
+  BOOST_CHECK_EQUAL(storage.repair(), 0);
+  BOOST_CHECK(storage.repairs()[1].empty());
+  BOOST_CHECK_EQUAL(flaky->get(k), "data");
+  // Writes of a key reach each backend in order.
+  auto const writes = flaky->writes;
+  for (int i = 0; i < 8; ++i)
+    storage.set(k, elle::Buffer(elle::sprintf("data %s", i)), false, true);
+  flaky->wait_writes(writes + 8);
+  BOOST_CHECK_EQUAL(flaky->get(k), "data 7");
+}
+
 static
 void
 filesystem_small_capacity()
@@ -155,6 +476,12 @@ ELLE_TEST_SUITE()
 {
   auto& suite = boost::unit_test::framework::master_test_suite();
   suite.add(BOOST_TEST_CASE(filesystem));
+  suite.add(BOOST_TEST_CASE(filesystem_durable));
+  suite.add(BOOST_TEST_CASE(packed));
+  suite.add(BOOST_TEST_CASE(packed_compaction));
+  suite.add(BOOST_TEST_CASE(strip));
+  suite.add(BOOST_TEST_CASE(mirror));
+  suite.add(BOOST_TEST_CASE(mirror_repair));
   suite.add(BOOST_TEST_CASE(filesystem_small_capacity));
   suite.add(BOOST_TEST_CASE(filesystem_large_capacity));
   suite.add(BOOST_TEST_CASE(memory));